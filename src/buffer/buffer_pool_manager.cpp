@@ -15,7 +15,10 @@
 
 #include "buffer/buffer_pool_manager.h"
 
+#include <algorithm>
+
 #include "common/macros.h"
+#include "recovery/log_recovery.h"
 
 namespace bustub {
 
@@ -39,25 +42,40 @@ BufferPoolManager::~BufferPoolManager() {
 bool BufferPoolManager::FlushPageImpl(page_id_t page_id) {
   // Make sure you call DiskManager::WritePage!
 
-  std::scoped_lock<std::mutex> lck{latch_};
+  std::unique_lock<std::mutex> lck{latch_};
 
   Page *page{nullptr};
-  frame_id_t frame_id = -1;
+  bool can_force = true;
+  while (true) {
+    frame_id_t frame_id = -1;
+    if (page_table_.count(page_id) == 1) {
+      frame_id = page_table_.at(page_id);
+    }
+    // if the page is not in the buffer pool, no-op.
+    if (frame_id == -1) {
+      return false;
+    }
 
-  if (page_table_.count(page_id) == 1) {
-    frame_id = page_table_.at(page_id);
-  }
-  // if the page is not in the buffer pool, no-op.
-  if (frame_id == -1) {
-    return false;
-  }
+    assert(frame_id >= 0 && frame_id < static_cast<int>(pool_size_));
+    page = &pages_[frame_id];
+    assert(page);
 
-  assert(frame_id >= 0 && frame_id < static_cast<int>(pool_size_));
-  page = &pages_[frame_id];
-  assert(page);
+    // a half recovered page must not reach the disk. The page stays pinned until it is recovered, look again after.
+    if (page->is_recovering_) {
+      recovered_cv_.wait(lck, [page] { return !page->is_recovering_; });
+      continue;
+    }
+
+    // like eviction, force the log with the latch released, so that the other pages stay available meanwhile. The page
+    // may be changed or evicted in the meantime, look again.
+    if (IsDurable(page) || !can_force) {
+      break;
+    }
+    can_force = ForceLogForPage(page, &lck);
+  }
 
   // flush the data to disk no matter the page is dirty or not.
-  disk_manager_->WritePage(page_id, page->GetData());
+  WriteBackPage(page_id, page);
   // and the page is definitely not dirty after flushing.
   page->is_dirty_ = false;
 
@@ -66,17 +84,23 @@ bool BufferPoolManager::FlushPageImpl(page_id_t page_id) {
 
 void BufferPoolManager::FlushAllPagesImpl() {
   // You can do it!
-  std::scoped_lock<std::mutex> lck{latch_};
-
-  for (const auto &[page_id, frame_id] : page_table_) {
-    assert(frame_id >= 0 && frame_id < static_cast<int>(pool_size_));
-    Page *page = &pages_[frame_id];
-    assert(page);
+  std::vector<page_id_t> page_ids;
+  lsn_t max_lsn = INVALID_LSN;
+  {
+    std::scoped_lock<std::mutex> lck{latch_};
+    for (const auto &[page_id, frame_id] : page_table_) {
+      assert(frame_id >= 0 && frame_id < static_cast<int>(pool_size_));
+      page_ids.push_back(page_id);
+      max_lsn = std::max(max_lsn, pages_[frame_id].GetLSN());
+    }
+  }
 
-    // flush the data to disk no matter the page is dirty or not.
-    disk_manager_->WritePage(page_id, page->GetData());
-    // and the page is definitely not dirty after flushing.
-    page->is_dirty_ = false;
+  // force the log once for all the pages rather than page by page, then flush them like FlushPage.
+  if (enable_logging && log_manager_ != nullptr) {
+    log_manager_->WaitUntilPersistent(max_lsn);
+  }
+  for (const page_id_t page_id : page_ids) {
+    FlushPageImpl(page_id);
   }
 }
 
@@ -92,20 +116,18 @@ Page *BufferPoolManager::NewPageImpl(page_id_t *page_id) {
   /// Before flushed to disk, the newly created data are stored temporarily in the buffer pool.
   /// NewPgImp looks for an unpinned frame and use it as the container to manage the data.
 
-  std::scoped_lock<std::mutex> lck{latch_};
+  std::unique_lock<std::mutex> lck{latch_};
 
   // try to find an unpinned frame to be used as the data container.
   Page *page{nullptr};
   frame_id_t frame_id = -1;
 
-  // first, lookup the free list.
-  if (!free_list_.empty()) {
-    frame_id = free_list_.front();
-    free_list_.pop_front();
-  } else {
-    // alternatively, try to evict one.
-    if (!replacer_->Victim(&frame_id)) {
-      // failed to evict. No unpinned frame was found.
+  // take a frame that can be reused without waiting for the log, forcing the log with the latch released if there is
+  // none.
+  bool durable_only = true;
+  while (!FindVictim(&frame_id, durable_only)) {
+    // no unpinned frame was found.
+    if (!durable_only || !ForceLogForEviction(&lck, &durable_only)) {
       return nullptr;
     }
   }
@@ -123,7 +145,7 @@ Page *BufferPoolManager::NewPageImpl(page_id_t *page_id) {
   // flush the old page if it's from the replacer and it's dirty.
   const page_id_t old_page_id = page->GetPageId();
   if (old_page_id != INVALID_PAGE_ID && page->IsDirty()) {
-    disk_manager_->WritePage(old_page_id, page->GetData());
+    WriteBackPage(old_page_id, page);
     page->is_dirty_ = false;
   }
 
@@ -142,6 +164,7 @@ Page *BufferPoolManager::NewPageImpl(page_id_t *page_id) {
   // flush the new page immediately to make it persistent. The page id matters, not the data.
   page->ResetMemory();
   disk_manager_->WritePage(new_page_id, page->GetData());
+  TrackRecLSN(page);
 
   // set the output param.
   *page_id = new_page_id;
@@ -158,17 +181,24 @@ Page *BufferPoolManager::FetchPageImpl(page_id_t page_id) {
   // 3.     Delete R from the page table and insert P.
   // 4.     Update P's metadata, read in the page content from disk, and then return a pointer to P.
 
-  std::scoped_lock<std::mutex> lck{latch_};
+  std::unique_lock<std::mutex> lck{latch_};
 
   Page *page{nullptr};
   frame_id_t frame_id = -1;
 
-  if (page_table_.count(page_id) == 1) {
-    frame_id = page_table_.at(page_id);
+  bool in_pool = page_table_.count(page_id) == 1;
+  bool durable_only = true;
+  while (!in_pool && !FindVictim(&frame_id, durable_only)) {
+    // every unpinned page waits for the log. Another thread may read P in while the log is forced, look again.
+    if (!durable_only || !ForceLogForEviction(&lck, &durable_only)) {
+      return nullptr;
+    }
+    in_pool = page_table_.count(page_id) == 1;
   }
 
   // if P exists, fetch the in-memory page directly.
-  if (frame_id != -1) {
+  if (in_pool) {
+    frame_id = page_table_.at(page_id);
     assert(frame_id >= 0 && frame_id < static_cast<int>(pool_size_));
     page = &pages_[frame_id];
     assert(page);
@@ -178,27 +208,14 @@ Page *BufferPoolManager::FetchPageImpl(page_id_t page_id) {
     // pin the page on this frame.
     ++page->pin_count_;
     assert(page->GetPinCount() >= 1);
+    // another thread read the page in and is still recovering it.
+    recovered_cv_.wait(lck, [page] { return !page->is_recovering_; });
+    TrackRecLSN(page);
 
     return page;
   }
 
-  // otherwise, P does not exist.
-  // try to find an unpinned frame in which the fetched on-disk page is stored.
-
-  // request a replacement frame from free list if it's not empty.
-  //! search the free list first to minimize disk I/Os and hence better efficiency.
-  if (!free_list_.empty()) {
-    frame_id = free_list_.front();
-    free_list_.pop_front();
-  } else {
-    // otherwise, try to evict one.
-    if (!replacer_->Victim(&frame_id)) {
-      // failed to evict.
-      return nullptr;
-    }
-  }
-
-  // found an unpinned frame!
+  // otherwise, P does not exist and an unpinned frame was found to store the fetched on-disk page.
   assert(frame_id >= 0 && frame_id < static_cast<int>(pool_size_));
   page = &pages_[frame_id];
   assert(page);
@@ -207,7 +224,7 @@ Page *BufferPoolManager::FetchPageImpl(page_id_t page_id) {
   // flush the old page if it's from the replacer and it's dirty.
   const page_id_t old_page_id = page->GetPageId();
   if (old_page_id != INVALID_PAGE_ID && page->IsDirty()) {
-    disk_manager_->WritePage(old_page_id, page->GetData());
+    WriteBackPage(old_page_id, page);
     page->is_dirty_ = false;
   }
 
@@ -227,6 +244,19 @@ Page *BufferPoolManager::FetchPageImpl(page_id_t page_id) {
   // read data in from disk.
   //! It's the caller's job to ensure that the page_id is valid, i.e. it corresponds to a physical page.
   disk_manager_->ReadPage(page_id, page->GetData());
+  // a page that is still missing changes after a crash is recovered before it is handed out. Recovery reads the log,
+  // so release the latch meanwhile: the pin keeps the frame, and other fetchers of the page wait until it is recovered.
+  LogRecovery *log_recovery = log_recovery_;
+  if (log_recovery != nullptr) {
+    page->is_recovering_ = true;
+    lck.unlock();
+    const bool changed = log_recovery->RecoverPage(page_id, page);
+    lck.lock();
+    page->is_dirty_ |= changed;
+    page->is_recovering_ = false;
+    recovered_cv_.notify_all();
+  }
+  TrackRecLSN(page);
 
   return page;
 }
@@ -238,34 +268,45 @@ bool BufferPoolManager::DeletePageImpl(page_id_t page_id) {
   // 2.   If P exists, but has a non-zero pin-count, return false. Someone is using the page.
   // 3.   Otherwise, P can be deleted. Remove P from the page table, reset its metadata and return it to the free list.
 
-  std::scoped_lock<std::mutex> lck{latch_};
+  std::unique_lock<std::mutex> lck{latch_};
 
-  // search the page table.
   frame_id_t frame_id = -1;
-  if (page_table_.count(page_id) == 1) {
-    frame_id = page_table_.at(page_id);
-  }
-  // P does not exist.
-  if (frame_id == -1) {
-    return true;
-  }
+  Page *page{nullptr};
+  bool can_force = true;
+  while (true) {
+    // search the page table.
+    frame_id = -1;
+    if (page_table_.count(page_id) == 1) {
+      frame_id = page_table_.at(page_id);
+    }
+    // P does not exist.
+    if (frame_id == -1) {
+      return true;
+    }
 
-  // get the page.
-  assert(frame_id >= 0 && frame_id < static_cast<int>(pool_size_));
-  Page *page = &pages_[frame_id];
-  assert(page);
+    // get the page.
+    assert(frame_id >= 0 && frame_id < static_cast<int>(pool_size_));
+    page = &pages_[frame_id];
+    assert(page);
 
-  // check if we can thread-safely delete it.
-  assert(page->GetPinCount() >= 0);
-  if (page->GetPinCount() > 0) {
-    // no, someone else is using it.
-    return false;
+    // check if we can thread-safely delete it.
+    assert(page->GetPinCount() >= 0);
+    if (page->GetPinCount() > 0) {
+      // no, someone else is using it.
+      return false;
+    }
+    assert(page->GetPinCount() == 0);
+
+    // a dirty page is written back first, force the log with the latch released. Look again afterwards.
+    if (IsDurable(page) || !can_force) {
+      break;
+    }
+    can_force = ForceLogForPage(page, &lck);
   }
-  assert(page->GetPinCount() == 0);
 
   // flush the page if it's dirty.
   if (page->IsDirty()) {
-    disk_manager_->WritePage(page_id, page->GetData());
+    WriteBackPage(page_id, page);
     page->is_dirty_ = false;
   }
   assert(!page->IsDirty());
@@ -284,6 +325,7 @@ bool BufferPoolManager::DeletePageImpl(page_id_t page_id) {
 
   // return it to free list.
   free_list_.push_front(frame_id);
+  unpinned_cv_.notify_all();
 
   return true;
 }
@@ -316,13 +358,96 @@ bool BufferPoolManager::UnpinPageImpl(page_id_t page_id, bool is_dirty) {
     if (--page->pin_count_ == 0) {
       assert(page->GetPinCount() == 0);
       replacer_->Unpin(frame_id);
+      unpinned_cv_.notify_all();
     }
   }
   // set the dirty flag.
   //! if it's already dirty, don't reset it!
   page->is_dirty_ |= is_dirty;
+  // nobody can change a clean unpinned page.
+  if (page->GetPinCount() == 0 && !page->IsDirty()) {
+    page->rec_lsn_ = INVALID_LSN;
+  }
 
   return was_pinned;
 }
 
+bool BufferPoolManager::FindVictim(frame_id_t *frame_id, bool durable_only) {
+  //! search the free list first to minimize disk I/Os and hence better efficiency.
+  if (!free_list_.empty()) {
+    *frame_id = free_list_.front();
+    free_list_.pop_front();
+    return true;
+  }
+
+  bool found;
+  if (!durable_only || !enable_logging || log_manager_ == nullptr) {
+    found = replacer_->Victim(frame_id);
+  } else {
+    bool skipped{false};
+    found = replacer_->Victim(frame_id, [&](frame_id_t candidate) {
+      const bool durable = IsDurable(&pages_[candidate]);
+      skipped |= !durable;
+      return durable;
+    });
+    // get the log of the skipped pages on its way, so that they are durable by the time they are evicted.
+    if (skipped) {
+      log_manager_->RequestFlush();
+    }
+  }
+  if (found) {
+    ++num_evictions_;
+  }
+  return found;
+}
+
+bool BufferPoolManager::ForceLogForEviction(std::unique_lock<std::mutex> *lck, bool *forced) {
+  if (replacer_->Size() == 0) {
+    return false;
+  }
+  if (!enable_logging || log_manager_ == nullptr) {
+    return true;
+  }
+  ++num_eviction_log_waits_;
+  // everything appended so far covers the LSN of every unpinned page.
+  const lsn_t lsn = log_manager_->GetNextLSN() - 1;
+  lck->unlock();
+  *forced = log_manager_->WaitUntilPersistent(lsn);
+  lck->lock();
+  return true;
+}
+
+bool BufferPoolManager::ForceLogForPage(Page *page, std::unique_lock<std::mutex> *lck) {
+  const lsn_t lsn = page->GetLSN();
+  lck->unlock();
+  const bool forced = log_manager_->WaitUntilPersistent(lsn);
+  lck->lock();
+  return forced;
+}
+
+void BufferPoolManager::WriteBackPage(page_id_t page_id, Page *page) {
+  // a pinned page may be changed again, but only by records logged from now on.
+  page->rec_lsn_ = INVALID_LSN;
+  if (page->GetPinCount() > 0) {
+    TrackRecLSN(page);
+  }
+  disk_manager_->WritePage(page_id, page->GetData());
+}
+
+void BufferPoolManager::WaitForUnpinnedFrame() {
+  std::unique_lock<std::mutex> lck{latch_};
+  unpinned_cv_.wait(lck, [this] { return !free_list_.empty() || replacer_->Size() > 0; });
+}
+
+std::vector<std::pair<page_id_t, lsn_t>> BufferPoolManager::GetDirtyPageTable() {
+  std::scoped_lock<std::mutex> lck{latch_};
+  std::vector<std::pair<page_id_t, lsn_t>> dirty_pages;
+  for (const auto &[page_id, frame_id] : page_table_) {
+    if (pages_[frame_id].rec_lsn_ != INVALID_LSN) {
+      dirty_pages.emplace_back(page_id, pages_[frame_id].rec_lsn_);
+    }
+  }
+  return dirty_pages;
+}
+
 }  // namespace bustub
@@ -20,6 +20,8 @@ ClockReplacer::~ClockReplacer() = default;
 
 bool ClockReplacer::Victim(frame_id_t *frame_id) { return false; }
 
+bool ClockReplacer::Victim(frame_id_t *frame_id, const std::function<bool(frame_id_t)> &filter) { return false; }
+
 void ClockReplacer::Pin(frame_id_t frame_id) {}
 
 void ClockReplacer::Unpin(frame_id_t frame_id) {}
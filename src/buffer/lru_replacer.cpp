@@ -14,6 +14,7 @@
 // niebayes@gmail.com
 
 #include <cassert>
+#include <iterator>
 
 #include "buffer/lru_replacer.h"
 
@@ -47,6 +48,25 @@ bool LRUReplacer::Victim(frame_id_t *frame_id) {
   return true;
 }
 
+bool LRUReplacer::Victim(frame_id_t *frame_id, const std::function<bool(frame_id_t)> &filter) {
+  std::scoped_lock<std::mutex> lck{latch_};
+
+  // walk from LRU to MRU until the filter accepts a frame.
+  for (auto it = lst_.rbegin(); it != lst_.rend(); ++it) {
+    if (filter(*it)) {
+      const frame_id_t key = *it;
+      lst_.erase(std::next(it).base());
+      ump_.erase(key);
+      assert(lst_.size() == ump_.size());
+
+      *frame_id = key;
+      return true;
+    }
+  }
+
+  return false;
+}
+
 void LRUReplacer::Pin(frame_id_t frame_id) {
   std::scoped_lock<std::mutex> lck{latch_};
 
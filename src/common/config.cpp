@@ -16,8 +16,14 @@ namespace bustub {
 
 std::atomic<bool> enable_logging(false);
 
+std::atomic<bool> enable_early_lock_release(false);
+
 std::chrono::duration<int64_t> log_timeout = std::chrono::seconds(1);
 
-std::chrono::milliseconds cycle_detection_interval = std::chrono::milliseconds(50);
+int log_stream_count = 1;
+
+int lock_escalation_threshold = 1000;
+
+std::chrono::milliseconds checkpoint_interval = std::chrono::milliseconds(1000);
 
 }  // namespace bustub
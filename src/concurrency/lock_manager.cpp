@@ -12,50 +12,717 @@
 
 #include "concurrency/lock_manager.h"
 
+#include <algorithm>
+#include <chrono>  // NOLINT
 #include <utility>
 #include <vector>
 
 namespace bustub {
 
-bool LockManager::LockShared(Transaction *txn, const RID &rid) {
-  txn->GetSharedLockSet()->emplace(rid);
+bool LockManager::LockShared(Transaction *txn, const RID &rid, table_oid_t oid) {
+  if (txn->IsSharedLocked(rid) || txn->IsExclusiveLocked(rid) || IsCoveredByTable(txn, oid, LockMode::SHARED)) {
+    return true;
+  }
+  if (txn->GetState() == TransactionState::ABORTED) {
+    return false;
+  }
+  if (txn->GetIsolationLevel() == IsolationLevel::READ_UNCOMMITTED) {
+    txn->SetState(TransactionState::ABORTED);
+    throw TransactionAbortException(txn->GetTransactionId(), AbortReason::LOCKSHARED_ON_READ_UNCOMMITTED);
+  }
+  if (oid != INVALID_TABLE_OID && !AcquireTableLock(txn, oid, LockMode::INTENTION_SHARED, true)) {
+    return false;
+  }
+  if (!AcquireLock(txn, rid, LockMode::SHARED)) {
+    return false;
+  }
+  if (oid != INVALID_TABLE_OID) {
+    TrackRowLock(txn, oid, rid);
+  }
   return true;
 }
 
-bool LockManager::LockExclusive(Transaction *txn, const RID &rid) {
-  txn->GetExclusiveLockSet()->emplace(rid);
+bool LockManager::LockExclusive(Transaction *txn, const RID &rid, table_oid_t oid) {
+  // A transaction keeps the locks it holds once it is aborted, so that it can roll back.
+  if (txn->IsExclusiveLocked(rid) || IsCoveredByTable(txn, oid, LockMode::EXCLUSIVE)) {
+    return true;
+  }
+  if (txn->GetState() == TransactionState::ABORTED) {
+    return false;
+  }
+  if (oid != INVALID_TABLE_OID && !AcquireTableLock(txn, oid, LockMode::INTENTION_EXCLUSIVE, true)) {
+    return false;
+  }
+  if (!AcquireLock(txn, rid, LockMode::EXCLUSIVE)) {
+    return false;
+  }
+  if (oid != INVALID_TABLE_OID) {
+    TrackRowLock(txn, oid, rid);
+  }
   return true;
 }
 
-bool LockManager::LockUpgrade(Transaction *txn, const RID &rid) {
+bool LockManager::LockUpgrade(Transaction *txn, const RID &rid, table_oid_t oid) {
+  if (txn->IsExclusiveLocked(rid) || IsCoveredByTable(txn, oid, LockMode::EXCLUSIVE)) {
+    return true;
+  }
+  if (txn->GetState() == TransactionState::ABORTED) {
+    return false;
+  }
+  if (txn->GetState() == TransactionState::SHRINKING) {
+    txn->SetState(TransactionState::ABORTED);
+    throw TransactionAbortException(txn->GetTransactionId(), AbortReason::LOCK_ON_SHRINKING);
+  }
+  if (oid != INVALID_TABLE_OID && !AcquireTableLock(txn, oid, LockMode::INTENTION_EXCLUSIVE, true)) {
+    return false;
+  }
+
+  auto *partition = GetPartition(rid);
+  std::unique_lock<std::mutex> lck(partition->latch_);
+  auto found = partition->lock_table_.find(rid);
+  if (found == partition->lock_table_.end()) {
+    return false;
+  }
+  auto &queue = found->second;
+  auto request = std::find_if(queue.request_queue_.begin(), queue.request_queue_.end(),
+                              [txn](const LockRequest &r) { return r.txn_id_ == txn->GetTransactionId(); });
+  if (request == queue.request_queue_.end() || !request->granted_) {
+    return false;
+  }
+  if (!UpgradeInPlace(&queue, request, LockMode::EXCLUSIVE)) {
+    if (queue.upgrading_) {
+      txn->SetState(TransactionState::ABORTED);
+      throw TransactionAbortException(txn->GetTransactionId(), AbortReason::UPGRADE_CONFLICT);
+    }
+    // Trade the shared lock for an exclusive request, granted as soon as the other shared locks are released.
+    request = RequeueForUpgrade(&queue, request, LockMode::EXCLUSIVE);
+    queue.upgrading_ = true;
+    bool granted = WaitForGrant(txn, &queue, request, &lck, WaitTarget{txn, rid, INVALID_TABLE_OID});
+    queue.upgrading_ = false;
+    if (!granted) {
+      if (EraseRequest(&queue, request)) {
+        partition->lock_table_.erase(found);
+      }
+      lck.unlock();
+      ForgetLock(txn, rid);
+      throw TransactionAbortException(txn->GetTransactionId(), AbortReason::DEADLOCK);
+    }
+  }
+  lck.unlock();
+  upgrades_.fetch_add(1, std::memory_order_relaxed);
+
   txn->GetSharedLockSet()->erase(rid);
   txn->GetExclusiveLockSet()->emplace(rid);
   return true;
 }
 
 bool LockManager::Unlock(Transaction *txn, const RID &rid) {
+  ForgetLock(txn, rid);
+  LockMode lock_mode;
+  if (!ReleaseLock(txn, rid, &lock_mode)) {
+    return false;
+  }
+
+  // Under READ_COMMITTED, shared locks are released as soon as the tuple is read and do not end the growing phase.
+  if (txn->GetState() == TransactionState::GROWING &&
+      !(lock_mode == LockMode::SHARED && txn->GetIsolationLevel() == IsolationLevel::READ_COMMITTED)) {
+    txn->SetState(TransactionState::SHRINKING);
+  }
+  return true;
+}
+
+bool LockManager::LockTable(Transaction *txn, table_oid_t oid, LockMode lock_mode) {
+  return AcquireTableLock(txn, oid, lock_mode, true);
+}
+
+bool LockManager::UnlockTable(Transaction *txn, table_oid_t oid) {
+  auto table_locks = txn->GetTableLockSet();
+  auto held = table_locks->find(oid);
+  if (held == table_locks->end()) {
+    return false;
+  }
+  auto table_row_locks = txn->GetTableRowLockSet();
+  auto rows = table_row_locks->find(oid);
+  if (rows != table_row_locks->end()) {
+    if (!rows->second.empty()) {
+      return false;
+    }
+    table_row_locks->erase(rows);
+  }
+  LockMode lock_mode = held->second;
+  table_locks->erase(held);
+
+  {
+    std::scoped_lock<std::mutex> lck(table_latch_);
+    auto found = table_lock_table_.find(oid);
+    BUSTUB_ASSERT(found != table_lock_table_.end(), "A locked table must have a request queue.");
+    auto &queue = found->second;
+    auto request = std::find_if(queue.request_queue_.begin(), queue.request_queue_.end(),
+                                [txn](const LockRequest &r) { return r.txn_id_ == txn->GetTransactionId(); });
+    BUSTUB_ASSERT(request != queue.request_queue_.end(), "A locked table must have a request of the transaction.");
+    if (EraseRequest(&queue, request)) {
+      table_lock_table_.erase(found);
+    }
+  }
+
+  bool is_shared = lock_mode == LockMode::SHARED || lock_mode == LockMode::INTENTION_SHARED;
+  if (txn->GetState() == TransactionState::GROWING &&
+      !(is_shared && txn->GetIsolationLevel() == IsolationLevel::READ_COMMITTED)) {
+    txn->SetState(TransactionState::SHRINKING);
+  }
+  return true;
+}
+
+bool LockManager::AcquireLock(Transaction *txn, const RID &rid, LockMode lock_mode) {
+  if (txn->GetState() == TransactionState::SHRINKING) {
+    txn->SetState(TransactionState::ABORTED);
+    throw TransactionAbortException(txn->GetTransactionId(), AbortReason::LOCK_ON_SHRINKING);
+  }
+
+  auto *partition = GetPartition(rid);
+  std::unique_lock<std::mutex> lck(partition->latch_);
+  // Queues are nodes of the map, so a rehash caused by another record does not move them.
+  auto &queue = partition->lock_table_[rid];
+  auto request = queue.request_queue_.emplace(queue.request_queue_.end(), txn, lock_mode);
+  partition->requests_.fetch_add(1, std::memory_order_relaxed);
+  if (!WaitForGrant(txn, &queue, request, &lck, WaitTarget{txn, rid, INVALID_TABLE_OID})) {
+    if (EraseRequest(&queue, request)) {
+      partition->lock_table_.erase(rid);
+    }
+    lck.unlock();
+    throw TransactionAbortException(txn->GetTransactionId(), AbortReason::DEADLOCK);
+  }
+  lck.unlock();
+
+  if (lock_mode == LockMode::SHARED) {
+    txn->GetSharedLockSet()->emplace(rid);
+  } else {
+    txn->GetExclusiveLockSet()->emplace(rid);
+  }
+  return true;
+}
+
+bool LockManager::AcquireTableLock(Transaction *txn, table_oid_t oid, LockMode lock_mode, bool wait) {
+  auto table_locks = txn->GetTableLockSet();
+  auto held = table_locks->find(oid);
+  bool upgrade = held != table_locks->end();
+  if (upgrade && Covers(held->second, lock_mode)) {
+    return true;
+  }
+  if (txn->GetState() == TransactionState::ABORTED) {
+    return false;
+  }
+  // SHARED and INTENTION_EXCLUSIVE are the only pair of modes neither of which covers the other.
+  if (upgrade && !Covers(lock_mode, held->second)) {
+    lock_mode = LockMode::SHARED_INTENTION_EXCLUSIVE;
+  }
+  if (txn->GetState() == TransactionState::SHRINKING) {
+    txn->SetState(TransactionState::ABORTED);
+    throw TransactionAbortException(txn->GetTransactionId(), AbortReason::LOCK_ON_SHRINKING);
+  }
+  bool is_shared = lock_mode == LockMode::SHARED || lock_mode == LockMode::INTENTION_SHARED ||
+                   lock_mode == LockMode::SHARED_INTENTION_EXCLUSIVE;
+  if (is_shared && txn->GetIsolationLevel() == IsolationLevel::READ_UNCOMMITTED) {
+    txn->SetState(TransactionState::ABORTED);
+    throw TransactionAbortException(txn->GetTransactionId(), AbortReason::LOCKSHARED_ON_READ_UNCOMMITTED);
+  }
+
+  std::unique_lock<std::mutex> lck(table_latch_);
+  auto &queue = table_lock_table_[oid];
+  std::list<LockRequest>::iterator request;
+  if (!upgrade) {
+    request = queue.request_queue_.emplace(queue.request_queue_.end(), txn, lock_mode);
+    table_requests_.fetch_add(1, std::memory_order_relaxed);
+    if (!wait && !IsGrantable(queue, request)) {
+      if (EraseRequest(&queue, request)) {
+        table_lock_table_.erase(oid);
+      }
+      return false;
+    }
+  } else {
+    request = std::find_if(queue.request_queue_.begin(), queue.request_queue_.end(),
+                           [txn](const LockRequest &r) { return r.txn_id_ == txn->GetTransactionId(); });
+    BUSTUB_ASSERT(request != queue.request_queue_.end(), "A locked table must have a request of the transaction.");
+    if (UpgradeInPlace(&queue, request, lock_mode)) {
+      held->second = lock_mode;
+      upgrades_.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+    if (!wait) {
+      return false;
+    }
+    if (queue.upgrading_) {
+      txn->SetState(TransactionState::ABORTED);
+      throw TransactionAbortException(txn->GetTransactionId(), AbortReason::UPGRADE_CONFLICT);
+    }
+    request = RequeueForUpgrade(&queue, request, lock_mode);
+    queue.upgrading_ = true;
+  }
+
+  bool granted = WaitForGrant(txn, &queue, request, &lck, WaitTarget{txn, RID(), oid});
+  if (upgrade) {
+    queue.upgrading_ = false;
+  }
+  if (!granted) {
+    if (EraseRequest(&queue, request)) {
+      table_lock_table_.erase(oid);
+    }
+    lck.unlock();
+    // An upgrade gives up the lock it started from.
+    table_locks->erase(oid);
+    throw TransactionAbortException(txn->GetTransactionId(), AbortReason::DEADLOCK);
+  }
+  lck.unlock();
+  if (upgrade) {
+    upgrades_.fetch_add(1, std::memory_order_relaxed);
+  }
+  (*table_locks)[oid] = lock_mode;
+  return true;
+}
+
+bool LockManager::IsCoveredByTable(Transaction *txn, table_oid_t oid, LockMode row_mode) {
+  if (oid == INVALID_TABLE_OID) {
+    return false;
+  }
+  auto table_locks = txn->GetTableLockSet();
+  auto held = table_locks->find(oid);
+  return held != table_locks->end() && Covers(held->second, row_mode);
+}
+
+void LockManager::TrackRowLock(Transaction *txn, table_oid_t oid, const RID &rid) {
+  auto table_row_locks = txn->GetTableRowLockSet();
+  auto &rows = (*table_row_locks)[oid];
+  rows.emplace(rid);
+  if (lock_escalation_threshold <= 0) {
+    return;
+  }
+  auto threshold = static_cast<size_t>(lock_escalation_threshold);
+  if (rows.size() <= threshold || (rows.size() - 1) % threshold != 0) {
+    return;
+  }
+
+  // Only INTENTION_SHARED means that every record is locked in shared mode.
+  LockMode held = txn->GetTableLockSet()->at(oid);
+  LockMode escalated = held == LockMode::INTENTION_SHARED ? LockMode::SHARED : LockMode::EXCLUSIVE;
+  if (!AcquireTableLock(txn, oid, escalated, false)) {
+    return;
+  }
+  // The table lock covers every record of the table, so releasing the record locks does not end the growing phase.
+  for (const auto &locked_rid : rows) {
+    txn->GetSharedLockSet()->erase(locked_rid);
+    txn->GetExclusiveLockSet()->erase(locked_rid);
+    LockMode lock_mode;
+    ReleaseLock(txn, locked_rid, &lock_mode);
+  }
+  table_row_locks->erase(oid);
+}
+
+void LockManager::ForgetLock(Transaction *txn, const RID &rid) {
   txn->GetSharedLockSet()->erase(rid);
   txn->GetExclusiveLockSet()->erase(rid);
+  for (auto &[oid, rows] : *txn->GetTableRowLockSet()) {
+    if (rows.erase(rid) > 0) {
+      break;
+    }
+  }
+}
+
+bool LockManager::ReleaseLock(Transaction *txn, const RID &rid, LockMode *lock_mode) {
+  auto *partition = GetPartition(rid);
+  std::scoped_lock<std::mutex> lck(partition->latch_);
+  auto found = partition->lock_table_.find(rid);
+  if (found == partition->lock_table_.end()) {
+    return false;
+  }
+  auto &queue = found->second;
+  auto request = std::find_if(queue.request_queue_.begin(), queue.request_queue_.end(),
+                              [txn](const LockRequest &r) { return r.txn_id_ == txn->GetTransactionId(); });
+  if (request == queue.request_queue_.end()) {
+    return false;
+  }
+  *lock_mode = request->lock_mode_;
+  if (EraseRequest(&queue, request)) {
+    partition->lock_table_.erase(found);
+  }
+  return true;
+}
+
+bool LockManager::WaitForGrant(Transaction *txn, LockRequestQueue *queue, std::list<LockRequest>::iterator request,
+                               std::unique_lock<std::mutex> *lck, const WaitTarget &target) {
+  if (txn->GetState() == TransactionState::ABORTED) {
+    deadlock_aborts_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  if (IsGrantable(*queue, request)) {
+    request->granted_ = true;
+    return true;
+  }
+  auto wait_start = std::chrono::steady_clock::now();
+
+  // Register before looking at the state again, so that whoever aborts txn from now on knows where to wake it up.
+  {
+    std::scoped_lock<std::mutex> graph_lck(latch_);
+    waiting_[txn->GetTransactionId()] = target;
+  }
+  bool granted = false;
+  while (txn->GetState() != TransactionState::ABORTED) {
+    auto blockers = GetBlockers(*queue, request);
+    if (blockers.empty()) {
+      request->granted_ = true;
+      granted = true;
+      break;
+    }
+    if (deadlock_mode_ == DeadlockMode::WAIT_DIE) {
+      if (std::any_of(blockers.begin(), blockers.end(),
+                      [txn](Transaction *blocker) { return blocker->GetTransactionId() < txn->GetTransactionId(); })) {
+        txn->SetState(TransactionState::ABORTED);
+        break;
+      }
+    } else if (deadlock_mode_ == DeadlockMode::WOUND_WAIT) {
+      // A transaction that is committing or aborting already is about to release its locks anyway.
+      std::vector<txn_id_t> wounded;
+      for (auto *blocker : blockers) {
+        if (blocker->GetTransactionId() > txn->GetTransactionId() &&
+            blocker->CompareAndSetState(TransactionState::GROWING, TransactionState::ABORTED)) {
+          wounded.push_back(blocker->GetTransactionId());
+        }
+      }
+      if (!wounded.empty()) {
+        // The wounded may wait on any queue, whose latch must not be taken while holding this one.
+        lck->unlock();
+        for (auto txn_id : wounded) {
+          NotifyWaiter(txn_id);
+        }
+        lck->lock();
+        continue;
+      }
+    } else {
+      auto victim = BlockOn(txn, blockers);
+      if (victim == txn->GetTransactionId()) {
+        break;
+      }
+      if (victim != INVALID_TXN_ID) {
+        lck->unlock();
+        NotifyWaiter(victim);
+        lck->lock();
+        continue;
+      }
+    }
+    queue->cv_.wait(*lck);
+  }
+  {
+    std::scoped_lock<std::mutex> graph_lck(latch_);
+    waiting_.erase(txn->GetTransactionId());
+    waits_for_.erase(txn->GetTransactionId());
+  }
+  if (granted && deadlock_mode_ == DeadlockMode::DETECTION &&
+      std::any_of(std::next(request), queue->request_queue_.end(),
+                  [&request](const LockRequest &r) { return AreCompatible(request->lock_mode_, r.lock_mode_); })) {
+    // The requests behind that waited for this one may no longer do so.
+    queue->cv_.notify_all();
+  }
+  RecordWait(target, std::chrono::steady_clock::now() - wait_start, granted);
+  return granted;
+}
+
+txn_id_t LockManager::BlockOn(Transaction *txn, const std::vector<Transaction *> &blockers) {
+  txn_id_t txn_id = txn->GetTransactionId();
+  std::scoped_lock<std::mutex> graph_lck(latch_);
+  // Victims are aborted under latch_, and must not bring their edges back.
+  if (txn->GetState() == TransactionState::ABORTED) {
+    return txn_id;
+  }
+  auto &edges = waits_for_[txn_id];
+  edges.clear();
+  for (auto *blocker : blockers) {
+    edges.push_back(blocker->GetTransactionId());
+  }
+  std::sort(edges.begin(), edges.end());
+  edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+  // The graph had no cycle before, so a new one goes through txn.
+  std::vector<txn_id_t> path{txn_id};
+  std::unordered_set<txn_id_t> visited;
+  txn_id_t victim;
+  if (!FindCycle(&path, &visited, &victim)) {
+    return INVALID_TXN_ID;
+  }
+  // Every transaction of the cycle is blocked, and thus in waiting_.
+  waiting_.at(victim).txn_->CompareAndSetState(TransactionState::GROWING, TransactionState::ABORTED);
+  waits_for_.erase(victim);
+  return victim;
+}
+
+void LockManager::NotifyWaiter(txn_id_t txn_id) {
+  WaitTarget target;
+  {
+    std::scoped_lock<std::mutex> graph_lck(latch_);
+    auto found = waiting_.find(txn_id);
+    if (found == waiting_.end()) {
+      return;
+    }
+    target = found->second;
+  }
+  // Taking the latch of the queue makes sure the waiter is either asleep or yet to look at its state.
+  if (target.oid_ != INVALID_TABLE_OID) {
+    std::scoped_lock<std::mutex> lck(table_latch_);
+    auto found = table_lock_table_.find(target.oid_);
+    if (found != table_lock_table_.end()) {
+      found->second.cv_.notify_all();
+    }
+  } else {
+    auto *partition = GetPartition(target.rid_);
+    std::scoped_lock<std::mutex> lck(partition->latch_);
+    auto found = partition->lock_table_.find(target.rid_);
+    if (found != partition->lock_table_.end()) {
+      found->second.cv_.notify_all();
+    }
+  }
+}
+
+std::vector<Transaction *> LockManager::GetBlockers(const LockRequestQueue &queue,
+                                                    std::list<LockRequest>::const_iterator request) {
+  std::vector<Transaction *> blockers;
+  for (auto it = queue.request_queue_.begin(); it != request; ++it) {
+    if (!it->granted_ || !AreCompatible(it->lock_mode_, request->lock_mode_)) {
+      blockers.push_back(it->txn_);
+    }
+  }
+  return blockers;
+}
+
+void LockManager::RecordWait(const WaitTarget &target, std::chrono::nanoseconds wait_time, bool granted) {
+  if (target.oid_ != INVALID_TABLE_OID) {
+    table_wait_latency_.Record(wait_time);
+  } else {
+    row_wait_latency_.Record(wait_time);
+  }
+  if (!granted) {
+    deadlock_aborts_.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (waits_.fetch_add(1, std::memory_order_relaxed) % hot_spot_sample_rate_.load(std::memory_order_relaxed) != 0) {
+    return;
+  }
+
+  RID rid = target.oid_ != INVALID_TABLE_OID ? RID() : target.rid_;
+  auto wait_us = std::chrono::duration_cast<std::chrono::microseconds>(wait_time);
+  std::scoped_lock<std::mutex> lck(hot_spot_latch_);
+  auto spot = std::find_if(hot_spots_.begin(), hot_spots_.end(), [&](const LockHotSpot &s) {
+    return s.oid_ == target.oid_ && s.rid_ == rid;
+  });
+  if (spot != hot_spots_.end()) {
+    spot->waits_++;
+    spot->wait_time_ += wait_us;
+    return;
+  }
+  if (hot_spots_.size() < MAX_HOT_SPOTS) {
+    hot_spots_.push_back(LockHotSpot{rid, target.oid_, 1, wait_us});
+    return;
+  }
+  // Space-saving: the new spot takes over the coldest one and its count, so a spot that keeps coming back climbs up.
+  auto coldest = std::min_element(hot_spots_.begin(), hot_spots_.end(),
+                                  [](const LockHotSpot &a, const LockHotSpot &b) { return a.waits_ < b.waits_; });
+  *coldest = LockHotSpot{rid, target.oid_, coldest->waits_ + 1, wait_us};
+}
+
+LockManagerStats LockManager::GetStats(size_t top_n) {
+  LockManagerStats stats;
+  stats.row_wait_latency_ = row_wait_latency_.GetSnapshot();
+  stats.table_wait_latency_ = table_wait_latency_.GetSnapshot();
+  stats.requests_ = table_requests_.load();
+  for (const auto &partition : lock_table_) {
+    stats.requests_ += partition.requests_.load();
+  }
+  stats.waits_ = waits_.load();
+  stats.upgrades_ = upgrades_.load();
+  stats.deadlock_aborts_ = deadlock_aborts_.load();
+  {
+    std::scoped_lock<std::mutex> lck(hot_spot_latch_);
+    stats.hot_spots_ = hot_spots_;
+  }
+  std::sort(stats.hot_spots_.begin(), stats.hot_spots_.end(),
+            [](const LockHotSpot &a, const LockHotSpot &b) { return a.waits_ > b.waits_; });
+  if (stats.hot_spots_.size() > top_n) {
+    stats.hot_spots_.resize(top_n);
+  }
+  return stats;
+}
+
+void LockManager::ResetStats() {
+  row_wait_latency_.Reset();
+  table_wait_latency_.Reset();
+  table_requests_ = 0;
+  for (auto &partition : lock_table_) {
+    partition.requests_ = 0;
+  }
+  waits_ = 0;
+  upgrades_ = 0;
+  deadlock_aborts_ = 0;
+  std::scoped_lock<std::mutex> lck(hot_spot_latch_);
+  hot_spots_.clear();
+}
+
+bool LockManager::UpgradeInPlace(LockRequestQueue *queue, std::list<LockRequest>::iterator request,
+                                 LockMode lock_mode) {
+  // Do not get ahead of an upgrade that is already waiting.
+  if (queue->upgrading_) {
+    return false;
+  }
+  for (const auto &other : queue->request_queue_) {
+    if (!other.granted_) {
+      break;
+    }
+    if (&other != &*request && !AreCompatible(other.lock_mode_, lock_mode)) {
+      return false;
+    }
+  }
+  request->lock_mode_ = lock_mode;
+  // The requests behind may have to wait for this one now.
+  queue->cv_.notify_all();
   return true;
 }
 
-void LockManager::AddEdge(txn_id_t t1, txn_id_t t2) {}
+std::list<LockManager::LockRequest>::iterator LockManager::RequeueForUpgrade(LockRequestQueue *queue,
+                                                                             std::list<LockRequest>::iterator request,
+                                                                             LockMode lock_mode) {
+  Transaction *txn = request->txn_;
+  queue->request_queue_.erase(request);
+  auto first_waiting = std::find_if(queue->request_queue_.begin(), queue->request_queue_.end(),
+                                    [](const LockRequest &r) { return !r.granted_; });
+  // The requests behind have to wait for this one now, and must know about it to deal with deadlocks.
+  queue->cv_.notify_all();
+  return queue->request_queue_.emplace(first_waiting, txn, lock_mode);
+}
+
+bool LockManager::IsGrantable(const LockRequestQueue &queue, std::list<LockRequest>::const_iterator request) {
+  // Granted requests always form a prefix of the queue, so this only looks at the granted requests.
+  for (auto it = queue.request_queue_.begin(); it != request; ++it) {
+    if (!it->granted_ || !AreCompatible(it->lock_mode_, request->lock_mode_)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool LockManager::AreCompatible(LockMode held, LockMode requested) {
+  switch (held) {
+    case LockMode::INTENTION_SHARED:
+      return requested != LockMode::EXCLUSIVE;
+    case LockMode::INTENTION_EXCLUSIVE:
+      return requested == LockMode::INTENTION_SHARED || requested == LockMode::INTENTION_EXCLUSIVE;
+    case LockMode::SHARED:
+      return requested == LockMode::INTENTION_SHARED || requested == LockMode::SHARED;
+    case LockMode::SHARED_INTENTION_EXCLUSIVE:
+      return requested == LockMode::INTENTION_SHARED;
+    case LockMode::EXCLUSIVE:
+      return false;
+  }
+  return false;
+}
+
+bool LockManager::Covers(LockMode held, LockMode requested) {
+  switch (held) {
+    case LockMode::INTENTION_SHARED:
+      return requested == LockMode::INTENTION_SHARED;
+    case LockMode::INTENTION_EXCLUSIVE:
+      return requested == LockMode::INTENTION_SHARED || requested == LockMode::INTENTION_EXCLUSIVE;
+    case LockMode::SHARED:
+      return requested == LockMode::INTENTION_SHARED || requested == LockMode::SHARED;
+    case LockMode::SHARED_INTENTION_EXCLUSIVE:
+      return requested != LockMode::EXCLUSIVE;
+    case LockMode::EXCLUSIVE:
+      return true;
+  }
+  return false;
+}
 
-void LockManager::RemoveEdge(txn_id_t t1, txn_id_t t2) {}
+bool LockManager::EraseRequest(LockRequestQueue *queue, std::list<LockRequest>::iterator request) {
+  queue->request_queue_.erase(request);
+  if (queue->request_queue_.empty()) {
+    return true;
+  }
+  queue->cv_.notify_all();
+  return false;
+}
 
-bool LockManager::HasCycle(txn_id_t *txn_id) { return false; }
+void LockManager::AddEdge(txn_id_t t1, txn_id_t t2) {
+  std::scoped_lock<std::mutex> lck(latch_);
+  // Neighbours are kept sorted so that the search for cycles is deterministic.
+  auto &edges = waits_for_[t1];
+  auto it = std::lower_bound(edges.begin(), edges.end(), t2);
+  if (it == edges.end() || *it != t2) {
+    edges.insert(it, t2);
+  }
+}
+
+void LockManager::RemoveEdge(txn_id_t t1, txn_id_t t2) {
+  std::scoped_lock<std::mutex> lck(latch_);
+  auto found = waits_for_.find(t1);
+  if (found == waits_for_.end()) {
+    return;
+  }
+  auto &edges = found->second;
+  auto it = std::lower_bound(edges.begin(), edges.end(), t2);
+  if (it != edges.end() && *it == t2) {
+    edges.erase(it);
+  }
+  if (edges.empty()) {
+    waits_for_.erase(found);
+  }
+}
 
-std::vector<std::pair<txn_id_t, txn_id_t>> LockManager::GetEdgeList() { return {}; }
+bool LockManager::HasCycle(txn_id_t *txn_id) {
+  std::scoped_lock<std::mutex> lck(latch_);
+  std::vector<txn_id_t> nodes;
+  nodes.reserve(waits_for_.size());
+  for (const auto &[node, edges] : waits_for_) {
+    nodes.push_back(node);
+  }
+  std::sort(nodes.begin(), nodes.end());
+  std::unordered_set<txn_id_t> visited;
+  for (auto node : nodes) {
+    if (visited.count(node) == 0) {
+      std::vector<txn_id_t> path{node};
+      if (FindCycle(&path, &visited, txn_id)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+bool LockManager::FindCycle(std::vector<txn_id_t> *path, std::unordered_set<txn_id_t> *visited, txn_id_t *txn_id) {
+  visited->insert(path->back());
+  auto found = waits_for_.find(path->back());
+  if (found == waits_for_.end()) {
+    return false;
+  }
+  for (auto next : found->second) {
+    auto on_path = std::find(path->begin(), path->end(), next);
+    if (on_path != path->end()) {
+      *txn_id = *std::max_element(on_path, path->end());
+      return true;
+    }
+    if (visited->count(next) == 0) {
+      path->push_back(next);
+      if (FindCycle(path, visited, txn_id)) {
+        return true;
+      }
+      path->pop_back();
+    }
+  }
+  return false;
+}
 
-void LockManager::RunCycleDetection() {
-  while (enable_cycle_detection_) {
-    std::this_thread::sleep_for(cycle_detection_interval);
-    {
-      std::unique_lock<std::mutex> l(latch_);
-      // TODO(student): remove the continue and add your cycle detection and abort code here
-      continue;
+std::vector<std::pair<txn_id_t, txn_id_t>> LockManager::GetEdgeList() {
+  std::scoped_lock<std::mutex> lck(latch_);
+  std::vector<std::pair<txn_id_t, txn_id_t>> edge_list;
+  for (const auto &[t1, edges] : waits_for_) {
+    for (auto t2 : edges) {
+      edge_list.emplace_back(t1, t2);
     }
   }
+  return edge_list;
 }
 
 }  // namespace bustub
@@ -12,102 +12,351 @@
 
 #include "concurrency/transaction_manager.h"
 
+#include <algorithm>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include "catalog/catalog.h"
 #include "storage/table/table_heap.h"
 
 namespace bustub {
 
-std::unordered_map<txn_id_t, Transaction *> TransactionManager::txn_map = {};
-
-Transaction *TransactionManager::Begin(Transaction *txn, IsolationLevel isolation_level) {
-  // Acquire the global transaction latch in shared mode.
-  global_txn_latch_.RLock();
+Transaction *TransactionManager::Begin(Transaction *txn, IsolationLevel isolation_level,
+                                       ConcurrencyControl concurrency_control) {
+  // Enter the global transaction latch, waiting for a checkpoint in progress.
+  global_txn_latch_.Enter();
 
   if (txn == nullptr) {
-    txn = new Transaction(next_txn_id_++, isolation_level);
+    Transaction *pooled = nullptr;
+    {
+      std::scoped_lock<std::mutex> lck{pool_latch_};
+      if (!free_txns_.empty()) {
+        pooled = free_txns_.back();
+        free_txns_.pop_back();
+      }
+    }
+    if (pooled != nullptr) {
+      pooled->Reset(next_txn_id_++, isolation_level, concurrency_control);
+      txn = pooled;
+    } else {
+      txn = new Transaction(next_txn_id_++, isolation_level, concurrency_control);
+    }
+  }
+
+  if (HasReadTs(txn)) {
+    std::scoped_lock<std::mutex> lck{timestamp_latch_};
+    txn->SetReadTs(last_commit_ts_);
+    active_snapshots_.insert(last_commit_ts_);
   }
 
-  txn_map[txn->GetTransactionId()] = txn;
+  if (enable_logging && log_manager_ != nullptr) {
+    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::BEGIN);
+    // A checkpoint sees both the BEGIN record and the table entry, or neither, see AppendEndRecord.
+    std::scoped_lock<std::mutex> lck{active_txns_latch_};
+    lsn_t lsn = log_manager_->AppendLogRecord(&log_record);
+    txn->SetPrevLSN(lsn);
+    active_txns_.emplace(txn, lsn);
+  }
+
+  txn_registry_.Register(txn);
   return txn;
 }
 
-void TransactionManager::Commit(Transaction *txn) {
+bool TransactionManager::Commit(Transaction *txn) {
+  if (txn->GetConcurrencyControl() == ConcurrencyControl::OPTIMISTIC && !WriteAndValidate(txn)) {
+    Abort(txn);
+    return false;
+  }
   txn->SetState(TransactionState::COMMITTED);
 
-  // Perform all deletes before we commit.
+  // Perform all deletes before we commit, a page at a time. The write set is kept for stamping the versions.
   auto write_set = txn->GetWriteSet();
-  while (!write_set->empty()) {
-    auto &item = write_set->back();
-    auto table = item.table_;
-    if (item.wtype_ == WType::DELETE) {
-      // Note that this also releases the lock when holding the page latch.
-      table->ApplyDelete(item.rid_, txn);
+  for (const auto &[table, writes] : GroupByTable(*write_set, true)) {
+    // Note that this also releases the locks when holding the page latches.
+    table->ApplyDeletes(writes, txn);
+  }
+
+  // With early lock release, the lsn to wait for once the locks are released, before the commit is acknowledged.
+  lsn_t durable_lsn = INVALID_LSN;
+  if (enable_logging && log_manager_ != nullptr) {
+    // The transaction is committed once its commit record is durable. Concurrent committers share the same flush.
+    lsn_t lsn = AppendEndRecord(txn, LogRecordType::COMMIT);
+    if (!enable_early_lock_release) {
+      log_manager_->WaitUntilPersistent(lsn);
+    } else if (write_set->empty() && txn->GetIndexWriteSet()->empty()) {
+      // Whatever a read-only transaction read was committed by a record no later than this one.
+      durable_lsn = early_release_lsn_.load();
+    } else {
+      // Whoever reads the writes from now on depends on this commit record.
+      RaiseEarlyReleaseLsn(lsn);
+      durable_lsn = lsn;
     }
-    write_set->pop_back();
+  } else if (log_manager_ != nullptr) {
+    // the transaction may have begun before logging was turned off.
+    RemoveActiveTransaction(txn);
   }
+
+  // The writes become visible to snapshots once durable (or appended, with early lock release), and to everybody else
+  // once the locks are released.
+  CommitVersions(txn);
   write_set->clear();
+  EndSnapshot(txn);
 
   // Release all the locks.
   ReleaseLocks(txn);
-  // Release the global transaction latch.
-  global_txn_latch_.RUnlock();
+  if (durable_lsn != INVALID_LSN) {
+    log_manager_->WaitUntilPersistent(durable_lsn);
+  }
+  txn_registry_.Unregister(txn);
+  // Leave the global transaction latch.
+  global_txn_latch_.Exit();
+  return true;
 }
 
 void TransactionManager::Abort(Transaction *txn) {
   txn->SetState(TransactionState::ABORTED);
-  // Rollback before releasing the lock.
+  // The writes an optimistic transaction deferred never happened.
+  txn->GetDeferredWriteSet()->clear();
+  txn->GetReadSet()->clear();
+  // Rollback before releasing the lock, a page at a time.
   auto table_write_set = txn->GetWriteSet();
-  while (!table_write_set->empty()) {
-    auto &item = table_write_set->back();
-    auto table = item.table_;
-    if (item.wtype_ == WType::DELETE) {
-      table->RollbackDelete(item.rid_, txn);
-    } else if (item.wtype_ == WType::INSERT) {
-      // Note that this also releases the lock when holding the page latch.
-      table->ApplyDelete(item.rid_, txn);
-    } else if (item.wtype_ == WType::UPDATE) {
-      table->UpdateTuple(item.tuple_, item.rid_, txn);
-    }
-    table_write_set->pop_back();
+  for (const auto &[table, writes] : GroupByTable(*table_write_set, false)) {
+    // Note that this also releases the locks of the inserted tuples when holding the page latches.
+    table->RollbackWrites(writes, txn);
+  }
+  // The versions go back last, once the pages hold them again.
+  for (const auto &item : *table_write_set) {
+    item.table_->GetVersionStore()->Rollback(item.rid_, txn);
   }
   table_write_set->clear();
+  EndSnapshot(txn);
   // Rollback index updates
+  RollbackIndexWrites(txn);
+
+  if (enable_logging && log_manager_ != nullptr) {
+    AppendEndRecord(txn, LogRecordType::ABORT);
+  } else if (log_manager_ != nullptr) {
+    // the transaction may have begun before logging was turned off.
+    RemoveActiveTransaction(txn);
+  }
+
+  // Release all the locks.
+  ReleaseLocks(txn);
+  txn_registry_.Unregister(txn);
+  // Leave the global transaction latch.
+  global_txn_latch_.Exit();
+}
+
+void TransactionManager::Release(Transaction *txn) {
+  BUSTUB_ASSERT(txn->GetState() == TransactionState::COMMITTED || txn->GetState() == TransactionState::ABORTED,
+                "Only a finished transaction can be reused.");
+  {
+    std::scoped_lock<std::mutex> lck{pool_latch_};
+    if (free_txns_.size() < MAX_POOLED_TXNS) {
+      free_txns_.push_back(txn);
+      return;
+    }
+  }
+  delete txn;
+}
+
+bool TransactionManager::WriteAndValidate(Transaction *txn) {
+  auto deferred_write_set = txn->GetDeferredWriteSet();
+  std::vector<TableWriteRecord> writes(deferred_write_set->begin(), deferred_write_set->end());
+  deferred_write_set->clear();
+  // Committers lock the tuples they write in the same order, so that they never deadlock with each other.
+  std::stable_sort(writes.begin(), writes.end(),
+                   [](const TableWriteRecord &a, const TableWriteRecord &b) { return a.rid_.Get() < b.rid_.Get(); });
+  try {
+    for (const auto &write : writes) {
+      if (!write.table_->ApplyDeferredWrite(write, txn)) {
+        return false;
+      }
+    }
+  } catch (TransactionAbortException &e) {
+    return false;
+  }
+  // The tuples written are now locked, while the ones only read may still change until the commit is stamped. Like
+  // a lock released at commit, such a change is ordered after this transaction.
+  auto read_set = txn->GetReadSet();
+  bool valid = std::all_of(read_set->begin(), read_set->end(), [txn](const TableReadRecord &read) {
+    return read.table_->GetVersionStore()->Validate(read.rid_, txn, read.begin_ts_);
+  });
+  read_set->clear();
+  return valid && txn->GetState() != TransactionState::ABORTED;
+}
+
+void TransactionManager::RaiseEarlyReleaseLsn(lsn_t lsn) {
+  lsn_t last = early_release_lsn_.load();
+  while (last < lsn && !early_release_lsn_.compare_exchange_weak(last, lsn)) {
+  }
+}
+
+std::vector<std::pair<TableHeap *, std::vector<const TableWriteRecord *>>> TransactionManager::GroupByTable(
+    const std::deque<TableWriteRecord> &write_set, bool deletes_only) {
+  std::vector<std::pair<TableHeap *, std::vector<const TableWriteRecord *>>> groups;
+  for (auto item = write_set.rbegin(); item != write_set.rend(); ++item) {
+    if (deletes_only && item->wtype_ != WType::DELETE) {
+      continue;
+    }
+    // A transaction writes a handful of tables at most.
+    auto group = std::find_if(groups.begin(), groups.end(), [&item](const auto &g) { return g.first == item->table_; });
+    if (group == groups.end()) {
+      group = groups.emplace(groups.end(), item->table_, std::vector<const TableWriteRecord *>{});
+    }
+    group->second.push_back(&*item);
+  }
+  return groups;
+}
+
+void TransactionManager::RollbackIndexWrites(Transaction *txn) {
+  /** An entry to put back into an index or take out of it. */
+  struct IndexUndo {
+    Tuple key_;
+    RID rid_;
+    bool insert_;
+  };
+  /** The undos of an index, newest first. */
+  struct IndexUndoGroup {
+    const IndexWriteRecord *first_;
+    TableMetadata *table_info_;
+    IndexInfo *index_info_;
+    std::vector<IndexUndo> undos_;
+  };
+
   auto index_write_set = txn->GetIndexWriteSet();
-  while (!index_write_set->empty()) {
-    auto &item = index_write_set->back();
-    auto catalog = item.catalog_;
-    // Metadata identifying the table that should be deleted from.
-    TableMetadata *table_info = catalog->GetTable(item.table_oid_);
-    IndexInfo *index_info = catalog->GetIndex(item.index_oid_);
-    auto new_key = item.tuple_.KeyFromTuple(table_info->schema_, *(index_info->index_->GetKeySchema()),
-                                            index_info->index_->GetKeyAttrs());
-    if (item.wtype_ == WType::DELETE) {
-      index_info->index_->InsertEntry(new_key, item.rid_, txn);
-    } else if (item.wtype_ == WType::INSERT) {
-      index_info->index_->DeleteEntry(new_key, item.rid_, txn);
-    } else if (item.wtype_ == WType::UPDATE) {
+  std::vector<IndexUndoGroup> groups;
+  for (auto item = index_write_set->rbegin(); item != index_write_set->rend(); ++item) {
+    auto group = std::find_if(groups.begin(), groups.end(), [&item](const IndexUndoGroup &g) {
+      return g.first_->catalog_ == item->catalog_ && g.first_->table_oid_ == item->table_oid_ &&
+             g.first_->index_oid_ == item->index_oid_;
+    });
+    if (group == groups.end()) {
+      // Metadata identifying the table that should be deleted from.
+      group = groups.insert(groups.end(), IndexUndoGroup{&*item, item->catalog_->GetTable(item->table_oid_),
+                                                         item->catalog_->GetIndex(item->index_oid_), {}});
+    }
+    TableMetadata *table_info = group->table_info_;
+    Index *index = group->index_info_->index_.get();
+    auto new_key = item->tuple_.KeyFromTuple(table_info->schema_, *index->GetKeySchema(), index->GetKeyAttrs());
+    if (item->wtype_ == WType::DELETE) {
+      group->undos_.push_back(IndexUndo{new_key, item->rid_, true});
+    } else if (item->wtype_ == WType::INSERT) {
+      group->undos_.push_back(IndexUndo{new_key, item->rid_, false});
+    } else if (item->wtype_ == WType::UPDATE) {
       // Delete the new key and insert the old key
-      index_info->index_->DeleteEntry(new_key, item.rid_, txn);
-      auto old_key = item.old_tuple_.KeyFromTuple(table_info->schema_, *(index_info->index_->GetKeySchema()),
-                                                  index_info->index_->GetKeyAttrs());
-      index_info->index_->InsertEntry(old_key, item.rid_, txn);
+      group->undos_.push_back(IndexUndo{new_key, item->rid_, false});
+      auto old_key = item->old_tuple_.KeyFromTuple(table_info->schema_, *index->GetKeySchema(), index->GetKeyAttrs());
+      group->undos_.push_back(IndexUndo{old_key, item->rid_, true});
+    }
+  }
+
+  for (auto &group : groups) {
+    Index *index = group.index_info_->index_.get();
+    const Schema *key_schema = index->GetKeySchema();
+    // The undos of different keys commute, so the index is walked in key order.
+    std::stable_sort(group.undos_.begin(), group.undos_.end(), [key_schema](const IndexUndo &a, const IndexUndo &b) {
+      for (uint32_t i = 0; i < key_schema->GetColumnCount(); i++) {
+        Value lhs = a.key_.GetValue(key_schema, i);
+        Value rhs = b.key_.GetValue(key_schema, i);
+        if (lhs.CompareLessThan(rhs) == CmpBool::CmpTrue) {
+          return true;
+        }
+        if (rhs.CompareLessThan(lhs) == CmpBool::CmpTrue) {
+          return false;
+        }
+      }
+      return false;
+    });
+    for (const auto &undo : group.undos_) {
+      if (undo.insert_) {
+        index->InsertEntry(undo.key_, undo.rid_, txn);
+      } else {
+        index->DeleteEntry(undo.key_, undo.rid_, txn);
+      }
     }
-    index_write_set->pop_back();
   }
-  table_write_set->clear();
   index_write_set->clear();
+}
 
-  // Release all the locks.
-  ReleaseLocks(txn);
-  // Release the global transaction latch.
-  global_txn_latch_.RUnlock();
+void TransactionManager::BlockAllTransactions() { global_txn_latch_.Block(); }
+
+void TransactionManager::ResumeTransactions() { global_txn_latch_.Resume(); }
+
+lsn_t TransactionManager::AppendEndRecord(Transaction *txn, LogRecordType type) {
+  LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(), type);
+  // Were the transaction dropped from the table after its record is appended, a checkpoint could begin in between
+  // and still list it as active, and the analysis from that checkpoint would never see the record.
+  std::scoped_lock<std::mutex> lck{active_txns_latch_};
+  lsn_t lsn = log_manager_->AppendLogRecord(&log_record);
+  txn->SetPrevLSN(lsn);
+  active_txns_.erase(txn);
+  return lsn;
 }
 
-void TransactionManager::BlockAllTransactions() { global_txn_latch_.WLock(); }
+void TransactionManager::RemoveActiveTransaction(Transaction *txn) {
+  std::scoped_lock<std::mutex> lck{active_txns_latch_};
+  active_txns_.erase(txn);
+}
 
-void TransactionManager::ResumeTransactions() { global_txn_latch_.WUnlock(); }
+void TransactionManager::CommitVersions(Transaction *txn) {
+  auto write_set = txn->GetWriteSet();
+  if (write_set->empty()) {
+    return;
+  }
+  // Readers take the latch to begin, so none of them sees only part of the commit.
+  std::scoped_lock<std::mutex> lck{timestamp_latch_};
+  timestamp_t commit_ts = last_commit_ts_ + 1;
+  last_commit_ts_ = commit_ts;
+  timestamp_t watermark = GetWatermarkLocked();
+  for (const auto &item : *write_set) {
+    item.table_->GetVersionStore()->Commit(item.rid_, txn, commit_ts, watermark);
+    versioned_tables_.insert(item.table_);
+  }
+}
+
+void TransactionManager::EndSnapshot(Transaction *txn) {
+  if (!HasReadTs(txn)) {
+    return;
+  }
+  std::scoped_lock<std::mutex> lck{timestamp_latch_};
+  auto found = active_snapshots_.find(txn->GetReadTs());
+  if (found != active_snapshots_.end()) {
+    active_snapshots_.erase(found);
+  }
+}
+
+timestamp_t TransactionManager::GetWatermark() {
+  std::scoped_lock<std::mutex> lck{timestamp_latch_};
+  return GetWatermarkLocked();
+}
+
+size_t TransactionManager::CollectGarbage() {
+  std::vector<TableHeap *> tables;
+  timestamp_t watermark;
+  {
+    std::scoped_lock<std::mutex> lck{timestamp_latch_};
+    tables.assign(versioned_tables_.begin(), versioned_tables_.end());
+    watermark = GetWatermarkLocked();
+  }
+  // A snapshot that begins from now on is at or after the watermark.
+  size_t reclaimed = 0;
+  for (auto *table : tables) {
+    reclaimed += table->GetVersionStore()->CollectGarbage(watermark);
+  }
+  return reclaimed;
+}
+
+std::vector<ActiveTransaction> TransactionManager::GetActiveTransactionTable() {
+  std::scoped_lock<std::mutex> lck{active_txns_latch_};
+  std::vector<ActiveTransaction> active_txns;
+  active_txns.reserve(active_txns_.size());
+  for (const auto &[txn, first_lsn] : active_txns_) {
+    active_txns.push_back({txn->GetTransactionId(), first_lsn, txn->GetPrevLSN()});
+  }
+  return active_txns;
+}
 
 }  // namespace bustub
@@ -0,0 +1,165 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// version_store.cpp
+//
+// Identification: src/concurrency/version_store.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include "concurrency/version_store.h"
+
+namespace bustub {
+
+bool VersionStore::GetVisible(const RID &rid, Transaction *txn, bool exists, Tuple *tuple) {
+  std::scoped_lock<std::mutex> lck(latch_);
+  auto found = chains_.find(rid);
+  if (found == chains_.end()) {
+    return exists;
+  }
+  const auto &chain = found->second;
+  // A transaction sees its own writes.
+  if (chain.writer_ == txn->GetTransactionId() ||
+      (chain.writer_ == INVALID_TXN_ID && chain.begin_ts_ <= txn->GetReadTs())) {
+    return exists;
+  }
+  for (const auto &version : chain.versions_) {
+    if (version.begin_ts_ <= txn->GetReadTs()) {
+      if (version.exists_) {
+        *tuple = version.tuple_;
+      }
+      return version.exists_;
+    }
+  }
+  return false;
+}
+
+bool VersionStore::GetLatest(const RID &rid, Transaction *txn, bool exists, Tuple *tuple, timestamp_t *begin_ts) {
+  std::scoped_lock<std::mutex> lck(latch_);
+  auto found = chains_.find(rid);
+  if (found == chains_.end()) {
+    *begin_ts = 0;
+    return exists;
+  }
+  const auto &chain = found->second;
+  if (chain.writer_ == INVALID_TXN_ID) {
+    *begin_ts = chain.begin_ts_;
+    return exists;
+  }
+  // The version txn wrote itself is validated as the committed one it replaced.
+  const auto &replaced = chain.versions_.front();
+  *begin_ts = replaced.begin_ts_;
+  if (chain.writer_ == txn->GetTransactionId()) {
+    return exists;
+  }
+  if (replaced.exists_) {
+    *tuple = replaced.tuple_;
+  }
+  return replaced.exists_;
+}
+
+bool VersionStore::Validate(const RID &rid, Transaction *txn, timestamp_t begin_ts) {
+  std::scoped_lock<std::mutex> lck(latch_);
+  auto found = chains_.find(rid);
+  if (found == chains_.end()) {
+    // The chain of a tuple written after txn began is kept until txn ends, see IsObsolete.
+    return begin_ts <= txn->GetReadTs();
+  }
+  const auto &chain = found->second;
+  if (chain.writer_ == INVALID_TXN_ID) {
+    return chain.begin_ts_ == begin_ts;
+  }
+  return chain.writer_ == txn->GetTransactionId() && chain.versions_.front().begin_ts_ == begin_ts;
+}
+
+bool VersionStore::BeginWrite(const RID &rid, Transaction *txn, bool exists, const Tuple &tuple) {
+  std::scoped_lock<std::mutex> lck(latch_);
+  // A tuple without a chain can never conflict, so only the chains of tuples actually written are created.
+  auto &chain = chains_[rid];
+  if (chain.writer_ == txn->GetTransactionId()) {
+    return true;
+  }
+  // The first writer wins.
+  if (chain.writer_ != INVALID_TXN_ID || (txn->GetIsolationLevel() == IsolationLevel::SNAPSHOT_ISOLATION &&
+                                          chain.begin_ts_ > txn->GetReadTs())) {
+    return false;
+  }
+  chain.versions_.push_front(TupleVersion{chain.begin_ts_, exists, exists ? tuple : Tuple{}});
+  chain.writer_ = txn->GetTransactionId();
+  return true;
+}
+
+void VersionStore::BeginInsert(const RID &rid, Transaction *txn) {
+  std::scoped_lock<std::mutex> lck(latch_);
+  auto &chain = chains_[rid];
+  // The slot may still hold the versions of a deleted tuple for older snapshots.
+  chain.versions_.push_front(TupleVersion{chain.begin_ts_, false, Tuple{}});
+  chain.writer_ = txn->GetTransactionId();
+}
+
+void VersionStore::Commit(const RID &rid, Transaction *txn, timestamp_t commit_ts, timestamp_t watermark) {
+  std::scoped_lock<std::mutex> lck(latch_);
+  auto found = chains_.find(rid);
+  if (found == chains_.end() || found->second.writer_ != txn->GetTransactionId()) {
+    return;
+  }
+  auto &chain = found->second;
+  chain.writer_ = INVALID_TXN_ID;
+  chain.begin_ts_ = commit_ts;
+  Prune(&chain, watermark);
+  if (IsObsolete(chain, watermark)) {
+    chains_.erase(found);
+  }
+}
+
+void VersionStore::Rollback(const RID &rid, Transaction *txn) {
+  std::scoped_lock<std::mutex> lck(latch_);
+  auto found = chains_.find(rid);
+  if (found == chains_.end() || found->second.writer_ != txn->GetTransactionId()) {
+    return;
+  }
+  auto &chain = found->second;
+  chain.writer_ = INVALID_TXN_ID;
+  chain.begin_ts_ = chain.versions_.front().begin_ts_;
+  chain.versions_.pop_front();
+  // Nothing was reclaimed since the write, so a chain that says no more than the page did not exist before it.
+  if (chain.versions_.empty() && chain.begin_ts_ == 0) {
+    chains_.erase(found);
+  }
+}
+
+size_t VersionStore::CollectGarbage(timestamp_t watermark) {
+  std::scoped_lock<std::mutex> lck(latch_);
+  size_t reclaimed = 0;
+  for (auto it = chains_.begin(); it != chains_.end();) {
+    reclaimed += Prune(&it->second, watermark);
+    if (IsObsolete(it->second, watermark)) {
+      it = chains_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  return reclaimed;
+}
+
+size_t VersionStore::Prune(VersionChain *chain, timestamp_t watermark) {
+  // The oldest snapshot sees the newest version that began at or before it, and nobody sees the versions before.
+  auto &versions = chain->versions_;
+  auto keep = versions.begin();
+  if (chain->writer_ != INVALID_TXN_ID || chain->begin_ts_ > watermark) {
+    while (keep != versions.end() && keep->begin_ts_ > watermark) {
+      ++keep;
+    }
+    if (keep != versions.end()) {
+      ++keep;
+    }
+  }
+  size_t dropped = versions.end() - keep;
+  versions.erase(keep, versions.end());
+  return dropped;
+}
+
+}  // namespace bustub
@@ -12,9 +12,13 @@
 
 #pragma once
 
+#include <atomic>
+#include <condition_variable>  // NOLINT
 #include <list>
 #include <mutex>  // NOLINT
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "buffer/lru_replacer.h"
 #include "recovery/log_manager.h"
@@ -23,6 +27,8 @@
 
 namespace bustub {
 
+class LogRecovery;
+
 /**
  * BufferPoolManager reads disk pages to and from its internal buffer pool.
  */
@@ -97,6 +103,31 @@ class BufferPoolManager {
   /** @return size of the buffer pool */
   size_t GetPoolSize() { return pool_size_; }
 
+  /**
+   * The dirty page table for fuzzy checkpoints: every page that may differ from its copy on disk, with its recovery
+   * LSN. Pages pinned since the last write count as dirty since they may be modified before they are unpinned.
+   * @return the (page id, recLSN) pairs
+   */
+  std::vector<std::pair<page_id_t, lsn_t>> GetDirtyPageTable();
+
+  /**
+   * Hand every page read from disk to on-demand recovery before anybody sees it, see LogRecovery::RecoverOnDemand.
+   * @param log_recovery the recovery in progress, nullptr once it is over
+   */
+  void SetLogRecovery(LogRecovery *log_recovery) { log_recovery_ = log_recovery; }
+
+  /** @return true while on-demand recovery is in progress, i.e. until its master record is written */
+  bool IsRecovering() const { return log_recovery_ != nullptr; }
+
+  /** Block until some frame is free or unpinned, e.g. after FetchPage or NewPage returned nullptr. */
+  void WaitForUnpinnedFrame();
+
+  /** @return the number of pages evicted to make room for another page */
+  size_t GetNumEvictions() { return num_evictions_; }
+
+  /** @return the number of times eviction found no page whose log records were on disk and had to force the log */
+  size_t GetNumEvictionLogWaits() { return num_eviction_log_waits_; }
+
  protected:
   /**
    * Grading function. Do not modify!
@@ -112,7 +143,8 @@ class BufferPoolManager {
   }
 
   /**
-   * Fetch the requested page from the buffer pool.
+   * Fetch the requested page from the buffer pool. A page read from disk during on-demand recovery is recovered with
+   * latch_ released; it stays pinned and marked as recovering meanwhile, and other fetchers of the page wait for it.
    * @param page_id id of page to be fetched
    * @return the requested page
    */
@@ -127,7 +159,7 @@ class BufferPoolManager {
   bool UnpinPageImpl(page_id_t page_id, bool is_dirty);
 
   /**
-   * Flushes the target page to disk.
+   * Flushes the target page to disk. The log is forced up to the page LSN with latch_ released, see ForceLogForPage.
    * @param page_id id of page to be flushed, cannot be INVALID_PAGE_ID
    * @return false if the page could not be found in the page table, true otherwise
    */
@@ -148,10 +180,67 @@ class BufferPoolManager {
   bool DeletePageImpl(page_id_t page_id);
 
   /**
-   * Flushes all the pages in the buffer pool to disk.
+   * Flushes all the pages in the buffer pool to disk, like FlushPageImpl. The log is forced once up to the largest
+   * page LSN first.
    */
   void FlushAllPagesImpl();
 
+  /**
+   * Find a frame for a page that is not in the buffer pool: a free frame first, else the least recently used unpinned
+   * page. The frame is removed from the free list or the replacer. The caller must hold latch_.
+   * @param[out] frame_id the frame
+   * @param durable_only only evict pages that are clean or whose log records are all on disk, so that writing them
+   * back does not have to wait for the log. If some page is skipped, a log flush is requested in the background.
+   * @return false if no such frame exists
+   */
+  bool FindVictim(frame_id_t *frame_id, bool durable_only);
+
+  /**
+   * Force the log so that the unpinned pages can be evicted without breaking the WAL rule. latch_ is released while
+   * waiting, so the pages in the buffer pool stay available and the caller must look at the page table again.
+   * @param lck the caller's lock on latch_
+   * @param[out] forced set to false if the log cannot be forced, in which case any unpinned page may be evicted
+   * @return false if there is no unpinned page to make room for
+   */
+  bool ForceLogForEviction(std::unique_lock<std::mutex> *lck, bool *forced);
+
+  /**
+   * Force the log up to the page LSN so that the page can be written back, like ForceLogForEviction. The page may be
+   * changed or evicted while latch_ is released, so the caller must look it up again.
+   * @param page the frame holding the page
+   * @param lck the caller's lock on latch_
+   * @return false if the log cannot be forced, in which case the page may be written anyway
+   */
+  bool ForceLogForPage(Page *page, std::unique_lock<std::mutex> *lck);
+
+  /**
+   * @return true if the page can be written back without breaking the WAL rule: it is clean, or the log records
+   * describing its changes are on disk. The caller must hold latch_.
+   */
+  bool IsDurable(Page *page) {
+    return !page->IsDirty() || !enable_logging || log_manager_ == nullptr ||
+           page->GetLSN() <= log_manager_->GetPersistentLSN();
+  }
+
+  /**
+   * Writes the page back to disk. It never waits for the log: following the WAL rule, the caller makes the page
+   * durable first with latch_ released, see IsDurable and ForceLogForPage.
+   * @param page_id id of the page to be written
+   * @param page the frame holding the page
+   */
+  void WriteBackPage(page_id_t page_id, Page *page);
+
+  /**
+   * Start tracking the recovery LSN of a page that is being pinned, unless it is already tracked. Any change made
+   * under the pin is logged after this call, so the next lsn is a safe recLSN.
+   * @param page the frame holding the page
+   */
+  void TrackRecLSN(Page *page) {
+    if (page->rec_lsn_ == INVALID_LSN && enable_logging && log_manager_ != nullptr) {
+      page->rec_lsn_ = log_manager_->GetNextLSN();
+    }
+  }
+
   /** Number of pages in the buffer pool. */
   size_t pool_size_;
   /** Array of buffer pool pages. */
@@ -170,5 +259,17 @@ class BufferPoolManager {
   std::mutex latch_;
 
   page_id_t next_page_id_;
+
+  /** On-demand recovery in progress, if any. */
+  std::atomic<LogRecovery *> log_recovery_{nullptr};
+  /** Notified under latch_ whenever a page is done recovering. */
+  std::condition_variable recovered_cv_;
+  /** Notified under latch_ whenever a frame is freed or unpinned. */
+  std::condition_variable unpinned_cv_;
+
+  /** The number of pages evicted from the replacer. */
+  std::atomic<size_t> num_evictions_{0};
+  /** The number of times eviction had to force the log, see ForceLogForEviction. */
+  std::atomic<size_t> num_eviction_log_waits_{0};
 };
 }  // namespace bustub
@@ -39,6 +39,8 @@ class ClockReplacer : public Replacer {
 
   bool Victim(frame_id_t *frame_id) override;
 
+  bool Victim(frame_id_t *frame_id, const std::function<bool(frame_id_t)> &filter) override;
+
   void Pin(frame_id_t frame_id) override;
 
   void Unpin(frame_id_t frame_id) override;
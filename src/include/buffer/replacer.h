@@ -12,6 +12,8 @@
 
 #pragma once
 
+#include <functional>
+
 #include "common/config.h"
 
 namespace bustub {
@@ -31,6 +33,15 @@ class Replacer {
    */
   virtual bool Victim(frame_id_t *frame_id) = 0;
 
+  /**
+   * Remove the victim frame as defined by the replacement policy among the frames the filter accepts. Frames it
+   * rejects stay in the replacer.
+   * @param[out] frame_id id of frame that was removed
+   * @param filter called with candidate frames in replacement order until it accepts one
+   * @return true if an accepted victim frame was found, false otherwise
+   */
+  virtual bool Victim(frame_id_t *frame_id, const std::function<bool(frame_id_t)> &filter) = 0;
+
   /**
    * Pins a frame, indicating that it should not be victimized until it is unpinned.
    * @param frame_id the id of the frame to pin
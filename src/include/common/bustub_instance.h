@@ -23,11 +23,17 @@ namespace bustub {
 
 class BustubInstance {
  public:
-  explicit BustubInstance(const std::string &db_file_name) {
+  explicit BustubInstance(const std::string &db_file_name) : BustubInstance(new DiskManager(db_file_name)) {}
+
+  /**
+   * Creates an instance on top of the given disk manager, e.g. a SimulatedDiskManager for benchmarks.
+   * @param disk_manager the disk manager, the instance takes ownership of it
+   */
+  explicit BustubInstance(DiskManager *disk_manager) {
     enable_logging = false;
 
     // storage related
-    disk_manager_ = new DiskManager(db_file_name);
+    disk_manager_ = disk_manager;
 
     // log related
     log_manager_ = new LogManager(disk_manager_);
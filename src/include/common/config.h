@@ -18,15 +18,27 @@
 
 namespace bustub {
 
-/** Cycle detection is performed every CYCLE_DETECTION_INTERVAL milliseconds. */
-extern std::chrono::milliseconds cycle_detection_interval;
+/** A transaction holding more than LOCK_ESCALATION_THRESHOLD record locks on a table locks the whole table, 0 never. */
+extern int lock_escalation_threshold;
 
 /** True if logging should be enabled, false otherwise. */
 extern std::atomic<bool> enable_logging;
 
+/**
+ * If ENABLE_LOGGING is true, a committing transaction releases its locks as soon as its commit record is appended
+ * instead of once it is durable, see TransactionManager::Commit.
+ */
+extern std::atomic<bool> enable_early_lock_release;
+
 /** If ENABLE_LOGGING is true, the log should be flushed to disk every LOG_TIMEOUT. */
 extern std::chrono::duration<int64_t> log_timeout;
 
+/** The number of log streams. With more than one, the log is striped over as many buffers, flush threads and files. */
+extern int log_stream_count;
+
+/** If the background checkpointer is running, a fuzzy checkpoint is taken every CHECKPOINT_INTERVAL milliseconds. */
+extern std::chrono::milliseconds checkpoint_interval;
+
 static constexpr int INVALID_PAGE_ID = -1;                                    // invalid page id
 static constexpr int INVALID_TXN_ID = -1;                                     // invalid transaction id
 static constexpr int INVALID_LSN = -1;                                        // invalid log sequence number
@@ -34,12 +46,15 @@ static constexpr int HEADER_PAGE_ID = 0;                                      //
 static constexpr int PAGE_SIZE = 4096;                                        // size of a data page in byte
 static constexpr int BUFFER_POOL_SIZE = 10;                                   // size of buffer pool
 static constexpr int LOG_BUFFER_SIZE = ((BUFFER_POOL_SIZE + 1) * PAGE_SIZE);  // size of a log buffer in byte
+static constexpr int LOG_SEGMENT_SIZE = 64 * LOG_BUFFER_SIZE;               // size of a log segment file in byte
 static constexpr int BUCKET_SIZE = 50;                                        // size of extendible hash bucket
+static constexpr int LOCK_TABLE_PARTITIONS = 1024;                            // number of lock table partitions
 
 using frame_id_t = int32_t;    // frame id type
 using page_id_t = int32_t;     // page id type
 using txn_id_t = int32_t;      // transaction id type
 using lsn_t = int32_t;         // log sequence number type
+using timestamp_t = int64_t;   // commit timestamp type
 using slot_offset_t = size_t;  // slot offset type
 using oid_t = uint16_t;
 
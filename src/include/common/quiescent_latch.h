@@ -0,0 +1,125 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// quiescent_latch.h
+//
+// Identification: src/include/common/quiescent_latch.h
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>  // NOLINT
+#include <cstdint>
+#include <mutex>  // NOLINT
+
+#include "common/macros.h"
+
+namespace bustub {
+
+/**
+ * QuiescentLatch lets many threads run critical sections that a rare blocker waits to drain, without the threads
+ * sharing a cache line, e.g. transactions and checkpoints.
+ *
+ * A thread announces a critical section in a slot of its own, one of NUM_SLOTS, by incrementing the slot's counter,
+ * and leaves it by decrementing the counter of its current slot, which needs not be the one it entered from: only the
+ * sum of the counters means anything. Neither touches anything else unless a blocker is about, so the common path
+ * writes no shared memory.
+ *
+ * The blocker raises a flag and then waits for the counters to sum up to zero, while a thread entering looks at the
+ * flag after announcing itself, and backs off if it is raised. With sequentially consistent accesses, either the
+ * blocker sees the announcement, or the thread sees the flag.
+ */
+class QuiescentLatch {
+ public:
+  QuiescentLatch() = default;
+
+  DISALLOW_COPY_AND_MOVE(QuiescentLatch);
+
+  /** Enter a critical section, waiting while the latch is blocked. */
+  void Enter() {
+    auto &slot = slots_[ThreadSlot()];
+    while (true) {
+      slot.active_.fetch_add(1);
+      if (!blocked_.load()) {
+        return;
+      }
+      slot.active_.fetch_sub(1);
+      std::unique_lock<std::mutex> lck(latch_);
+      cv_.notify_all();
+      cv_.wait(lck, [this] { return !blocked_.load(); });
+    }
+  }
+
+  /** Leave a critical section, possibly on another thread than the one it was entered on. */
+  void Exit() {
+    slots_[ThreadSlot()].active_.fetch_sub(1);
+    if (blocked_.load()) {
+      std::scoped_lock<std::mutex> lck(latch_);
+      cv_.notify_all();
+    }
+  }
+
+  /** Keep new critical sections from starting, and wait for those in progress to end. */
+  void Block() {
+    block_latch_.lock();
+    std::unique_lock<std::mutex> lck(latch_);
+    blocked_.store(true);
+    cv_.wait(lck, [this] { return IsQuiescent(); });
+  }
+
+  /** Let critical sections start again. */
+  void Resume() {
+    {
+      std::scoped_lock<std::mutex> lck(latch_);
+      blocked_.store(false);
+      cv_.notify_all();
+    }
+    block_latch_.unlock();
+  }
+
+ private:
+  static constexpr size_t NUM_SLOTS = 64;
+
+  /** A slot of the latch. Aligned so that two slots never share a cache line. */
+  struct alignas(64) Slot {
+    /** The critical sections entered from this slot, less those left from it. */
+    std::atomic<int64_t> active_{0};
+  };
+
+  /** @return the slot of the calling thread, handed out round-robin the first time the thread asks */
+  static size_t ThreadSlot() {
+    static std::atomic<size_t> next_slot{0};
+    thread_local size_t slot = next_slot.fetch_add(1) % NUM_SLOTS;
+    return slot;
+  }
+
+  /**
+   * Counters only go down once blocked_ is raised, but for the short-lived increments of threads backing off, so the
+   * sum of counters read one after the other is never below the number of critical sections still in progress.
+   * @return true if no critical section is in progress
+   */
+  bool IsQuiescent() const {
+    int64_t active = 0;
+    for (const auto &slot : slots_) {
+      active += slot.active_.load();
+    }
+    return active == 0;
+  }
+
+  std::array<Slot, NUM_SLOTS> slots_;
+  /** Raised while a blocker waits or holds the latch. */
+  std::atomic<bool> blocked_{false};
+  /** Serializes blockers. */
+  std::mutex block_latch_;
+  /** Protects the waits on cv_, for blockers waiting for quiescence and threads waiting to enter. */
+  std::mutex latch_;
+  std::condition_variable cv_;
+};
+
+}  // namespace bustub
@@ -0,0 +1,128 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// latency_histogram.h
+//
+// Identification: src/include/common/util/latency_histogram.h
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+namespace bustub {
+
+/**
+ * LatencyHistogram is a lock-free histogram of latencies with power-of-two microsecond buckets.
+ * Bucket i counts the samples in [2^(i-1), 2^i) microseconds, bucket 0 counts the samples below 1 microsecond.
+ * Recording a sample is a handful of relaxed atomic increments, so it is cheap enough for every I/O or lock wait.
+ */
+class LatencyHistogram {
+ public:
+  static constexpr size_t NUM_BUCKETS = 32;
+
+  /**
+   * A consistent-enough copy of a histogram. Samples recorded concurrently with taking the snapshot may or may not
+   * be included, which is fine for monitoring purposes.
+   */
+  struct Snapshot {
+    std::array<uint64_t, NUM_BUCKETS> buckets_{};
+    uint64_t count_{0};
+    uint64_t sum_us_{0};
+    uint64_t max_us_{0};
+
+    /** @return the mean latency in microseconds */
+    double Mean() const { return count_ == 0 ? 0 : static_cast<double>(sum_us_) / count_; }
+
+    /**
+     * @param percentile the percentile in [0, 100]
+     * @return the upper bound (in microseconds) of the bucket holding the given percentile
+     */
+    uint64_t Percentile(double percentile) const {
+      if (count_ == 0) {
+        return 0;
+      }
+      auto target = static_cast<uint64_t>(percentile / 100.0 * count_);
+      uint64_t seen = 0;
+      for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+        seen += buckets_[i];
+        if (seen > target) {
+          return std::min(BucketUpperBound(i), max_us_);
+        }
+      }
+      return max_us_;
+    }
+
+    /** @return a one-line human readable summary */
+    std::string ToString() const {
+      std::ostringstream os;
+      os << "count=" << count_ << " mean=" << Mean() << "us p50=" << Percentile(50) << "us p99=" << Percentile(99)
+         << "us max=" << max_us_ << "us";
+      return os.str();
+    }
+  };
+
+  LatencyHistogram() = default;
+
+  /** Record one sample. */
+  void Record(std::chrono::nanoseconds latency) {
+    auto us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(latency).count());
+    buckets_[BucketOf(us)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_us_.fetch_add(us, std::memory_order_relaxed);
+    uint64_t cur_max = max_us_.load(std::memory_order_relaxed);
+    while (us > cur_max && !max_us_.compare_exchange_weak(cur_max, us, std::memory_order_relaxed)) {
+    }
+  }
+
+  /** @return a copy of the current counters */
+  Snapshot GetSnapshot() const {
+    Snapshot snapshot;
+    for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+      snapshot.buckets_[i] = buckets_[i].load(std::memory_order_relaxed);
+    }
+    snapshot.count_ = count_.load(std::memory_order_relaxed);
+    snapshot.sum_us_ = sum_us_.load(std::memory_order_relaxed);
+    snapshot.max_us_ = max_us_.load(std::memory_order_relaxed);
+    return snapshot;
+  }
+
+  /** Clear all the counters. */
+  void Reset() {
+    for (auto &bucket : buckets_) {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+    count_.store(0, std::memory_order_relaxed);
+    sum_us_.store(0, std::memory_order_relaxed);
+    max_us_.store(0, std::memory_order_relaxed);
+  }
+
+ private:
+  static size_t BucketOf(uint64_t us) {
+    size_t bucket = 0;
+    while (us != 0 && bucket + 1 < NUM_BUCKETS) {
+      us >>= 1;
+      ++bucket;
+    }
+    return bucket;
+  }
+
+  static uint64_t BucketUpperBound(size_t bucket) { return bucket == 0 ? 0 : (uint64_t{1} << bucket) - 1; }
+
+  std::array<std::atomic<uint64_t>, NUM_BUCKETS> buckets_{};
+  std::atomic<uint64_t> count_{0};
+  std::atomic<uint64_t> sum_us_{0};
+  std::atomic<uint64_t> max_us_{0};
+};
+
+}  // namespace bustub
@@ -13,31 +13,89 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>  // NOLINT
 #include <condition_variable>  // NOLINT
 #include <list>
 #include <memory>
 #include <mutex>  // NOLINT
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
 #include "common/rid.h"
+#include "common/util/latency_histogram.h"
 #include "concurrency/transaction.h"
 
 namespace bustub {
 
 class TransactionManager;
 
+/** A record or a table that lock requests had to wait for, as seen by the sampled waits. */
+struct LockHotSpot {
+  /** The record, or an invalid RID for a table. */
+  RID rid_;
+  /** The table, or INVALID_TABLE_OID for a record. */
+  table_oid_t oid_;
+  /** The number of sampled waits on it, an overestimate by at most the count of the spot it evicted. */
+  uint64_t waits_;
+  /** The total time the sampled waits took. */
+  std::chrono::microseconds wait_time_;
+};
+
 /**
- * LockManager handles transactions asking for locks on records.
+ * A snapshot of the lock manager's contention statistics. Compare the wait histograms with the latency of the
+ * transactions to tell whether slow transactions are lock-bound, and the hot spots to tell which records and tables
+ * they wait for.
  */
-class LockManager {
-  enum class LockMode { SHARED, EXCLUSIVE };
+struct LockManagerStats {
+  /** How long the requests on records that could not be granted right away waited, granted or aborted. */
+  LatencyHistogram::Snapshot row_wait_latency_;
+  /** How long the requests on tables that could not be granted right away waited, granted or aborted. */
+  LatencyHistogram::Snapshot table_wait_latency_;
+  /** The number of lock requests queued, on records and tables. */
+  uint64_t requests_{0};
+  /** The number of requests that had to wait. */
+  uint64_t waits_{0};
+  /** The number of locks upgraded, in place or by waiting. */
+  uint64_t upgrades_{0};
+  /** The number of requests given up because the deadlock policy aborted their transaction. */
+  uint64_t deadlock_aborts_{0};
+  /** The hottest records and tables, the one with the most sampled waits first. */
+  std::vector<LockHotSpot> hot_spots_;
+};
 
+/**
+ * LockManager handles transactions asking for locks on records and tables.
+ *
+ * The lock table is split into LOCK_TABLE_PARTITIONS partitions by the hash of the RID, each with its own latch
+ * guarding the request queues of its records. Requests on records of different partitions never touch the same
+ * latch, and a transaction waiting for a lock only sleeps on the condition variable of its record.
+ *
+ * Tables are locked with the multi-granularity modes: a record locked on behalf of a table takes an intention lock on
+ * the table first, and a transaction holding more than lock_escalation_threshold record locks on a table trades them
+ * for a shared or exclusive lock on the whole table. A table lock that covers a record lock makes the latter free.
+ *
+ * Deadlocks are handled by one of three policies, the age of a transaction being given by its id:
+ * - DETECTION: the waits-for graph is kept up to date as transactions block and get their locks. A transaction that
+ *   blocks looks for a cycle through itself right away, and aborts the youngest transaction of the cycle.
+ * - WOUND_WAIT: a transaction asking for a lock aborts the younger transactions in its way and waits for the older
+ *   ones. A wounded transaction that is not waiting notices it the next time it asks for a lock, or commits if it is
+ *   done already.
+ * - WAIT_DIE: a transaction asking for a lock waits if it is older than every transaction in its way, and aborts
+ *   itself otherwise.
+ * With the latter two, no cycle can ever form, and nobody waits for a detection round.
+ */
+class LockManager {
   class LockRequest {
    public:
-    LockRequest(txn_id_t txn_id, LockMode lock_mode) : txn_id_(txn_id), lock_mode_(lock_mode), granted_(false) {}
+    LockRequest(Transaction *txn, LockMode lock_mode)
+        : txn_(txn), txn_id_(txn->GetTransactionId()), lock_mode_(lock_mode), granted_(false) {}
 
+    /** The requesting transaction, valid as long as the request is queued. */
+    Transaction *txn_;
     txn_id_t txn_id_;
     LockMode lock_mode_;
     bool granted_;
@@ -46,31 +104,42 @@ class LockManager {
   class LockRequestQueue {
    public:
     std::list<LockRequest> request_queue_;
-    std::condition_variable cv_;  // for notifying blocked transactions on this rid
+    std::condition_variable cv_;  // for notifying blocked transactions on this rid or table
     bool upgrading_ = false;
   };
 
+  /** A partition of the lock table. Aligned so that the latches of two partitions never share a cache line. */
+  struct alignas(64) LockTablePartition {
+    /** Protects lock_table_ and every queue in it. */
+    std::mutex latch_;
+    /** The request queues of the records hashed to this partition, dropped once empty. */
+    std::unordered_map<RID, LockRequestQueue> lock_table_;
+    /** The number of requests queued in this partition, counted here to keep clear of the other partitions. */
+    std::atomic<uint64_t> requests_{0};
+  };
+
+  /** Where a blocked transaction waits: the queue of a table if oid_ is valid, else the queue of a record. */
+  struct WaitTarget {
+    Transaction *txn_;
+    RID rid_;
+    table_oid_t oid_;
+  };
+
  public:
+  /** How deadlocks are dealt with, see LockManager. */
+  enum class DeadlockMode { DETECTION, WOUND_WAIT, WAIT_DIE };
+
   /**
-   * Creates a new lock manager configured for the deadlock detection policy.
+   * Creates a new lock manager configured for the given deadlock policy.
+   * @param deadlock_mode the deadlock policy
    */
-  LockManager() {
-    enable_cycle_detection_ = true;
-    cycle_detection_thread_ = new std::thread(&LockManager::RunCycleDetection, this);
-    LOG_INFO("Cycle detection thread launched");
-  }
-
-  ~LockManager() {
-    enable_cycle_detection_ = false;
-    cycle_detection_thread_->join();
-    delete cycle_detection_thread_;
-    LOG_INFO("Cycle detection thread stopped");
-  }
+  explicit LockManager(DeadlockMode deadlock_mode = DeadlockMode::DETECTION) : deadlock_mode_(deadlock_mode) {}
 
   /*
    * [LOCK_NOTE]: For all locking functions, we:
-   * 1. return false if the transaction is aborted; and
-   * 2. block on wait, return true when the lock request is granted; and
+   * 1. return false if the transaction is aborted, unless it holds the lock already; and
+   * 2. block on wait, return true when the lock request is granted, and throw a TransactionAbortException if the
+   *    transaction is aborted by the deadlock policy instead; and
    * 3. it is undefined behavior to try locking an already locked RID in the same transaction, i.e. the transaction
    *    is responsible for keeping track of its current locks.
    */
@@ -79,25 +148,28 @@ class LockManager {
    * Acquire a lock on RID in shared mode. See [LOCK_NOTE] in header file.
    * @param txn the transaction requesting the shared lock
    * @param rid the RID to be locked in shared mode
+   * @param oid the table the RID belongs to, which is locked in intention shared mode first, or INVALID_TABLE_OID
    * @return true if the lock is granted, false otherwise
    */
-  bool LockShared(Transaction *txn, const RID &rid);
+  bool LockShared(Transaction *txn, const RID &rid, table_oid_t oid = INVALID_TABLE_OID);
 
   /**
    * Acquire a lock on RID in exclusive mode. See [LOCK_NOTE] in header file.
    * @param txn the transaction requesting the exclusive lock
    * @param rid the RID to be locked in exclusive mode
+   * @param oid the table the RID belongs to, which is locked in intention exclusive mode first, or INVALID_TABLE_OID
    * @return true if the lock is granted, false otherwise
    */
-  bool LockExclusive(Transaction *txn, const RID &rid);
+  bool LockExclusive(Transaction *txn, const RID &rid, table_oid_t oid = INVALID_TABLE_OID);
 
   /**
    * Upgrade a lock from a shared lock to an exclusive lock.
    * @param txn the transaction requesting the lock upgrade
    * @param rid the RID that should already be locked in shared mode by the requesting transaction
+   * @param oid the table the RID belongs to, or INVALID_TABLE_OID
    * @return true if the upgrade is successful, false otherwise
    */
-  bool LockUpgrade(Transaction *txn, const RID &rid);
+  bool LockUpgrade(Transaction *txn, const RID &rid, table_oid_t oid = INVALID_TABLE_OID);
 
   /**
    * Release the lock held by the transaction.
@@ -107,6 +179,25 @@ class LockManager {
    */
   bool Unlock(Transaction *txn, const RID &rid);
 
+  /**
+   * Acquire a lock on a table. A transaction already holding a weaker lock on the table upgrades it to the weakest
+   * mode covering both, e.g. SHARED and INTENTION_EXCLUSIVE to SHARED_INTENTION_EXCLUSIVE. See [LOCK_NOTE].
+   * @param txn the transaction requesting the lock
+   * @param oid the table to be locked
+   * @param lock_mode the requested lock mode
+   * @return true if the lock is granted, false otherwise
+   */
+  bool LockTable(Transaction *txn, table_oid_t oid, LockMode lock_mode);
+
+  /**
+   * Release a table lock held by the transaction.
+   * @param txn the transaction releasing the lock
+   * @param oid the table that is locked by the transaction
+   * @return true if the unlock is successful, false if the transaction does not hold the lock or still holds record
+   * locks on the table
+   */
+  bool UnlockTable(Transaction *txn, table_oid_t oid);
+
   /*** Graph API ***/
   /**
    * Adds edge t1->t2
@@ -128,18 +219,179 @@ class LockManager {
   /** @return the set of all edges in the graph, used for testing only! */
   std::vector<std::pair<txn_id_t, txn_id_t>> GetEdgeList();
 
-  /** Runs cycle detection in the background. */
-  void RunCycleDetection();
+  /*** Statistics ***/
+
+  /**
+   * @param top_n the maximum number of hot spots to report
+   * @return a snapshot of the wait histograms, the counters and the hottest records and tables
+   */
+  LockManagerStats GetStats(size_t top_n = 10);
+
+  /** Clear all the statistics. */
+  void ResetStats();
+
+  /**
+   * Only one wait out of every rate is looked at by the hot spot tracker, which keeps its latch off the path of most
+   * waits. The histograms and counters see every wait.
+   * @param rate the sampling rate, 1 tracks every wait
+   */
+  void SetHotSpotSampleRate(uint32_t rate) { hot_spot_sample_rate_ = std::max<uint32_t>(rate, 1); }
 
  private:
+  static_assert(LOCK_TABLE_PARTITIONS > 1 && (LOCK_TABLE_PARTITIONS & (LOCK_TABLE_PARTITIONS - 1)) == 0,
+                "the number of partitions must be a power of two");
+
+  /**
+   * The hash of a RID is the RID itself, so the RIDs of a page would share a few partitions and the same slot on
+   * different pages would share one. Fibonacci hashing mixes the page id and the slot into the top bits instead.
+   * @return the partition of the lock table holding the request queue of rid
+   */
+  LockTablePartition *GetPartition(const RID &rid) {
+    auto hash = static_cast<uint64_t>(rid.Get()) * 0x9E3779B97F4A7C15ULL;
+    return &lock_table_[hash >> (64 - __builtin_ctz(LOCK_TABLE_PARTITIONS))];
+  }
+
+  /**
+   * Enqueue a lock request on rid and block until it is granted. See [LOCK_NOTE] in header file.
+   * @param txn the transaction requesting the lock, which must not hold any lock on rid yet
+   * @param rid the RID to be locked
+   * @param lock_mode the requested lock mode
+   * @return true if the lock is granted, false otherwise
+   */
+  bool AcquireLock(Transaction *txn, const RID &rid, LockMode lock_mode);
+
+  /**
+   * Lock a table, or upgrade the lock txn holds on it. See LockTable.
+   * @param wait false to give up instead of blocking, leaving the lock txn holds on the table as it was
+   * @return true if the lock is granted, false otherwise
+   */
+  bool AcquireTableLock(Transaction *txn, table_oid_t oid, LockMode lock_mode, bool wait);
+
+  /**
+   * @param oid the table of a record, or INVALID_TABLE_OID
+   * @param row_mode the mode the record is to be locked in
+   * @return true if txn holds a table lock that covers locking the record in row_mode, so it needs no lock of its own
+   */
+  static bool IsCoveredByTable(Transaction *txn, table_oid_t oid, LockMode row_mode);
+
+  /**
+   * Remember a record locked on behalf of a table, and escalate to a table lock once txn holds more than
+   * lock_escalation_threshold record locks on it. Escalation does not block: if the table lock cannot be granted
+   * right away, txn keeps its record locks and tries again after another lock_escalation_threshold records.
+   */
+  void TrackRowLock(Transaction *txn, table_oid_t oid, const RID &rid);
+
+  /** Remove rid from the record locks txn keeps track of. */
+  static void ForgetLock(Transaction *txn, const RID &rid);
+
+  /**
+   * Drop the request of txn on rid from the lock table.
+   * @param[out] lock_mode the mode of the dropped request
+   * @return false if txn has no request on rid
+   */
+  bool ReleaseLock(Transaction *txn, const RID &rid, LockMode *lock_mode);
+
+  /**
+   * Block until the request of txn is granted, or txn is aborted, applying the deadlock policy on the way.
+   * @param request the request of txn in the queue
+   * @param lck the caller's lock on the latch guarding the queue
+   * @param target the queue, for other transactions to wake txn up when they abort it
+   * @return true if the request is granted, false if txn was aborted, in which case the request is still queued
+   */
+  bool WaitForGrant(Transaction *txn, LockRequestQueue *queue, std::list<LockRequest>::iterator request,
+                    std::unique_lock<std::mutex> *lck, const WaitTarget &target);
+
+  /** Wake up the transaction if it is blocked, after it was aborted. The caller must not hold any latch. */
+  void NotifyWaiter(txn_id_t txn_id);
+
+  /** @return the transactions of the requests ahead of the given one that it has to wait for */
+  static std::vector<Transaction *> GetBlockers(const LockRequestQueue &queue,
+                                                std::list<LockRequest>::const_iterator request);
+
+  /**
+   * Replace the edges of a blocked transaction in the waits-for graph, then look for a cycle through it. The graph
+   * never has a cycle for long: the youngest transaction of a new cycle is aborted and its edges removed right away.
+   * @param blockers the transactions txn waits for, see GetBlockers
+   * @return the transaction aborted, txn itself if it is aborted already, or INVALID_TXN_ID if there is no cycle
+   */
+  txn_id_t BlockOn(Transaction *txn, const std::vector<Transaction *> &blockers);
+
+  /**
+   * Depth-first search for a cycle through the nodes on path, visiting the neighbours of a node in ascending order.
+   * @param[out] txn_id the youngest transaction of the cycle if one is found
+   */
+  bool FindCycle(std::vector<txn_id_t> *path, std::unordered_set<txn_id_t> *visited, txn_id_t *txn_id);
+
+  /**
+   * Change the mode of a granted request to a stronger one if every other granted request allows it and no other
+   * upgrade is waiting.
+   * @return true if the request was upgraded
+   */
+  static bool UpgradeInPlace(LockRequestQueue *queue, std::list<LockRequest>::iterator request, LockMode lock_mode);
+
+  /**
+   * Replace a granted request by a request for a stronger mode queued ahead of every waiting request, to be waited
+   * for with WaitForGrant.
+   * @return the new request
+   */
+  static std::list<LockRequest>::iterator RequeueForUpgrade(LockRequestQueue *queue,
+                                                            std::list<LockRequest>::iterator request,
+                                                            LockMode lock_mode);
+
+  /**
+   * A request is granted in FIFO order: once every request ahead of it is granted and compatible with it.
+   * @return true if the request can be granted
+   */
+  static bool IsGrantable(const LockRequestQueue &queue, std::list<LockRequest>::const_iterator request);
+
+  /** @return true if a lock in mode held may be granted while another transaction holds a lock in mode requested */
+  static bool AreCompatible(LockMode held, LockMode requested);
+
+  /** @return true if holding a lock in mode held implies holding a lock in mode requested */
+  static bool Covers(LockMode held, LockMode requested);
+
+  /**
+   * Drop a request from its queue and wake up the requests behind it. The caller must hold the latch guarding the
+   * queue, and drop the queue if this returns true.
+   * @return true if the queue is empty
+   */
+  static bool EraseRequest(LockRequestQueue *queue, std::list<LockRequest>::iterator request);
+
+  /** Account for a request that waited for the given time on target, see WaitForGrant. */
+  void RecordWait(const WaitTarget &target, std::chrono::nanoseconds wait_time, bool granted);
+
+  /** The maximum number of records and tables the hot spot tracker keeps count of. */
+  static constexpr size_t MAX_HOT_SPOTS = 64;
+
+  /** The deadlock policy. */
+  DeadlockMode deadlock_mode_;
+
+  /** Protects waits_for_ and waiting_. */
   std::mutex latch_;
-  std::atomic<bool> enable_cycle_detection_;
-  std::thread *cycle_detection_thread_;
 
   /** Lock table for lock requests. */
-  std::unordered_map<RID, LockRequestQueue> lock_table_;
-  /** Waits-for graph representation. */
+  std::array<LockTablePartition, LOCK_TABLE_PARTITIONS> lock_table_;
+  /** Protects table_lock_table_ and every queue in it. */
+  std::mutex table_latch_;
+  /** Lock table for table lock requests, a transaction only goes there once per table unless it upgrades. */
+  std::unordered_map<table_oid_t, LockRequestQueue> table_lock_table_;
+  /** Waits-for graph representation: the edges of the blocked transactions, sorted, under DETECTION. */
   std::unordered_map<txn_id_t, std::vector<txn_id_t>> waits_for_;
+  /** The blocked transactions and where they wait. */
+  std::unordered_map<txn_id_t, WaitTarget> waiting_;
+
+  LatencyHistogram row_wait_latency_;
+  LatencyHistogram table_wait_latency_;
+  /** The number of requests queued on tables, the requests on records being counted by partition. */
+  std::atomic<uint64_t> table_requests_{0};
+  std::atomic<uint64_t> waits_{0};
+  std::atomic<uint64_t> upgrades_{0};
+  std::atomic<uint64_t> deadlock_aborts_{0};
+  std::atomic<uint32_t> hot_spot_sample_rate_{8};
+  /** Protects hot_spots_, only taken for the sampled waits. */
+  std::mutex hot_spot_latch_;
+  /** The records and tables with the most sampled waits, kept by the space-saving algorithm. */
+  std::vector<LockHotSpot> hot_spots_;
 };
 
 }  // namespace bustub
@@ -17,6 +17,7 @@
 #include <memory>
 #include <string>
 #include <thread>  // NOLINT
+#include <unordered_map>
 #include <unordered_set>
 
 #include "common/config.h"
@@ -44,20 +45,36 @@ namespace bustub {
 enum class TransactionState { GROWING, SHRINKING, COMMITTED, ABORTED };
 
 /**
- * Transaction isolation level.
+ * Transaction isolation level. Under SNAPSHOT_ISOLATION, a transaction reads the tuples as of its read timestamp,
+ * without locking them, and aborts if it writes a tuple that was written since then.
  */
-enum class IsolationLevel { READ_UNCOMMITTED, REPEATABLE_READ, READ_COMMITTED };
+enum class IsolationLevel { READ_UNCOMMITTED, REPEATABLE_READ, READ_COMMITTED, SNAPSHOT_ISOLATION };
+
+/**
+ * How a transaction is kept apart from the others. An OPTIMISTIC transaction takes no tuple locks while it runs: it
+ * reads the newest committed versions, keeps its updates and deletes to itself, and at commit applies them and checks
+ * that nothing it read has changed since, aborting otherwise. Its isolation level does not matter. Inserts are applied
+ * right away as under TWO_PHASE_LOCKING, and phantoms are not detected.
+ */
+enum class ConcurrencyControl { TWO_PHASE_LOCKING, OPTIMISTIC };
 
 /**
  * Type of write operation.
  */
 enum class WType { INSERT = 0, DELETE, UPDATE };
 
+/**
+ * Lock modes. Records are locked in SHARED or EXCLUSIVE mode, tables in any mode.
+ */
+enum class LockMode { SHARED, EXCLUSIVE, INTENTION_SHARED, INTENTION_EXCLUSIVE, SHARED_INTENTION_EXCLUSIVE };
+
 class TableHeap;
 class Catalog;
 using table_oid_t = uint32_t;
 using index_oid_t = uint32_t;
 
+static constexpr table_oid_t INVALID_TABLE_OID = UINT32_MAX;  // invalid table oid
+
 /**
  * WriteRecord tracks information related to a write.
  */
@@ -74,6 +91,20 @@ class TableWriteRecord {
   TableHeap *table_;
 };
 
+/**
+ * ReadRecord tracks a tuple read by an optimistic transaction, validated when it commits.
+ */
+class TableReadRecord {
+ public:
+  TableReadRecord(RID rid, timestamp_t begin_ts, TableHeap *table) : rid_(rid), begin_ts_(begin_ts), table_(table) {}
+
+  RID rid_;
+  /** The begin timestamp of the version read, see VersionStore. */
+  timestamp_t begin_ts_;
+  /** The table heap specifies which table this read record is for. */
+  TableHeap *table_;
+};
+
 /**
  * WriteRecord tracks information related to a write.
  */
@@ -148,17 +179,23 @@ class TransactionAbortException : public std::exception {
  */
 class Transaction {
  public:
-  explicit Transaction(txn_id_t txn_id, IsolationLevel isolation_level = IsolationLevel::REPEATABLE_READ)
+  explicit Transaction(txn_id_t txn_id, IsolationLevel isolation_level = IsolationLevel::REPEATABLE_READ,
+                       ConcurrencyControl concurrency_control = ConcurrencyControl::TWO_PHASE_LOCKING)
       : state_(TransactionState::GROWING),
         isolation_level_(isolation_level),
+        concurrency_control_(concurrency_control),
         thread_id_(std::this_thread::get_id()),
         txn_id_(txn_id),
         prev_lsn_(INVALID_LSN),
         shared_lock_set_{new std::unordered_set<RID>},
-        exclusive_lock_set_{new std::unordered_set<RID>} {
+        exclusive_lock_set_{new std::unordered_set<RID>},
+        table_lock_set_{new std::unordered_map<table_oid_t, LockMode>},
+        table_row_lock_set_{new std::unordered_map<table_oid_t, std::unordered_set<RID>>} {
     // Initialize the sets that will be tracked.
     table_write_set_ = std::make_shared<std::deque<TableWriteRecord>>();
     index_write_set_ = std::make_shared<std::deque<IndexWriteRecord>>();
+    table_read_set_ = std::make_shared<std::deque<TableReadRecord>>();
+    deferred_write_set_ = std::make_shared<std::deque<TableWriteRecord>>();
     page_set_ = std::make_shared<std::deque<bustub::Page *>>();
     deleted_page_set_ = std::make_shared<std::unordered_set<page_id_t>>();
   }
@@ -167,6 +204,30 @@ class Transaction {
 
   DISALLOW_COPY(Transaction);
 
+  /**
+   * Make a finished transaction a new one, keeping the containers it tracks its work in so that they need not be
+   * allocated again. See TransactionManager::Release.
+   */
+  void Reset(txn_id_t txn_id, IsolationLevel isolation_level, ConcurrencyControl concurrency_control) {
+    state_ = TransactionState::GROWING;
+    isolation_level_ = isolation_level;
+    concurrency_control_ = concurrency_control;
+    thread_id_ = std::this_thread::get_id();
+    txn_id_ = txn_id;
+    prev_lsn_ = INVALID_LSN;
+    read_ts_ = 0;
+    table_write_set_->clear();
+    index_write_set_->clear();
+    table_read_set_->clear();
+    deferred_write_set_->clear();
+    page_set_->clear();
+    deleted_page_set_->clear();
+    shared_lock_set_->clear();
+    exclusive_lock_set_->clear();
+    table_lock_set_->clear();
+    table_row_lock_set_->clear();
+  }
+
   /** @return the id of the thread running the transaction */
   inline std::thread::id GetThreadId() const { return thread_id_; }
 
@@ -176,12 +237,24 @@ class Transaction {
   /** @return the isolation level of this transaction */
   inline IsolationLevel GetIsolationLevel() const { return isolation_level_; }
 
+  /** @return the concurrency control of this transaction */
+  inline ConcurrencyControl GetConcurrencyControl() const { return concurrency_control_; }
+
   /** @return the list of table write records of this transaction */
   inline std::shared_ptr<std::deque<TableWriteRecord>> GetWriteSet() { return table_write_set_; }
 
   /** @return the list of index write records of this transaction */
   inline std::shared_ptr<std::deque<IndexWriteRecord>> GetIndexWriteSet() { return index_write_set_; }
 
+  /** @return the list of table read records of this transaction, only kept under OPTIMISTIC concurrency control */
+  inline std::shared_ptr<std::deque<TableReadRecord>> GetReadSet() { return table_read_set_; }
+
+  /**
+   * @return the updates and deletes an optimistic transaction applies when it commits, in the order it made them.
+   * Unlike in the write set, the tuple of an update is the new one.
+   */
+  inline std::shared_ptr<std::deque<TableWriteRecord>> GetDeferredWriteSet() { return deferred_write_set_; }
+
   /** @return the page set */
   inline std::shared_ptr<std::deque<Page *>> GetPageSet() { return page_set_; }
 
@@ -228,6 +301,14 @@ class Transaction {
   /** @return true if rid is exclusively locked by this transaction */
   bool IsExclusiveLocked(const RID &rid) { return exclusive_lock_set_->find(rid) != exclusive_lock_set_->end(); }
 
+  /** @return the tables locked by this transaction and their lock modes */
+  inline std::shared_ptr<std::unordered_map<table_oid_t, LockMode>> GetTableLockSet() { return table_lock_set_; }
+
+  /** @return the records locked by this transaction on behalf of each table, see LockManager */
+  inline std::shared_ptr<std::unordered_map<table_oid_t, std::unordered_set<RID>>> GetTableRowLockSet() {
+    return table_row_lock_set_;
+  }
+
   /** @return the current state of the transaction */
   inline TransactionState GetState() { return state_; }
 
@@ -237,6 +318,24 @@ class Transaction {
    */
   inline void SetState(TransactionState state) { state_ = state; }
 
+  /**
+   * Set the state of the transaction if it is still the expected one. The lock manager uses this to abort another
+   * transaction without overriding a commit or an abort that is under way.
+   * @return true if the state was changed
+   */
+  inline bool CompareAndSetState(TransactionState expected, TransactionState state) {
+    return state_.compare_exchange_strong(expected, state);
+  }
+
+  /** @return the read timestamp: the transaction sees the versions committed at or before it */
+  inline timestamp_t GetReadTs() { return read_ts_; }
+
+  /**
+   * Set the read timestamp.
+   * @param read_ts new read timestamp
+   */
+  inline void SetReadTs(timestamp_t read_ts) { read_ts_ = read_ts; }
+
   /** @return the previous LSN */
   inline lsn_t GetPrevLSN() { return prev_lsn_; }
 
@@ -247,10 +346,12 @@ class Transaction {
   inline void SetPrevLSN(lsn_t prev_lsn) { prev_lsn_ = prev_lsn; }
 
  private:
-  /** The current transaction state. */
-  TransactionState state_;
+  /** The current transaction state. Other transactions may abort this one through the lock manager. */
+  std::atomic<TransactionState> state_;
   /** The isolation level of the transaction. */
   IsolationLevel isolation_level_;
+  /** The concurrency control of the transaction. */
+  ConcurrencyControl concurrency_control_;
   /** The thread ID, used in single-threaded transactions. */
   std::thread::id thread_id_;
   /** The ID of this transaction. */
@@ -260,8 +361,14 @@ class Transaction {
   std::shared_ptr<std::deque<TableWriteRecord>> table_write_set_;
   /** The undo set of indexes. */
   std::shared_ptr<std::deque<IndexWriteRecord>> index_write_set_;
-  /** The LSN of the last record written by the transaction. */
-  lsn_t prev_lsn_;
+  /** The read set of an optimistic transaction. */
+  std::shared_ptr<std::deque<TableReadRecord>> table_read_set_;
+  /** The writes an optimistic transaction defers to its commit. */
+  std::shared_ptr<std::deque<TableWriteRecord>> deferred_write_set_;
+  /** The LSN of the last record written by the transaction. Also read by fuzzy checkpoints. */
+  std::atomic<lsn_t> prev_lsn_;
+  /** The snapshot of a transaction under SNAPSHOT_ISOLATION or OPTIMISTIC, see TransactionManager::Begin. */
+  timestamp_t read_ts_{0};
 
   /** Concurrent index: the pages that were latched during index operation. */
   std::shared_ptr<std::deque<Page *>> page_set_;
@@ -272,6 +379,10 @@ class Transaction {
   std::shared_ptr<std::unordered_set<RID>> shared_lock_set_;
   /** LockManager: the set of exclusive-locked tuples held by this transaction. */
   std::shared_ptr<std::unordered_set<RID>> exclusive_lock_set_;
+  /** LockManager: the tables locked by this transaction and their lock modes. */
+  std::shared_ptr<std::unordered_map<table_oid_t, LockMode>> table_lock_set_;
+  /** LockManager: the tuples of each table locked by this transaction, also in one of the two sets above. */
+  std::shared_ptr<std::unordered_map<table_oid_t, std::unordered_set<RID>>> table_row_lock_set_;
 };
 
 }  // namespace bustub
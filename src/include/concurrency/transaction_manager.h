@@ -13,40 +13,82 @@
 #pragma once
 
 #include <atomic>
+#include <deque>
+#include <mutex>  // NOLINT
+#include <set>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include "common/config.h"
+#include "common/quiescent_latch.h"
 #include "concurrency/lock_manager.h"
 #include "concurrency/transaction.h"
+#include "concurrency/transaction_registry.h"
 #include "recovery/log_manager.h"
 
 namespace bustub {
 class LockManager;
+class TableHeap;
+
+/** An entry of the active transaction table, see TransactionManager::GetActiveTransactionTable. */
+struct ActiveTransaction {
+  txn_id_t txn_id_;
+  /** The lsn of the BEGIN record of the transaction. */
+  lsn_t first_lsn_;
+  /** The lsn of the last record written by the transaction. */
+  lsn_t last_lsn_;
+};
 
 /**
  * TransactionManager keeps track of all the transactions running in the system.
+ *
+ * It also hands out the timestamps of multi-version concurrency control: a transaction under SNAPSHOT_ISOLATION reads
+ * as of the last commit before it began, and every transaction that wrote a tuple stamps its versions with a new
+ * commit timestamp once its commit is durable.
+ *
+ * An optimistic transaction also gets a read timestamp, which keeps the versions it may have to validate. Its commit
+ * first applies the writes it deferred, locking the tuples in rid order as any writer would, and then validates
+ * backward: every tuple it read must still be the version it read, committed by nobody since and being written by
+ * nobody else. If the validation fails, the transaction is aborted instead.
+ *
+ * With enable_early_lock_release, a committing transaction releases its locks once its commit record is appended,
+ * without waiting for the log flush. Another transaction may then read what it wrote before it is durable, and must
+ * not be acknowledged before it is: a transaction that wrote anything appends its own commit record after the one it
+ * depends on, and waits for it to be durable anyway, while a read-only transaction waits for the last commit record of
+ * a transaction that released its locks early.
+ *
+ * The transactions Begin creates come from a pool of finished transactions handed back with Release, which keeps the
+ * containers a transaction tracks its locks and writes in from being allocated anew for every transaction.
  */
 class TransactionManager {
  public:
   explicit TransactionManager(LockManager *lock_manager, LogManager *log_manager = nullptr)
       : lock_manager_(lock_manager), log_manager_(log_manager) {}
 
-  ~TransactionManager() = default;
+  ~TransactionManager() {
+    for (auto *txn : free_txns_) {
+      delete txn;
+    }
+  }
 
   /**
    * Begins a new transaction.
-   * @param txn an optional transaction object to be initialized, otherwise a new transaction is created.
+   * @param txn an optional transaction object to be initialized, otherwise a pooled or new transaction is created.
    * @param isolation_level an optional isolation level of the transaction.
+   * @param concurrency_control an optional concurrency control of the transaction.
    * @return an initialized transaction
    */
-  Transaction *Begin(Transaction *txn = nullptr, IsolationLevel isolation_level = IsolationLevel::REPEATABLE_READ);
+  Transaction *Begin(Transaction *txn = nullptr, IsolationLevel isolation_level = IsolationLevel::REPEATABLE_READ,
+                     ConcurrencyControl concurrency_control = ConcurrencyControl::TWO_PHASE_LOCKING);
 
   /**
    * Commits a transaction.
    * @param txn the transaction to commit
+   * @return false if the transaction was optimistic and failed its validation, in which case it is aborted instead
    */
-  void Commit(Transaction *txn);
+  bool Commit(Transaction *txn);
 
   /**
    * Aborts a transaction
@@ -55,23 +97,18 @@ class TransactionManager {
   void Abort(Transaction *txn);
 
   /**
-   * Global list of running transactions
+   * Hand a committed or aborted transaction back for a later Begin to reuse, instead of deleting it. The caller must
+   * not use the transaction any more.
+   * @param txn the finished transaction
    */
-
-  /** The transaction map is a global list of all the running transactions in the system. */
-  static std::unordered_map<txn_id_t, Transaction *> txn_map;
+  void Release(Transaction *txn);
 
   /**
-   * Locates and returns the transaction with the given transaction ID.
-   * @param txn_id the id of the transaction to be found, it must exist!
-   * @return the transaction with the given transaction id
+   * Locates and returns a running transaction.
+   * @param txn_id the id of the transaction to be found
+   * @return the transaction with the given transaction id, or nullptr if no such transaction is running
    */
-  static Transaction *GetTransaction(txn_id_t txn_id) {
-    assert(TransactionManager::txn_map.find(txn_id) != TransactionManager::txn_map.end());
-    auto *res = TransactionManager::txn_map[txn_id];
-    assert(res != nullptr);
-    return res;
-  }
+  Transaction *GetTransaction(txn_id_t txn_id) { return txn_registry_.Find(txn_id); }
 
   /** Prevents all transactions from performing operations, used for checkpointing. */
   void BlockAllTransactions();
@@ -79,30 +116,134 @@ class TransactionManager {
   /** Resumes all transactions, used for checkpointing. */
   void ResumeTransactions();
 
+  /**
+   * A snapshot of the transactions that have logged their BEGIN record but not yet their COMMIT or ABORT record,
+   * used for fuzzy checkpointing. Transactions keep running while it is taken, but append these records and enter or
+   * leave the table in one step, so a transaction missing from the table has either not appended its BEGIN record
+   * yet or already appended its COMMIT or ABORT record.
+   * @return the active transaction table
+   */
+  std::vector<ActiveTransaction> GetActiveTransactionTable();
+
+  /** @return the oldest snapshot still in use: no version older than the one it sees is needed any more */
+  timestamp_t GetWatermark();
+
+  /**
+   * Reclaim the versions no snapshot can see any more in every table written so far. Versions are also reclaimed as
+   * their tuples are written again, so this only matters for the tuples that are no longer written.
+   * @return the number of versions reclaimed
+   */
+  size_t CollectGarbage();
+
  private:
   /**
    * Releases all the locks held by the given transaction.
    * @param txn the transaction whose locks should be released
    */
   void ReleaseLocks(Transaction *txn) {
-    std::unordered_set<RID> lock_set;
-    for (auto item : *txn->GetExclusiveLockSet()) {
-      lock_set.emplace(item);
+    // Unlock drops the record from the lock sets of txn.
+    for (const auto &lock_set : {txn->GetExclusiveLockSet(), txn->GetSharedLockSet()}) {
+      while (!lock_set->empty()) {
+        RID locked_rid = *lock_set->begin();
+        lock_manager_->Unlock(txn, locked_rid);
+      }
     }
-    for (auto item : *txn->GetSharedLockSet()) {
-      lock_set.emplace(item);
+    // Table locks go last, once no record lock depends on them.
+    std::vector<table_oid_t> locked_tables;
+    for (const auto &[oid, lock_mode] : *txn->GetTableLockSet()) {
+      locked_tables.push_back(oid);
     }
-    for (auto locked_rid : lock_set) {
-      lock_manager_->Unlock(txn, locked_rid);
+    for (auto oid : locked_tables) {
+      lock_manager_->UnlockTable(txn, oid);
     }
   }
 
+  /**
+   * The write and validation phases of an optimistic transaction. The writes it applied stay in its write set, to be
+   * rolled back if this fails.
+   * @return true if the transaction may commit
+   */
+  bool WriteAndValidate(Transaction *txn);
+
+  /** @return true if txn has a read timestamp, i.e. it reads a snapshot or runs optimistically */
+  static bool HasReadTs(Transaction *txn) {
+    return txn->GetIsolationLevel() == IsolationLevel::SNAPSHOT_ISOLATION ||
+           txn->GetConcurrencyControl() == ConcurrencyControl::OPTIMISTIC;
+  }
+
+  /**
+   * Group the table write records of a transaction by table, so that each table applies its records page by page.
+   * @param deletes_only true to keep only the DELETE records
+   * @return the tables in the order they were first written, each with its records newest first
+   */
+  static std::vector<std::pair<TableHeap *, std::vector<const TableWriteRecord *>>> GroupByTable(
+      const std::deque<TableWriteRecord> &write_set, bool deletes_only);
+
+  /**
+   * Undo the index writes of an aborting transaction. The catalog is looked up once per index, and the entries of an
+   * index are put back and taken out in key order, the entries of a key in reverse order of the writes.
+   */
+  static void RollbackIndexWrites(Transaction *txn);
+
+  /**
+   * Append the COMMIT or ABORT record of a transaction and drop it from the active transaction table, in one step as
+   * far as GetActiveTransactionTable is concerned.
+   * @return the lsn of the record
+   */
+  lsn_t AppendEndRecord(Transaction *txn, LogRecordType type);
+
+  /** Drop a transaction from the active transaction table without logging, when logging was turned off. */
+  void RemoveActiveTransaction(Transaction *txn);
+
+  /** Stamp the versions written by a committing transaction with a new commit timestamp. */
+  void CommitVersions(Transaction *txn);
+
+  /** Release the snapshot of a finished transaction, if it has one. */
+  void EndSnapshot(Transaction *txn);
+
+  /** Make lsn the last commit record of a transaction that released its locks early, if it is the largest so far. */
+  void RaiseEarlyReleaseLsn(lsn_t lsn);
+
+  /** @return the watermark, the caller holds timestamp_latch_ */
+  timestamp_t GetWatermarkLocked() { return active_snapshots_.empty() ? last_commit_ts_ : *active_snapshots_.begin(); }
+
+  /** The maximum number of finished transactions kept for reuse. */
+  static constexpr size_t MAX_POOLED_TXNS = 64;
+
   std::atomic<txn_id_t> next_txn_id_{0};
   LockManager *lock_manager_ __attribute__((__unused__));
-  LogManager *log_manager_ __attribute__((__unused__));
+  LogManager *log_manager_;
+
+  /** The largest commit record of a transaction that released its locks before it was durable. */
+  std::atomic<lsn_t> early_release_lsn_{INVALID_LSN};
 
-  /** The global transaction latch is used for checkpointing. */
-  ReaderWriterLatch global_txn_latch_;
+  /**
+   * The global transaction latch is used for checkpointing: a transaction is in it from Begin to Commit or Abort, and
+   * BlockAllTransactions waits for every transaction to leave.
+   */
+  QuiescentLatch global_txn_latch_;
+
+  /** The running transactions. */
+  TransactionRegistry txn_registry_;
+
+  /** Protects free_txns_. */
+  std::mutex pool_latch_;
+  /** The transactions handed back by Release. */
+  std::vector<Transaction *> free_txns_;
+
+  /** Protects active_txns_. */
+  std::mutex active_txns_latch_;
+  /** The transactions with a BEGIN but without a COMMIT/ABORT record, and the lsn of their BEGIN record. */
+  std::unordered_map<Transaction *, lsn_t> active_txns_;
+
+  /** Protects the members below, and makes a commit visible to all snapshots at once. */
+  std::mutex timestamp_latch_;
+  /** The commit timestamp of the last transaction that wrote a tuple. */
+  timestamp_t last_commit_ts_{0};
+  /** The read timestamps of the running transactions under SNAPSHOT_ISOLATION or OPTIMISTIC. */
+  std::multiset<timestamp_t> active_snapshots_;
+  /** The tables that may hold versions, for CollectGarbage. */
+  std::unordered_set<TableHeap *> versioned_tables_;
 };
 
 }  // namespace bustub
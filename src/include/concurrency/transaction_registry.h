@@ -0,0 +1,91 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// transaction_registry.h
+//
+// Identification: src/include/concurrency/transaction_registry.h
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <mutex>  // NOLINT
+#include <vector>
+
+#include "common/config.h"
+#include "common/macros.h"
+#include "concurrency/transaction.h"
+
+namespace bustub {
+
+/**
+ * TransactionRegistry maps the ids of the running transactions to the transactions.
+ *
+ * Transaction ids are handed out in sequence, so sharding them by their low bits spreads concurrent transactions
+ * evenly over REGISTRY_SHARDS shards, each with its own latch. A shard is a plain vector of the transactions hashed to
+ * it: transactions leave the registry when they finish, so a shard only ever holds a few of them, and its vector
+ * stops allocating once it has grown to the largest number of transactions that ran at once.
+ */
+class TransactionRegistry {
+ public:
+  TransactionRegistry() = default;
+
+  DISALLOW_COPY_AND_MOVE(TransactionRegistry);
+
+  /** Add a transaction that has just begun. */
+  void Register(Transaction *txn) {
+    auto &shard = GetShard(txn->GetTransactionId());
+    std::scoped_lock<std::mutex> lck(shard.latch_);
+    shard.txns_.push_back(txn);
+  }
+
+  /** Drop a transaction that has finished. */
+  void Unregister(Transaction *txn) {
+    auto &shard = GetShard(txn->GetTransactionId());
+    std::scoped_lock<std::mutex> lck(shard.latch_);
+    auto found = std::find(shard.txns_.begin(), shard.txns_.end(), txn);
+    if (found != shard.txns_.end()) {
+      *found = shard.txns_.back();
+      shard.txns_.pop_back();
+    }
+  }
+
+  /** @return the running transaction with the given id, or nullptr if there is none */
+  Transaction *Find(txn_id_t txn_id) {
+    auto &shard = GetShard(txn_id);
+    std::scoped_lock<std::mutex> lck(shard.latch_);
+    auto found = std::find_if(shard.txns_.begin(), shard.txns_.end(),
+                              [txn_id](Transaction *txn) { return txn->GetTransactionId() == txn_id; });
+    return found == shard.txns_.end() ? nullptr : *found;
+  }
+
+  /** @return the number of running transactions */
+  size_t Size() {
+    size_t size = 0;
+    for (auto &shard : shards_) {
+      std::scoped_lock<std::mutex> lck(shard.latch_);
+      size += shard.txns_.size();
+    }
+    return size;
+  }
+
+ private:
+  static constexpr size_t REGISTRY_SHARDS = 16;
+
+  /** A shard of the registry. Aligned so that the latches of two shards never share a cache line. */
+  struct alignas(64) Shard {
+    std::mutex latch_;
+    std::vector<Transaction *> txns_;
+  };
+
+  Shard &GetShard(txn_id_t txn_id) { return shards_[static_cast<size_t>(txn_id) % REGISTRY_SHARDS]; }
+
+  std::array<Shard, REGISTRY_SHARDS> shards_;
+};
+
+}  // namespace bustub
@@ -0,0 +1,140 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// version_store.h
+//
+// Identification: src/include/concurrency/version_store.h
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <deque>
+#include <mutex>  // NOLINT
+#include <unordered_map>
+
+#include "common/config.h"
+#include "common/macros.h"
+#include "common/rid.h"
+#include "concurrency/transaction.h"
+#include "storage/table/tuple.h"
+
+namespace bustub {
+
+/**
+ * VersionStore keeps the older versions of the tuples of a table for transactions under SNAPSHOT_ISOLATION.
+ *
+ * The newest version of a tuple is the one on its page. Before a transaction changes a tuple, the version it replaces
+ * is pushed onto the version chain of the tuple, and the chain remembers the writer until it commits or aborts. A
+ * version is valid from its begin timestamp, the commit timestamp of the transaction that wrote it, to the begin
+ * timestamp of the next newer version. A tuple without a chain has been there for every snapshot.
+ *
+ * Every transaction that writes a tuple goes through the store, whatever its isolation level, so that snapshots stay
+ * consistent; only snapshot reads look for older versions. Optimistic transactions read the newest committed versions
+ * and validate at commit that their begin timestamps have not changed. Versions that no snapshot can see any more are
+ * reclaimed when their tuple is committed again, and by CollectGarbage.
+ *
+ * The callers hold the latch of the page of a tuple across the page access and the matching store call, so that both
+ * always agree on the newest version. A writer holds the exclusive lock on the tuple until it has committed or rolled
+ * back its version, which also keeps the slot of a tuple it deleted from being reused in the meantime.
+ */
+class VersionStore {
+ public:
+  VersionStore() = default;
+
+  DISALLOW_COPY_AND_MOVE(VersionStore);
+
+  /**
+   * Find the version of a tuple visible to the snapshot of txn.
+   * @param rid the tuple
+   * @param exists true if the page holds the tuple, which is then in tuple
+   * @param[in,out] tuple the version on the page, replaced by the visible version if that is an older one
+   * @return true if a version is visible, false if the tuple did not exist for the snapshot
+   */
+  bool GetVisible(const RID &rid, Transaction *txn, bool exists, Tuple *tuple);
+
+  /**
+   * Find the newest committed version of a tuple for an optimistic read, or the version txn wrote itself.
+   * @param exists true if the page holds the tuple, which is then in tuple
+   * @param[in,out] tuple the version on the page, replaced by the committed version if another transaction wrote it
+   * @param[out] begin_ts the begin timestamp of the version read, to validate the read with
+   * @return true if the version read exists
+   */
+  bool GetLatest(const RID &rid, Transaction *txn, bool exists, Tuple *tuple, timestamp_t *begin_ts);
+
+  /**
+   * Validate an optimistic read when txn commits.
+   * @param begin_ts the begin timestamp of the version txn read, see GetLatest
+   * @return true if that version is still the newest committed one and no other transaction is writing the tuple
+   */
+  bool Validate(const RID &rid, Transaction *txn, timestamp_t begin_ts);
+
+  /**
+   * Keep the version on the page before txn updates or deletes the tuple. Nothing is kept if txn wrote the tuple
+   * already, the oldest version it replaced being the one to roll back to.
+   * @param exists true if the page holds the tuple, which is then tuple
+   * @return false on a write-write conflict: another transaction wrote the tuple and has not committed yet, or txn is
+   * under SNAPSHOT_ISOLATION and the tuple was committed after its snapshot
+   */
+  bool BeginWrite(const RID &rid, Transaction *txn, bool exists, const Tuple &tuple);
+
+  /** Keep the absence of a tuple that txn just inserted in a free slot. A new tuple never conflicts. */
+  void BeginInsert(const RID &rid, Transaction *txn);
+
+  /**
+   * Make the version txn wrote the newest committed one.
+   * @param commit_ts the commit timestamp of txn
+   * @param watermark the oldest snapshot still active, the versions older than what it sees are reclaimed
+   */
+  void Commit(const RID &rid, Transaction *txn, timestamp_t commit_ts, timestamp_t watermark);
+
+  /** Bring back the version txn replaced, once the page holds it again. */
+  void Rollback(const RID &rid, Transaction *txn);
+
+  /**
+   * Reclaim the versions no snapshot can see any more.
+   * @param watermark the oldest snapshot still active
+   * @return the number of versions reclaimed
+   */
+  size_t CollectGarbage(timestamp_t watermark);
+
+ private:
+  /** A replaced version of a tuple. */
+  struct TupleVersion {
+    timestamp_t begin_ts_;
+    /** False if the tuple did not exist, i.e. before it was inserted or once it was deleted. */
+    bool exists_;
+    Tuple tuple_;
+  };
+
+  /** The versions of a tuple. */
+  struct VersionChain {
+    /** The transaction that wrote the version on the page and has yet to commit, or INVALID_TXN_ID. */
+    txn_id_t writer_{INVALID_TXN_ID};
+    /** The begin timestamp of the version on the page, once committed. */
+    timestamp_t begin_ts_{0};
+    /** The replaced versions, newest first. */
+    std::deque<TupleVersion> versions_;
+  };
+
+  /**
+   * Drop the versions of a chain no snapshot at or after the watermark can see.
+   * @return the number of versions dropped
+   */
+  static size_t Prune(VersionChain *chain, timestamp_t watermark);
+
+  /** @return true if the chain says no more than the page, so it can go */
+  static bool IsObsolete(const VersionChain &chain, timestamp_t watermark) {
+    return chain.writer_ == INVALID_TXN_ID && chain.versions_.empty() && chain.begin_ts_ <= watermark;
+  }
+
+  /** Protects chains_. */
+  std::mutex latch_;
+  /** The version chains of the tuples written while an older snapshot may still need them. */
+  std::unordered_map<RID, VersionChain> chains_;
+};
+
+}  // namespace bustub
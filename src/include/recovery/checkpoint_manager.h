@@ -12,6 +12,12 @@
 
 #pragma once
 
+#include <condition_variable>  // NOLINT
+#include <mutex>               // NOLINT
+#include <thread>              // NOLINT
+#include <utility>
+#include <vector>
+
 #include "buffer/buffer_pool_manager.h"
 #include "concurrency/transaction_manager.h"
 #include "recovery/log_manager.h"
@@ -20,6 +26,13 @@ namespace bustub {
 
 /**
  * CheckpointManager creates consistent checkpoints by blocking all other transactions temporarily.
+ *
+ * It can also take fuzzy checkpoints, which do not stop transactions: a BEGIN_CHECKPOINT record is followed by an
+ * END_CHECKPOINT record holding the active transaction table and the dirty page table, and the master record is
+ * pointed at the checkpoint once both are durable. Recovery then starts its analysis at the last checkpoint and its
+ * redo at the oldest record a dirty page or an active transaction still depends on, and the log segments before that
+ * record are deleted. A background checkpointer writes the dirty pages out between checkpoints, so that the part of
+ * the log recovery has to read, and the log kept on disk, keep moving forward.
  */
 class CheckpointManager {
  public:
@@ -29,15 +42,43 @@ class CheckpointManager {
         log_manager_(log_manager),
         buffer_pool_manager_(buffer_pool_manager) {}
 
-  ~CheckpointManager() = default;
+  ~CheckpointManager() { StopBackgroundCheckpointer(); }
 
   void BeginCheckpoint();
   void EndCheckpoint();
 
+  /**
+   * Take a fuzzy checkpoint while transactions keep running. Does nothing if logging is disabled, the log is striped
+   * or on-demand recovery is in progress.
+   * @return the lsn of the BEGIN_CHECKPOINT record, INVALID_LSN if no checkpoint was taken
+   */
+  lsn_t FuzzyCheckpoint();
+
+  /**
+   * Start a thread that, every checkpoint_interval, writes out the pages that were dirty at the last checkpoint and
+   * then takes a fuzzy checkpoint.
+   */
+  void RunBackgroundCheckpointer();
+
+  /** Stop and join the background checkpointer, if it is running. */
+  void StopBackgroundCheckpointer();
+
  private:
-  TransactionManager *transaction_manager_ __attribute__((__unused__));
-  LogManager *log_manager_ __attribute__((__unused__));
-  BufferPoolManager *buffer_pool_manager_ __attribute__((__unused__));
+  /** The body of the background checkpointer. */
+  void BackgroundCheckpointer();
+
+  TransactionManager *transaction_manager_;
+  LogManager *log_manager_;
+  BufferPoolManager *buffer_pool_manager_;
+
+  /** Protects stop_checkpointer_. */
+  std::mutex latch_;
+  /** Wakes up the background checkpointer when it should stop. */
+  std::condition_variable cv_;
+  bool stop_checkpointer_{false};
+  std::thread *checkpointer_thread_{nullptr};
+  /** The dirty page table of the last fuzzy checkpoint. Only used by the background checkpointer. */
+  std::vector<std::pair<page_id_t, lsn_t>> last_dirty_pages_;
 };
 
 }  // namespace bustub
@@ -15,26 +15,75 @@
 #include <algorithm>
 #include <condition_variable>  // NOLINT
 #include <future>              // NOLINT
-#include <mutex>               // NOLINT
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <thread>              // NOLINT
+#include <utility>
+#include <vector>
 
 #include "recovery/log_record.h"
 #include "storage/disk/disk_manager.h"
 
 namespace bustub {
 
+/**
+ * The master record points recovery at the last complete fuzzy checkpoint, see CheckpointManager::FuzzyCheckpoint.
+ * Offsets are positions in the log file at which a flushed batch of records starts.
+ */
+struct MasterRecord {
+  /** The lsn of the BEGIN_CHECKPOINT record. */
+  lsn_t checkpoint_lsn_;
+  /** Analysis starts here, at or before the BEGIN_CHECKPOINT record. */
+  int64_t checkpoint_offset_;
+  /** Redo starts here, at or before the oldest record that the disk may miss or that undo may need. */
+  int64_t redo_offset_;
+  /** No record before checkpoint_offset_ has a larger lsn, the lsns of a restarted log go on from here. */
+  lsn_t last_lsn_;
+};
+
 /**
  * LogManager maintains a separate thread that is awakened whenever the log buffer is full or whenever a timeout
  * happens. When the thread is awakened, the log buffer's content is written into the disk log file.
+ *
+ * The log manager is double-buffered: the flush thread swaps log_buffer_ and flush_buffer_ and then writes
+ * flush_buffer_ without holding the latch, so appends continue while the previous buffer is on its way to disk.
+ * Committing transactions do not flush on their own. They request a flush and wait until persistent_lsn_ reaches
+ * their commit record, so a single write and sync makes every commit appended in the meantime durable (group commit).
+ *
+ * Appends do not take the latch. The next lsn and the end of the log buffer live in a single 64-bit word; a record
+ * reserves its lsn and its bytes with one compare-and-swap on that word, is serialized in parallel with the other
+ * appenders and is then published by adding its size to completed_. To flush, the flush thread seals the word so that
+ * no new reservations are handed out, waits for completed_ to catch up with the sealed end (every reserved record is
+ * fully written) and swaps the buffers. The latch is only taken on the slow paths: waiting for a full or sealed
+ * buffer, waiting for persistence, and by the flush thread.
+ *
+ * With log_stream_count > 1 the log is striped: every transaction appends to one of several streams, each with its own
+ * buffers, flush thread and log stream file, so that appends and flushes of different streams never meet. Lsns still
+ * come from a single counter, which a record reads while it reserves its space under the stream's latch, so every
+ * stream is in lsn order. Every record the stream gets after its flush thread took the latch has an lsn at least as
+ * large as the counter, so once the drained buffer is on disk the stream is durable up to there. The persistent lsn is
+ * the smallest of these points over all the streams. Recovery merges the streams back into the log in lsn order, see
+ * LogRecovery. Fuzzy checkpoints and log truncation rely on the log file offsets of a single stream and are not
+ * available in this mode.
  */
 class LogManager {
  public:
   explicit LogManager(DiskManager *disk_manager)
-      : next_lsn_(0), persistent_lsn_(INVALID_LSN), disk_manager_(disk_manager) {
+      : reserve_state_(PackState(0, 0)), persistent_lsn_(INVALID_LSN), disk_manager_(disk_manager) {
     log_buffer_ = new char[LOG_BUFFER_SIZE];
     flush_buffer_ = new char[LOG_BUFFER_SIZE];
+    if (log_stream_count > 1) {
+      for (int i = 0; i < log_stream_count; i++) {
+        streams_.emplace_back(std::make_unique<LogStream>(i));
+      }
+    }
   }
 
   ~LogManager() {
+    if (IsFlushThreadRunning()) {
+      StopFlushThread();
+    }
     delete[] log_buffer_;
     delete[] flush_buffer_;
     log_buffer_ = nullptr;
@@ -46,29 +95,245 @@ class LogManager {
 
   lsn_t AppendLogRecord(LogRecord *log_record);
 
-  inline lsn_t GetNextLSN() { return next_lsn_; }
+  /**
+   * Append an INSERT/MARKDELETE/APPLYDELETE/ROLLBACKDELETE record whose tuple bytes are copied straight from the
+   * caller (usually the table page) into the log buffer. Unlike AppendLogRecord, no LogRecord and no Tuple copy are
+   * built on the way. The serialized record is identical to the one AppendLogRecord writes.
+   * @param data the tuple data, may be nullptr if size is 0
+   * @param size the tuple size
+   * @return the lsn of the record
+   */
+  lsn_t AppendTupleLogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type, const RID &rid,
+                             const char *data, uint32_t size);
+
+  /**
+   * Append an UPDATE record straight from the old and the new tuple data, see AppendTupleLogRecord.
+   * If the update keeps the tuple size, an UPDATE_DELTA record carrying only the changed byte ranges is appended
+   * instead whenever it is the smaller of the two.
+   * @return the lsn of the record
+   */
+  lsn_t AppendUpdateLogRecord(txn_id_t txn_id, lsn_t prev_lsn, const RID &rid, const char *old_data,
+                              uint32_t old_size, const char *new_data, uint32_t new_size);
+
+  /**
+   * Append an INDEX_INSERT/INDEX_DELETE/INDEX_WRITE record whose entries are copied straight from the B+ tree page
+   * into the log buffer, see AppendTupleLogRecord.
+   * @param index_name the name of the index the page belongs to
+   * @param position the index of the first entry, or a byte offset in the page for INDEX_WRITE
+   * @param entries the first entry
+   * @param entry_size the size of an entry
+   * @param num_entries the number of entries, which follow each other
+   * @return the lsn of the record
+   */
+  lsn_t AppendIndexLogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type,
+                             const std::string &index_name, page_id_t page_id, int32_t position, const char *entries,
+                             uint32_t entry_size, int32_t num_entries);
+
+  /**
+   * Block until every log record up to and including lsn is on disk. A flush is requested, but the caller does
+   * not flush by itself: concurrent callers are all served by the same flush.
+   * Returns immediately if the flush thread is not running.
+   * @param lsn the log sequence number that must become persistent
+   * @return false if the log could not be forced that far because the flush thread is not running
+   */
+  bool WaitUntilPersistent(lsn_t lsn);
+
+  /** Ask the flush thread to write the log buffer now instead of at the next timeout, without waiting for it. */
+  void RequestFlush();
+
+  /** Force every log record appended so far to disk, e.g. for checkpoints. */
+  void Flush() { WaitUntilPersistent(GetNextLSN() - 1); }
+
+  /**
+   * @return the log file offset of the flushed batch holding the record with the given lsn, which must be persistent
+   */
+  int64_t GetLogOffset(lsn_t lsn);
+
+  /**
+   * Point recovery at a checkpoint by replacing the master record.
+   * @param checkpoint_lsn the lsn of the BEGIN_CHECKPOINT record, it must be persistent
+   * @param redo_lsn the lsn recovery has to redo from, it must be persistent
+   */
+  void WriteMasterRecord(lsn_t checkpoint_lsn, lsn_t redo_lsn);
+
+  /**
+   * Give the log before the flushed batch holding the given record back to the disk manager, which deletes the log
+   * segments that only hold older records. Nothing older than the redo point of the master record may be truncated.
+   * @param lsn the oldest lsn still needed, it must be persistent
+   */
+  void TruncateLog(lsn_t lsn);
+
+  /** @return true if the log is striped over several streams, see the class comment */
+  bool IsStriped() const { return !streams_.empty(); }
+
+  inline lsn_t GetNextLSN() { return IsStriped() ? next_lsn_.load() : StateLSN(reserve_state_.load()); }
   inline lsn_t GetPersistentLSN() { return persistent_lsn_; }
   inline void SetPersistentLSN(lsn_t lsn) { persistent_lsn_ = lsn; }
   inline char *GetLogBuffer() { return log_buffer_; }
 
  private:
-  // TODO(students): you may add your own member variables
+  /** A stream of the striped log, see the class comment. */
+  struct LogStream {
+    explicit LogStream(int id)
+        : id_(id), log_buffer_(new char[LOG_BUFFER_SIZE]), flush_buffer_(new char[LOG_BUFFER_SIZE]) {}
+    ~LogStream() {
+      delete[] log_buffer_;
+      delete[] flush_buffer_;
+    }
+
+    int id_;
+    /** The end of the reserved part of log_buffer_. Protected by latch_. */
+    uint32_t reserved_{0};
+    /** The number of bytes of log_buffer_ whose records are fully serialized. */
+    std::atomic<int> completed_{0};
+    char *log_buffer_;
+    char *flush_buffer_;
+    /** Protects reserved_ and flush_requested_, held by the flush thread while it drains and swaps the buffers. */
+    std::mutex latch_;
+    bool flush_requested_{false};
+    /** Wakes up the stream's flush thread. */
+    std::condition_variable cv_;
+    /** Signalled when the buffers were swapped, wakes up appenders waiting for buffer space. */
+    std::condition_variable flushed_cv_;
+    /** Every record of the stream with an lsn up to this one is on disk. Protected by LogManager::latch_. */
+    lsn_t durable_lsn_{INVALID_LSN};
+    std::thread thread_;
+  };
+
+  /**
+   * Go on with the lsns of the log a previous run left on disk, so that new records never reuse an lsn that is
+   * already in the log or on a page. Called before anything is appended.
+   */
+  void ResumeLog();
+
+  /** The body of the flush thread. */
+  void FlushThread();
+
+  /** The body of the flush thread of a stream of the striped log. */
+  void StreamFlushThread(LogStream *stream);
+
+  /** @return true if the flush thread, or the flush threads of the streams, are running */
+  bool IsFlushThreadRunning() {
+    return flush_thread_ != nullptr || (IsStriped() && streams_.front()->thread_.joinable());
+  }
 
-  /** The atomic counter which records the next log sequence number. */
-  std::atomic<lsn_t> next_lsn_;
+  /**
+   * @return the stream the records of a transaction go to. Records without a transaction go to the stream of the
+   * appending thread.
+   */
+  LogStream *PickStream(txn_id_t txn_id) {
+    const size_t key = txn_id != INVALID_TXN_ID ? static_cast<size_t>(txn_id)
+                                                : std::hash<std::thread::id>{}(std::this_thread::get_id());
+    return streams_[key % streams_.size()].get();
+  }
+
+  /** Ask the flush thread of a stream to write its buffer now. */
+  static void RequestStreamFlush(LogStream *stream) {
+    {
+      std::scoped_lock<std::mutex> lck{stream->latch_};
+      stream->flush_requested_ = true;
+    }
+    stream->cv_.notify_one();
+  }
+
+  /**
+   * Reserve size bytes in the log buffer and the next lsn, waiting for the flush thread if the buffer is full.
+   * The caller must serialize its record into the returned space and then call CompleteReservation(size, txn_id).
+   * @param size the size of the record
+   * @param txn_id the transaction of the record, which picks the stream of a striped log
+   * @param[out] lsn the lsn of the record
+   * @return where the record goes in the log buffer
+   */
+  char *Reserve(int size, txn_id_t txn_id, lsn_t *lsn);
+
+  /** Reserve size bytes in the buffer of a stream of the striped log, see Reserve. */
+  char *ReserveInStream(LogStream *stream, int size, lsn_t *lsn);
+
+  /**
+   * @return the first flushed batch starting after lsn, i.e. the batch holding lsn is right before it unless it is
+   * the first one. The caller must hold latch_.
+   */
+  std::vector<std::pair<lsn_t, int64_t>>::iterator FindBatchAfter(lsn_t lsn) {
+    return std::upper_bound(flush_index_.begin(), flush_index_.end(), lsn,
+                            [](lsn_t lsn, const std::pair<lsn_t, int64_t> &batch) { return lsn < batch.first; });
+  }
+
+  /** Publish a reserved record of the given size as fully written. */
+  void CompleteReservation(int size, txn_id_t txn_id) {
+    (IsStriped() ? PickStream(txn_id)->completed_ : completed_).fetch_add(size, std::memory_order_release);
+  }
+
+  /** Serialize the log record into dest, which must have room for log_record->GetSize() bytes. */
+  static void SerializeLogRecord(const LogRecord &log_record, char *dest);
+
+  /** Serialize a log record header into dest. @return the position right after the header */
+  static char *SerializeHeader(char *dest, int32_t size, lsn_t lsn, txn_id_t txn_id, lsn_t prev_lsn,
+                               LogRecordType log_record_type);
+
+  /** Serialize a tuple as | tuple_size | tuple_data | into dest. @return the position right after the tuple */
+  static char *SerializeTupleData(char *dest, const char *data, uint32_t size);
+
+  /**
+   * Find the byte ranges in which two tuples of the same size differ. Ranges closer to each other than the size of a
+   * range header are merged, since logging the bytes in between is cheaper than starting a new range.
+   * @param[out] ranges the (offset, length) of every range, in offset order
+   * @return the size of the UPDATE_DELTA record holding the ranges
+   */
+  static int32_t DiffTuples(const char *old_data, const char *new_data, uint32_t size,
+                            std::vector<std::pair<uint32_t, uint32_t>> *ranges);
+
+  /** Set in the offset half of reserve_state_ while the flush thread drains and swaps the log buffer. */
+  static constexpr uint32_t SEALED = 0x80000000U;
+
+  static uint64_t PackState(lsn_t lsn, uint32_t offset) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(lsn)) << 32) | offset;
+  }
+  static lsn_t StateLSN(uint64_t state) { return static_cast<lsn_t>(state >> 32); }
+  static uint32_t StateOffset(uint64_t state) { return static_cast<uint32_t>(state); }
+  /** @return true if a record of the given size can be reserved in the given state */
+  static bool HasRoom(uint64_t state, int size) {
+    return (StateOffset(state) & SEALED) == 0 && StateOffset(state) + size <= static_cast<uint32_t>(LOG_BUFFER_SIZE);
+  }
+
+  /** The next log sequence number (high half) and the end of the reserved part of log_buffer_ (low half). */
+  std::atomic<uint64_t> reserve_state_;
+  /** The number of bytes of log_buffer_ whose records are fully serialized. */
+  std::atomic<int> completed_{0};
   /** The log records before and including the persistent lsn have been written to disk. */
   std::atomic<lsn_t> persistent_lsn_;
 
+  /** The buffer log records are appended to. Only swapped by the flush thread while reserve_state_ is sealed. */
   char *log_buffer_;
+  /** The buffer being written to disk by the flush thread. Only touched by the flush thread after the swap. */
   char *flush_buffer_;
+  /** True if some thread is waiting for the log buffer to be written. Protected by latch_. */
+  bool flush_requested_{false};
 
   std::mutex latch_;
 
-  std::thread *flush_thread_ __attribute__((__unused__));
+  std::thread *flush_thread_{nullptr};
 
+  /** The first lsn of the next batch to flush. Protected by latch_. */
+  lsn_t flushed_lsn_{0};
+  /** The log file offset of the next batch to flush. Protected by latch_. */
+  int64_t log_offset_{0};
+  /**
+   * The first lsn and the log file offset of every flushed batch, in lsn order. Batches before the truncation point
+   * are dropped. Protected by latch_.
+   */
+  std::vector<std::pair<lsn_t, int64_t>> flush_index_;
+
+  /** Wakes up the flush thread. */
   std::condition_variable cv_;
+  /** Signalled after every flush: wakes up appenders waiting for buffer space and waiters on persistent_lsn_. */
+  std::condition_variable flushed_cv_;
+
+  /** The streams of a striped log, empty unless log_stream_count > 1. */
+  std::vector<std::unique_ptr<LogStream>> streams_;
+  /** The next lsn of a striped log. */
+  std::atomic<lsn_t> next_lsn_{0};
 
-  DiskManager *disk_manager_ __attribute__((__unused__));
+  DiskManager *disk_manager_;
 };
 
 }  // namespace bustub
@@ -14,6 +14,8 @@
 
 #include <cassert>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "common/config.h"
 #include "storage/table/tuple.h"
@@ -32,6 +34,32 @@ enum class LogRecordType {
   ABORT,
   /** Creating a new page in the table heap. */
   NEWPAGE,
+  /** The start of a fuzzy checkpoint. */
+  BEGIN_CHECKPOINT,
+  /** The end of a fuzzy checkpoint, carrying the active transaction table and the dirty page table. */
+  END_CHECKPOINT,
+  /** An update that keeps the tuple size, carrying only the byte ranges that changed. */
+  UPDATE_DELTA,
+  /** Entries inserted into a B+ tree page. */
+  INDEX_INSERT,
+  /** Entries removed from a B+ tree page. */
+  INDEX_DELETE,
+  /** Bytes written into a B+ tree page, e.g. its header or a separator key. */
+  INDEX_WRITE,
+  /** A new root page id of an index in the header page. */
+  INDEX_ROOT,
+  /**
+   * The end of a transaction that on-demand recovery found unfinished. Its records are undone page by page without
+   * being logged, see LogRecovery::RecoverOnDemand.
+   */
+  RECOVERY_ABORT,
+};
+
+/** A byte range of a tuple changed by an UPDATE_DELTA record, with its bytes before and after the update. */
+struct TupleDeltaRange {
+  uint32_t offset_;
+  std::vector<char> old_bytes_;
+  std::vector<char> new_bytes_;
 };
 
 /**
@@ -53,10 +81,28 @@ enum class LogRecordType {
  *-----------------------------------------------------------------------------------
  * | HEADER | tuple_rid | tuple_size | old_tuple_data | tuple_size | new_tuple_data |
  *-----------------------------------------------------------------------------------
+ * For update delta type log record, every range holds length old bytes followed by length new bytes
+ *------------------------------------------------------------------------------------------------
+ * | HEADER | tuple_rid | tuple_size | num_ranges | (offset, length, old_bytes, new_bytes) ... |
+ *------------------------------------------------------------------------------------------------
  * For new page type log record
- *--------------------------
- * | HEADER | prev_page_id |
- *--------------------------
+ *------------------------------------
+ * | HEADER | prev_page_id | page_id |
+ *------------------------------------
+ * For index page type log record (INDEX_INSERT/INDEX_DELETE/INDEX_WRITE), the entries are raw bytes since recovery
+ * does not know the key type. For INDEX_WRITE the position is a byte offset in the page and there is a single entry.
+ * The index name lets recovery undo leaf entries by key through their tree.
+ *-------------------------------------------------------------------------------------------------
+ * | HEADER | page_id | position | entry_size | num_entries | entries | name_size | index_name |
+ *-------------------------------------------------------------------------------------------------
+ * For index root type log record
+ *------------------------------------------------------
+ * | HEADER | root_page_id | index_name (INDEX_NAME_SIZE) |
+ *------------------------------------------------------
+ * For end checkpoint type log record, the prevLSN of the header is the lsn of the begin checkpoint record
+ *------------------------------------------------------------------------------------------
+ * | HEADER | num_txns | (txn_id, last_lsn) ... | num_pages | (page_id, rec_lsn) ... |
+ *------------------------------------------------------------------------------------------
  */
 class LogRecord {
   friend class LogManager;
@@ -98,6 +144,22 @@ class LogRecord {
     size_ = HEADER_SIZE + sizeof(RID) + old_tuple.GetLength() + new_tuple.GetLength() + 2 * sizeof(int32_t);
   }
 
+  // constructor for UPDATE_DELTA type
+  LogRecord(txn_id_t txn_id, lsn_t prev_lsn, const RID &update_rid, uint32_t tuple_size,
+            std::vector<TupleDeltaRange> delta_ranges)
+      : txn_id_(txn_id),
+        prev_lsn_(prev_lsn),
+        log_record_type_(LogRecordType::UPDATE_DELTA),
+        update_rid_(update_rid),
+        delta_tuple_size_(tuple_size),
+        delta_ranges_(std::move(delta_ranges)) {
+    // calculate log record size, header size + rid + tuple size + number of ranges + the ranges
+    size_ = HEADER_SIZE + sizeof(RID) + 2 * sizeof(int32_t);
+    for (const auto &range : delta_ranges_) {
+      size_ += DELTA_RANGE_HEADER_SIZE + range.old_bytes_.size() + range.new_bytes_.size();
+    }
+  }
+
   // constructor for NEWPAGE type
   LogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type, page_id_t prev_page_id, page_id_t page_id)
       : size_(HEADER_SIZE),
@@ -110,6 +172,48 @@ class LogRecord {
     size_ = HEADER_SIZE + sizeof(page_id_t) * 2;
   }
 
+  // constructor for INDEX_INSERT/INDEX_DELETE/INDEX_WRITE type
+  LogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type, const std::string &index_name,
+            page_id_t page_id, int32_t position, uint32_t entry_size, std::vector<char> entries)
+      : txn_id_(txn_id),
+        prev_lsn_(prev_lsn),
+        log_record_type_(log_record_type),
+        page_id_(page_id),
+        index_position_(position),
+        index_entry_size_(entry_size),
+        index_entries_(std::move(entries)),
+        index_name_(index_name) {
+    assert(index_entry_size_ > 0 && index_entries_.size() % index_entry_size_ == 0);
+    // calculate log record size, header size + page id + position + entry size + number of entries + the entries +
+    // the index name and its size
+    size_ = HEADER_SIZE + sizeof(page_id_t) + 4 * sizeof(int32_t) + index_entries_.size() + index_name_.size();
+  }
+
+  // constructor for INDEX_ROOT type
+  LogRecord(txn_id_t txn_id, lsn_t prev_lsn, const std::string &index_name, page_id_t root_page_id)
+      : txn_id_(txn_id),
+        prev_lsn_(prev_lsn),
+        log_record_type_(LogRecordType::INDEX_ROOT),
+        page_id_(root_page_id),
+        index_name_(index_name) {
+    assert(index_name_.size() < INDEX_NAME_SIZE);
+    // calculate log record size, header size + root page id + index name
+    size_ = HEADER_SIZE + sizeof(page_id_t) + INDEX_NAME_SIZE;
+  }
+
+  // constructor for END_CHECKPOINT type
+  LogRecord(lsn_t begin_checkpoint_lsn, std::vector<std::pair<txn_id_t, lsn_t>> active_txns,
+            std::vector<std::pair<page_id_t, lsn_t>> dirty_pages)
+      : txn_id_(INVALID_TXN_ID),
+        prev_lsn_(begin_checkpoint_lsn),
+        log_record_type_(LogRecordType::END_CHECKPOINT),
+        active_txns_(std::move(active_txns)),
+        dirty_pages_(std::move(dirty_pages)) {
+    // calculate log record size, header size + the sizes of both tables + their entries
+    size_ = HEADER_SIZE + 2 * sizeof(int32_t) + active_txns_.size() * (sizeof(txn_id_t) + sizeof(lsn_t)) +
+            dirty_pages_.size() * (sizeof(page_id_t) + sizeof(lsn_t));
+  }
+
   ~LogRecord() = default;
 
   inline Tuple &GetDeleteTuple() { return delete_tuple_; }
@@ -126,8 +230,26 @@ class LogRecord {
 
   inline RID &GetUpdateRID() { return update_rid_; }
 
+  inline uint32_t GetDeltaTupleSize() { return delta_tuple_size_; }
+
+  inline std::vector<TupleDeltaRange> &GetDeltaRanges() { return delta_ranges_; }
+
   inline page_id_t GetNewPageRecord() { return prev_page_id_; }
 
+  inline page_id_t GetPageId() { return page_id_; }
+
+  inline int32_t GetIndexPosition() { return index_position_; }
+
+  inline uint32_t GetIndexEntrySize() { return index_entry_size_; }
+
+  inline std::vector<char> &GetIndexEntries() { return index_entries_; }
+
+  inline std::string &GetIndexName() { return index_name_; }
+
+  inline std::vector<std::pair<txn_id_t, lsn_t>> &GetActiveTransactionTable() { return active_txns_; }
+
+  inline std::vector<std::pair<page_id_t, lsn_t>> &GetDirtyPageTable() { return dirty_pages_; }
+
   inline int32_t GetSize() { return size_; }
 
   inline lsn_t GetLSN() { return lsn_; }
@@ -173,10 +295,31 @@ class LogRecord {
   Tuple old_tuple_;
   Tuple new_tuple_;
 
+  // case3b: for update delta operation, the size of the tuple (unchanged by the update) and the changed ranges
+  uint32_t delta_tuple_size_{0};
+  std::vector<TupleDeltaRange> delta_ranges_;
+
   // case4: for new page operation
   page_id_t prev_page_id_{INVALID_PAGE_ID};
   page_id_t page_id_{INVALID_PAGE_ID};
+
+  // case4b: for index page operations, page_id_ and where the entries go, their size and their bytes
+  int32_t index_position_{0};
+  uint32_t index_entry_size_{0};
+  std::vector<char> index_entries_;
+
+  // case4c: for a new index root, page_id_ is the root. Index page records name their index too.
+  std::string index_name_;
+
+  // case5: for end checkpoint, the active transactions with their last lsn and the dirty pages with their recLSN
+  std::vector<std::pair<txn_id_t, lsn_t>> active_txns_;
+  std::vector<std::pair<page_id_t, lsn_t>> dirty_pages_;
+
   static const int HEADER_SIZE = 20;
+  /** The offset and the length in front of the bytes of every range of an UPDATE_DELTA record. */
+  static const int DELTA_RANGE_HEADER_SIZE = 2 * sizeof(uint32_t);
+  /** The space taken by an index name in an INDEX_ROOT record, the same as in the header page. */
+  static const uint32_t INDEX_NAME_SIZE = 32;
 };  // namespace bustub
 
 }  // namespace bustub
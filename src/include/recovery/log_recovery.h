@@ -13,8 +13,16 @@
 #pragma once
 
 #include <algorithm>
+#include <condition_variable>  // NOLINT
+#include <deque>
+#include <functional>
+#include <memory>
 #include <mutex>  // NOLINT
+#include <string>
+#include <thread>  // NOLINT
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "buffer/buffer_pool_manager.h"
 #include "concurrency/lock_manager.h"
@@ -22,35 +30,281 @@
 
 namespace bustub {
 
+class TablePage;
+
 /**
  * Read log file from disk, redo and undo.
+ *
+ * Redo reads the log in chunks of LOG_BUFFER_SIZE bytes, the next chunk being read in the background while the
+ * current one is deserialized. Every page-level record is handed to the redo worker that owns its page, so records
+ * of one page are replayed in log order while different pages are replayed in parallel.
+ *
+ * If the master record points at a fuzzy checkpoint, an analysis pass from the checkpoint rebuilds the active
+ * transaction table and the dirty page table first, and redo starts at the checkpoint's redo point instead of the
+ * start of the log.
+ *
+ * The streams of a striped log are merged into the log in lsn order before anything else, so the passes below only
+ * ever see a single log.
+ *
+ * B+ tree pages are recovered the same way as table pages. Their splits and merges are redo-only, so the entries a
+ * transaction inserted or removed in a leaf may no longer belong on the page they were logged on; they are undone by
+ * key through the tree instead, which every index in the log has to be registered for, see RegisterIndex.
+ *
+ * Instead of Redo and Undo, RecoverOnDemand only analyzes the log and indexes, for every page, the log records it has
+ * to redo and undo. The database opens right away: the buffer pool recovers each page the first time it reads it,
+ * and a background thread recovers the pages nobody asks for.
+ *
+ * The undo of a loser is not logged, and new transactions may change and flush its pages before every page is
+ * recovered. Before the database opens, RecoverOnDemand ends every loser with a RECOVERY_ABORT record, and every
+ * page it undoes gets an lsn at least as large. If the database crashes again, the next recovery only undoes the
+ * records of such a loser on the pages whose lsn is below its RECOVERY_ABORT record, i.e. the pages that were never
+ * recovered.
+ *
+ * Once every page is recovered and on disk, the master record is pointed at the end of the recovered log, so that the
+ * next recovery neither redoes nor undoes its transactions again.
  */
 class LogRecovery {
  public:
   LogRecovery(DiskManager *disk_manager, BufferPoolManager *buffer_pool_manager)
       : disk_manager_(disk_manager), buffer_pool_manager_(buffer_pool_manager), offset_(0) {
-    log_buffer_ = new char[LOG_BUFFER_SIZE];
+    // a record may straddle two chunks, so the buffer holds the unparsed tail of a chunk followed by the next one.
+    log_buffer_ = new char[2 * LOG_BUFFER_SIZE];
   }
 
   ~LogRecovery() {
+    WaitForRecovery();
     delete[] log_buffer_;
     log_buffer_ = nullptr;
   }
 
-  void Redo();
+  /**
+   * Takes an entry a transaction inserted out of a leaf of an index, or puts one it removed back (reinsert), by its
+   * key through the tree, see BPlusTree::UndoLeafEntry.
+   */
+  using IndexUndo = std::function<void(const char *entry, bool reinsert)>;
+
+  /**
+   * Register an index whose leaf entries recovery may have to undo, before Undo or RecoverOnDemand.
+   * @param index_name the name the index logs its pages with
+   * @param undo undoes an entry of the index
+   */
+  void RegisterIndex(const std::string &index_name, IndexUndo undo) { indexes_[index_name] = std::move(undo); }
+
+  /**
+   * Redo the whole log.
+   * @param num_threads the number of redo workers, 1 replays the log on the calling thread
+   */
+  void Redo(size_t num_threads = 1);
   void Undo();
-  bool DeserializeLogRecord(const char *data, LogRecord *log_record);
+
+  /**
+   * Instant restart: analyze the log and index the records every page has to redo or undo, without touching any
+   * page. The database may be used as soon as this returns, e.g. by starting transactions; pages are recovered as the
+   * buffer pool reads them and in the background.
+   */
+  void RecoverOnDemand();
+
+  /**
+   * Block until the background thread has recovered every page, which ends on-demand recovery. No fuzzy checkpoint
+   * is taken before, see CheckpointManager::FuzzyCheckpoint.
+   */
+  void WaitForRecovery();
+
+  /**
+   * Bring a page that was just read from disk up to date if on-demand recovery has records pending for it. The
+   * buffer pool calls this without its latch, but with the frame pinned and marked as recovering, so nobody sees the
+   * page before it is recovered.
+   * @param page_id the id of the page
+   * @param page the frame holding the page
+   * @return true if the page was changed
+   */
+  bool RecoverPage(page_id_t page_id, Page *page);
+
+  /**
+   * Deserialize a log record.
+   * @param data the serialized record
+   * @param size the number of bytes available at data
+   * @return true means deserialize succeed, otherwise can't deserialize cause incomplete log record
+   */
+  bool DeserializeLogRecord(const char *data, int size, LogRecord *log_record);
 
  private:
-  DiskManager *disk_manager_ __attribute__((__unused__));
-  BufferPoolManager *buffer_pool_manager_ __attribute__((__unused__));
+  /** A log record for a redo worker, see RedoLogRecord. */
+  struct RedoTask {
+    std::unique_ptr<LogRecord> log_record_;
+    bool link_prev_page_;
+  };
+
+  /** A redo worker and the batches of tasks it has yet to replay, in log order. */
+  struct RedoWorker {
+    std::mutex latch_;
+    std::condition_variable cv_;
+    std::deque<std::vector<RedoTask>> batches_;
+    bool done_{false};
+    std::thread thread_;
+  };
+
+  /** The number of batches a worker may lag behind the reader before the reader waits for it. */
+  static constexpr size_t MAX_PENDING_BATCHES = 4;
+
+  /** Where a record pending for a page under on-demand recovery is in the log file. */
+  struct PendingRecord {
+    int64_t offset_;
+    int size_;
+    bool link_prev_page_;
+  };
+
+  /** The records a page has to redo, in log order, and then to undo, in reverse log order. */
+  struct PendingPage {
+    std::vector<PendingRecord> redo_;
+    std::vector<std::pair<lsn_t, PendingRecord>> undo_;
+  };
+
+  /** A log stream being read record by record, see MergeLogStreams. */
+  struct StreamCursor {
+    int stream_;
+    /** The size of the stream. */
+    int size_;
+    /** The stream offset of buffer_[0]. */
+    int offset_;
+    /** The position of the current record in buffer_. */
+    int pos_;
+    /** The lsn and the size of the current record. */
+    lsn_t lsn_;
+    int32_t record_size_;
+    std::unique_ptr<char[]> buffer_;
+  };
+
+  /**
+   * Append the records of the log streams left by a striped log to the log in lsn order and delete the streams. Every
+   * stream is in lsn order and lsns are dense, so the first lsn missing from every stream is where the durable log
+   * ends: a stream may have reached disk past records another stream lost in the crash, and what follows them is
+   * dropped. A crash while merging leaves the streams behind; merging them again skips the records already in the log.
+   */
+  void MergeLogStreams();
+
+  /**
+   * Make sure the record at the cursor is entirely in its buffer, reading the stream on if needed.
+   * @return false at the end of the stream, or at a record torn by a crash
+   */
+  bool PeekLogStream(StreamCursor *cursor);
+
+  /** @return the page the record applies to, INVALID_PAGE_ID for BEGIN/COMMIT/ABORT */
+  static page_id_t GetRedoPageId(const LogRecord &log_record);
+
+  /**
+   * Replay a record on its page if the page has not seen it yet.
+   * @param link_prev_page for a NEWPAGE record, link the previous page to the new one instead of initializing it
+   */
+  void RedoLogRecord(LogRecord *log_record, bool link_prev_page);
+
+  /**
+   * Replay a record on the given page, which must be the one the record applies to, see RedoLogRecord.
+   * @return true if the page was changed
+   */
+  static bool ApplyRedo(LogRecord *log_record, TablePage *page, bool link_prev_page);
+
+  /** Revert a record of a transaction that did not finish on the given page, which must be the one it applies to. */
+  static void ApplyUndo(LogRecord *log_record, TablePage *page);
+
+  /**
+   * Scan the log from the redo point, building active_txn_ and lsn_mapping_ (or, from a checkpoint, relying on the
+   * analysis for active_txn_), and hand over every record a page may be missing.
+   * @param redo called with the record, its log file offset, the page it goes to and whether it links that page to
+   * the next one
+   * @param end_of_chunk if set, called after the records of each chunk have been handed over
+   */
+  void ScanForRedo(const std::function<void(std::unique_ptr<LogRecord>, int64_t, page_id_t, bool)> &redo,
+                   const std::function<void()> &end_of_chunk);
+
+  /**
+   * Read the record at the given log file offset.
+   * @param size the size of the record if known, LOG_BUFFER_SIZE otherwise
+   * @param buffer holds at least size bytes
+   */
+  void ReadLogRecord(int64_t offset, int size, char *buffer, LogRecord *log_record);
+
+  /** Run by the background thread of on-demand recovery until every page is recovered. */
+  void BackgroundRecovery();
+
+  /**
+   * Read the log from the given offset to its end, the next chunk being read while the current one is parsed.
+   * @param offset a log file offset at which a record starts
+   * @param visit called with every record, in log order, and its log file offset
+   * @param end_of_chunk if set, called after the records of each chunk have been visited
+   */
+  void ScanLog(int64_t offset, const std::function<void(std::unique_ptr<LogRecord>, int64_t)> &visit,
+               const std::function<void()> &end_of_chunk);
+
+  /** Rebuild active_txn_ and dirty_page_table_ from the checkpoint the master record points at. */
+  void Analyze(const MasterRecord &master);
+
+  /** Run by each redo worker until the reader is done. */
+  void RedoWorkerThread(RedoWorker *worker);
+
+  /** Undo a record of a transaction that did not finish. */
+  void UndoLogRecord(LogRecord *log_record);
+
+  /**
+   * @return true if an earlier on-demand recovery already undid the record of a loser on the given page, see the
+   * class comment
+   */
+  bool IsUndone(const LogRecord &log_record, Page *page) const {
+    auto it = abort_lsns_.find(log_record.txn_id_);
+    return it != abort_lsns_.end() && page->GetLSN() >= it->second;
+  }
+
+  /**
+   * Append a RECOVERY_ABORT record to the log for every loser in active_txn_ that has none yet, see the class
+   * comment. The log must not be in use yet.
+   */
+  void AbortLosers();
+
+  /** Undo the leaf entries of an INDEX_INSERT/INDEX_DELETE record of a transaction that did not finish. */
+  void UndoIndexEntries(const LogRecord &log_record);
+
+  /** @return true for the records whose undo goes through an index instead of the page they were logged on */
+  static bool IsIndexEntryRecord(const LogRecord &log_record) {
+    return log_record.log_record_type_ == LogRecordType::INDEX_INSERT ||
+           log_record.log_record_type_ == LogRecordType::INDEX_DELETE;
+  }
+
+  /** Point the master record at the end of the recovered log, see the class comment. Every page must be on disk. */
+  void EndRecovery();
+
+  DiskManager *disk_manager_;
+  BufferPoolManager *buffer_pool_manager_;
 
   /** Maintain active transactions and its corresponding latest lsn. */
   std::unordered_map<txn_id_t, lsn_t> active_txn_;
   /** Mapping the log sequence number to log file offset for undos. */
-  std::unordered_map<lsn_t, int> lsn_mapping_;
+  std::unordered_map<lsn_t, int64_t> lsn_mapping_;
+  /** The pages that may be missing changes on disk and the oldest such change, built by the analysis. */
+  std::unordered_map<page_id_t, lsn_t> dirty_page_table_;
+
+  /** The indexes whose leaf entries may be undone, by name, see RegisterIndex. */
+  std::unordered_map<std::string, IndexUndo> indexes_;
+
+  /** Protects pending_pages_. */
+  std::mutex pending_latch_;
+  /** The pages on-demand recovery has yet to bring up to date. */
+  std::unordered_map<page_id_t, PendingPage> pending_pages_;
+  /** Recovers the pages nobody asks for, running while on-demand recovery is in progress. */
+  std::thread recovery_thread_;
+
+  /**
+   * The losers that an earlier on-demand recovery ended with a RECOVERY_ABORT record, and the lsn of the first such
+   * record, see the class comment.
+   */
+  std::unordered_map<txn_id_t, lsn_t> abort_lsns_;
+
+  /** The end of the log before recovery, -1 until ScanForRedo has read it. */
+  int64_t end_offset_{-1};
+  /** The largest lsn in the log before recovery, including the RECOVERY_ABORT records of AbortLosers. */
+  lsn_t last_lsn_{INVALID_LSN};
 
-  int offset_ __attribute__((__unused__));
+  /** The log file offset of the first byte in log_buffer_. */
+  int64_t offset_;
   char *log_buffer_;
 };
 
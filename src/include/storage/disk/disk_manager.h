@@ -13,53 +13,100 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>  // NOLINT
+#include <deque>
 #include <fstream>
 #include <future>  // NOLINT
+#include <memory>
+#include <mutex>  // NOLINT
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "common/config.h"
+#include "common/util/latency_histogram.h"
 
 namespace bustub {
 
+/** The kinds of I/O performed by the disk manager. */
+enum class IOType { READ_PAGE, WRITE_PAGE, READ_LOG, WRITE_LOG, SYNC };
+
+/** A single I/O that took longer than the slow I/O threshold. */
+struct SlowIORecord {
+  IOType type_;
+  /** The page that was read or written, INVALID_PAGE_ID for log I/O. */
+  page_id_t page_id_;
+  /** The number of bytes transferred. */
+  int size_;
+  std::chrono::microseconds latency_;
+};
+
+/**
+ * A snapshot of the disk manager's I/O statistics. Compare the tail of the read/write histograms with the lock and
+ * latch wait times to tell whether slow operations are disk-bound.
+ */
+struct DiskManagerStats {
+  LatencyHistogram::Snapshot read_latency_;
+  LatencyHistogram::Snapshot write_latency_;
+  LatencyHistogram::Snapshot log_read_latency_;
+  LatencyHistogram::Snapshot log_write_latency_;
+  LatencyHistogram::Snapshot sync_latency_;
+  uint64_t bytes_read_{0};
+  uint64_t bytes_written_{0};
+  uint64_t log_bytes_read_{0};
+  uint64_t log_bytes_written_{0};
+  /** The most recent slow I/Os, oldest first. */
+  std::vector<SlowIORecord> slow_ios_;
+};
+
 /**
  * DiskManager takes care of the allocation and deallocation of pages within a database. It performs the reading and
  * writing of pages to and from disk, providing a logical file layer within the context of a database management system.
+ *
+ * The log is a single sequence of bytes addressed by offset, stored in fixed-size segment files <db>.log.0,
+ * <db>.log.1, ... Segment n holds the offsets [n * log_segment_size, (n + 1) * log_segment_size). Segments that
+ * recovery no longer needs are deleted with TruncateLog, which bounds the disk space of the log; offsets are never
+ * reused, so the remaining segments keep their names and offsets.
+ *
+ * A striped log writes log stream files <db>.log.stream0, <db>.log.stream1, ... instead, each with its own latch so
+ * that streams are written in parallel. Recovery merges them into the log and deletes them.
  */
 class DiskManager {
  public:
   /**
    * Creates a new disk manager that writes to the specified database file.
    * @param db_file the file name of the database file to write to
+   * @param log_segment_size the size of a log segment file, it must not change between restarts
    */
-  explicit DiskManager(const std::string &db_file);
+  explicit DiskManager(const std::string &db_file, int log_segment_size = LOG_SEGMENT_SIZE);
 
-  ~DiskManager() = default;
+  virtual ~DiskManager() = default;
 
   /**
    * Shut down the disk manager and close all the file resources.
    */
-  void ShutDown();
+  virtual void ShutDown();
 
   /**
    * Write a page to the database file.
    * @param page_id id of the page
    * @param page_data raw page data
    */
-  void WritePage(page_id_t page_id, const char *page_data);
+  virtual void WritePage(page_id_t page_id, const char *page_data);
 
   /**
    * Read a page from the database file.
    * @param page_id id of the page
    * @param[out] page_data output buffer
    */
-  void ReadPage(page_id_t page_id, char *page_data);
+  virtual void ReadPage(page_id_t page_id, char *page_data);
 
   /**
    * Flush the entire log buffer into disk.
    * @param log_data raw log data
    * @param size size of log entry
    */
-  void WriteLog(char *log_data, int size);
+  virtual void WriteLog(char *log_data, int size);
 
   /**
    * Read a log entry from the log file.
@@ -68,7 +115,56 @@ class DiskManager {
    * @param offset offset of the log entry in the file
    * @return true if the read was successful, false otherwise
    */
-  bool ReadLog(char *log_data, int size, int offset);
+  virtual bool ReadLog(char *log_data, int size, int64_t offset);
+
+  /**
+   * Delete the log before the given offset, as far as whole segments allow. The log is unchanged if the offset is
+   * older than what was already truncated.
+   * @param offset the oldest log offset that must be kept
+   */
+  virtual void TruncateLog(int64_t offset);
+
+  /** @return the offset at which the next log write goes, i.e. the size of the log including truncated parts */
+  virtual int64_t GetLogSize();
+
+  /**
+   * Append to a log stream file and sync it, like WriteLog. Different streams may be written concurrently.
+   * @param stream the id of the stream
+   * @param log_data raw log data
+   * @param size size of log data
+   */
+  virtual void WriteLogStream(int stream, const char *log_data, int size);
+
+  /**
+   * Read from a log stream file, like ReadLog.
+   * @return false if the offset is at or past the end of the stream
+   */
+  virtual bool ReadLogStream(int stream, char *log_data, int size, int offset);
+
+  /** @return the size of a log stream file, -1 if there is no such stream */
+  virtual int GetLogStreamSize(int stream);
+
+  /** @return the ids of the log streams on disk, in increasing order */
+  virtual std::vector<int> GetLogStreams();
+
+  /** Delete a log stream file, once recovery has merged it into the log. */
+  virtual void RemoveLogStream(int stream);
+
+  /**
+   * Replace the master record, a small side file that tells recovery where the last checkpoint is. The record is
+   * replaced atomically: a crash leaves either the old or the new record.
+   * @param data the master record
+   * @param size the size of the master record
+   */
+  virtual void WriteMasterRecord(const char *data, int size);
+
+  /**
+   * Read the master record.
+   * @param[out] data output buffer
+   * @param size the size of the master record
+   * @return false if no master record was ever written
+   */
+  virtual bool ReadMasterRecord(char *data, int size);
 
   /**
    * Allocate a page on disk.
@@ -100,19 +196,93 @@ class DiskManager {
   /** Checks if the non-blocking flush future was set. */
   inline bool HasFlushLogFuture() { return flush_log_f_ != nullptr; }
 
+  /** @return a snapshot of the I/O latency histograms, byte counts and the slow I/O trace */
+  DiskManagerStats GetStats();
+
+  /** Clear all the I/O statistics. */
+  void ResetStats();
+
+  /**
+   * Any I/O taking at least this long is logged and kept in the slow I/O trace. Zero disables the trace.
+   * @param threshold the slow I/O threshold
+   */
+  void SetSlowIOThreshold(std::chrono::microseconds threshold) { slow_io_threshold_us_ = threshold.count(); }
+
+ protected:
+  /** Creates a disk manager without any backing file, for subclasses that provide their own storage. */
+  DiskManager();
+
+  /** The maximum number of slow I/Os remembered by the trace. */
+  static constexpr size_t SLOW_IO_TRACE_SIZE = 64;
+
+  /** Account for one I/O in the histogram, the byte counter and the slow I/O trace. */
+  void RecordIO(IOType type, std::chrono::steady_clock::time_point start, page_id_t page_id, int size);
+
+  std::atomic<page_id_t> next_page_id_;
+  std::atomic<int> num_flushes_;
+  std::atomic<int> num_writes_;
+  bool flush_log_;
+  std::future<void> *flush_log_f_;
+
  private:
   int GetFileSize(const std::string &file_name);
-  // stream to write log file
+
+  /** @return the log offset at which the given log segment starts */
+  int64_t SegmentStart(int segment) const { return static_cast<int64_t>(segment) * log_segment_size_; }
+
+  /** @return the file name of the given log segment */
+  std::string GetLogSegmentName(int segment) const { return log_name_ + "." + std::to_string(segment); }
+
+  /** @return the file name of the given log stream */
+  std::string GetLogStreamName(int stream) const { return log_name_ + ".stream" + std::to_string(stream); }
+
+  /** Find the log segments left on disk and where the log ends. */
+  void OpenLog();
+
+  /** A log stream file open for appending, see WriteLogStream. */
+  struct LogStreamFile {
+    std::mutex latch_;
+    std::ofstream io_;
+  };
+
+  /** Protects the log segment state and streams below. */
+  std::mutex log_latch_;
+  int log_segment_size_;
+  /** The oldest log segment still on disk. */
+  int first_log_segment_{0};
+  /** The end of the log. Offsets are never reused, so they outgrow an int long before the disk fills up. */
+  int64_t log_size_{0};
+  // stream to append to log segment log_write_segment_
   std::fstream log_io_;
+  int log_write_segment_{-1};
+  // stream to read log segment log_read_segment_
+  std::ifstream log_read_io_;
+  int log_read_segment_{-1};
+  /** Protects log_streams_ but not the files in it, which have their own latches. */
+  std::mutex log_streams_latch_;
+  std::unordered_map<int, std::unique_ptr<LogStreamFile>> log_streams_;
+  // prefix of the log segment file names
   std::string log_name_;
+  // file holding the master record
+  std::string master_name_;
   // stream to write db file
   std::fstream db_io_;
   std::string file_name_;
-  std::atomic<page_id_t> next_page_id_;
-  int num_flushes_;
-  int num_writes_;
-  bool flush_log_;
-  std::future<void> *flush_log_f_;
+
+  // I/O statistics, all of them can be updated concurrently.
+  LatencyHistogram read_latency_;
+  LatencyHistogram write_latency_;
+  LatencyHistogram log_read_latency_;
+  LatencyHistogram log_write_latency_;
+  LatencyHistogram sync_latency_;
+  std::atomic<uint64_t> bytes_read_{0};
+  std::atomic<uint64_t> bytes_written_{0};
+  std::atomic<uint64_t> log_bytes_read_{0};
+  std::atomic<uint64_t> log_bytes_written_{0};
+  std::atomic<int64_t> slow_io_threshold_us_{0};
+  /** Protects slow_ios_, only taken on the slow path. */
+  std::mutex slow_io_latch_;
+  std::deque<SlowIORecord> slow_ios_;
 };
 
 }  // namespace bustub
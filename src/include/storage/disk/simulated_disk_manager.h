@@ -0,0 +1,143 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// simulated_disk_manager.h
+//
+// Identification: src/include/storage/disk/simulated_disk_manager.h
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <chrono>  // NOLINT
+#include <map>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "storage/disk/disk_manager.h"
+
+namespace bustub {
+
+/** How the injected latency of each I/O is drawn. */
+enum class LatencyDistribution {
+  /** Every I/O takes exactly the configured latency. */
+  CONSTANT,
+  /** Uniform in [0, 2 * latency], i.e. the configured latency is the mean. */
+  UNIFORM,
+  /** Exponential with the configured latency as its mean, which gives a long tail. */
+  EXPONENTIAL,
+};
+
+/**
+ * The performance characteristics of a simulated device.
+ * The time of an I/O is its injected latency plus the time to move its bytes at the device bandwidth. The device
+ * moves one transfer at a time, so concurrent I/Os queue up behind each other once the bandwidth is saturated.
+ */
+struct DiskProfile {
+  LatencyDistribution distribution_{LatencyDistribution::CONSTANT};
+  std::chrono::microseconds read_latency_{0};
+  std::chrono::microseconds write_latency_{0};
+  /** Latency of making a log write durable, added on top of the write. */
+  std::chrono::microseconds sync_latency_{0};
+  /** Device bandwidth in bytes per second, 0 means unlimited. */
+  uint64_t bandwidth_{0};
+
+  /** @return a device without any latency, i.e. a plain in-memory store */
+  static DiskProfile Memory() { return DiskProfile{}; }
+
+  /** @return a rough model of a NVMe SSD */
+  static DiskProfile SSD() {
+    return DiskProfile{LatencyDistribution::EXPONENTIAL, std::chrono::microseconds(80), std::chrono::microseconds(30),
+                       std::chrono::microseconds(50), 1000ULL * 1000 * 1000};
+  }
+
+  /** @return a rough model of a 7200rpm HDD, dominated by seeks */
+  static DiskProfile HDD() {
+    return DiskProfile{LatencyDistribution::UNIFORM, std::chrono::microseconds(8000), std::chrono::microseconds(8000),
+                       std::chrono::microseconds(4000), 150ULL * 1000 * 1000};
+  }
+};
+
+/**
+ * SimulatedDiskManager keeps the database and the log in memory and injects configurable latency into every I/O.
+ * It makes performance experiments reproducible and independent of the host's disk. All the DiskManager statistics
+ * are maintained as usual and include the injected latency.
+ */
+class SimulatedDiskManager : public DiskManager {
+ public:
+  /**
+   * Creates a new simulated disk.
+   * @param profile the latency and bandwidth of the simulated device
+   * @param seed the seed of the latency generator, so that runs are repeatable
+   */
+  explicit SimulatedDiskManager(const DiskProfile &profile = DiskProfile::Memory(), uint32_t seed = 15445);
+
+  ~SimulatedDiskManager() override = default;
+
+  void ShutDown() override {}
+
+  void WritePage(page_id_t page_id, const char *page_data) override;
+
+  void ReadPage(page_id_t page_id, char *page_data) override;
+
+  void WriteLog(char *log_data, int size) override;
+
+  bool ReadLog(char *log_data, int size, int64_t offset) override;
+
+  void TruncateLog(int64_t offset) override;
+
+  int64_t GetLogSize() override;
+
+  void WriteLogStream(int stream, const char *log_data, int size) override;
+
+  bool ReadLogStream(int stream, char *log_data, int size, int offset) override;
+
+  int GetLogStreamSize(int stream) override;
+
+  std::vector<int> GetLogStreams() override;
+
+  void RemoveLogStream(int stream) override;
+
+  void WriteMasterRecord(const char *data, int size) override;
+
+  bool ReadMasterRecord(char *data, int size) override;
+
+  /** @return the simulated device profile */
+  const DiskProfile &GetProfile() const { return profile_; }
+
+ private:
+  /** Sleep for one I/O of the given size with the given mean latency. */
+  void SimulateIO(std::chrono::microseconds latency, int size);
+
+  /** @return a latency drawn from the configured distribution */
+  std::chrono::microseconds DrawLatency(std::chrono::microseconds mean);
+
+  DiskProfile profile_;
+
+  /** Protects the generator and the device clock. */
+  std::mutex device_latch_;
+  std::mt19937 generator_;
+  /** The time at which the device has finished all the transfers issued so far. */
+  std::chrono::steady_clock::time_point device_free_at_;
+
+  /** Protects pages_. */
+  std::mutex pages_latch_;
+  std::unordered_map<page_id_t, std::unique_ptr<char[]>> pages_;
+
+  /** Protects log_start_, log_, log_streams_ and master_. */
+  std::mutex log_latch_;
+  /** The log offset of log_[0], everything before it was truncated. */
+  int64_t log_start_{0};
+  std::vector<char> log_;
+  /** The log streams by id, ordered so that GetLogStreams lists them in order. */
+  std::map<int, std::vector<char>> log_streams_;
+  std::vector<char> master_;
+};
+
+}  // namespace bustub
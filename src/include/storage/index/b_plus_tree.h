@@ -10,12 +10,17 @@
 //===----------------------------------------------------------------------===//
 #pragma once
 
+#include <optional>
 #include <queue>
 #include <shared_mutex>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "common/util/hash_util.h"
+#include "concurrency/lock_manager.h"
 #include "concurrency/transaction.h"
+#include "recovery/log_manager.h"
 #include "storage/index/index_iterator.h"
 #include "storage/page/b_plus_tree_internal_page.h"
 #include "storage/page/b_plus_tree_leaf_page.h"
@@ -35,6 +40,23 @@ enum class OP_TYPE { READ, INSERT, DELETE };
  * (2) support insert & remove
  * (3) The structure should shrink and grow dynamically
  * (4) Implement index iterator for range scan
+ *
+ * Given a log manager, every page change is logged ahead, see LogRecovery.
+ * Leaf entries inserted or removed on behalf of a transaction are undone if it
+ * does not finish, while splits, merges and root changes are redo only.
+ *
+ * Given a lock manager, transactions lock the keys they read and write, so that
+ * range scans are serializable without a table lock (next-key locking). A lock
+ * on a key also covers the gap between the previous key and it, and a lock on
+ * the end of the tree covers the gap after the last key:
+ * - a scan, or a lookup, takes a shared lock on every key it reaches, and on the
+ *   first key after the range it reads, or on the end of the tree;
+ * - Insert and Remove take exclusive locks on their key and on the next one,
+ *   since they change the gap that one covers.
+ * Writers into different gaps thus never wait for each other. The locks are
+ * taken holding no latch, and the next key is checked again once locked, as it
+ * may have changed while waiting. Like the tuples of a table, keys are only
+ * locked when logging is on, and snapshot and optimistic reads take no locks.
  */
 INDEX_TEMPLATE_ARGUMENTS
 class BPlusTree {
@@ -43,11 +65,23 @@ class BPlusTree {
 
  public:
   explicit BPlusTree(std::string name, BufferPoolManager *buffer_pool_manager, const KeyComparator &comparator,
-                     int leaf_max_size = LEAF_PAGE_SIZE, int internal_max_size = INTERNAL_PAGE_SIZE);
+                     int leaf_max_size = LEAF_PAGE_SIZE, int internal_max_size = INTERNAL_PAGE_SIZE,
+                     LogManager *log_manager = nullptr, LockManager *lock_manager = nullptr);
 
   // Returns true if this B+ tree has no keys and values.
   bool IsEmpty() const;
 
+  // Open a tree that is already on disk, e.g. after a restart, by reading its
+  // root page id from the header page. Returns false if there is no record of it.
+  bool LoadRootPageId();
+
+  // Undo a leaf entry of a transaction that did not finish, for recovery: take
+  // an entry it inserted out of the tree, or put one it removed back
+  // (reinsert). Splits and merges are never undone and may have moved the entry
+  // off the page it was logged on, so it goes by key, see
+  // LogRecovery::RegisterIndex.
+  void UndoLeafEntry(const char *entry, bool reinsert);
+
   // Insert a key-value pair into this B+ tree.
   bool Insert(const KeyType &key, const ValueType &value, Transaction *transaction = nullptr);
 
@@ -57,9 +91,10 @@ class BPlusTree {
   // return the value associated with a given key
   bool GetValue(const KeyType &key, std::vector<ValueType> *result, Transaction *transaction = nullptr);
 
-  // index iterator
-  INDEXITERATOR_TYPE begin();
-  INDEXITERATOR_TYPE Begin(const KeyType &key);
+  // index iterator, locking the keys it reaches on behalf of the transaction if
+  // one is given. A locking scan ends early if the transaction is aborted.
+  INDEXITERATOR_TYPE begin(Transaction *transaction = nullptr);
+  INDEXITERATOR_TYPE Begin(const KeyType &key, Transaction *transaction = nullptr);
   INDEXITERATOR_TYPE end();
 
   void Print(BufferPoolManager *bpm) {
@@ -83,7 +118,7 @@ class BPlusTree {
   Page *FindLeafPage(const KeyType &key, bool left_most = false);
 
  public:
-  void StartNewTree(const KeyType &key, const ValueType &value);
+  void StartNewTree(const KeyType &key, const ValueType &value, Transaction *transaction = nullptr);
 
   bool InsertIntoLeaf(const KeyType &key, const ValueType &value, Transaction *transaction = nullptr);
 
@@ -108,11 +143,49 @@ class BPlusTree {
   void TryUnlatchRoot(const OP_TYPE &op_type);
   void ReleaseAllPages(Transaction *transaction);
   void FreeAllPages(Transaction *transaction);
-  Page *FindLeafPageCrabbing(const KeyType &key, Transaction *transaction, const OP_TYPE &op_type);
+  Page *FindLeafPageCrabbing(const KeyType &key, Transaction *transaction, const OP_TYPE &op_type,
+                             bool left_most = false);
   Page *FindLeafPageOptimistic(const KeyType &key, Transaction *transaction);
 
   void UpdateRootPageId(int insert_record = 0);
 
+  // Log the entries [index, index + num_entries) of a node, after they are
+  // inserted or before they are removed. Without a transaction the record is
+  // redo only.
+  void LogEntries(LogRecordType type, BPlusTreePage *node, int index, int num_entries,
+                  Transaction *transaction = nullptr);
+  // Log size bytes of a node starting at offset, after they are written.
+  void LogWrite(BPlusTreePage *node, size_t offset, size_t size);
+  void LogHeader(BPlusTreePage *node) { LogWrite(node, 0, node->GetHeaderSize()); }
+  void LogEntryWrite(BPlusTreePage *node, int index);
+  // Log the new parent page id of the children [index, index + num_entries) of a node.
+  void LogAdoptedChildren(InternalPage *node, int index, int num_entries);
+  bool IsLogging() const { return enable_logging && log_manager_ != nullptr; }
+  static size_t EntrySize(BPlusTreePage *node) {
+    return node->IsLeafPage() ? sizeof(MappingType) : sizeof(std::pair<KeyType, page_id_t>);
+  }
+
+  // Key-range locking, see the class comment.
+  // Returns true if the transaction locks the keys it accesses in the given mode.
+  bool LocksKeys(Transaction *transaction, LockMode lock_mode) const;
+  // The lock name of a key, nullptr standing for the end of the tree. Keys that
+  // are equal have the same bytes, so the name is their hash, in a page id space
+  // of their own; two keys sharing a name only lock more than needed.
+  RID KeyLock(const KeyType *key) const;
+  bool LockKey(const RID &lock, LockMode lock_mode, Transaction *transaction);
+  // Returns the first entry at or after key (after it if !inclusive), from the
+  // start of the tree if key is nullptr, or nothing at the end of the tree.
+  std::optional<MappingType> FindNextKey(const KeyType *key, bool inclusive);
+  // Lock the key FindNextKey finds, or the end of the tree, until it is the one
+  // FindNextKey still finds. Returns false if the lock is not granted.
+  bool LockNextKey(const KeyType *key, bool inclusive, LockMode lock_mode, Transaction *transaction,
+                   std::optional<MappingType> *next);
+  // Lock a key about to be inserted or removed and the gap it is in.
+  bool LockGap(const KeyType &key, Transaction *transaction);
+  // Move a locking iterator to the next key it locks.
+  void SeekLocked(INDEXITERATOR_TYPE *iterator, const KeyType *key, bool inclusive);
+  INDEXITERATOR_TYPE BeginLocked(const KeyType *key, Transaction *transaction);
+
   /* Debug Routines for FREE!! */
   void ToGraph(BPlusTreePage *page, BufferPoolManager *bpm, std::ofstream &out) const;
 
@@ -125,6 +198,12 @@ class BPlusTree {
   KeyComparator comparator_;
   int leaf_max_size_;
   int internal_max_size_;
+  LogManager *log_manager_;
+  LockManager *lock_manager_;
+  // the hash of the index name, which the lock names of its keys start from.
+  hash_t name_hash_;
+  // the page id of the lock names of keys, which no page has.
+  static constexpr page_id_t KEY_LOCK_PAGE_ID = -2;
   // reader-writer latch.
   mutable std::shared_mutex root_latch_;
   static thread_local uint32_t root_latch_cnt_;
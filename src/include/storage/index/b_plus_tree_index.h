@@ -25,7 +25,8 @@ namespace bustub {
 INDEX_TEMPLATE_ARGUMENTS
 class BPlusTreeIndex : public Index {
  public:
-  BPlusTreeIndex(IndexMetadata *metadata, BufferPoolManager *buffer_pool_manager);
+  BPlusTreeIndex(IndexMetadata *metadata, BufferPoolManager *buffer_pool_manager, LogManager *log_manager = nullptr,
+                 LockManager *lock_manager = nullptr);
 
   void InsertEntry(const Tuple &key, RID rid, Transaction *transaction) override;
 
@@ -33,9 +34,9 @@ class BPlusTreeIndex : public Index {
 
   void ScanKey(const Tuple &key, std::vector<RID> *result, Transaction *transaction) override;
 
-  INDEXITERATOR_TYPE GetBeginIterator();
+  INDEXITERATOR_TYPE GetBeginIterator(Transaction *transaction = nullptr);
 
-  INDEXITERATOR_TYPE GetBeginIterator(const KeyType &key);
+  INDEXITERATOR_TYPE GetBeginIterator(const KeyType &key, Transaction *transaction = nullptr);
 
   INDEXITERATOR_TYPE GetEndIterator();
 
@@ -19,8 +19,21 @@ namespace bustub {
 
 #define INDEXITERATOR_TYPE IndexIterator<KeyType, ValueType, KeyComparator>
 
+class Transaction;
+
+INDEX_TEMPLATE_ARGUMENTS
+class BPlusTree;
+
+/**
+ * An iterator over the entries of a B+ tree in key order.
+ *
+ * The iterator of a scan on behalf of a transaction that locks keys holds no page: it takes the shared lock on every
+ * key it reaches, and on the end of the tree, and keeps a copy of the entry. See BPlusTree::Begin.
+ */
 INDEX_TEMPLATE_ARGUMENTS
 class IndexIterator {
+  friend class BPlusTree<KeyType, ValueType, KeyComparator>;
+
  public:
   explicit IndexIterator(B_PLUS_TREE_LEAF_PAGE_TYPE *leaf_page, int index, BufferPoolManager *bpm, bool is_end = false);
   ~IndexIterator();
@@ -40,6 +53,11 @@ class IndexIterator {
   int index_{0};
   BufferPoolManager *bpm_{nullptr};
   bool is_end_;
+  /** The tree and the transaction of a locking scan, nullptr otherwise. */
+  BPlusTree<KeyType, ValueType, KeyComparator> *tree_{nullptr};
+  Transaction *txn_{nullptr};
+  /** The current entry of a locking scan. */
+  MappingType item_;
 };
 
 }  // namespace bustub
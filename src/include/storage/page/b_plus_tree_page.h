@@ -62,6 +62,16 @@ class BPlusTreePage {
 
   void SetLSN(lsn_t lsn = INVALID_LSN);
 
+  /*
+   * Raw access to the entries, for logging and recovery which do not know the
+   * key type. Entries are entry_size bytes long and start right after the
+   * header of the leaf or internal page.
+   */
+  size_t GetHeaderSize() const;
+  char *EntryAt(int index, size_t entry_size);
+  void InsertEntries(int index, const char *entries, int num_entries, size_t entry_size);
+  void RemoveEntries(int index, int num_entries, size_t entry_size);
+
  private:
   // member variable, attributes that both internal and leaf page share
   IndexPageType page_type_;
@@ -86,6 +86,13 @@ class Page {
   int pin_count_ = 0;
   /** True if the page is dirty, i.e. it is different from its corresponding page on disk. */
   bool is_dirty_ = false;
+  /**
+   * No log record older than the recovery LSN has changed the page since it was last written to disk. INVALID_LSN if
+   * the page is neither dirty nor pinned, i.e. it cannot differ from the page on disk.
+   */
+  lsn_t rec_lsn_ = INVALID_LSN;
+  /** True while on-demand recovery brings the page up to date. Nobody else may use the page meanwhile. */
+  bool is_recovering_ = false;
   /** Page latch. */
   ReaderWriterLatch rwlatch_;
 };
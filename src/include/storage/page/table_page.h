@@ -13,6 +13,7 @@
 #pragma once
 
 #include <cstring>
+#include <vector>
 
 #include "common/rid.h"
 #include "concurrency/lock_manager.h"
@@ -40,6 +41,8 @@ namespace bustub {
  *  | TupleCount (4) | Tuple_1 offset (4) | Tuple_1 size (4) | ... |
  *  ----------------------------------------------------------------
  *
+ * Changes without a transaction are neither logged nor locked: they are recovery replaying the log, which may run
+ * on demand while new transactions log theirs.
  */
 class TablePage : public Page {
  public:
@@ -79,9 +82,11 @@ class TablePage : public Page {
    * @param txn transaction performing the insert
    * @param lock_manager the lock manager
    * @param log_manager the log manager
+   * @param table_oid the table the page belongs to, see LockManager
    * @return true if the insert is successful (i.e. there is enough space)
    */
-  bool InsertTuple(const Tuple &tuple, RID *rid, Transaction *txn, LockManager *lock_manager, LogManager *log_manager);
+  bool InsertTuple(const Tuple &tuple, RID *rid, Transaction *txn, LockManager *lock_manager, LogManager *log_manager,
+                   table_oid_t table_oid = INVALID_TABLE_OID);
 
   /**
    * Mark a tuple as deleted. This does not actually delete the tuple.
@@ -89,9 +94,11 @@ class TablePage : public Page {
    * @param txn transaction performing the delete
    * @param lock_manager the lock manager
    * @param log_manager the log manager
+   * @param table_oid the table the page belongs to, see LockManager
    * @return true if marking the tuple as deleted is successful (i.e the tuple exists)
    */
-  bool MarkDelete(const RID &rid, Transaction *txn, LockManager *lock_manager, LogManager *log_manager);
+  bool MarkDelete(const RID &rid, Transaction *txn, LockManager *lock_manager, LogManager *log_manager,
+                  table_oid_t table_oid = INVALID_TABLE_OID);
 
   /**
    * Update a tuple.
@@ -101,14 +108,31 @@ class TablePage : public Page {
    * @param txn transaction performing the update
    * @param lock_manager the lock manager
    * @param log_manager the log manager
+   * @param table_oid the table the page belongs to, see LockManager
    * @return true if updating the tuple succeeded
    */
   bool UpdateTuple(const Tuple &new_tuple, Tuple *old_tuple, const RID &rid, Transaction *txn,
-                   LockManager *lock_manager, LogManager *log_manager);
+                   LockManager *lock_manager, LogManager *log_manager, table_oid_t table_oid = INVALID_TABLE_OID);
+
+  /**
+   * Overwrite part of a tuple in place, keeping its size. This is not logged: it replays an UPDATE_DELTA record
+   * during recovery.
+   * @param rid rid of the tuple
+   * @param offset where the bytes go in the tuple
+   * @param data the new bytes
+   * @param size the number of bytes
+   */
+  void WriteTupleBytes(const RID &rid, uint32_t offset, const char *data, uint32_t size);
 
   /** To be called on commit or abort. Actually perform the delete or rollback an insert. */
   void ApplyDelete(const RID &rid, Transaction *txn, LogManager *log_manager);
 
+  /**
+   * To be called on commit. Perform the deletes of several tuples of this page, compacting the page once for all of
+   * them. The page ends up as if ApplyDelete was called for each tuple, and the same log records are written.
+   */
+  void ApplyDeletes(const std::vector<RID> &rids, Transaction *txn, LogManager *log_manager);
+
   /** To be called on abort. Rollback a delete, i.e. this reverses a MarkDelete. */
   void RollbackDelete(const RID &rid, Transaction *txn, LogManager *log_manager);
 
@@ -118,24 +142,36 @@ class TablePage : public Page {
    * @param[out] tuple the tuple that was read
    * @param txn transaction performing the read
    * @param lock_manager the lock manager
+   * @param table_oid the table the page belongs to, see LockManager
    * @return true if the read is successful (i.e. the tuple exists)
    */
-  bool GetTuple(const RID &rid, Tuple *tuple, Transaction *txn, LockManager *lock_manager);
+  bool GetTuple(const RID &rid, Tuple *tuple, Transaction *txn, LockManager *lock_manager,
+                table_oid_t table_oid = INVALID_TABLE_OID);
+
+  /**
+   * Read a tuple without locking it, for snapshot reads that look up the visible version in a VersionStore.
+   * @param rid rid of the tuple to read
+   * @param[out] tuple the tuple that was read, left alone if there is none
+   * @return true if the slot holds a tuple that is not deleted
+   */
+  bool ReadTuple(const RID &rid, Tuple *tuple);
 
   /** @return the rid of the first tuple in this page */
 
   /**
    * @param[out] first_rid the RID of the first tuple in this page
+   * @param include_deleted also return the slots of deleted tuples, which snapshots may still see
    * @return true if the first tuple exists, false otherwise
    */
-  bool GetFirstTupleRid(RID *first_rid);
+  bool GetFirstTupleRid(RID *first_rid, bool include_deleted = false);
 
   /**
    * @param cur_rid the RID of the current tuple
    * @param[out] next_rid the RID of the tuple following the current tuple
+   * @param include_deleted also return the slots of deleted tuples, which snapshots may still see
    * @return true if the next tuple exists, false otherwise
    */
-  bool GetNextTupleRid(const RID &cur_rid, RID *next_rid);
+  bool GetNextTupleRid(const RID &cur_rid, RID *next_rid, bool include_deleted = false);
 
  private:
   static_assert(sizeof(page_id_t) == 4);
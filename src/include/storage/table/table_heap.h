@@ -12,7 +12,11 @@
 
 #pragma once
 
+#include <functional>
+#include <vector>
+
 #include "buffer/buffer_pool_manager.h"
+#include "concurrency/version_store.h"
 #include "recovery/log_manager.h"
 #include "storage/page/table_page.h"
 #include "storage/table/table_iterator.h"
@@ -23,6 +27,10 @@ namespace bustub {
 /**
  * TableHeap represents a physical table on disk.
  * This is just a doubly-linked list of pages.
+ *
+ * The pages hold the newest version of every tuple and the version store the older ones. Transactions under
+ * SNAPSHOT_ISOLATION read the versions of their snapshot without taking any lock. Optimistic transactions read the
+ * newest committed versions without locks too, and defer their updates and deletes to their commit.
  */
 class TableHeap {
   friend class TableIterator;
@@ -36,9 +44,10 @@ class TableHeap {
    * @param lock_manager the lock manager
    * @param log_manager the log manager
    * @param first_page_id the id of the first page
+   * @param table_oid the oid of the table, under which its tuples are locked, or INVALID_TABLE_OID to lock only tuples
    */
   TableHeap(BufferPoolManager *buffer_pool_manager, LockManager *lock_manager, LogManager *log_manager,
-            page_id_t first_page_id);
+            page_id_t first_page_id, table_oid_t table_oid = INVALID_TABLE_OID);
 
   /**
    * Create a table heap with a transaction. (create table)
@@ -46,9 +55,10 @@ class TableHeap {
    * @param lock_manager the lock manager
    * @param log_manager the log manager
    * @param txn the creating transaction
+   * @param table_oid the oid of the table, under which its tuples are locked, or INVALID_TABLE_OID to lock only tuples
    */
   TableHeap(BufferPoolManager *buffer_pool_manager, LockManager *lock_manager, LogManager *log_manager,
-            Transaction *txn);
+            Transaction *txn, table_oid_t table_oid = INVALID_TABLE_OID);
 
   /**
    * Insert a tuple into the table. If the tuple is too large (>= page_size), return false.
@@ -60,7 +70,8 @@ class TableHeap {
   bool InsertTuple(const Tuple &tuple, RID *rid, Transaction *txn);
 
   /**
-   * Mark the tuple as deleted. The actual delete will occur when ApplyDelete is called.
+   * Mark the tuple as deleted. The actual delete will occur when ApplyDelete is called. A running optimistic
+   * transaction only checks that the tuple exists, and marks it when it commits.
    * @param rid resource id of the tuple of delete
    * @param txn transaction performing the delete
    * @return true iff the delete is successful (i.e the tuple exists)
@@ -69,6 +80,7 @@ class TableHeap {
 
   /**
    * if the new tuple is too large to fit in the old page, return false (will delete and insert)
+   * A running optimistic transaction only checks that the tuple exists, and updates it when it commits.
    * @param tuple new tuple
    * @param rid rid of the old tuple
    * @param txn transaction performing the update
@@ -76,6 +88,14 @@ class TableHeap {
    */
   bool UpdateTuple(const Tuple &tuple, const RID &rid, Transaction *txn);
 
+  /**
+   * Called on the commit of an optimistic transaction to apply a write it deferred, see UpdateTuple and MarkDelete.
+   * @param write the deferred write, which is for this table
+   * @param txn the committing transaction
+   * @return true if the write is successful
+   */
+  bool ApplyDeferredWrite(const TableWriteRecord &write, Transaction *txn);
+
   /**
    * Called on Commit/Abort to actually delete a tuple or rollback an insert.
    * @param rid rid of the tuple to delete
@@ -91,7 +111,22 @@ class TableHeap {
   void RollbackDelete(const RID &rid, Transaction *txn);
 
   /**
-   * Read a tuple from the table.
+   * Called on Commit to actually delete the tuples txn marked as deleted, latching each page once for all its tuples.
+   * @param writes the DELETE records of the write set of txn on this table
+   * @param txn the committing transaction
+   */
+  void ApplyDeletes(const std::vector<const TableWriteRecord *> &writes, Transaction *txn);
+
+  /**
+   * Called on Abort to roll back the writes of txn on this table, latching each page once for all its tuples.
+   * @param writes the records of the write set of txn on this table, newest first
+   * @param txn the aborting transaction
+   */
+  void RollbackWrites(const std::vector<const TableWriteRecord *> &writes, Transaction *txn);
+
+  /**
+   * Read a tuple from the table, the version of its snapshot under SNAPSHOT_ISOLATION. An optimistic transaction reads
+   * its own writes, or else the newest committed version, which it validates when it commits.
    * @param rid rid of the tuple to read
    * @param tuple output variable for the tuple
    * @param txn transaction performing the read
@@ -108,11 +143,75 @@ class TableHeap {
   /** @return the id of the first page of this table */
   inline page_id_t GetFirstPageId() const { return first_page_id_; }
 
+  /** @return the oid of this table */
+  inline table_oid_t GetTableOid() const { return table_oid_; }
+
+  /** @return the older versions of the tuples of this table */
+  inline VersionStore *GetVersionStore() { return &version_store_; }
+
  private:
+  /**
+   * Take an intention lock on the table before latching a page, so that waiting for it never holds a page latch.
+   * @return false if the lock could not be granted
+   */
+  bool LockTable(Transaction *txn, LockMode lock_mode);
+
+  /**
+   * Lock a tuple before latching its page, so that waiting for the lock, or being aborted on a deadlock, never holds a
+   * page latch. A tuple about to be written is locked exclusively, so that the version store only ever sees the
+   * writer holding the lock.
+   * @param lock_mode SHARED or EXCLUSIVE
+   * @return false if the lock could not be granted
+   */
+  bool LockTuple(Transaction *txn, const RID &rid, LockMode lock_mode);
+
+  /**
+   * Apply the given writes page by page, with each page fetched and latched once.
+   * @param apply called with each page and its writes, in the order given, which keeps the order of the writes of
+   * each tuple
+   */
+  void ApplyByPage(std::vector<const TableWriteRecord *> writes,
+                   const std::function<void(TablePage *, const std::vector<const TableWriteRecord *> &)> &apply);
+
+  /** Update a tuple on its page, see UpdateTuple. */
+  bool UpdateTupleOnPage(const Tuple &tuple, const RID &rid, Transaction *txn);
+
+  /** Mark a tuple as deleted on its page, see MarkDelete. */
+  bool MarkDeleteOnPage(const RID &rid, Transaction *txn);
+
+  /** @return true if txn defers its writes to its commit, i.e. it is a running optimistic transaction */
+  static bool DefersWrites(Transaction *txn) {
+    return txn->GetConcurrencyControl() == ConcurrencyControl::OPTIMISTIC &&
+           txn->GetState() == TransactionState::GROWING;
+  }
+
+  /**
+   * Defer an update or a delete of an optimistic transaction to its commit.
+   * @return false if the tuple does not exist for txn
+   */
+  bool DeferWrite(const RID &rid, WType wtype, const Tuple &tuple, Transaction *txn);
+
+  /** @return the last write txn deferred on a tuple of this table, nullptr if none */
+  const TableWriteRecord *FindDeferredWrite(const RID &rid, Transaction *txn);
+
+  /** @return true if txn reads versions instead of locking, so that scans also visit the deleted tuples */
+  static bool ReadsVersions(Transaction *txn) {
+    return txn->GetIsolationLevel() == IsolationLevel::SNAPSHOT_ISOLATION ||
+           txn->GetConcurrencyControl() == ConcurrencyControl::OPTIMISTIC;
+  }
+
+  /**
+   * Keep the version of a tuple that txn is about to update or delete. The caller holds the write latch of the page.
+   * @return false on a write-write conflict, in which case txn is aborted
+   */
+  bool BeginWrite(TablePage *page, const RID &rid, Transaction *txn);
+
   BufferPoolManager *buffer_pool_manager_;
   LockManager *lock_manager_;
   LogManager *log_manager_;
   page_id_t first_page_id_{};
+  table_oid_t table_oid_;
+  VersionStore version_store_;
 };
 
 }  // namespace bustub
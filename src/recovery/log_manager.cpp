@@ -22,33 +22,516 @@ namespace bustub {
  *
  * This thread runs forever until system shutdown/StopFlushThread
  */
-void LogManager::RunFlushThread() {}
+void LogManager::RunFlushThread() {
+  if (IsFlushThreadRunning()) {
+    return;
+  }
+  if (GetNextLSN() == 0) {
+    ResumeLog();
+  }
+  enable_logging = true;
+  if (IsStriped()) {
+    for (auto &stream : streams_) {
+      stream->thread_ = std::thread(&LogManager::StreamFlushThread, this, stream.get());
+    }
+    return;
+  }
+  {
+    // new records go after whatever is in the log by now, recovery may have added to it.
+    std::scoped_lock<std::mutex> lck{latch_};
+    log_offset_ = disk_manager_->GetLogSize();
+  }
+  flush_thread_ = new std::thread(&LogManager::FlushThread, this);
+}
 
 /*
  * Stop and join the flush thread, set enable_logging = false
+ * Everything appended before the call is flushed before the thread exits.
  */
-void LogManager::StopFlushThread() {}
+void LogManager::StopFlushThread() {
+  if (!IsFlushThreadRunning()) {
+    return;
+  }
+  {
+    std::scoped_lock<std::mutex> lck{latch_};
+    enable_logging = false;
+  }
+  if (IsStriped()) {
+    for (auto &stream : streams_) {
+      RequestStreamFlush(stream.get());
+      stream->thread_.join();
+    }
+    return;
+  }
+  cv_.notify_one();
+  flush_thread_->join();
+  delete flush_thread_;
+  flush_thread_ = nullptr;
+}
+
+void LogManager::ResumeLog() {
+  // the master record points at a record boundary, everything before it has smaller lsns.
+  MasterRecord master{};
+  int64_t offset = 0;
+  lsn_t last_lsn = INVALID_LSN;
+  if (disk_manager_->ReadMasterRecord(reinterpret_cast<char *>(&master), sizeof(master))) {
+    offset = master.checkpoint_offset_;
+    last_lsn = master.last_lsn_;
+  }
+
+  // only the record headers are needed. A record cut by the end of a chunk is read again at the start of the next.
+  auto buffer = std::make_unique<char[]>(LOG_BUFFER_SIZE);
+  bool end_of_log = false;
+  while (!end_of_log && disk_manager_->ReadLog(buffer.get(), LOG_BUFFER_SIZE, offset)) {
+    int pos = 0;
+    while (pos + LogRecord::HEADER_SIZE <= LOG_BUFFER_SIZE) {
+      int32_t size;
+      memcpy(&size, buffer.get() + pos, sizeof(int32_t));
+      // the log is zero-padded past its end.
+      if (size < LogRecord::HEADER_SIZE) {
+        end_of_log = true;
+        break;
+      }
+      if (pos + size > LOG_BUFFER_SIZE) {
+        break;
+      }
+      lsn_t lsn;
+      memcpy(&lsn, buffer.get() + pos + 4, sizeof(lsn_t));
+      last_lsn = std::max(last_lsn, lsn);
+      pos += size;
+    }
+    end_of_log = end_of_log || pos == 0;
+    offset += pos;
+  }
+
+  std::scoped_lock<std::mutex> lck{latch_};
+  reserve_state_ = PackState(last_lsn + 1, 0);
+  next_lsn_ = last_lsn + 1;
+  flushed_lsn_ = last_lsn + 1;
+  persistent_lsn_ = last_lsn;
+  // the streams have nothing to flush yet, they must not hold back the persistent lsn until they do.
+  for (auto &stream : streams_) {
+    stream->durable_lsn_ = last_lsn;
+  }
+}
+
+void LogManager::FlushThread() {
+  std::unique_lock<std::mutex> lck{latch_};
+  while (true) {
+    cv_.wait_for(lck, log_timeout, [&] { return flush_requested_ || !enable_logging; });
+    const bool stop = !enable_logging;
+    flush_requested_ = false;
+
+    uint64_t state = reserve_state_.load();
+    if (StateOffset(state) > 0) {
+      // seal the buffer: no reservation is handed out until the buffers are swapped.
+      while (!reserve_state_.compare_exchange_weak(state, state | SEALED)) {
+      }
+      const lsn_t next_lsn = StateLSN(state);
+      const int flush_size = static_cast<int>(StateOffset(state));
+      // wait for the appenders that got their space before the seal to finish serializing.
+      while (completed_.load(std::memory_order_acquire) != flush_size) {
+        std::this_thread::yield();
+      }
+
+      // swap the buffers so that appenders can go on while the full one is written.
+      std::swap(log_buffer_, flush_buffer_);
+      completed_.store(0, std::memory_order_relaxed);
+      reserve_state_.store(PackState(next_lsn, 0));
+      // appenders waiting for space may go on now.
+      flushed_cv_.notify_all();
+
+      // remember where the batch goes in the log file, for checkpoints.
+      flush_index_.emplace_back(flushed_lsn_, log_offset_);
+      flushed_lsn_ = next_lsn;
+      log_offset_ += flush_size;
+
+      lck.unlock();
+      disk_manager_->WriteLog(flush_buffer_, flush_size);
+      lck.lock();
+
+      persistent_lsn_ = next_lsn - 1;
+      flushed_cv_.notify_all();
+    }
+
+    if (stop) {
+      break;
+    }
+  }
+}
+
+void LogManager::StreamFlushThread(LogStream *stream) {
+  std::unique_lock<std::mutex> lck{stream->latch_};
+  while (true) {
+    stream->cv_.wait_for(lck, log_timeout, [&] { return stream->flush_requested_ || !enable_logging; });
+    const bool stop = !enable_logging;
+    stream->flush_requested_ = false;
+
+    // new reservations wait for the latch. Even with an empty buffer, this tells which lsns the stream can no longer
+    // get.
+    const auto flush_size = static_cast<int>(stream->reserved_);
+    while (stream->completed_.load(std::memory_order_acquire) != flush_size) {
+      std::this_thread::yield();
+    }
+    // every record reserved from now on takes its lsn after this point.
+    const lsn_t durable_lsn = next_lsn_.load() - 1;
+    if (flush_size > 0) {
+      std::swap(stream->log_buffer_, stream->flush_buffer_);
+      stream->completed_.store(0, std::memory_order_relaxed);
+    }
+    stream->reserved_ = 0;
+    stream->flushed_cv_.notify_all();
+
+    lck.unlock();
+    disk_manager_->WriteLogStream(stream->id_, stream->flush_buffer_, flush_size);
+    {
+      std::scoped_lock<std::mutex> log_lck{latch_};
+      stream->durable_lsn_ = durable_lsn;
+      lsn_t persistent_lsn = durable_lsn;
+      for (const auto &other : streams_) {
+        persistent_lsn = std::min(persistent_lsn, other->durable_lsn_);
+      }
+      persistent_lsn_ = persistent_lsn;
+    }
+    flushed_cv_.notify_all();
+    lck.lock();
+
+    if (stop) {
+      break;
+    }
+  }
+}
+
+char *LogManager::Reserve(int size, txn_id_t txn_id, lsn_t *lsn) {
+  BUSTUB_ASSERT(size <= LOG_BUFFER_SIZE, "Log record larger than the log buffer.");
+  if (IsStriped()) {
+    return ReserveInStream(PickStream(txn_id), size, lsn);
+  }
+  uint64_t state = reserve_state_.load();
+  while (true) {
+    if (HasRoom(state, size)) {
+      // fast path: claim the lsn and the bytes at once.
+      const uint32_t offset = StateOffset(state);
+      if (reserve_state_.compare_exchange_weak(state, PackState(StateLSN(state) + 1, offset + size))) {
+        *lsn = StateLSN(state);
+        return log_buffer_ + offset;
+      }
+      continue;
+    }
+
+    // slow path: the buffer is full or being swapped, wake up the flush thread and wait for a fresh buffer. Other
+    // appenders may fill the fresh buffer first, so look again once the flush thread took the request.
+    std::unique_lock<std::mutex> lck{latch_};
+    flush_requested_ = true;
+    cv_.notify_one();
+    flushed_cv_.wait(lck, [&] {
+      state = reserve_state_.load();
+      return HasRoom(state, size) || !flush_requested_;
+    });
+  }
+}
+
+char *LogManager::ReserveInStream(LogStream *stream, int size, lsn_t *lsn) {
+  // the space and the lsn are taken together, so that the records of a stream are in lsn order.
+  std::unique_lock<std::mutex> lck{stream->latch_};
+  while (stream->reserved_ + size > static_cast<uint32_t>(LOG_BUFFER_SIZE)) {
+    // the buffer is full, wake up the stream's flush thread and wait for a fresh buffer. Ask again if others filled
+    // the fresh one first.
+    stream->flush_requested_ = true;
+    stream->cv_.notify_one();
+    stream->flushed_cv_.wait(lck);
+  }
+  char *dest = stream->log_buffer_ + stream->reserved_;
+  stream->reserved_ += size;
+  *lsn = next_lsn_.fetch_add(1);
+  return dest;
+}
 
 /*
  * append a log record into log buffer
  * you MUST set the log record's lsn within this method
  * @return: lsn that is assigned to this log record
  *
- *
- * example below
- * // First, serialize the must have fields(20 bytes in total)
- * log_record.lsn_ = next_lsn_++;
- * memcpy(log_buffer_ + offset_, &log_record, 20);
- * int pos = offset_ + 20;
- *
- * if (log_record.log_record_type_ == LogRecordType::INSERT) {
- *    memcpy(log_buffer_ + pos, &log_record.insert_rid_, sizeof(RID));
- *    pos += sizeof(RID);
- *    // we have provided serialize function for tuple class
- *    log_record.insert_tuple_.SerializeTo(log_buffer_ + pos);
- *  }
- *
+ * The lsn and the space are reserved without the latch, see the class comment.
  */
-lsn_t LogManager::AppendLogRecord(LogRecord *log_record) { return INVALID_LSN; }
+lsn_t LogManager::AppendLogRecord(LogRecord *log_record) {
+  char *dest = Reserve(log_record->GetSize(), log_record->txn_id_, &log_record->lsn_);
+  SerializeLogRecord(*log_record, dest);
+  CompleteReservation(log_record->GetSize(), log_record->txn_id_);
+  return log_record->lsn_;
+}
+
+lsn_t LogManager::AppendTupleLogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type, const RID &rid,
+                                       const char *data, uint32_t size) {
+  const int32_t record_size = LogRecord::HEADER_SIZE + sizeof(RID) + sizeof(int32_t) + size;
+  lsn_t lsn;
+  char *dest = Reserve(record_size, txn_id, &lsn);
+  dest = SerializeHeader(dest, record_size, lsn, txn_id, prev_lsn, log_record_type);
+  memcpy(dest, &rid, sizeof(RID));
+  SerializeTupleData(dest + sizeof(RID), data, size);
+  CompleteReservation(record_size, txn_id);
+  return lsn;
+}
+
+lsn_t LogManager::AppendUpdateLogRecord(txn_id_t txn_id, lsn_t prev_lsn, const RID &rid, const char *old_data,
+                                        uint32_t old_size, const char *new_data, uint32_t new_size) {
+  const int32_t record_size = LogRecord::HEADER_SIZE + sizeof(RID) + 2 * sizeof(int32_t) + old_size + new_size;
+  lsn_t lsn;
+  if (old_size == new_size) {
+    std::vector<std::pair<uint32_t, uint32_t>> ranges;
+    const int32_t delta_size = DiffTuples(old_data, new_data, old_size, &ranges);
+    if (delta_size < record_size) {
+      char *dest = Reserve(delta_size, txn_id, &lsn);
+      dest = SerializeHeader(dest, delta_size, lsn, txn_id, prev_lsn, LogRecordType::UPDATE_DELTA);
+      memcpy(dest, &rid, sizeof(RID));
+      dest += sizeof(RID);
+      const auto num_ranges = static_cast<int32_t>(ranges.size());
+      memcpy(dest, &old_size, sizeof(uint32_t));
+      memcpy(dest + sizeof(uint32_t), &num_ranges, sizeof(int32_t));
+      dest += sizeof(uint32_t) + sizeof(int32_t);
+      for (const auto &[offset, length] : ranges) {
+        memcpy(dest, &offset, sizeof(uint32_t));
+        memcpy(dest + sizeof(uint32_t), &length, sizeof(uint32_t));
+        dest += LogRecord::DELTA_RANGE_HEADER_SIZE;
+        memcpy(dest, old_data + offset, length);
+        memcpy(dest + length, new_data + offset, length);
+        dest += 2 * length;
+      }
+      CompleteReservation(delta_size, txn_id);
+      return lsn;
+    }
+  }
+  char *dest = Reserve(record_size, txn_id, &lsn);
+  dest = SerializeHeader(dest, record_size, lsn, txn_id, prev_lsn, LogRecordType::UPDATE);
+  memcpy(dest, &rid, sizeof(RID));
+  dest = SerializeTupleData(dest + sizeof(RID), old_data, old_size);
+  SerializeTupleData(dest, new_data, new_size);
+  CompleteReservation(record_size, txn_id);
+  return lsn;
+}
+
+lsn_t LogManager::AppendIndexLogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type,
+                                       const std::string &index_name, page_id_t page_id, int32_t position,
+                                       const char *entries, uint32_t entry_size, int32_t num_entries) {
+  const uint32_t entries_size = entry_size * num_entries;
+  const auto name_size = static_cast<int32_t>(index_name.size());
+  const int32_t record_size =
+      LogRecord::HEADER_SIZE + sizeof(page_id_t) + 4 * sizeof(int32_t) + entries_size + name_size;
+  lsn_t lsn;
+  char *dest = Reserve(record_size, txn_id, &lsn);
+  dest = SerializeHeader(dest, record_size, lsn, txn_id, prev_lsn, log_record_type);
+  memcpy(dest, &page_id, sizeof(page_id_t));
+  memcpy(dest + sizeof(page_id_t), &position, sizeof(int32_t));
+  memcpy(dest + sizeof(page_id_t) + sizeof(int32_t), &entry_size, sizeof(uint32_t));
+  memcpy(dest + sizeof(page_id_t) + 2 * sizeof(int32_t), &num_entries, sizeof(int32_t));
+  dest += sizeof(page_id_t) + 3 * sizeof(int32_t);
+  memcpy(dest, entries, entries_size);
+  memcpy(dest + entries_size, &name_size, sizeof(int32_t));
+  memcpy(dest + entries_size + sizeof(int32_t), index_name.data(), name_size);
+  CompleteReservation(record_size, txn_id);
+  return lsn;
+}
+
+bool LogManager::WaitUntilPersistent(lsn_t lsn) {
+  std::unique_lock<std::mutex> lck{latch_};
+  // nothing beyond the last assigned lsn can ever become persistent.
+  lsn = std::min(lsn, GetNextLSN() - 1);
+  while (IsFlushThreadRunning() && enable_logging && persistent_lsn_ < lsn) {
+    if (IsStriped()) {
+      // every stream that may still get a record up to lsn has to seal its buffer.
+      for (auto &stream : streams_) {
+        if (stream->durable_lsn_ < lsn) {
+          RequestStreamFlush(stream.get());
+        }
+      }
+    } else {
+      flush_requested_ = true;
+      cv_.notify_one();
+    }
+    flushed_cv_.wait(lck);
+  }
+  return persistent_lsn_ >= lsn;
+}
+
+void LogManager::RequestFlush() {
+  if (IsStriped()) {
+    for (auto &stream : streams_) {
+      RequestStreamFlush(stream.get());
+    }
+    return;
+  }
+  std::scoped_lock<std::mutex> lck{latch_};
+  flush_requested_ = true;
+  cv_.notify_one();
+}
+
+int64_t LogManager::GetLogOffset(lsn_t lsn) {
+  std::scoped_lock<std::mutex> lck{latch_};
+  // the record is in the last batch starting at or before it.
+  auto it = FindBatchAfter(lsn);
+  return it == flush_index_.begin() ? 0 : std::prev(it)->second;
+}
+
+void LogManager::WriteMasterRecord(lsn_t checkpoint_lsn, lsn_t redo_lsn) {
+  MasterRecord master{checkpoint_lsn, GetLogOffset(checkpoint_lsn), GetLogOffset(redo_lsn), checkpoint_lsn};
+  disk_manager_->WriteMasterRecord(reinterpret_cast<const char *>(&master), sizeof(MasterRecord));
+}
+
+void LogManager::TruncateLog(lsn_t lsn) {
+  int64_t offset;
+  {
+    std::scoped_lock<std::mutex> lck{latch_};
+    auto it = FindBatchAfter(lsn);
+    // nothing is known to be older than lsn.
+    if (it == flush_index_.begin()) {
+      return;
+    }
+    --it;
+    offset = it->second;
+    flush_index_.erase(flush_index_.begin(), it);
+  }
+  disk_manager_->TruncateLog(offset);
+}
+
+/*
+ * For EACH log record, HEADER is like (5 fields in common, 20 bytes in total).
+ *---------------------------------------------
+ * | size | LSN | transID | prevLSN | LogType |
+ *---------------------------------------------
+ * The payload follows the header, see log_record.h.
+ */
+void LogManager::SerializeLogRecord(const LogRecord &log_record, char *dest) {
+  char *pos = SerializeHeader(dest, log_record.size_, log_record.lsn_, log_record.txn_id_, log_record.prev_lsn_,
+                              log_record.log_record_type_);
+  auto write = [&](const void *src, size_t size) {
+    memcpy(pos, src, size);
+    pos += size;
+  };
+
+  switch (log_record.log_record_type_) {
+    case LogRecordType::INSERT:
+      write(&log_record.insert_rid_, sizeof(RID));
+      log_record.insert_tuple_.SerializeTo(pos);
+      pos += sizeof(int32_t) + log_record.insert_tuple_.GetLength();
+      break;
+    case LogRecordType::MARKDELETE:
+    case LogRecordType::APPLYDELETE:
+    case LogRecordType::ROLLBACKDELETE:
+      write(&log_record.delete_rid_, sizeof(RID));
+      log_record.delete_tuple_.SerializeTo(pos);
+      pos += sizeof(int32_t) + log_record.delete_tuple_.GetLength();
+      break;
+    case LogRecordType::UPDATE:
+      write(&log_record.update_rid_, sizeof(RID));
+      log_record.old_tuple_.SerializeTo(pos);
+      pos += sizeof(int32_t) + log_record.old_tuple_.GetLength();
+      log_record.new_tuple_.SerializeTo(pos);
+      pos += sizeof(int32_t) + log_record.new_tuple_.GetLength();
+      break;
+    case LogRecordType::UPDATE_DELTA: {
+      write(&log_record.update_rid_, sizeof(RID));
+      write(&log_record.delta_tuple_size_, sizeof(uint32_t));
+      auto num_ranges = static_cast<int32_t>(log_record.delta_ranges_.size());
+      write(&num_ranges, sizeof(int32_t));
+      for (const auto &range : log_record.delta_ranges_) {
+        auto length = static_cast<uint32_t>(range.new_bytes_.size());
+        write(&range.offset_, sizeof(uint32_t));
+        write(&length, sizeof(uint32_t));
+        write(range.old_bytes_.data(), length);
+        write(range.new_bytes_.data(), length);
+      }
+      break;
+    }
+    case LogRecordType::NEWPAGE:
+      write(&log_record.prev_page_id_, sizeof(page_id_t));
+      write(&log_record.page_id_, sizeof(page_id_t));
+      break;
+    case LogRecordType::INDEX_INSERT:
+    case LogRecordType::INDEX_DELETE:
+    case LogRecordType::INDEX_WRITE: {
+      auto num_entries = static_cast<int32_t>(log_record.index_entries_.size() / log_record.index_entry_size_);
+      write(&log_record.page_id_, sizeof(page_id_t));
+      write(&log_record.index_position_, sizeof(int32_t));
+      write(&log_record.index_entry_size_, sizeof(uint32_t));
+      write(&num_entries, sizeof(int32_t));
+      write(log_record.index_entries_.data(), log_record.index_entries_.size());
+      auto name_size = static_cast<int32_t>(log_record.index_name_.size());
+      write(&name_size, sizeof(int32_t));
+      write(log_record.index_name_.data(), name_size);
+      break;
+    }
+    case LogRecordType::INDEX_ROOT: {
+      char name[LogRecord::INDEX_NAME_SIZE] = {};
+      log_record.index_name_.copy(name, LogRecord::INDEX_NAME_SIZE - 1);
+      write(&log_record.page_id_, sizeof(page_id_t));
+      write(name, LogRecord::INDEX_NAME_SIZE);
+      break;
+    }
+    case LogRecordType::END_CHECKPOINT: {
+      auto num_txns = static_cast<int32_t>(log_record.active_txns_.size());
+      write(&num_txns, sizeof(int32_t));
+      for (const auto &[txn_id, last_lsn] : log_record.active_txns_) {
+        write(&txn_id, sizeof(txn_id_t));
+        write(&last_lsn, sizeof(lsn_t));
+      }
+      auto num_pages = static_cast<int32_t>(log_record.dirty_pages_.size());
+      write(&num_pages, sizeof(int32_t));
+      for (const auto &[page_id, rec_lsn] : log_record.dirty_pages_) {
+        write(&page_id, sizeof(page_id_t));
+        write(&rec_lsn, sizeof(lsn_t));
+      }
+      break;
+    }
+    default:
+      break;
+  }
+  BUSTUB_ASSERT(pos - dest == log_record.size_, "Serialized size does not match the log record size.");
+}
+
+char *LogManager::SerializeHeader(char *dest, int32_t size, lsn_t lsn, txn_id_t txn_id, lsn_t prev_lsn,
+                                  LogRecordType log_record_type) {
+  memcpy(dest, &size, sizeof(int32_t));
+  memcpy(dest + 4, &lsn, sizeof(lsn_t));
+  memcpy(dest + 8, &txn_id, sizeof(txn_id_t));
+  memcpy(dest + 12, &prev_lsn, sizeof(lsn_t));
+  memcpy(dest + 16, &log_record_type, sizeof(LogRecordType));
+  return dest + LogRecord::HEADER_SIZE;
+}
+
+char *LogManager::SerializeTupleData(char *dest, const char *data, uint32_t size) {
+  memcpy(dest, &size, sizeof(uint32_t));
+  if (size > 0) {
+    memcpy(dest + sizeof(uint32_t), data, size);
+  }
+  return dest + sizeof(uint32_t) + size;
+}
+
+int32_t LogManager::DiffTuples(const char *old_data, const char *new_data, uint32_t size,
+                               std::vector<std::pair<uint32_t, uint32_t>> *ranges) {
+  int32_t record_size = LogRecord::HEADER_SIZE + sizeof(RID) + 2 * sizeof(int32_t);
+  uint32_t i = 0;
+  while (i < size) {
+    if (old_data[i] == new_data[i]) {
+      i++;
+      continue;
+    }
+    uint32_t end = i + 1;
+    while (end < size && old_data[end] != new_data[end]) {
+      end++;
+    }
+    // a short run of equal bytes is logged as part of the previous range.
+    if (!ranges->empty() &&
+        i - (ranges->back().first + ranges->back().second) < static_cast<uint32_t>(LogRecord::DELTA_RANGE_HEADER_SIZE)) {
+      auto &last = ranges->back();
+      record_size += 2 * (end - last.first - last.second);
+      last.second = end - last.first;
+    } else {
+      ranges->emplace_back(i, end - i);
+      record_size += LogRecord::DELTA_RANGE_HEADER_SIZE + 2 * (end - i);
+    }
+    i = end;
+  }
+  return record_size;
+}
 
 }  // namespace bustub
@@ -12,6 +12,14 @@
 
 #include "recovery/log_recovery.h"
 
+#include <algorithm>
+#include <cstring>
+#include <future>  // NOLINT
+#include <queue>
+#include <unordered_set>
+
+#include "storage/page/b_plus_tree_page.h"
+#include "storage/page/header_page.h"
 #include "storage/page/table_page.h"
 
 namespace bustub {
@@ -20,7 +28,220 @@ namespace bustub {
  * @return: true means deserialize succeed, otherwise can't deserialize cause
  * incomplete log record
  */
-bool LogRecovery::DeserializeLogRecord(const char *data, LogRecord *log_record) { return false; }
+bool LogRecovery::DeserializeLogRecord(const char *data, int size, LogRecord *log_record) {
+  if (size < LogRecord::HEADER_SIZE) {
+    return false;
+  }
+  int32_t record_size;
+  memcpy(&record_size, data, sizeof(int32_t));
+  if (record_size < LogRecord::HEADER_SIZE || record_size > size) {
+    return false;
+  }
+
+  log_record->size_ = record_size;
+  memcpy(&log_record->lsn_, data + 4, sizeof(lsn_t));
+  memcpy(&log_record->txn_id_, data + 8, sizeof(txn_id_t));
+  memcpy(&log_record->prev_lsn_, data + 12, sizeof(lsn_t));
+  memcpy(&log_record->log_record_type_, data + 16, sizeof(LogRecordType));
+
+  const char *pos = data + LogRecord::HEADER_SIZE;
+  switch (log_record->log_record_type_) {
+    case LogRecordType::INSERT:
+      memcpy(&log_record->insert_rid_, pos, sizeof(RID));
+      log_record->insert_tuple_.DeserializeFrom(pos + sizeof(RID));
+      break;
+    case LogRecordType::MARKDELETE:
+    case LogRecordType::APPLYDELETE:
+    case LogRecordType::ROLLBACKDELETE:
+      memcpy(&log_record->delete_rid_, pos, sizeof(RID));
+      log_record->delete_tuple_.DeserializeFrom(pos + sizeof(RID));
+      break;
+    case LogRecordType::UPDATE:
+      memcpy(&log_record->update_rid_, pos, sizeof(RID));
+      pos += sizeof(RID);
+      log_record->old_tuple_.DeserializeFrom(pos);
+      pos += sizeof(int32_t) + log_record->old_tuple_.GetLength();
+      log_record->new_tuple_.DeserializeFrom(pos);
+      break;
+    case LogRecordType::UPDATE_DELTA: {
+      memcpy(&log_record->update_rid_, pos, sizeof(RID));
+      pos += sizeof(RID);
+      memcpy(&log_record->delta_tuple_size_, pos, sizeof(uint32_t));
+      int32_t num_ranges;
+      memcpy(&num_ranges, pos + sizeof(uint32_t), sizeof(int32_t));
+      pos += sizeof(uint32_t) + sizeof(int32_t);
+      log_record->delta_ranges_.resize(num_ranges);
+      for (auto &range : log_record->delta_ranges_) {
+        uint32_t length;
+        memcpy(&range.offset_, pos, sizeof(uint32_t));
+        memcpy(&length, pos + sizeof(uint32_t), sizeof(uint32_t));
+        pos += LogRecord::DELTA_RANGE_HEADER_SIZE;
+        range.old_bytes_.assign(pos, pos + length);
+        range.new_bytes_.assign(pos + length, pos + 2 * length);
+        pos += 2 * length;
+      }
+      break;
+    }
+    case LogRecordType::NEWPAGE:
+      memcpy(&log_record->prev_page_id_, pos, sizeof(page_id_t));
+      memcpy(&log_record->page_id_, pos + sizeof(page_id_t), sizeof(page_id_t));
+      break;
+    case LogRecordType::INDEX_INSERT:
+    case LogRecordType::INDEX_DELETE:
+    case LogRecordType::INDEX_WRITE: {
+      int32_t num_entries;
+      memcpy(&log_record->page_id_, pos, sizeof(page_id_t));
+      memcpy(&log_record->index_position_, pos + sizeof(page_id_t), sizeof(int32_t));
+      memcpy(&log_record->index_entry_size_, pos + sizeof(page_id_t) + sizeof(int32_t), sizeof(uint32_t));
+      memcpy(&num_entries, pos + sizeof(page_id_t) + 2 * sizeof(int32_t), sizeof(int32_t));
+      pos += sizeof(page_id_t) + 3 * sizeof(int32_t);
+      log_record->index_entries_.assign(pos, pos + num_entries * log_record->index_entry_size_);
+      pos += num_entries * log_record->index_entry_size_;
+      int32_t name_size;
+      memcpy(&name_size, pos, sizeof(int32_t));
+      log_record->index_name_.assign(pos + sizeof(int32_t), name_size);
+      break;
+    }
+    case LogRecordType::INDEX_ROOT:
+      memcpy(&log_record->page_id_, pos, sizeof(page_id_t));
+      pos += sizeof(page_id_t);
+      log_record->index_name_.assign(pos, strnlen(pos, LogRecord::INDEX_NAME_SIZE));
+      break;
+    case LogRecordType::END_CHECKPOINT: {
+      int32_t num_txns;
+      memcpy(&num_txns, pos, sizeof(int32_t));
+      pos += sizeof(int32_t);
+      log_record->active_txns_.resize(num_txns);
+      for (auto &[txn_id, last_lsn] : log_record->active_txns_) {
+        memcpy(&txn_id, pos, sizeof(txn_id_t));
+        memcpy(&last_lsn, pos + sizeof(txn_id_t), sizeof(lsn_t));
+        pos += sizeof(txn_id_t) + sizeof(lsn_t);
+      }
+      int32_t num_pages;
+      memcpy(&num_pages, pos, sizeof(int32_t));
+      pos += sizeof(int32_t);
+      log_record->dirty_pages_.resize(num_pages);
+      for (auto &[page_id, rec_lsn] : log_record->dirty_pages_) {
+        memcpy(&page_id, pos, sizeof(page_id_t));
+        memcpy(&rec_lsn, pos + sizeof(page_id_t), sizeof(lsn_t));
+        pos += sizeof(page_id_t) + sizeof(lsn_t);
+      }
+      break;
+    }
+    case LogRecordType::BEGIN:
+    case LogRecordType::COMMIT:
+    case LogRecordType::ABORT:
+    case LogRecordType::BEGIN_CHECKPOINT:
+    case LogRecordType::RECOVERY_ABORT:
+      break;
+    default:
+      return false;
+  }
+  return true;
+}
+
+void LogRecovery::ScanLog(int64_t offset, const std::function<void(std::unique_ptr<LogRecord>, int64_t)> &visit,
+                          const std::function<void()> &end_of_chunk) {
+  // the next chunk is read while the current one is deserialized.
+  auto read_buffer = std::make_unique<char[]>(LOG_BUFFER_SIZE);
+  int64_t read_offset = offset;
+  auto prefetch = [&]() {
+    return std::async(std::launch::async, [this, &read_buffer, read_offset] {
+      return disk_manager_->ReadLog(read_buffer.get(), LOG_BUFFER_SIZE, read_offset);
+    });
+  };
+
+  offset_ = offset;
+  int buffered = 0;
+  bool end_of_log = false;
+  auto next_chunk = prefetch();
+  while (!end_of_log && next_chunk.get()) {
+    // append the chunk behind the tail left by the previous one.
+    memcpy(log_buffer_ + buffered, read_buffer.get(), LOG_BUFFER_SIZE);
+    buffered += LOG_BUFFER_SIZE;
+    read_offset += LOG_BUFFER_SIZE;
+    next_chunk = prefetch();
+
+    int pos = 0;
+    while (true) {
+      auto log_record = std::make_unique<LogRecord>();
+      if (!DeserializeLogRecord(log_buffer_ + pos, buffered - pos, log_record.get())) {
+        int32_t size = 0;
+        if (buffered - pos >= static_cast<int>(sizeof(int32_t))) {
+          memcpy(&size, log_buffer_ + pos, sizeof(int32_t));
+        }
+        // the log is zero-padded past its end, any other failure is a record cut by the end of the chunk.
+        end_of_log = buffered - pos >= LogRecord::HEADER_SIZE && size <= 0;
+        break;
+      }
+      const int size = log_record->GetSize();
+      visit(std::move(log_record), offset_ + pos);
+      pos += size;
+    }
+    if (end_of_chunk) {
+      end_of_chunk();
+    }
+
+    memmove(log_buffer_, log_buffer_ + pos, buffered - pos);
+    offset_ += pos;
+    buffered -= pos;
+  }
+  if (next_chunk.valid()) {
+    next_chunk.wait();
+  }
+}
+
+/*
+ *analysis phase: rebuild the active transaction table and the dirty page table
+ *as of the end of the log, starting from the last checkpoint
+ */
+void LogRecovery::Analyze(const MasterRecord &master) {
+  std::unordered_set<txn_id_t> finished_txns;
+  ScanLog(
+      master.checkpoint_offset_,
+      [&](std::unique_ptr<LogRecord> log_record, int64_t /* offset */) {
+        const lsn_t lsn = log_record->GetLSN();
+        const txn_id_t txn_id = log_record->GetTxnId();
+        switch (log_record->GetLogRecordType()) {
+          case LogRecordType::BEGIN_CHECKPOINT:
+            return;
+          case LogRecordType::END_CHECKPOINT:
+            // the batch holding our checkpoint may start with the end of an older one.
+            if (log_record->GetPrevLSN() != master.checkpoint_lsn_) {
+              return;
+            }
+            // what the log says after the begin record is newer than the tables.
+            for (const auto &[active_txn_id, last_lsn] : log_record->GetActiveTransactionTable()) {
+              if (active_txn_.count(active_txn_id) == 0 && finished_txns.count(active_txn_id) == 0) {
+                active_txn_[active_txn_id] = last_lsn;
+              }
+            }
+            for (const auto &[page_id, rec_lsn] : log_record->GetDirtyPageTable()) {
+              auto [it, inserted] = dirty_page_table_.emplace(page_id, rec_lsn);
+              if (!inserted) {
+                it->second = std::min(it->second, rec_lsn);
+              }
+            }
+            return;
+          case LogRecordType::COMMIT:
+          case LogRecordType::ABORT:
+            active_txn_.erase(txn_id);
+            finished_txns.insert(txn_id);
+            return;
+          default:
+            if (txn_id != INVALID_TXN_ID) {
+              active_txn_[txn_id] = lsn;
+            }
+            break;
+        }
+        const page_id_t page_id = GetRedoPageId(*log_record);
+        if (page_id != INVALID_PAGE_ID) {
+          // keeps the recLSN if the page is already dirty.
+          dirty_page_table_.emplace(page_id, lsn);
+        }
+      },
+      nullptr);
+}
 
 /*
  *redo phase on TABLE PAGE level(table/table_page.h)
@@ -28,13 +249,616 @@ bool LogRecovery::DeserializeLogRecord(const char *data, LogRecord *log_record)
  *log buffer to reduce unnecessary I/O operations), remember to compare page's
  *LSN with log_record's sequence number, and also build active_txn_ table &
  *lsn_mapping_ table
+ *
+ *The reader thread deserializes the records and builds the tables, the records
+ *are replayed by num_threads workers, each owning the pages with
+ *page_id % num_threads equal to its index.
+ *
+ *If there is a checkpoint, the tables come from the analysis instead and redo
+ *starts at the checkpoint's redo point. Records older than the recLSN of their
+ *page in the dirty page table are skipped without fetching the page.
  */
-void LogRecovery::Redo() {}
+void LogRecovery::Redo(size_t num_threads) {
+  std::vector<std::unique_ptr<RedoWorker>> workers;
+  if (num_threads > 1) {
+    for (size_t i = 0; i < num_threads; i++) {
+      workers.emplace_back(std::make_unique<RedoWorker>());
+      workers.back()->thread_ = std::thread(&LogRecovery::RedoWorkerThread, this, workers.back().get());
+    }
+  }
+  std::vector<std::vector<RedoTask>> batches(workers.size());
+
+  auto dispatch = [&](std::unique_ptr<LogRecord> log_record, int64_t /* offset */, page_id_t page_id,
+                      bool link_prev_page) {
+    if (workers.empty()) {
+      RedoLogRecord(log_record.get(), link_prev_page);
+    } else {
+      batches[page_id % workers.size()].push_back(RedoTask{std::move(log_record), link_prev_page});
+    }
+  };
+
+  auto submit = [&]() {
+    for (size_t i = 0; i < workers.size(); i++) {
+      if (batches[i].empty()) {
+        continue;
+      }
+      RedoWorker *worker = workers[i].get();
+      std::unique_lock<std::mutex> lck{worker->latch_};
+      worker->cv_.wait(lck, [&] { return worker->batches_.size() < MAX_PENDING_BATCHES; });
+      worker->batches_.emplace_back(std::move(batches[i]));
+      batches[i].clear();
+      worker->cv_.notify_all();
+    }
+  };
+
+  ScanForRedo(dispatch, submit);
+
+  for (auto &worker : workers) {
+    {
+      std::scoped_lock<std::mutex> lck{worker->latch_};
+      worker->done_ = true;
+    }
+    worker->cv_.notify_all();
+    worker->thread_.join();
+  }
+}
+
+void LogRecovery::ScanForRedo(const std::function<void(std::unique_ptr<LogRecord>, int64_t, page_id_t, bool)> &redo,
+                              const std::function<void()> &end_of_chunk) {
+  MergeLogStreams();
+  end_offset_ = disk_manager_->GetLogSize();
+
+  MasterRecord master{};
+  const bool from_checkpoint = disk_manager_->ReadMasterRecord(reinterpret_cast<char *>(&master), sizeof(master));
+  if (from_checkpoint) {
+    last_lsn_ = master.last_lsn_;
+    Analyze(master);
+  }
+
+  auto visit = [&](std::unique_ptr<LogRecord> log_record, int64_t offset) {
+    const lsn_t lsn = log_record->GetLSN();
+    const txn_id_t txn_id = log_record->GetTxnId();
+    const LogRecordType type = log_record->GetLogRecordType();
+    last_lsn_ = std::max(last_lsn_, lsn);
+    if (type == LogRecordType::BEGIN_CHECKPOINT || type == LogRecordType::END_CHECKPOINT) {
+      return;
+    }
+    lsn_mapping_[lsn] = offset;
+    // the loser stays a loser, only the pages that were recovered since are done with it.
+    if (type == LogRecordType::RECOVERY_ABORT) {
+      abort_lsns_.emplace(txn_id, lsn);
+    }
+    // records without a transaction, e.g. B+ tree splits and merges, are redo only.
+    if (!from_checkpoint && txn_id != INVALID_TXN_ID) {
+      if (type == LogRecordType::COMMIT || type == LogRecordType::ABORT) {
+        active_txn_.erase(txn_id);
+      } else {
+        active_txn_[txn_id] = lsn;
+      }
+    }
+
+    const page_id_t page_id = GetRedoPageId(*log_record);
+    if (page_id == INVALID_PAGE_ID) {
+      return;
+    }
+    if (type == LogRecordType::NEWPAGE && log_record->prev_page_id_ != INVALID_PAGE_ID) {
+      // the link from the previous page belongs to the worker of that page. It is not logged on its own, so the
+      // dirty page table knows nothing about it.
+      const page_id_t prev_page_id = log_record->prev_page_id_;
+      redo(std::make_unique<LogRecord>(*log_record), offset, prev_page_id, true);
+    }
+    if (from_checkpoint) {
+      auto it = dirty_page_table_.find(page_id);
+      if (it == dirty_page_table_.end() || lsn < it->second) {
+        return;
+      }
+    }
+    redo(std::move(log_record), offset, page_id, false);
+  };
+
+  ScanLog(from_checkpoint ? master.redo_offset_ : 0, visit, end_of_chunk);
+}
+
+void LogRecovery::MergeLogStreams() {
+  const std::vector<int> streams = disk_manager_->GetLogStreams();
+  if (streams.empty()) {
+    return;
+  }
+
+  std::vector<StreamCursor> cursors;
+  using HeapEntry = std::pair<lsn_t, size_t>;
+  std::priority_queue<HeapEntry, std::vector<HeapEntry>, std::greater<>> heap;
+  for (int stream : streams) {
+    cursors.push_back(StreamCursor{stream, disk_manager_->GetLogStreamSize(stream), 0, 0, INVALID_LSN, 0,
+                                   std::make_unique<char[]>(LOG_BUFFER_SIZE)});
+  }
+  for (size_t i = 0; i < cursors.size(); i++) {
+    StreamCursor &cursor = cursors[i];
+    if (disk_manager_->ReadLogStream(cursor.stream_, cursor.buffer_.get(), LOG_BUFFER_SIZE, 0) &&
+        PeekLogStream(&cursor)) {
+      heap.emplace(cursor.lsn_, i);
+    }
+  }
+
+  // the streams go on from the last record in the log, which ends at the master record unless a merge crashed.
+  MasterRecord master{};
+  int64_t offset = 0;
+  lsn_t next_lsn = 0;
+  if (disk_manager_->ReadMasterRecord(reinterpret_cast<char *>(&master), sizeof(master))) {
+    offset = master.checkpoint_offset_;
+    next_lsn = master.last_lsn_ + 1;
+  }
+  ScanLog(
+      offset,
+      [&](std::unique_ptr<LogRecord> log_record, int64_t /* offset */) {
+        next_lsn = std::max(next_lsn, log_record->GetLSN() + 1);
+      },
+      nullptr);
+
+  // the disk manager wants the buffers it writes from to alternate.
+  std::unique_ptr<char[]> merge_buffers[2] = {std::make_unique<char[]>(LOG_BUFFER_SIZE),
+                                             std::make_unique<char[]>(LOG_BUFFER_SIZE)};
+  int current = 0;
+  int merged = 0;
+  while (!heap.empty()) {
+    StreamCursor &cursor = cursors[heap.top().second];
+    heap.pop();
+    if (cursor.lsn_ > next_lsn) {
+      break;
+    }
+    if (cursor.lsn_ == next_lsn) {
+      if (merged + cursor.record_size_ > LOG_BUFFER_SIZE) {
+        disk_manager_->WriteLog(merge_buffers[current].get(), merged);
+        current = 1 - current;
+        merged = 0;
+      }
+      memcpy(merge_buffers[current].get() + merged, cursor.buffer_.get() + cursor.pos_, cursor.record_size_);
+      merged += cursor.record_size_;
+      next_lsn++;
+    }
+    cursor.pos_ += cursor.record_size_;
+    if (PeekLogStream(&cursor)) {
+      heap.emplace(cursor.lsn_, &cursor - cursors.data());
+    }
+  }
+  if (merged > 0) {
+    disk_manager_->WriteLog(merge_buffers[current].get(), merged);
+  }
+
+  for (int stream : streams) {
+    disk_manager_->RemoveLogStream(stream);
+  }
+}
+
+bool LogRecovery::PeekLogStream(StreamCursor *cursor) {
+  for (bool refilled = false;; refilled = true) {
+    const int buffered = std::min(LOG_BUFFER_SIZE, cursor->size_ - cursor->offset_);
+    if (cursor->pos_ + LogRecord::HEADER_SIZE <= buffered) {
+      memcpy(&cursor->record_size_, cursor->buffer_.get() + cursor->pos_, sizeof(int32_t));
+      if (cursor->record_size_ < LogRecord::HEADER_SIZE) {
+        return false;
+      }
+      if (cursor->pos_ + cursor->record_size_ <= buffered) {
+        memcpy(&cursor->lsn_, cursor->buffer_.get() + cursor->pos_ + 4, sizeof(lsn_t));
+        return true;
+      }
+    }
+    // the record starts or ends past the buffer, which holds the whole stream or the whole record after a refill.
+    if (refilled) {
+      return false;
+    }
+    cursor->offset_ += cursor->pos_;
+    cursor->pos_ = 0;
+    if (!disk_manager_->ReadLogStream(cursor->stream_, cursor->buffer_.get(), LOG_BUFFER_SIZE, cursor->offset_)) {
+      return false;
+    }
+  }
+}
+
+void LogRecovery::RedoWorkerThread(RedoWorker *worker) {
+  std::unique_lock<std::mutex> lck{worker->latch_};
+  while (true) {
+    worker->cv_.wait(lck, [&] { return !worker->batches_.empty() || worker->done_; });
+    if (worker->batches_.empty()) {
+      return;
+    }
+    std::vector<RedoTask> batch = std::move(worker->batches_.front());
+    worker->batches_.pop_front();
+    // the reader may be waiting for room.
+    worker->cv_.notify_all();
+
+    lck.unlock();
+    for (auto &task : batch) {
+      RedoLogRecord(task.log_record_.get(), task.link_prev_page_);
+    }
+    lck.lock();
+  }
+}
+
+page_id_t LogRecovery::GetRedoPageId(const LogRecord &log_record) {
+  switch (log_record.log_record_type_) {
+    case LogRecordType::INSERT:
+      return log_record.insert_rid_.GetPageId();
+    case LogRecordType::MARKDELETE:
+    case LogRecordType::APPLYDELETE:
+    case LogRecordType::ROLLBACKDELETE:
+      return log_record.delete_rid_.GetPageId();
+    case LogRecordType::UPDATE:
+    case LogRecordType::UPDATE_DELTA:
+      return log_record.update_rid_.GetPageId();
+    case LogRecordType::NEWPAGE:
+    case LogRecordType::INDEX_INSERT:
+    case LogRecordType::INDEX_DELETE:
+    case LogRecordType::INDEX_WRITE:
+      return log_record.page_id_;
+    case LogRecordType::INDEX_ROOT:
+      return HEADER_PAGE_ID;
+    default:
+      return INVALID_PAGE_ID;
+  }
+}
+
+void LogRecovery::RedoLogRecord(LogRecord *log_record, bool link_prev_page) {
+  const page_id_t page_id = link_prev_page ? log_record->prev_page_id_ : GetRedoPageId(*log_record);
+  auto page = static_cast<TablePage *>(buffer_pool_manager_->FetchPage(page_id));
+  BUSTUB_ASSERT(page != nullptr, "Redo could not fetch a page.");
+  buffer_pool_manager_->UnpinPage(page_id, ApplyRedo(log_record, page, link_prev_page));
+}
+
+bool LogRecovery::ApplyRedo(LogRecord *log_record, TablePage *page, bool link_prev_page) {
+  if (link_prev_page) {
+    // linking is not logged on its own, it is idempotent instead: a page's next page never changes once set.
+    if (page->GetNextPageId() == log_record->page_id_) {
+      return false;
+    }
+    page->SetNextPageId(log_record->page_id_);
+    return true;
+  }
+
+  if (log_record->log_record_type_ == LogRecordType::INDEX_ROOT) {
+    // the header page has no lsn. Its records are only ever overwritten, so replaying them in log order is enough.
+    auto header_page = reinterpret_cast<HeaderPage *>(static_cast<Page *>(page));
+    page_id_t root_page_id;
+    if (header_page->GetRootId(log_record->index_name_, &root_page_id) && root_page_id == log_record->page_id_) {
+      return false;
+    }
+    if (!header_page->UpdateRecord(log_record->index_name_, log_record->page_id_) &&
+        log_record->page_id_ != INVALID_PAGE_ID) {
+      header_page->InsertRecord(log_record->index_name_, log_record->page_id_);
+    }
+    return true;
+  }
+
+  // the page already reflects the record.
+  if (page->GetLSN() >= log_record->lsn_) {
+    return false;
+  }
+
+  switch (log_record->log_record_type_) {
+    case LogRecordType::INSERT: {
+      RID rid;
+      page->InsertTuple(log_record->insert_tuple_, &rid, nullptr, nullptr, nullptr);
+      break;
+    }
+    case LogRecordType::MARKDELETE:
+      page->MarkDelete(log_record->delete_rid_, nullptr, nullptr, nullptr);
+      break;
+    case LogRecordType::APPLYDELETE:
+      page->ApplyDelete(log_record->delete_rid_, nullptr, nullptr);
+      break;
+    case LogRecordType::ROLLBACKDELETE:
+      page->RollbackDelete(log_record->delete_rid_, nullptr, nullptr);
+      break;
+    case LogRecordType::UPDATE: {
+      Tuple old_tuple;
+      page->UpdateTuple(log_record->new_tuple_, &old_tuple, log_record->update_rid_, nullptr, nullptr, nullptr);
+      break;
+    }
+    case LogRecordType::UPDATE_DELTA:
+      for (const auto &range : log_record->delta_ranges_) {
+        page->WriteTupleBytes(log_record->update_rid_, range.offset_, range.new_bytes_.data(),
+                              range.new_bytes_.size());
+      }
+      break;
+    case LogRecordType::NEWPAGE:
+      page->Init(log_record->page_id_, PAGE_SIZE, log_record->prev_page_id_, nullptr, nullptr);
+      break;
+    case LogRecordType::INDEX_INSERT: {
+      auto index_page = reinterpret_cast<BPlusTreePage *>(page->GetData());
+      const uint32_t entry_size = log_record->index_entry_size_;
+      index_page->InsertEntries(log_record->index_position_, log_record->index_entries_.data(),
+                                log_record->index_entries_.size() / entry_size, entry_size);
+      break;
+    }
+    case LogRecordType::INDEX_DELETE: {
+      auto index_page = reinterpret_cast<BPlusTreePage *>(page->GetData());
+      const uint32_t entry_size = log_record->index_entry_size_;
+      index_page->RemoveEntries(log_record->index_position_, log_record->index_entries_.size() / entry_size,
+                                entry_size);
+      break;
+    }
+    case LogRecordType::INDEX_WRITE:
+      memcpy(page->GetData() + log_record->index_position_, log_record->index_entries_.data(),
+             log_record->index_entries_.size());
+      break;
+    default:
+      UNREACHABLE("Not a page-level log record.");
+  }
+  page->SetLSN(log_record->lsn_);
+  return true;
+}
 
 /*
  *undo phase on TABLE PAGE level(table/table_page.h)
  *iterate through active txn map and undo each operation
+ *
+ *The records of all the active transactions are undone in reverse lsn order.
+ */
+void LogRecovery::Undo() {
+  std::priority_queue<lsn_t> to_undo;
+  for (const auto &[txn_id, lsn] : active_txn_) {
+    to_undo.push(lsn);
+  }
+
+  while (!to_undo.empty()) {
+    const lsn_t lsn = to_undo.top();
+    to_undo.pop();
+    auto it = lsn_mapping_.find(lsn);
+    BUSTUB_ASSERT(it != lsn_mapping_.end(), "Undo of a record that redo has not seen.");
+
+    LogRecord log_record;
+    ReadLogRecord(it->second, LOG_BUFFER_SIZE, log_buffer_, &log_record);
+    BUSTUB_ASSERT(log_record.lsn_ == lsn, "Undo read a different record than redo.");
+    UndoLogRecord(&log_record);
+
+    if (log_record.prev_lsn_ != INVALID_LSN) {
+      to_undo.push(log_record.prev_lsn_);
+    }
+  }
+
+  active_txn_.clear();
+  lsn_mapping_.clear();
+  dirty_page_table_.clear();
+  // the pages recovery changed carry no recLSN, they must not depend on a log that checkpoints may truncate.
+  buffer_pool_manager_->FlushAllPages();
+  EndRecovery();
+}
+
+void LogRecovery::EndRecovery() {
+  if (end_offset_ < 0) {
+    return;
+  }
+  // no END_CHECKPOINT record matches INVALID_LSN, so the analysis from here starts out with empty tables: nothing
+  // before this point is missing on disk and none of its transactions is left to undo.
+  MasterRecord master{INVALID_LSN, end_offset_, end_offset_, last_lsn_};
+  disk_manager_->WriteMasterRecord(reinterpret_cast<const char *>(&master), sizeof(MasterRecord));
+  end_offset_ = -1;
+}
+
+void LogRecovery::UndoLogRecord(LogRecord *log_record) {
+  if (IsIndexEntryRecord(*log_record)) {
+    // the index entries of a loser are undone before its RECOVERY_ABORT record is written.
+    if (abort_lsns_.count(log_record->txn_id_) == 0) {
+      UndoIndexEntries(*log_record);
+    }
+    return;
+  }
+  const page_id_t page_id = GetRedoPageId(*log_record);
+  if (page_id == INVALID_PAGE_ID || log_record->log_record_type_ == LogRecordType::NEWPAGE) {
+    return;
+  }
+
+  auto page = static_cast<TablePage *>(buffer_pool_manager_->FetchPage(page_id));
+  BUSTUB_ASSERT(page != nullptr, "Undo could not fetch a page.");
+  if (IsUndone(*log_record, page)) {
+    buffer_pool_manager_->UnpinPage(page_id, false);
+    return;
+  }
+  ApplyUndo(log_record, page);
+  buffer_pool_manager_->UnpinPage(page_id, true);
+}
+
+void LogRecovery::ApplyUndo(LogRecord *log_record, TablePage *page) {
+  switch (log_record->log_record_type_) {
+    case LogRecordType::INSERT:
+      page->ApplyDelete(log_record->insert_rid_, nullptr, nullptr);
+      break;
+    case LogRecordType::MARKDELETE:
+      page->RollbackDelete(log_record->delete_rid_, nullptr, nullptr);
+      break;
+    case LogRecordType::APPLYDELETE: {
+      RID rid;
+      page->InsertTuple(log_record->delete_tuple_, &rid, nullptr, nullptr, nullptr);
+      break;
+    }
+    case LogRecordType::ROLLBACKDELETE:
+      page->MarkDelete(log_record->delete_rid_, nullptr, nullptr, nullptr);
+      break;
+    case LogRecordType::UPDATE: {
+      Tuple new_tuple;
+      page->UpdateTuple(log_record->old_tuple_, &new_tuple, log_record->update_rid_, nullptr, nullptr, nullptr);
+      break;
+    }
+    case LogRecordType::UPDATE_DELTA:
+      for (const auto &range : log_record->delta_ranges_) {
+        page->WriteTupleBytes(log_record->update_rid_, range.offset_, range.old_bytes_.data(),
+                              range.old_bytes_.size());
+      }
+      break;
+    default:
+      UNREACHABLE("Not a page-level log record.");
+  }
+}
+
+void LogRecovery::UndoIndexEntries(const LogRecord &log_record) {
+  auto it = indexes_.find(log_record.index_name_);
+  BUSTUB_ASSERT(it != indexes_.end(), "Undo of an entry of an index that is not registered.");
+  const bool reinsert = log_record.log_record_type_ == LogRecordType::INDEX_DELETE;
+  const uint32_t entry_size = log_record.index_entry_size_;
+  for (size_t offset = 0; offset < log_record.index_entries_.size(); offset += entry_size) {
+    it->second(log_record.index_entries_.data() + offset, reinsert);
+  }
+}
+
+void LogRecovery::ReadLogRecord(int64_t offset, int size, char *buffer, LogRecord *log_record) {
+  disk_manager_->ReadLog(buffer, size, offset);
+  bool complete = DeserializeLogRecord(buffer, size, log_record);
+  BUSTUB_ASSERT(complete, "A record in the middle of the log is cut.");
+}
+
+/*
+ *instant restart: the same scan as redo, but the records are only indexed by
+ *page. The records of the unfinished transactions are found through their
+ *prev_lsn chains like undo does and indexed too, so that every page can be
+ *recovered on its own, in any order
  */
-void LogRecovery::Undo() {}
+void LogRecovery::RecoverOnDemand() {
+  ScanForRedo(
+      [&](std::unique_ptr<LogRecord> log_record, int64_t offset, page_id_t page_id, bool link_prev_page) {
+        pending_pages_[page_id].redo_.push_back(PendingRecord{offset, log_record->GetSize(), link_prev_page});
+      },
+      nullptr);
+
+  // index entries are undone through their tree, which reads pages on its own. Those of a loser with a
+  // RECOVERY_ABORT record are undone already.
+  std::vector<std::unique_ptr<LogRecord>> index_undo;
+  for (const auto &[txn_id, last_lsn] : active_txn_) {
+    for (lsn_t lsn = last_lsn; lsn != INVALID_LSN;) {
+      auto it = lsn_mapping_.find(lsn);
+      BUSTUB_ASSERT(it != lsn_mapping_.end(), "Undo of a record that redo has not seen.");
+      auto log_record = std::make_unique<LogRecord>();
+      ReadLogRecord(it->second, LOG_BUFFER_SIZE, log_buffer_, log_record.get());
+      const page_id_t page_id = GetRedoPageId(*log_record);
+      lsn = log_record->prev_lsn_;
+      if (IsIndexEntryRecord(*log_record)) {
+        if (abort_lsns_.count(txn_id) == 0) {
+          index_undo.push_back(std::move(log_record));
+        }
+      } else if (page_id != INVALID_PAGE_ID && log_record->log_record_type_ != LogRecordType::NEWPAGE) {
+        pending_pages_[page_id].undo_.emplace_back(log_record->lsn_,
+                                                   PendingRecord{it->second, log_record->size_, false});
+      }
+    }
+  }
+  for (auto &[page_id, pending_page] : pending_pages_) {
+    std::sort(pending_page.undo_.begin(), pending_page.undo_.end(),
+              [](const auto &a, const auto &b) { return a.first > b.first; });
+  }
+  std::sort(index_undo.begin(), index_undo.end(), [](const auto &a, const auto &b) { return a->lsn_ > b->lsn_; });
+  lsn_mapping_.clear();
+  dirty_page_table_.clear();
+
+  buffer_pool_manager_->SetLogRecovery(this);
+  // the index pages the trees read on the way are recovered on demand. The losers' entries are gone before anybody
+  // may look them up, and on disk before the losers are aborted.
+  for (auto &log_record : index_undo) {
+    UndoIndexEntries(*log_record);
+  }
+  if (!index_undo.empty()) {
+    buffer_pool_manager_->FlushAllPages();
+  }
+  AbortLosers();
+  active_txn_.clear();
+  recovery_thread_ = std::thread(&LogRecovery::BackgroundRecovery, this);
+}
+
+void LogRecovery::AbortLosers() {
+  // the disk manager wants the buffers it writes from to alternate, log_buffer_ has room for two.
+  char *buffer = log_buffer_;
+  int size = 0;
+  for (const auto &[txn_id, last_lsn] : active_txn_) {
+    if (abort_lsns_.count(txn_id) == 1) {
+      continue;
+    }
+    if (size + LogRecord::HEADER_SIZE > LOG_BUFFER_SIZE) {
+      disk_manager_->WriteLog(buffer, size);
+      buffer = buffer == log_buffer_ ? log_buffer_ + LOG_BUFFER_SIZE : log_buffer_;
+      size = 0;
+    }
+    // | size | LSN | transID | prevLSN | LogType |, see LogManager::SerializeLogRecord.
+    const int32_t record_size = LogRecord::HEADER_SIZE;
+    const lsn_t lsn = ++last_lsn_;
+    const LogRecordType type = LogRecordType::RECOVERY_ABORT;
+    memcpy(buffer + size, &record_size, sizeof(int32_t));
+    memcpy(buffer + size + 4, &lsn, sizeof(lsn_t));
+    memcpy(buffer + size + 8, &txn_id, sizeof(txn_id_t));
+    memcpy(buffer + size + 12, &last_lsn, sizeof(lsn_t));
+    memcpy(buffer + size + 16, &type, sizeof(LogRecordType));
+    size += record_size;
+  }
+  if (size > 0) {
+    disk_manager_->WriteLog(buffer, size);
+  }
+  // the records belong to the recovered log.
+  end_offset_ = disk_manager_->GetLogSize();
+}
+
+bool LogRecovery::RecoverPage(page_id_t page_id, Page *page) {
+  PendingPage pending_page;
+  {
+    std::scoped_lock<std::mutex> lck{pending_latch_};
+    auto it = pending_pages_.find(page_id);
+    if (it == pending_pages_.end()) {
+      return false;
+    }
+    pending_page = std::move(it->second);
+    pending_pages_.erase(it);
+  }
+
+  // log_buffer_ belongs to the thread that scans the log, the buffer pool may call in from any thread.
+  auto buffer = std::make_unique<char[]>(LOG_BUFFER_SIZE);
+  auto table_page = static_cast<TablePage *>(page);
+  bool changed = false;
+  for (const auto &record : pending_page.redo_) {
+    LogRecord log_record;
+    ReadLogRecord(record.offset_, record.size_, buffer.get(), &log_record);
+    changed = ApplyRedo(&log_record, table_page, record.link_prev_page_) || changed;
+  }
+  for (const auto &[lsn, record] : pending_page.undo_) {
+    LogRecord log_record;
+    ReadLogRecord(record.offset_, record.size_, buffer.get(), &log_record);
+    if (!IsUndone(log_record, page)) {
+      ApplyUndo(&log_record, table_page);
+    }
+  }
+  // the page is done with the losers, whatever new transactions do to it. See the class comment.
+  if (!pending_page.undo_.empty() && page->GetLSN() < last_lsn_) {
+    page->SetLSN(last_lsn_);
+    changed = true;
+  }
+  return changed;
+}
+
+void LogRecovery::BackgroundRecovery() {
+  while (true) {
+    page_id_t page_id;
+    {
+      std::scoped_lock<std::mutex> lck{pending_latch_};
+      if (pending_pages_.empty()) {
+        return;
+      }
+      page_id = pending_pages_.begin()->first;
+    }
+    // reading the page recovers it, unless somebody else just did.
+    if (buffer_pool_manager_->FetchPage(page_id) == nullptr) {
+      // every frame is pinned, try again once one is unpinned.
+      buffer_pool_manager_->WaitForUnpinnedFrame();
+      continue;
+    }
+    buffer_pool_manager_->UnpinPage(page_id, false);
+  }
+}
+
+void LogRecovery::WaitForRecovery() {
+  if (!recovery_thread_.joinable()) {
+    return;
+  }
+  recovery_thread_.join();
+  // as after Undo, the recovered pages must not depend on a log that checkpoints may truncate. Checkpoints wait for
+  // the buffer pool to let go of the recovery, which happens once the master record is written.
+  buffer_pool_manager_->FlushAllPages();
+  EndRecovery();
+  buffer_pool_manager_->SetLogRecovery(nullptr);
+}
 
 }  // namespace bustub
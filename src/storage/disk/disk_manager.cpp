@@ -11,14 +11,19 @@
 //===----------------------------------------------------------------------===//
 
 #include <sys/stat.h>
+#include <algorithm>
 #include <cassert>
+#include <cctype>
+#include <cstdio>
 #include <cstring>
+#include <filesystem>
 #include <iostream>
 #include <string>
 #include <thread>  // NOLINT
 
 #include "common/exception.h"
 #include "common/logger.h"
+#include "common/macros.h"
 #include "storage/disk/disk_manager.h"
 
 namespace bustub {
@@ -26,31 +31,27 @@ namespace bustub {
 static char *buffer_used;
 
 /**
- * Constructor: open/create a single database file & log file
+ * Constructor: open/create a single database file, find the log segments
+ * Log segments are created when the log reaches them
  * @input db_file: database file name
  */
-DiskManager::DiskManager(const std::string &db_file)
-    : file_name_(db_file), next_page_id_(0), num_flushes_(0), num_writes_(0), flush_log_(false), flush_log_f_(nullptr) {
+DiskManager::DiskManager(const std::string &db_file, int log_segment_size)
+    : next_page_id_(0),
+      num_flushes_(0),
+      num_writes_(0),
+      flush_log_(false),
+      flush_log_f_(nullptr),
+      log_segment_size_(log_segment_size),
+      file_name_(db_file) {
+  BUSTUB_ASSERT(log_segment_size_ > 0, "Log segments cannot be empty.");
   std::string::size_type n = file_name_.rfind('.');
   if (n == std::string::npos) {
     LOG_DEBUG("wrong file format");
     return;
   }
   log_name_ = file_name_.substr(0, n) + ".log";
-
-  log_io_.open(log_name_, std::ios::binary | std::ios::in | std::ios::app | std::ios::out);
-  // directory or file does not exist
-  if (!log_io_.is_open()) {
-    log_io_.clear();
-    // create a new file
-    log_io_.open(log_name_, std::ios::binary | std::ios::trunc | std::ios::app | std::ios::out);
-    log_io_.close();
-    // reopen with original mode
-    log_io_.open(log_name_, std::ios::binary | std::ios::in | std::ios::app | std::ios::out);
-    if (!log_io_.is_open()) {
-      throw Exception("can't open dblog file");
-    }
-  }
+  master_name_ = file_name_.substr(0, n) + ".master";
+  OpenLog();
 
   db_io_.open(db_file, std::ios::binary | std::ios::in | std::ios::out);
   // directory or file does not exist
@@ -68,18 +69,34 @@ DiskManager::DiskManager(const std::string &db_file)
   buffer_used = nullptr;
 }
 
+/**
+ * Constructor for subclasses that keep their data somewhere else than in files
+ */
+DiskManager::DiskManager()
+    : next_page_id_(0),
+      num_flushes_(0),
+      num_writes_(0),
+      flush_log_(false),
+      flush_log_f_(nullptr),
+      log_segment_size_(LOG_SEGMENT_SIZE) {}
+
 /**
  * Close all file streams
  */
 void DiskManager::ShutDown() {
   db_io_.close();
+  std::scoped_lock<std::mutex> lck{log_latch_};
   log_io_.close();
+  log_write_segment_ = -1;
+  log_read_io_.close();
+  log_read_segment_ = -1;
 }
 
 /**
  * Write the contents of the specified page into disk file
  */
 void DiskManager::WritePage(page_id_t page_id, const char *page_data) {
+  auto start = std::chrono::steady_clock::now();
   size_t offset = static_cast<size_t>(page_id) * PAGE_SIZE;
   // set write cursor to offset
   num_writes_ += 1;
@@ -91,13 +108,17 @@ void DiskManager::WritePage(page_id_t page_id, const char *page_data) {
     return;
   }
   // needs to flush to keep disk file in sync
+  auto sync_start = std::chrono::steady_clock::now();
   db_io_.flush();
+  RecordIO(IOType::SYNC, sync_start, page_id, 0);
+  RecordIO(IOType::WRITE_PAGE, start, page_id, PAGE_SIZE);
 }
 
 /**
  * Read the contents of the specified page into the given memory area
  */
 void DiskManager::ReadPage(page_id_t page_id, char *page_data) {
+  auto start = std::chrono::steady_clock::now();
   int offset = page_id * PAGE_SIZE;
   // check if read beyond file length
   if (offset > GetFileSize(file_name_)) {
@@ -119,6 +140,7 @@ void DiskManager::ReadPage(page_id_t page_id, char *page_data) {
       // std::cerr << "Read less than a page" << std::endl;
       memset(page_data + read_count, 0, PAGE_SIZE - read_count);
     }
+    RecordIO(IOType::READ_PAGE, start, page_id, read_count);
   }
 }
 
@@ -142,48 +164,245 @@ void DiskManager::WriteLog(char *log_data, int size) {
     assert(flush_log_f_->wait_for(std::chrono::seconds(10)) == std::future_status::ready);
   }
 
+  auto start = std::chrono::steady_clock::now();
   num_flushes_ += 1;
-  // sequence write
-  log_io_.write(log_data, size);
-
-  // check for I/O error
-  if (log_io_.bad()) {
-    LOG_DEBUG("I/O error while writing log");
-    return;
+  std::scoped_lock<std::mutex> lck{log_latch_};
+  // sequence write, moving on to the next segment whenever the current one is full
+  for (int written = 0; written < size;) {
+    const int segment = static_cast<int>(log_size_ / log_segment_size_);
+    if (segment != log_write_segment_) {
+      // closing the full segment also flushes it
+      log_io_.close();
+      log_io_.clear();
+      log_io_.open(GetLogSegmentName(segment), std::ios::binary | std::ios::app | std::ios::out);
+      if (!log_io_.is_open()) {
+        LOG_DEBUG("can't open log segment %d", segment);
+        log_write_segment_ = -1;
+        return;
+      }
+      log_write_segment_ = segment;
+    }
+    const int count =
+        static_cast<int>(std::min<int64_t>(size - written, SegmentStart(segment + 1) - log_size_));
+    log_io_.write(log_data + written, count);
+    // check for I/O error
+    if (log_io_.bad()) {
+      LOG_DEBUG("I/O error while writing log");
+      return;
+    }
+    written += count;
+    log_size_ += count;
   }
   // needs to flush to keep disk file in sync
+  auto sync_start = std::chrono::steady_clock::now();
   log_io_.flush();
+  RecordIO(IOType::SYNC, sync_start, INVALID_PAGE_ID, 0);
+  RecordIO(IOType::WRITE_LOG, start, INVALID_PAGE_ID, size);
   flush_log_ = false;
 }
 
 /**
  * Read the contents of the log into the given memory area
- * Always read from the beginning and perform sequence read
- * @return: false means already reach the end
+ * Only the segments holding the requested range are opened
+ * @return: false means already reach the end, or the offset was truncated
  */
-bool DiskManager::ReadLog(char *log_data, int size, int offset) {
-  if (offset >= GetFileSize(log_name_)) {
+bool DiskManager::ReadLog(char *log_data, int size, int64_t offset) {
+  std::scoped_lock<std::mutex> lck{log_latch_};
+  if (offset >= log_size_) {
     // LOG_DEBUG("end of log file");
-    // LOG_DEBUG("file size is %d", GetFileSize(log_name_));
     return false;
   }
-  log_io_.seekp(offset);
-  log_io_.read(log_data, size);
-
-  if (log_io_.bad()) {
-    LOG_DEBUG("I/O error while reading log");
+  if (offset < SegmentStart(first_log_segment_)) {
+    LOG_DEBUG("reading truncated log at offset %ld", offset);
     return false;
   }
+  auto start = std::chrono::steady_clock::now();
+  int read_count = 0;
+  while (read_count < size && offset + read_count < log_size_) {
+    const int64_t pos = offset + read_count;
+    const int segment = static_cast<int>(pos / log_segment_size_);
+    if (segment != log_read_segment_) {
+      log_read_io_.close();
+      log_read_io_.clear();
+      log_read_io_.open(GetLogSegmentName(segment), std::ios::binary | std::ios::in);
+      log_read_segment_ = log_read_io_.is_open() ? segment : -1;
+      if (log_read_segment_ == -1) {
+        LOG_DEBUG("can't open log segment %d", segment);
+        break;
+      }
+    }
+    // the segment may have grown since the last read hit its end
+    log_read_io_.clear();
+    log_read_io_.seekg(pos - SegmentStart(segment));
+    const int count =
+        static_cast<int>(std::min<int64_t>(size - read_count, std::min(SegmentStart(segment + 1), log_size_) - pos));
+    log_read_io_.read(log_data + read_count, count);
+    if (log_read_io_.bad()) {
+      LOG_DEBUG("I/O error while reading log");
+      return false;
+    }
+    read_count += log_read_io_.gcount();
+    if (log_read_io_.gcount() < count) {
+      break;
+    }
+  }
   // if log file ends before reading "size"
-  int read_count = log_io_.gcount();
   if (read_count < size) {
-    log_io_.clear();
     memset(log_data + read_count, 0, size - read_count);
   }
+  RecordIO(IOType::READ_LOG, start, INVALID_PAGE_ID, read_count);
 
   return true;
 }
 
+/**
+ * Delete every log segment that ends at or before offset
+ */
+void DiskManager::TruncateLog(int64_t offset) {
+  std::scoped_lock<std::mutex> lck{log_latch_};
+  const int segment = static_cast<int>(std::min(offset, log_size_) / log_segment_size_);
+  for (; first_log_segment_ < segment; first_log_segment_++) {
+    if (first_log_segment_ == log_write_segment_) {
+      log_io_.close();
+      log_write_segment_ = -1;
+    }
+    if (first_log_segment_ == log_read_segment_) {
+      log_read_io_.close();
+      log_read_segment_ = -1;
+    }
+    if (std::remove(GetLogSegmentName(first_log_segment_).c_str()) != 0) {
+      LOG_DEBUG("can't delete log segment %d", first_log_segment_);
+    }
+  }
+}
+
+/**
+ * Append to a log stream file, opening it on its first write
+ * Only the stream's own latch is held while writing
+ */
+void DiskManager::WriteLogStream(int stream, const char *log_data, int size) {
+  if (size == 0) {
+    return;
+  }
+  LogStreamFile *file;
+  {
+    std::scoped_lock<std::mutex> lck{log_streams_latch_};
+    auto &entry = log_streams_[stream];
+    if (entry == nullptr) {
+      entry = std::make_unique<LogStreamFile>();
+      entry->io_.open(GetLogStreamName(stream), std::ios::binary | std::ios::app | std::ios::out);
+    }
+    file = entry.get();
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  num_flushes_ += 1;
+  std::scoped_lock<std::mutex> lck{file->latch_};
+  if (!file->io_.is_open()) {
+    LOG_DEBUG("can't open log stream %d", stream);
+    return;
+  }
+  file->io_.write(log_data, size);
+  if (file->io_.bad()) {
+    LOG_DEBUG("I/O error while writing log stream %d", stream);
+    return;
+  }
+  auto sync_start = std::chrono::steady_clock::now();
+  file->io_.flush();
+  RecordIO(IOType::SYNC, sync_start, INVALID_PAGE_ID, 0);
+  RecordIO(IOType::WRITE_LOG, start, INVALID_PAGE_ID, size);
+}
+
+/**
+ * Read the contents of a log stream into the given memory area
+ * @return: false means already reach the end of the stream
+ */
+bool DiskManager::ReadLogStream(int stream, char *log_data, int size, int offset) {
+  const int stream_size = GetLogStreamSize(stream);
+  if (offset >= stream_size) {
+    return false;
+  }
+  auto start = std::chrono::steady_clock::now();
+  std::ifstream io(GetLogStreamName(stream), std::ios::binary | std::ios::in);
+  io.seekg(offset);
+  io.read(log_data, std::min(size, stream_size - offset));
+  const int read_count = static_cast<int>(io.gcount());
+  // if the stream ends before reading "size"
+  if (read_count < size) {
+    memset(log_data + read_count, 0, size - read_count);
+  }
+  RecordIO(IOType::READ_LOG, start, INVALID_PAGE_ID, read_count);
+  return true;
+}
+
+int DiskManager::GetLogStreamSize(int stream) { return GetFileSize(GetLogStreamName(stream)); }
+
+std::vector<int> DiskManager::GetLogStreams() {
+  namespace fs = std::filesystem;
+  const fs::path log_path(log_name_);
+  const std::string prefix = log_path.filename().string() + ".stream";
+  std::error_code ec;
+  std::vector<int> streams;
+  for (const auto &entry : fs::directory_iterator(log_path.has_parent_path() ? log_path.parent_path() : ".", ec)) {
+    const std::string name = entry.path().filename().string();
+    if (name.size() > prefix.size() && name.compare(0, prefix.size(), prefix) == 0 &&
+        std::all_of(name.begin() + prefix.size(), name.end(), ::isdigit)) {
+      streams.push_back(std::stoi(name.substr(prefix.size())));
+    }
+  }
+  std::sort(streams.begin(), streams.end());
+  return streams;
+}
+
+void DiskManager::RemoveLogStream(int stream) {
+  {
+    std::scoped_lock<std::mutex> lck{log_streams_latch_};
+    log_streams_.erase(stream);
+  }
+  if (std::remove(GetLogStreamName(stream).c_str()) != 0) {
+    LOG_DEBUG("can't delete log stream %d", stream);
+  }
+}
+
+/**
+ * Returns the size of the log, including its truncated part
+ */
+int64_t DiskManager::GetLogSize() {
+  std::scoped_lock<std::mutex> lck{log_latch_};
+  return log_size_;
+}
+
+/**
+ * Write the master record into a temporary file and rename it over the old one, which is atomic on POSIX
+ */
+void DiskManager::WriteMasterRecord(const char *data, int size) {
+  std::string tmp_name = master_name_ + ".tmp";
+  std::ofstream master_io(tmp_name, std::ios::binary | std::ios::trunc | std::ios::out);
+  master_io.write(data, size);
+  master_io.flush();
+  if (master_io.bad()) {
+    LOG_DEBUG("I/O error while writing master record");
+    return;
+  }
+  master_io.close();
+  if (std::rename(tmp_name.c_str(), master_name_.c_str()) != 0) {
+    LOG_DEBUG("I/O error while replacing master record");
+  }
+}
+
+/**
+ * Read the master record
+ * @return: false means there is no master record yet
+ */
+bool DiskManager::ReadMasterRecord(char *data, int size) {
+  std::ifstream master_io(master_name_, std::ios::binary | std::ios::in);
+  if (!master_io.is_open()) {
+    return false;
+  }
+  master_io.read(data, size);
+  return master_io.gcount() == size;
+}
+
 /**
  * Allocate new page (operations like create index/table)
  * For now just keep an increasing counter
@@ -212,6 +431,109 @@ int DiskManager::GetNumWrites() const { return num_writes_; }
  */
 bool DiskManager::GetFlushState() const { return flush_log_; }
 
+/**
+ * Returns a snapshot of the I/O statistics
+ */
+DiskManagerStats DiskManager::GetStats() {
+  DiskManagerStats stats;
+  stats.read_latency_ = read_latency_.GetSnapshot();
+  stats.write_latency_ = write_latency_.GetSnapshot();
+  stats.log_read_latency_ = log_read_latency_.GetSnapshot();
+  stats.log_write_latency_ = log_write_latency_.GetSnapshot();
+  stats.sync_latency_ = sync_latency_.GetSnapshot();
+  stats.bytes_read_ = bytes_read_.load();
+  stats.bytes_written_ = bytes_written_.load();
+  stats.log_bytes_read_ = log_bytes_read_.load();
+  stats.log_bytes_written_ = log_bytes_written_.load();
+  std::scoped_lock<std::mutex> lck{slow_io_latch_};
+  stats.slow_ios_.assign(slow_ios_.begin(), slow_ios_.end());
+  return stats;
+}
+
+/**
+ * Clears all the I/O statistics, the legacy flush/write counters are kept
+ */
+void DiskManager::ResetStats() {
+  read_latency_.Reset();
+  write_latency_.Reset();
+  log_read_latency_.Reset();
+  log_write_latency_.Reset();
+  sync_latency_.Reset();
+  bytes_read_ = 0;
+  bytes_written_ = 0;
+  log_bytes_read_ = 0;
+  log_bytes_written_ = 0;
+  std::scoped_lock<std::mutex> lck{slow_io_latch_};
+  slow_ios_.clear();
+}
+
+/**
+ * Private helper function to account for one I/O started at start
+ */
+void DiskManager::RecordIO(IOType type, std::chrono::steady_clock::time_point start, page_id_t page_id, int size) {
+  auto latency = std::chrono::steady_clock::now() - start;
+  switch (type) {
+    case IOType::READ_PAGE:
+      read_latency_.Record(latency);
+      bytes_read_.fetch_add(size, std::memory_order_relaxed);
+      break;
+    case IOType::READ_LOG:
+      log_read_latency_.Record(latency);
+      log_bytes_read_.fetch_add(size, std::memory_order_relaxed);
+      break;
+    case IOType::WRITE_PAGE:
+      write_latency_.Record(latency);
+      bytes_written_.fetch_add(size, std::memory_order_relaxed);
+      break;
+    case IOType::WRITE_LOG:
+      log_write_latency_.Record(latency);
+      log_bytes_written_.fetch_add(size, std::memory_order_relaxed);
+      break;
+    case IOType::SYNC:
+      sync_latency_.Record(latency);
+      break;
+  }
+
+  // the fast path ends here unless the slow I/O trace is on and this I/O is slow.
+  auto latency_us = std::chrono::duration_cast<std::chrono::microseconds>(latency);
+  auto threshold_us = slow_io_threshold_us_.load(std::memory_order_relaxed);
+  if (threshold_us == 0 || latency_us.count() < threshold_us) {
+    return;
+  }
+  LOG_WARN("slow I/O: type %d, page %d, %d bytes, %ld us", static_cast<int>(type), page_id, size,
+           static_cast<int64_t>(latency_us.count()));
+  std::scoped_lock<std::mutex> lck{slow_io_latch_};
+  if (slow_ios_.size() == SLOW_IO_TRACE_SIZE) {
+    slow_ios_.pop_front();
+  }
+  slow_ios_.push_back({type, page_id, size, latency_us});
+}
+
+/**
+ * Private helper function to find the oldest and the newest log segment on disk
+ * The log ends in the newest segment
+ */
+void DiskManager::OpenLog() {
+  namespace fs = std::filesystem;
+  const fs::path log_path(log_name_);
+  const std::string prefix = log_path.filename().string() + ".";
+  std::error_code ec;
+  int last_segment = -1;
+  for (const auto &entry : fs::directory_iterator(log_path.has_parent_path() ? log_path.parent_path() : ".", ec)) {
+    const std::string name = entry.path().filename().string();
+    if (name.size() <= prefix.size() || name.compare(0, prefix.size(), prefix) != 0 ||
+        !std::all_of(name.begin() + prefix.size(), name.end(), ::isdigit)) {
+      continue;
+    }
+    const int segment = std::stoi(name.substr(prefix.size()));
+    first_log_segment_ = last_segment == -1 ? segment : std::min(first_log_segment_, segment);
+    last_segment = std::max(last_segment, segment);
+  }
+  if (last_segment != -1) {
+    log_size_ = SegmentStart(last_segment) + GetFileSize(GetLogSegmentName(last_segment));
+  }
+}
+
 /**
  * Private helper function to get disk file size
  */
@@ -0,0 +1,226 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// simulated_disk_manager.cpp
+//
+// Identification: src/storage/disk/simulated_disk_manager.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include "storage/disk/simulated_disk_manager.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <thread>  // NOLINT
+
+#include "common/macros.h"
+
+namespace bustub {
+
+SimulatedDiskManager::SimulatedDiskManager(const DiskProfile &profile, uint32_t seed)
+    : profile_(profile), generator_(seed), device_free_at_(std::chrono::steady_clock::now()) {}
+
+void SimulatedDiskManager::WritePage(page_id_t page_id, const char *page_data) {
+  auto start = std::chrono::steady_clock::now();
+  num_writes_ += 1;
+  SimulateIO(profile_.write_latency_, PAGE_SIZE);
+  {
+    std::scoped_lock<std::mutex> lck{pages_latch_};
+    auto &page = pages_[page_id];
+    if (page == nullptr) {
+      page = std::make_unique<char[]>(PAGE_SIZE);
+    }
+    memcpy(page.get(), page_data, PAGE_SIZE);
+  }
+  RecordIO(IOType::WRITE_PAGE, start, page_id, PAGE_SIZE);
+}
+
+void SimulatedDiskManager::ReadPage(page_id_t page_id, char *page_data) {
+  auto start = std::chrono::steady_clock::now();
+  SimulateIO(profile_.read_latency_, PAGE_SIZE);
+  {
+    std::scoped_lock<std::mutex> lck{pages_latch_};
+    auto it = pages_.find(page_id);
+    // like a read past the end of the file, a page that was never written reads as zeros.
+    if (it == pages_.end()) {
+      memset(page_data, 0, PAGE_SIZE);
+    } else {
+      memcpy(page_data, it->second.get(), PAGE_SIZE);
+    }
+  }
+  RecordIO(IOType::READ_PAGE, start, page_id, PAGE_SIZE);
+}
+
+void SimulatedDiskManager::WriteLog(char *log_data, int size) {
+  // no effect on num_flushes_ if log buffer is empty
+  if (size == 0) {
+    return;
+  }
+
+  flush_log_ = true;
+  if (flush_log_f_ != nullptr) {
+    // used for checking non-blocking flushing
+    assert(flush_log_f_->wait_for(std::chrono::seconds(10)) == std::future_status::ready);
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  num_flushes_ += 1;
+  SimulateIO(profile_.write_latency_, size);
+  {
+    std::scoped_lock<std::mutex> lck{log_latch_};
+    log_.insert(log_.end(), log_data, log_data + size);
+  }
+  auto sync_start = std::chrono::steady_clock::now();
+  SimulateIO(profile_.sync_latency_, 0);
+  RecordIO(IOType::SYNC, sync_start, INVALID_PAGE_ID, 0);
+  RecordIO(IOType::WRITE_LOG, start, INVALID_PAGE_ID, size);
+  flush_log_ = false;
+}
+
+bool SimulatedDiskManager::ReadLog(char *log_data, int size, int64_t offset) {
+  auto start = std::chrono::steady_clock::now();
+  int read_count;
+  {
+    std::scoped_lock<std::mutex> lck{log_latch_};
+    const int64_t log_end = log_start_ + static_cast<int64_t>(log_.size());
+    if (offset < log_start_ || offset >= log_end) {
+      return false;
+    }
+    read_count = static_cast<int>(std::min<int64_t>(size, log_end - offset));
+    memcpy(log_data, log_.data() + offset - log_start_, read_count);
+  }
+  // if log file ends before reading "size"
+  if (read_count < size) {
+    memset(log_data + read_count, 0, size - read_count);
+  }
+  SimulateIO(profile_.read_latency_, read_count);
+  RecordIO(IOType::READ_LOG, start, INVALID_PAGE_ID, read_count);
+  return true;
+}
+
+void SimulatedDiskManager::TruncateLog(int64_t offset) {
+  std::scoped_lock<std::mutex> lck{log_latch_};
+  // there are no segments in memory, the log is truncated exactly at offset.
+  const int64_t count = std::min(offset - log_start_, static_cast<int64_t>(log_.size()));
+  if (count > 0) {
+    log_.erase(log_.begin(), log_.begin() + count);
+    log_start_ += count;
+  }
+}
+
+int64_t SimulatedDiskManager::GetLogSize() {
+  std::scoped_lock<std::mutex> lck{log_latch_};
+  return log_start_ + static_cast<int64_t>(log_.size());
+}
+
+void SimulatedDiskManager::WriteLogStream(int stream, const char *log_data, int size) {
+  if (size == 0) {
+    return;
+  }
+  auto start = std::chrono::steady_clock::now();
+  num_flushes_ += 1;
+  SimulateIO(profile_.write_latency_, size);
+  {
+    std::scoped_lock<std::mutex> lck{log_latch_};
+    auto &log_stream = log_streams_[stream];
+    log_stream.insert(log_stream.end(), log_data, log_data + size);
+  }
+  auto sync_start = std::chrono::steady_clock::now();
+  SimulateIO(profile_.sync_latency_, 0);
+  RecordIO(IOType::SYNC, sync_start, INVALID_PAGE_ID, 0);
+  RecordIO(IOType::WRITE_LOG, start, INVALID_PAGE_ID, size);
+}
+
+bool SimulatedDiskManager::ReadLogStream(int stream, char *log_data, int size, int offset) {
+  auto start = std::chrono::steady_clock::now();
+  int read_count;
+  {
+    std::scoped_lock<std::mutex> lck{log_latch_};
+    auto it = log_streams_.find(stream);
+    if (it == log_streams_.end() || offset >= static_cast<int>(it->second.size())) {
+      return false;
+    }
+    read_count = std::min(size, static_cast<int>(it->second.size()) - offset);
+    memcpy(log_data, it->second.data() + offset, read_count);
+  }
+  if (read_count < size) {
+    memset(log_data + read_count, 0, size - read_count);
+  }
+  SimulateIO(profile_.read_latency_, read_count);
+  RecordIO(IOType::READ_LOG, start, INVALID_PAGE_ID, read_count);
+  return true;
+}
+
+int SimulatedDiskManager::GetLogStreamSize(int stream) {
+  std::scoped_lock<std::mutex> lck{log_latch_};
+  auto it = log_streams_.find(stream);
+  return it == log_streams_.end() ? -1 : static_cast<int>(it->second.size());
+}
+
+std::vector<int> SimulatedDiskManager::GetLogStreams() {
+  std::scoped_lock<std::mutex> lck{log_latch_};
+  std::vector<int> streams;
+  for (const auto &[stream, data] : log_streams_) {
+    streams.push_back(stream);
+  }
+  return streams;
+}
+
+void SimulatedDiskManager::RemoveLogStream(int stream) {
+  std::scoped_lock<std::mutex> lck{log_latch_};
+  log_streams_.erase(stream);
+}
+
+void SimulatedDiskManager::WriteMasterRecord(const char *data, int size) {
+  SimulateIO(profile_.write_latency_, size);
+  SimulateIO(profile_.sync_latency_, 0);
+  std::scoped_lock<std::mutex> lck{log_latch_};
+  master_.assign(data, data + size);
+}
+
+bool SimulatedDiskManager::ReadMasterRecord(char *data, int size) {
+  std::scoped_lock<std::mutex> lck{log_latch_};
+  if (static_cast<int>(master_.size()) != size) {
+    return false;
+  }
+  memcpy(data, master_.data(), size);
+  return true;
+}
+
+void SimulatedDiskManager::SimulateIO(std::chrono::microseconds latency, int size) {
+  std::chrono::steady_clock::time_point done;
+  {
+    std::scoped_lock<std::mutex> lck{device_latch_};
+    auto now = std::chrono::steady_clock::now();
+    done = now + DrawLatency(latency);
+    if (profile_.bandwidth_ != 0 && size > 0) {
+      // transfers are serialized on the device: queue behind whatever is still in flight.
+      auto transfer = std::chrono::nanoseconds(static_cast<int64_t>(size * 1e9 / profile_.bandwidth_));
+      device_free_at_ = std::max(device_free_at_, now) + transfer;
+      done = std::max(done, device_free_at_);
+    }
+  }
+  std::this_thread::sleep_until(done);
+}
+
+std::chrono::microseconds SimulatedDiskManager::DrawLatency(std::chrono::microseconds mean) {
+  if (mean.count() == 0) {
+    return mean;
+  }
+  switch (profile_.distribution_) {
+    case LatencyDistribution::CONSTANT:
+      return mean;
+    case LatencyDistribution::UNIFORM:
+      return std::chrono::microseconds(std::uniform_int_distribution<int64_t>(0, 2 * mean.count())(generator_));
+    case LatencyDistribution::EXPONENTIAL:
+      return std::chrono::microseconds(
+          static_cast<int64_t>(std::exponential_distribution<double>(1.0 / mean.count())(generator_)));
+  }
+  UNREACHABLE("unknown latency distribution");
+}
+
+}  // namespace bustub
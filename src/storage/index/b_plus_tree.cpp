@@ -9,6 +9,7 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include <cstring>
 #include <string>
 
 #include "common/exception.h"
@@ -59,13 +60,17 @@ bool IsNodeSafe(BPlusTreePage *node, const OP_TYPE &op_type) {
 
 INDEX_TEMPLATE_ARGUMENTS
 BPLUSTREE_TYPE::BPlusTree(std::string name, BufferPoolManager *buffer_pool_manager, const KeyComparator &comparator,
-                          int leaf_max_size, int internal_max_size)
+                          int leaf_max_size, int internal_max_size, LogManager *log_manager,
+                          LockManager *lock_manager)
     : index_name_(std::move(name)),
       root_page_id_(INVALID_PAGE_ID),
       buffer_pool_manager_(buffer_pool_manager),
       comparator_(comparator),
       leaf_max_size_(leaf_max_size),
-      internal_max_size_(internal_max_size) {}
+      internal_max_size_(internal_max_size),
+      log_manager_(log_manager),
+      lock_manager_(lock_manager),
+      name_hash_(HashUtil::HashBytes(index_name_.data(), index_name_.size())) {}
 
 INDEX_TEMPLATE_ARGUMENTS
 thread_local uint32_t BPLUSTREE_TYPE::root_latch_cnt_ = 0;
@@ -76,6 +81,47 @@ thread_local uint32_t BPLUSTREE_TYPE::root_latch_cnt_ = 0;
 INDEX_TEMPLATE_ARGUMENTS
 bool BPLUSTREE_TYPE::IsEmpty() const { return root_page_id_ == INVALID_PAGE_ID; }
 
+/*
+ * Look up the root page id of this tree in the header page
+ * @return : true means the header page has a record of this tree
+ */
+INDEX_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_TYPE::LoadRootPageId() {
+  HeaderPage *header_page = static_cast<HeaderPage *>(buffer_pool_manager_->FetchPage(HEADER_PAGE_ID));
+  if (header_page == nullptr) {
+    THROW_OOM("FetchPage fail");
+  }
+  page_id_t root_page_id{INVALID_PAGE_ID};
+  const bool found = header_page->GetRootId(index_name_, &root_page_id);
+  buffer_pool_manager_->UnpinPage(HEADER_PAGE_ID, false);
+
+  if (found) {
+    LatchRoot(OP_TYPE::INSERT);
+    root_page_id_ = root_page_id;
+    TryUnlatchRoot(OP_TYPE::INSERT);
+  }
+  return found;
+}
+
+/*
+ * Undo a leaf entry logged by a transaction that did not finish
+ * Recovery calls this once redo is done, so the header page has the root.
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_TYPE::UndoLeafEntry(const char *entry, bool reinsert) {
+  MappingType mapping;
+  memcpy(static_cast<void *>(&mapping), entry, sizeof(MappingType));
+  LoadRootPageId();
+  // the entry belongs to no live transaction, the one here only collects the pages to release.
+  Transaction transaction(INVALID_TXN_ID);
+  transaction.SetState(TransactionState::ABORTED);
+  if (reinsert) {
+    Insert(mapping.first, mapping.second, &transaction);
+  } else {
+    Remove(mapping.first, &transaction);
+  }
+}
+
 /*****************************************************************************
  * SEARCH
  *****************************************************************************/
@@ -86,6 +132,12 @@ bool BPLUSTREE_TYPE::IsEmpty() const { return root_page_id_ == INVALID_PAGE_ID;
  */
 INDEX_TEMPLATE_ARGUMENTS
 bool BPLUSTREE_TYPE::GetValue(const KeyType &key, std::vector<ValueType> *result, Transaction *transaction) {
+  // a missing key is locked through the gap it would be in.
+  std::optional<MappingType> next;
+  if (LocksKeys(transaction, LockMode::SHARED) && !LockNextKey(&key, true, LockMode::SHARED, transaction, &next)) {
+    return false;
+  }
+
   LatchRoot(OP_TYPE::READ);
   if (IsEmpty()) {
     TryUnlatchRoot(OP_TYPE::READ);
@@ -126,9 +178,13 @@ bool BPLUSTREE_TYPE::GetValue(const KeyType &key, std::vector<ValueType> *result
  */
 INDEX_TEMPLATE_ARGUMENTS
 bool BPLUSTREE_TYPE::Insert(const KeyType &key, const ValueType &value, Transaction *transaction) {
+  if (LocksKeys(transaction, LockMode::EXCLUSIVE) && !LockGap(key, transaction)) {
+    return false;
+  }
+
   LatchRoot(OP_TYPE::INSERT);
   if (IsEmpty()) {
-    StartNewTree(key, value);
+    StartNewTree(key, value, transaction);
 
     TryUnlatchRoot(OP_TYPE::INSERT);
     return true;
@@ -144,19 +200,22 @@ bool BPLUSTREE_TYPE::Insert(const KeyType &key, const ValueType &value, Transact
  * tree's root page id and insert entry directly into leaf page.
  */
 INDEX_TEMPLATE_ARGUMENTS
-void BPLUSTREE_TYPE::StartNewTree(const KeyType &key, const ValueType &value) {
+void BPLUSTREE_TYPE::StartNewTree(const KeyType &key, const ValueType &value, Transaction *transaction) {
   page_id_t page_id{INVALID_PAGE_ID};
   Page *page = buffer_pool_manager_->NewPage(&page_id);
   if (page == nullptr) {
     THROW_OOM("NewPage fail");
   }
 
-  root_page_id_ = page_id;
-  UpdateRootPageId(true);
-
   LeafPage *leaf_page = reinterpret_cast<LeafPage *>(page->GetData());
   leaf_page->Init(page_id, INVALID_PAGE_ID, leaf_max_size_);
+  LogHeader(leaf_page);
   leaf_page->Insert(key, value, comparator_);
+  LogEntries(LogRecordType::INDEX_INSERT, leaf_page, 0, 1, transaction);
+
+  // the root is logged once it is complete.
+  root_page_id_ = page_id;
+  UpdateRootPageId(true);
 
   buffer_pool_manager_->UnpinPage(page_id, true);
 }
@@ -192,8 +251,12 @@ bool BPLUSTREE_TYPE::InsertIntoLeaf(const KeyType &key, const ValueType &value,
   }
 
   const int old_size = leaf_page->GetSize();
+  const int index = leaf_page->KeyIndex(key, comparator_);
   const int size = leaf_page->Insert(key, value, comparator_);
   const bool is_dirty = (size > old_size);
+  if (is_dirty) {
+    LogEntries(LogRecordType::INDEX_INSERT, leaf_page, index, 1, transaction);
+  }
 
   if (size == leaf_page->GetMaxSize()) {
     assert(!is_safe);
@@ -233,6 +296,14 @@ N *BPLUSTREE_TYPE::Split(N *node) {
 
   N *split_node = reinterpret_cast<N *>(page->GetData());
   split_node->Init(page_id, node->GetParentPageId(), (node->IsLeafPage() ? leaf_max_size_ : internal_max_size_));
+  if (node->IsLeafPage()) {
+    reinterpret_cast<LeafPage *>(split_node)->SetNextPageId(reinterpret_cast<LeafPage *>(node)->GetNextPageId());
+  }
+  LogHeader(split_node);
+
+  // the moved entries are logged on both pages.
+  const int half_size = (node->GetSize() >> 1);
+  LogEntries(LogRecordType::INDEX_DELETE, node, node->GetSize() - half_size, half_size);
 
   if (node->IsLeafPage()) {
     LeafPage *leaf_node = reinterpret_cast<LeafPage *>(node);
@@ -240,15 +311,17 @@ N *BPLUSTREE_TYPE::Split(N *node) {
 
     leaf_node->MoveHalfTo(split_leaf_node);
 
-    split_leaf_node->SetNextPageId(leaf_node->GetNextPageId());
     leaf_node->SetNextPageId(page_id);
+    LogHeader(leaf_node);
 
   } else {
     InternalPage *internal_node = reinterpret_cast<InternalPage *>(node);
     InternalPage *split_internal_node = reinterpret_cast<InternalPage *>(split_node);
 
     internal_node->MoveHalfTo(split_internal_node, buffer_pool_manager_);
+    LogAdoptedChildren(split_internal_node, 0, half_size);
   }
+  LogEntries(LogRecordType::INDEX_INSERT, split_node, 0, half_size);
 
   return split_node;
 }
@@ -272,15 +345,20 @@ void BPLUSTREE_TYPE::InsertIntoParent(BPlusTreePage *old_node, const KeyType &ke
       THROW_OOM("NewPage fail");
     }
 
-    root_page_id_ = page_id;
-    UpdateRootPageId(false);
-
     InternalPage *new_root_node = reinterpret_cast<InternalPage *>(page->GetData());
     new_root_node->Init(page_id, INVALID_PAGE_ID, internal_max_size_);
+    LogHeader(new_root_node);
     new_root_node->PopulateNewRoot(old_node->GetPageId(), key, new_node->GetPageId());
+    LogEntries(LogRecordType::INDEX_INSERT, new_root_node, 0, 2);
 
     old_node->SetParentPageId(page_id);
+    LogHeader(old_node);
     new_node->SetParentPageId(page_id);
+    LogHeader(new_node);
+
+    // the root is logged once it is complete.
+    root_page_id_ = page_id;
+    UpdateRootPageId(false);
 
     buffer_pool_manager_->UnpinPage(new_node->GetPageId(), true);
     buffer_pool_manager_->UnpinPage(page_id, true);
@@ -295,6 +373,7 @@ void BPLUSTREE_TYPE::InsertIntoParent(BPlusTreePage *old_node, const KeyType &ke
   InternalPage *parent_page = reinterpret_cast<InternalPage *>(page->GetData());
 
   const int size = parent_page->InsertNodeAfter(old_node->GetPageId(), key, new_node->GetPageId());
+  LogEntries(LogRecordType::INDEX_INSERT, parent_page, parent_page->ValueIndex(new_node->GetPageId()), 1);
 
   buffer_pool_manager_->UnpinPage(new_node->GetPageId(), true);
   buffer_pool_manager_->UnpinPage(parent_page->GetPageId(), true);
@@ -319,6 +398,10 @@ void BPLUSTREE_TYPE::InsertIntoParent(BPlusTreePage *old_node, const KeyType &ke
  */
 INDEX_TEMPLATE_ARGUMENTS
 void BPLUSTREE_TYPE::Remove(const KeyType &key, Transaction *transaction) {
+  if (LocksKeys(transaction, LockMode::EXCLUSIVE) && !LockGap(key, transaction)) {
+    return;
+  }
+
   Page *page = FindLeafPageOptimistic(key, transaction);
   if (page == nullptr) {
     return;
@@ -340,6 +423,10 @@ void BPLUSTREE_TYPE::Remove(const KeyType &key, Transaction *transaction) {
   }
 
   const int old_size = leaf_page->GetSize();
+  const int index = leaf_page->KeyIndex(key, comparator_);
+  if (index < old_size && comparator_(leaf_page->KeyAt(index), key) == 0) {
+    LogEntries(LogRecordType::INDEX_DELETE, leaf_page, index, 1, transaction);
+  }
   const int size = leaf_page->RemoveAndDeleteRecord(key, comparator_);
 
   if (size < leaf_page->GetMinSize()) {
@@ -471,12 +558,16 @@ bool BPLUSTREE_TYPE::Coalesce(N **neighbor_node_, N **node_, InternalPage **pare
     std::swap(node, neighbor_node);
   }
 
+  // node is deleted, so only the entries it hands over to its neighbor are logged.
   const int node_index = parent->ValueIndex(node->GetPageId());
+  const int old_size = neighbor_node->GetSize();
   if (node->IsLeafPage()) {
     LeafPage *leaf_node = reinterpret_cast<LeafPage *>(node);
     LeafPage *neighbor_leaf_node = reinterpret_cast<LeafPage *>(neighbor_node);
 
     leaf_node->MoveAllTo(neighbor_leaf_node);
+    LogEntries(LogRecordType::INDEX_INSERT, neighbor_node, old_size, neighbor_node->GetSize() - old_size);
+    LogHeader(neighbor_node);
 
   } else {
     InternalPage *internal_node = reinterpret_cast<InternalPage *>(node);
@@ -484,10 +575,13 @@ bool BPLUSTREE_TYPE::Coalesce(N **neighbor_node_, N **node_, InternalPage **pare
 
     const KeyType &mid_key = parent->KeyAt(node_index);
     internal_node->MoveAllTo(neighbor_internal_node, mid_key, buffer_pool_manager_);
+    LogEntries(LogRecordType::INDEX_INSERT, neighbor_node, old_size, neighbor_node->GetSize() - old_size);
+    LogAdoptedChildren(neighbor_internal_node, old_size, neighbor_node->GetSize() - old_size);
   }
 
   transaction->AddIntoDeletedPageSet(node->GetPageId());
 
+  LogEntries(LogRecordType::INDEX_DELETE, parent, node_index, 1);
   parent->Remove(node_index);
   if (parent->GetSize() < parent->GetMinSize()) {
     return CoalesceOrRedistribute(parent, transaction);
@@ -521,11 +615,17 @@ void BPLUSTREE_TYPE::Redistribute(N *neighbor_node, N *node, int index) {
     LeafPage *neighbor_leaf_node = reinterpret_cast<LeafPage *>(neighbor_node);
 
     if (index == NODE_IS_LEFT) {
+      LogEntries(LogRecordType::INDEX_DELETE, neighbor_node, 0, 1);
       neighbor_leaf_node->MoveFirstToEndOf(leaf_node);
+      LogEntries(LogRecordType::INDEX_INSERT, node, node->GetSize() - 1, 1);
       parent->SetKeyAt(node_index + 1, neighbor_leaf_node->KeyAt(0));
+      LogEntryWrite(parent, node_index + 1);
     } else {
+      LogEntries(LogRecordType::INDEX_DELETE, neighbor_node, neighbor_node->GetSize() - 1, 1);
       neighbor_leaf_node->MoveLastToFrontOf(leaf_node);
+      LogEntries(LogRecordType::INDEX_INSERT, node, 0, 1);
       parent->SetKeyAt(node_index, leaf_node->KeyAt(0));
+      LogEntryWrite(parent, node_index);
     }
 
   } else {
@@ -536,10 +636,20 @@ void BPLUSTREE_TYPE::Redistribute(N *neighbor_node, N *node, int index) {
 
     if (index == NODE_IS_LEFT) {
       parent->SetKeyAt(node_index + 1, neighbor_internal_node->KeyAt(1));
+      LogEntryWrite(parent, node_index + 1);
+      LogEntries(LogRecordType::INDEX_DELETE, neighbor_node, 0, 1);
       neighbor_internal_node->MoveFirstToEndOf(internal_node, mid_key, buffer_pool_manager_);
+      LogEntries(LogRecordType::INDEX_INSERT, node, node->GetSize() - 1, 1);
+      LogAdoptedChildren(internal_node, node->GetSize() - 1, 1);
     } else {
       parent->SetKeyAt(node_index, neighbor_internal_node->KeyAt(neighbor_internal_node->GetSize() - 1));
+      LogEntryWrite(parent, node_index);
+      LogEntries(LogRecordType::INDEX_DELETE, neighbor_node, neighbor_node->GetSize() - 1, 1);
       neighbor_internal_node->MoveLastToFrontOf(internal_node, mid_key, buffer_pool_manager_);
+      // the moved child goes first and the old first child gets the middle key.
+      LogEntries(LogRecordType::INDEX_INSERT, node, 0, 1);
+      LogEntryWrite(internal_node, 1);
+      LogAdoptedChildren(internal_node, 0, 1);
     }
   }
 
@@ -561,17 +671,21 @@ bool BPLUSTREE_TYPE::AdjustRoot(BPlusTreePage *old_root_node) {
   bool shall_delete_root{false};
 
   if (!old_root_node->IsLeafPage() && old_root_node->GetSize() == 1) {
+    LogEntries(LogRecordType::INDEX_DELETE, old_root_node, 0, 1);
     const page_id_t &child_page_id = reinterpret_cast<InternalPage *>(old_root_node)->RemoveAndReturnOnlyChild();
-    root_page_id_ = child_page_id;
-    UpdateRootPageId(false);
 
     Page *page = buffer_pool_manager_->FetchPage(child_page_id);
     if (page == nullptr) {
       THROW_OOM("FetchPage fail");
     }
-    reinterpret_cast<BPlusTreePage *>(page->GetData())->SetParentPageId(INVALID_PAGE_ID);
+    BPlusTreePage *child_node = reinterpret_cast<BPlusTreePage *>(page->GetData());
+    child_node->SetParentPageId(INVALID_PAGE_ID);
+    LogHeader(child_node);
     buffer_pool_manager_->UnpinPage(child_page_id, true);
 
+    root_page_id_ = child_page_id;
+    UpdateRootPageId(false);
+
     shall_delete_root = true;
 
   } else if (old_root_node->IsLeafPage() && old_root_node->GetSize() == 0) {
@@ -592,12 +706,14 @@ bool BPLUSTREE_TYPE::AdjustRoot(BPlusTreePage *old_root_node) {
  * @return : index iterator
  */
 INDEX_TEMPLATE_ARGUMENTS
-INDEXITERATOR_TYPE BPLUSTREE_TYPE::begin() {
+INDEXITERATOR_TYPE BPLUSTREE_TYPE::begin(Transaction *transaction) {
+  if (LocksKeys(transaction, LockMode::SHARED)) {
+    return BeginLocked(nullptr, transaction);
+  }
   KeyType unused_key{};
   Page *page = FindLeafPage(unused_key, true);
   LeafPage *leaf_page = reinterpret_cast<LeafPage *>(page->GetData());
-  IndexIterator iter(leaf_page, 0, buffer_pool_manager_);
-  return iter;
+  return IndexIterator(leaf_page, 0, buffer_pool_manager_);
 }
 
 /*
@@ -606,12 +722,14 @@ INDEXITERATOR_TYPE BPLUSTREE_TYPE::begin() {
  * @return : index iterator
  */
 INDEX_TEMPLATE_ARGUMENTS
-INDEXITERATOR_TYPE BPLUSTREE_TYPE::Begin(const KeyType &key) {
+INDEXITERATOR_TYPE BPLUSTREE_TYPE::Begin(const KeyType &key, Transaction *transaction) {
+  if (LocksKeys(transaction, LockMode::SHARED)) {
+    return BeginLocked(&key, transaction);
+  }
   Page *page = FindLeafPage(key);
   LeafPage *leaf_page = reinterpret_cast<LeafPage *>(page->GetData());
   const int key_index = leaf_page->KeyIndex(key, comparator_);
-  IndexIterator iter(leaf_page, key_index, buffer_pool_manager_);
-  return iter;
+  return IndexIterator(leaf_page, key_index, buffer_pool_manager_);
 }
 
 /*
@@ -627,6 +745,133 @@ INDEXITERATOR_TYPE BPLUSTREE_TYPE::end() {
   return iter;
 }
 
+/*****************************************************************************
+ * KEY-RANGE LOCKING
+ *****************************************************************************/
+INDEX_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_TYPE::LocksKeys(Transaction *transaction, LockMode lock_mode) const {
+  if (lock_manager_ == nullptr || transaction == nullptr || !enable_logging ||
+      transaction->GetState() == TransactionState::ABORTED) {
+    // an aborted transaction holds the locks of what it rolls back already.
+    return false;
+  }
+  return lock_mode == LockMode::EXCLUSIVE ||
+         (transaction->GetIsolationLevel() != IsolationLevel::READ_UNCOMMITTED &&
+          transaction->GetIsolationLevel() != IsolationLevel::SNAPSHOT_ISOLATION &&
+          transaction->GetConcurrencyControl() == ConcurrencyControl::TWO_PHASE_LOCKING);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+RID BPLUSTREE_TYPE::KeyLock(const KeyType *key) const {
+  hash_t hash = name_hash_;
+  if (key != nullptr) {
+    hash = HashUtil::CombineHashes(hash, HashUtil::HashBytes(reinterpret_cast<const char *>(key), sizeof(KeyType)));
+  }
+  return RID(KEY_LOCK_PAGE_ID, static_cast<uint32_t>(hash));
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_TYPE::LockKey(const RID &lock, LockMode lock_mode, Transaction *transaction) {
+  if (transaction->IsExclusiveLocked(lock)) {
+    return true;
+  }
+  if (lock_mode == LockMode::SHARED) {
+    return transaction->IsSharedLocked(lock) || lock_manager_->LockShared(transaction, lock);
+  }
+  if (transaction->IsSharedLocked(lock)) {
+    return lock_manager_->LockUpgrade(transaction, lock);
+  }
+  return lock_manager_->LockExclusive(transaction, lock);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+std::optional<MappingType> BPLUSTREE_TYPE::FindNextKey(const KeyType *key, bool inclusive) {
+  KeyType unused_key{};
+  Page *page = FindLeafPageCrabbing(key != nullptr ? *key : unused_key, nullptr, OP_TYPE::READ, key == nullptr);
+  if (page == nullptr) {
+    return std::nullopt;
+  }
+  LeafPage *leaf_page = reinterpret_cast<LeafPage *>(page->GetData());
+  int index = 0;
+  if (key != nullptr) {
+    index = leaf_page->KeyIndex(*key, comparator_);
+    if (!inclusive && index < leaf_page->GetSize() && comparator_(leaf_page->KeyAt(index), *key) == 0) {
+      ++index;
+    }
+  }
+  TryUnlatchRoot(OP_TYPE::READ);
+
+  // the next leaf is pinned before this one is unlatched, so that it is not
+  // deleted in between, and latched after, since writers latch siblings from
+  // right to left.
+  while (index == leaf_page->GetSize() && leaf_page->GetNextPageId() != INVALID_PAGE_ID) {
+    Page *next_page = buffer_pool_manager_->FetchPage(leaf_page->GetNextPageId());
+    if (next_page == nullptr) {
+      THROW_OOM("FetchPage fail");
+    }
+    page->RUnlatch();
+    buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+    next_page->RLatch();
+    page = next_page;
+    leaf_page = reinterpret_cast<LeafPage *>(page->GetData());
+    index = 0;
+  }
+
+  std::optional<MappingType> next;
+  if (index < leaf_page->GetSize()) {
+    next = leaf_page->GetItem(index);
+  }
+  page->RUnlatch();
+  buffer_pool_manager_->UnpinPage(page->GetPageId(), false);
+  return next;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_TYPE::LockNextKey(const KeyType *key, bool inclusive, LockMode lock_mode, Transaction *transaction,
+                                 std::optional<MappingType> *next) {
+  *next = FindNextKey(key, inclusive);
+  while (true) {
+    const RID lock = KeyLock(next->has_value() ? &(*next)->first : nullptr);
+    if (!LockKey(lock, lock_mode, transaction)) {
+      return false;
+    }
+    // changing the gap takes an exclusive lock on the key that covers it, so
+    // once the lock is granted, the next key stays the same.
+    *next = FindNextKey(key, inclusive);
+    if (KeyLock(next->has_value() ? &(*next)->first : nullptr) == lock) {
+      return true;
+    }
+  }
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+bool BPLUSTREE_TYPE::LockGap(const KeyType &key, Transaction *transaction) {
+  std::optional<MappingType> next;
+  return LockKey(KeyLock(&key), LockMode::EXCLUSIVE, transaction) &&
+         LockNextKey(&key, false, LockMode::EXCLUSIVE, transaction, &next);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_TYPE::SeekLocked(INDEXITERATOR_TYPE *iterator, const KeyType *key, bool inclusive) {
+  std::optional<MappingType> next;
+  // a scan whose transaction is aborted ends right away.
+  const bool locked = LockNextKey(key, inclusive, LockMode::SHARED, iterator->txn_, &next);
+  iterator->is_end_ = !locked || !next.has_value();
+  if (!iterator->is_end_) {
+    iterator->item_ = *next;
+  }
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+INDEXITERATOR_TYPE BPLUSTREE_TYPE::BeginLocked(const KeyType *key, Transaction *transaction) {
+  // the iterator holds no page, so copying it is fine.
+  INDEXITERATOR_TYPE iter(nullptr, 0, nullptr, true);
+  iter.tree_ = this;
+  iter.txn_ = transaction;
+  SeekLocked(&iter, key, true);
+  return iter;
+}
+
 /*****************************************************************************
  * UTILITIES AND DEBUG
  *****************************************************************************/
@@ -713,7 +958,8 @@ void BPLUSTREE_TYPE::FreeAllPages(Transaction *transaction) {
 }
 
 INDEX_TEMPLATE_ARGUMENTS
-Page *BPLUSTREE_TYPE::FindLeafPageCrabbing(const KeyType &key, Transaction *transaction, const OP_TYPE &op_type) {
+Page *BPLUSTREE_TYPE::FindLeafPageCrabbing(const KeyType &key, Transaction *transaction, const OP_TYPE &op_type,
+                                           bool left_most) {
   LatchRoot(op_type);
   if (IsEmpty()) {
     TryUnlatchRoot(op_type);
@@ -732,7 +978,8 @@ Page *BPLUSTREE_TYPE::FindLeafPageCrabbing(const KeyType &key, Transaction *tran
 
   BPlusTreePage *node = reinterpret_cast<BPlusTreePage *>(page->GetData());
   while (!node->IsLeafPage()) {
-    const page_id_t child_page_id = reinterpret_cast<InternalPage *>(node)->Lookup(key, comparator_);
+    InternalPage *internal_node = reinterpret_cast<InternalPage *>(node);
+    const page_id_t child_page_id = left_most ? internal_node->ValueAt(0) : internal_node->Lookup(key, comparator_);
     Page *child_page = buffer_pool_manager_->FetchPage(child_page_id);
     if (child_page == nullptr) {
       THROW_OOM("FetchPage fail");
@@ -811,16 +1058,70 @@ Page *BPLUSTREE_TYPE::FindLeafPageOptimistic(const KeyType &key, Transaction *tr
 INDEX_TEMPLATE_ARGUMENTS
 void BPLUSTREE_TYPE::UpdateRootPageId(int insert_record) {
   HeaderPage *header_page = static_cast<HeaderPage *>(buffer_pool_manager_->FetchPage(HEADER_PAGE_ID));
-  if (insert_record != 0) {
-    // create a new record<index_name + root_page_id> in header_page
-    header_page->InsertRecord(index_name_, root_page_id_);
-  } else {
+  if (IsLogging()) {
+    LogRecord log_record(INVALID_TXN_ID, INVALID_LSN, index_name_, root_page_id_);
+    const lsn_t lsn = log_manager_->AppendLogRecord(&log_record);
+    // the header page has no lsn for the buffer pool to force the log up to before writing it, so the log is forced
+    // right away. Roots change rarely.
+    log_manager_->WaitUntilPersistent(lsn);
+  }
+  // a reopened tree that was emptied already has a record.
+  if (insert_record == 0 || !header_page->InsertRecord(index_name_, root_page_id_)) {
     // update root_page_id in header_page
     header_page->UpdateRecord(index_name_, root_page_id_);
   }
   buffer_pool_manager_->UnpinPage(HEADER_PAGE_ID, true);
 }
 
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_TYPE::LogEntries(LogRecordType type, BPlusTreePage *node, int index, int num_entries,
+                                Transaction *transaction) {
+  if (!IsLogging() || num_entries == 0) {
+    return;
+  }
+  const size_t entry_size = EntrySize(node);
+  const txn_id_t txn_id = (transaction != nullptr ? transaction->GetTransactionId() : INVALID_TXN_ID);
+  const lsn_t prev_lsn = (transaction != nullptr ? transaction->GetPrevLSN() : INVALID_LSN);
+  const lsn_t lsn = log_manager_->AppendIndexLogRecord(txn_id, prev_lsn, type, index_name_, node->GetPageId(), index,
+                                                       node->EntryAt(index, entry_size), entry_size, num_entries);
+  node->SetLSN(lsn);
+  if (transaction != nullptr) {
+    transaction->SetPrevLSN(lsn);
+  }
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_TYPE::LogWrite(BPlusTreePage *node, size_t offset, size_t size) {
+  if (!IsLogging()) {
+    return;
+  }
+  const lsn_t lsn =
+      log_manager_->AppendIndexLogRecord(INVALID_TXN_ID, INVALID_LSN, LogRecordType::INDEX_WRITE, index_name_,
+                                         node->GetPageId(), offset, reinterpret_cast<char *>(node) + offset, size, 1);
+  node->SetLSN(lsn);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_TYPE::LogEntryWrite(BPlusTreePage *node, int index) {
+  const size_t entry_size = EntrySize(node);
+  LogWrite(node, node->EntryAt(index, entry_size) - reinterpret_cast<char *>(node), entry_size);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void BPLUSTREE_TYPE::LogAdoptedChildren(InternalPage *node, int index, int num_entries) {
+  if (!IsLogging()) {
+    return;
+  }
+  for (int i = index; i < index + num_entries; ++i) {
+    Page *page = buffer_pool_manager_->FetchPage(node->ValueAt(i));
+    if (page == nullptr) {
+      THROW_OOM("FetchPage fail");
+    }
+    LogHeader(reinterpret_cast<BPlusTreePage *>(page->GetData()));
+    buffer_pool_manager_->UnpinPage(page->GetPageId(), true);
+  }
+}
+
 /*
  * This method is used for test only
  * Read data from file and insert one by one
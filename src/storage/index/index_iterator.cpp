@@ -4,6 +4,7 @@
 #include <cassert>
 
 #include "common/exception.h"
+#include "storage/index/b_plus_tree.h"
 #include "storage/index/index_iterator.h"
 
 #define THROW_OOM(msg) throw Exception(ExceptionType::OUT_OF_MEMORY, (msg));
@@ -31,7 +32,9 @@ INDEX_TEMPLATE_ARGUMENTS
 bool INDEXITERATOR_TYPE::isEnd() const { return is_end_; }
 
 INDEX_TEMPLATE_ARGUMENTS
-const MappingType &INDEXITERATOR_TYPE::operator*() const { return leaf_page_->GetItem(index_); }
+const MappingType &INDEXITERATOR_TYPE::operator*() const {
+  return tree_ != nullptr ? item_ : leaf_page_->GetItem(index_);
+}
 
 INDEX_TEMPLATE_ARGUMENTS
 INDEXITERATOR_TYPE &INDEXITERATOR_TYPE::operator++() {
@@ -39,6 +42,12 @@ INDEXITERATOR_TYPE &INDEXITERATOR_TYPE::operator++() {
     return *this;
   }
 
+  if (tree_ != nullptr) {
+    const KeyType key = item_.first;
+    tree_->SeekLocked(this, &key, false);
+    return *this;
+  }
+
   if (index_ < leaf_page_->GetSize() - 1) {
     ++index_;
   } else {
@@ -275,7 +275,7 @@ void B_PLUS_TREE_INTERNAL_PAGE_TYPE::MoveLastToFrontOf(BPlusTreeInternalPage *re
  */
 INDEX_TEMPLATE_ARGUMENTS
 void B_PLUS_TREE_INTERNAL_PAGE_TYPE::CopyFirstFrom(const MappingType &item, BufferPoolManager *buffer_pool_manager) {
-  for (int i = GetSize(); i > 1; --i) {
+  for (int i = GetSize(); i > 0; --i) {
     array_[i] = array_[i - 1];
   }
   array_[0].second = item.second;
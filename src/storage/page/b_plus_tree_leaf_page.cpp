@@ -113,7 +113,7 @@ bool B_PLUS_TREE_LEAF_PAGE_TYPE::Lookup(const KeyType &key, ValueType *value, co
 INDEX_TEMPLATE_ARGUMENTS
 int B_PLUS_TREE_LEAF_PAGE_TYPE::Insert(const KeyType &key, const ValueType &value, const KeyComparator &comparator) {
   const int pos = LowerBound(key, comparator);
-  if (comparator(KeyAt(pos), key) == 0) {
+  if (pos < GetSize() && comparator(KeyAt(pos), key) == 0) {
     return GetSize();
   }
   for (int i = GetSize(); i > pos; --i) {
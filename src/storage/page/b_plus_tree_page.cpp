@@ -11,6 +11,11 @@
 
 #include "storage/page/b_plus_tree_page.h"
 
+#include <cstring>
+
+#include "storage/page/b_plus_tree_internal_page.h"
+#include "storage/page/b_plus_tree_leaf_page.h"
+
 namespace bustub {
 
 /*
@@ -58,4 +63,27 @@ void BPlusTreePage::SetPageId(page_id_t page_id) { page_id_ = page_id; }
  */
 void BPlusTreePage::SetLSN(lsn_t lsn) { lsn_ = lsn; }
 
+/*
+ * Helper methods to access the entries as raw bytes
+ * Leaf pages keep the next page id in their header, so their entries start
+ * further into the page than those of internal pages
+ */
+size_t BPlusTreePage::GetHeaderSize() const { return IsLeafPage() ? LEAF_PAGE_HEADER_SIZE : INTERNAL_PAGE_HEADER_SIZE; }
+
+char *BPlusTreePage::EntryAt(int index, size_t entry_size) {
+  return reinterpret_cast<char *>(this) + GetHeaderSize() + index * entry_size;
+}
+
+void BPlusTreePage::InsertEntries(int index, const char *entries, int num_entries, size_t entry_size) {
+  memmove(EntryAt(index + num_entries, entry_size), EntryAt(index, entry_size), (size_ - index) * entry_size);
+  memcpy(EntryAt(index, entry_size), entries, num_entries * entry_size);
+  size_ += num_entries;
+}
+
+void BPlusTreePage::RemoveEntries(int index, int num_entries, size_t entry_size) {
+  memmove(EntryAt(index, entry_size), EntryAt(index + num_entries, entry_size),
+          (size_ - index - num_entries) * entry_size);
+  size_ -= num_entries;
+}
+
 }  // namespace bustub
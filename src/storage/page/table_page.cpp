@@ -12,7 +12,9 @@
 
 #include "storage/page/table_page.h"
 
+#include <algorithm>
 #include <cassert>
+#include <vector>
 
 namespace bustub {
 
@@ -21,7 +23,7 @@ void TablePage::Init(page_id_t page_id, uint32_t page_size, page_id_t prev_page_
   // Set the page ID.
   memcpy(GetData(), &page_id, sizeof(page_id));
   // Log that we are creating a new page.
-  if (enable_logging) {
+  if (enable_logging && txn != nullptr) {
     LogRecord log_record =
         LogRecord(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::NEWPAGE, prev_page_id, page_id);
     lsn_t lsn = log_manager->AppendLogRecord(&log_record);
@@ -36,7 +38,7 @@ void TablePage::Init(page_id_t page_id, uint32_t page_size, page_id_t prev_page_
 }
 
 bool TablePage::InsertTuple(const Tuple &tuple, RID *rid, Transaction *txn, LockManager *lock_manager,
-                            LogManager *log_manager) {
+                            LogManager *log_manager, table_oid_t table_oid) {
   BUSTUB_ASSERT(tuple.size_ > 0, "Cannot have empty tuples.");
   // If there is not enough space, then return false.
   if (GetFreeSpaceRemaining() < tuple.size_ + SIZE_TUPLE) {
@@ -72,24 +74,26 @@ bool TablePage::InsertTuple(const Tuple &tuple, RID *rid, Transaction *txn, Lock
   }
 
   // Write the log record.
-  if (enable_logging) {
+  if (enable_logging && txn != nullptr) {
     BUSTUB_ASSERT(!txn->IsSharedLocked(*rid) && !txn->IsExclusiveLocked(*rid), "A new tuple should not be locked.");
     // Acquire an exclusive lock on the new tuple.
-    bool locked = lock_manager->LockExclusive(txn, *rid);
+    bool locked = lock_manager->LockExclusive(txn, *rid, table_oid);
     BUSTUB_ASSERT(locked, "Locking a new tuple should always work.");
-    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::INSERT, *rid, tuple);
-    lsn_t lsn = log_manager->AppendLogRecord(&log_record);
+    // The tuple bytes go straight into the log buffer, see LogManager::AppendTupleLogRecord.
+    lsn_t lsn = log_manager->AppendTupleLogRecord(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::INSERT,
+                                                  *rid, tuple.data_, tuple.size_);
     SetLSN(lsn);
     txn->SetPrevLSN(lsn);
   }
   return true;
 }
 
-bool TablePage::MarkDelete(const RID &rid, Transaction *txn, LockManager *lock_manager, LogManager *log_manager) {
+bool TablePage::MarkDelete(const RID &rid, Transaction *txn, LockManager *lock_manager, LogManager *log_manager,
+                           table_oid_t table_oid) {
   uint32_t slot_num = rid.GetSlotNum();
   // If the slot number is invalid, abort the transaction.
   if (slot_num >= GetTupleCount()) {
-    if (enable_logging) {
+    if (enable_logging && txn != nullptr) {
       txn->SetState(TransactionState::ABORTED);
     }
     return false;
@@ -98,24 +102,23 @@ bool TablePage::MarkDelete(const RID &rid, Transaction *txn, LockManager *lock_m
   uint32_t tuple_size = GetTupleSize(slot_num);
   // If the tuple is already deleted, abort the transaction.
   if (IsDeleted(tuple_size)) {
-    if (enable_logging) {
+    if (enable_logging && txn != nullptr) {
       txn->SetState(TransactionState::ABORTED);
     }
     return false;
   }
 
-  if (enable_logging) {
+  if (enable_logging && txn != nullptr) {
     // Acquire an exclusive lock, upgrading from a shared lock if necessary.
     if (txn->IsSharedLocked(rid)) {
-      if (!lock_manager->LockUpgrade(txn, rid)) {
+      if (!lock_manager->LockUpgrade(txn, rid, table_oid)) {
         return false;
       }
-    } else if (!txn->IsExclusiveLocked(rid) && !lock_manager->LockExclusive(txn, rid)) {
+    } else if (!txn->IsExclusiveLocked(rid) && !lock_manager->LockExclusive(txn, rid, table_oid)) {
       return false;
     }
-    Tuple dummy_tuple;
-    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::MARKDELETE, rid, dummy_tuple);
-    lsn_t lsn = log_manager->AppendLogRecord(&log_record);
+    lsn_t lsn = log_manager->AppendTupleLogRecord(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::MARKDELETE,
+                                                  rid, nullptr, 0);
     SetLSN(lsn);
     txn->SetPrevLSN(lsn);
   }
@@ -128,12 +131,12 @@ bool TablePage::MarkDelete(const RID &rid, Transaction *txn, LockManager *lock_m
 }
 
 bool TablePage::UpdateTuple(const Tuple &new_tuple, Tuple *old_tuple, const RID &rid, Transaction *txn,
-                            LockManager *lock_manager, LogManager *log_manager) {
+                            LockManager *lock_manager, LogManager *log_manager, table_oid_t table_oid) {
   BUSTUB_ASSERT(new_tuple.size_ > 0, "Cannot have empty tuples.");
   uint32_t slot_num = rid.GetSlotNum();
   // If the slot number is invalid, abort the transaction.
   if (slot_num >= GetTupleCount()) {
-    if (enable_logging) {
+    if (enable_logging && txn != nullptr) {
       txn->SetState(TransactionState::ABORTED);
     }
     return false;
@@ -141,7 +144,7 @@ bool TablePage::UpdateTuple(const Tuple &new_tuple, Tuple *old_tuple, const RID
   uint32_t tuple_size = GetTupleSize(slot_num);
   // If the tuple is deleted, abort the transaction.
   if (IsDeleted(tuple_size)) {
-    if (enable_logging) {
+    if (enable_logging && txn != nullptr) {
       txn->SetState(TransactionState::ABORTED);
     }
     return false;
@@ -162,17 +165,19 @@ bool TablePage::UpdateTuple(const Tuple &new_tuple, Tuple *old_tuple, const RID
   old_tuple->rid_ = rid;
   old_tuple->allocated_ = true;
 
-  if (enable_logging) {
+  if (enable_logging && txn != nullptr) {
     // Acquire an exclusive lock, upgrading from shared if necessary.
     if (txn->IsSharedLocked(rid)) {
-      if (!lock_manager->LockUpgrade(txn, rid)) {
+      if (!lock_manager->LockUpgrade(txn, rid, table_oid)) {
         return false;
       }
-    } else if (!txn->IsExclusiveLocked(rid) && !lock_manager->LockExclusive(txn, rid)) {
+    } else if (!txn->IsExclusiveLocked(rid) && !lock_manager->LockExclusive(txn, rid, table_oid)) {
       return false;
     }
-    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::UPDATE, rid, *old_tuple, new_tuple);
-    lsn_t lsn = log_manager->AppendLogRecord(&log_record);
+    // Log the old value from the page itself rather than from the copy handed back to the caller.
+    lsn_t lsn = log_manager->AppendUpdateLogRecord(txn->GetTransactionId(), txn->GetPrevLSN(), rid,
+                                                   GetData() + tuple_offset, tuple_size, new_tuple.data_,
+                                                   new_tuple.size_);
     SetLSN(lsn);
     txn->SetPrevLSN(lsn);
   }
@@ -197,6 +202,13 @@ bool TablePage::UpdateTuple(const Tuple &new_tuple, Tuple *old_tuple, const RID
   return true;
 }
 
+void TablePage::WriteTupleBytes(const RID &rid, uint32_t offset, const char *data, uint32_t size) {
+  uint32_t slot_num = rid.GetSlotNum();
+  BUSTUB_ASSERT(slot_num < GetTupleCount(), "Cannot have more slots than tuples.");
+  BUSTUB_ASSERT(offset + size <= UnsetDeletedFlag(GetTupleSize(slot_num)), "Cannot write past the end of a tuple.");
+  memcpy(GetData() + GetTupleOffsetAtSlot(slot_num) + offset, data, size);
+}
+
 void TablePage::ApplyDelete(const RID &rid, Transaction *txn, LogManager *log_manager) {
   uint32_t slot_num = rid.GetSlotNum();
   BUSTUB_ASSERT(slot_num < GetTupleCount(), "Cannot have more slots than tuples.");
@@ -209,19 +221,13 @@ void TablePage::ApplyDelete(const RID &rid, Transaction *txn, LogManager *log_ma
   }
   // Otherwise we are rolling back an insert.
 
-  // We need to copy out the deleted tuple for undo purposes.
-  Tuple delete_tuple;
-  delete_tuple.size_ = tuple_size;
-  delete_tuple.data_ = new char[delete_tuple.size_];
-  memcpy(delete_tuple.data_, GetData() + tuple_offset, delete_tuple.size_);
-  delete_tuple.rid_ = rid;
-  delete_tuple.allocated_ = true;
-
-  if (enable_logging) {
+  if (enable_logging && txn != nullptr) {
     BUSTUB_ASSERT(txn->IsExclusiveLocked(rid), "We must own the exclusive lock!");
 
-    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::APPLYDELETE, rid, delete_tuple);
-    lsn_t lsn = log_manager->AppendLogRecord(&log_record);
+    // The deleted tuple is logged for undo purposes, straight from the page.
+    lsn_t lsn = log_manager->AppendTupleLogRecord(txn->GetTransactionId(), txn->GetPrevLSN(),
+                                                  LogRecordType::APPLYDELETE, rid, GetData() + tuple_offset,
+                                                  tuple_size);
     SetLSN(lsn);
     txn->SetPrevLSN(lsn);
   }
@@ -244,13 +250,56 @@ void TablePage::ApplyDelete(const RID &rid, Transaction *txn, LogManager *log_ma
   }
 }
 
+void TablePage::ApplyDeletes(const std::vector<RID> &rids, Transaction *txn, LogManager *log_manager) {
+  // The tuples are packed from the free space pointer to the end of the page.
+  uint32_t free_space_pointer = GetFreeSpacePointer();
+  for (uint32_t i = 0; i < GetTupleCount(); ++i) {
+    free_space_pointer += UnsetDeletedFlag(GetTupleSize(i));
+  }
+  for (const auto &rid : rids) {
+    uint32_t slot_num = rid.GetSlotNum();
+    BUSTUB_ASSERT(slot_num < GetTupleCount(), "Cannot have more slots than tuples.");
+    uint32_t tuple_size = UnsetDeletedFlag(GetTupleSize(slot_num));
+    if (enable_logging && txn != nullptr) {
+      BUSTUB_ASSERT(txn->IsExclusiveLocked(rid), "We must own the exclusive lock!");
+      // Nothing has moved yet, so the tuple is still where its slot says.
+      lsn_t lsn = log_manager->AppendTupleLogRecord(txn->GetTransactionId(), txn->GetPrevLSN(),
+                                                    LogRecordType::APPLYDELETE, rid,
+                                                    GetData() + GetTupleOffsetAtSlot(slot_num), tuple_size);
+      SetLSN(lsn);
+      txn->SetPrevLSN(lsn);
+    }
+    SetTupleSize(slot_num, 0);
+    SetTupleOffsetAtSlot(slot_num, 0);
+  }
+
+  // Pack the remaining tuples against the end of the tuples in the order they were in, starting from the last one so
+  // that a tuple only ever moves over the space of tuples already moved or deleted.
+  std::vector<uint32_t> slots;
+  for (uint32_t i = 0; i < GetTupleCount(); ++i) {
+    if (GetTupleSize(i) != 0) {
+      slots.push_back(i);
+    }
+  }
+  std::sort(slots.begin(), slots.end(),
+            [this](uint32_t a, uint32_t b) { return GetTupleOffsetAtSlot(a) > GetTupleOffsetAtSlot(b); });
+  for (auto slot : slots) {
+    uint32_t tuple_offset = GetTupleOffsetAtSlot(slot);
+    free_space_pointer -= UnsetDeletedFlag(GetTupleSize(slot));
+    if (free_space_pointer != tuple_offset) {
+      memmove(GetData() + free_space_pointer, GetData() + tuple_offset, UnsetDeletedFlag(GetTupleSize(slot)));
+      SetTupleOffsetAtSlot(slot, free_space_pointer);
+    }
+  }
+  SetFreeSpacePointer(free_space_pointer);
+}
+
 void TablePage::RollbackDelete(const RID &rid, Transaction *txn, LogManager *log_manager) {
   // Log the rollback.
-  if (enable_logging) {
+  if (enable_logging && txn != nullptr) {
     BUSTUB_ASSERT(txn->IsExclusiveLocked(rid), "We must own an exclusive lock on the RID.");
-    Tuple dummy_tuple;
-    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::ROLLBACKDELETE, rid, dummy_tuple);
-    lsn_t lsn = log_manager->AppendLogRecord(&log_record);
+    lsn_t lsn = log_manager->AppendTupleLogRecord(txn->GetTransactionId(), txn->GetPrevLSN(),
+                                                  LogRecordType::ROLLBACKDELETE, rid, nullptr, 0);
     SetLSN(lsn);
     txn->SetPrevLSN(lsn);
   }
@@ -265,12 +314,13 @@ void TablePage::RollbackDelete(const RID &rid, Transaction *txn, LogManager *log
   }
 }
 
-bool TablePage::GetTuple(const RID &rid, Tuple *tuple, Transaction *txn, LockManager *lock_manager) {
+bool TablePage::GetTuple(const RID &rid, Tuple *tuple, Transaction *txn, LockManager *lock_manager,
+                         table_oid_t table_oid) {
   // Get the current slot number.
   uint32_t slot_num = rid.GetSlotNum();
   // If somehow we have more slots than tuples, abort the transaction.
   if (slot_num >= GetTupleCount()) {
-    if (enable_logging) {
+    if (enable_logging && txn != nullptr) {
       txn->SetState(TransactionState::ABORTED);
     }
     return false;
@@ -279,22 +329,30 @@ bool TablePage::GetTuple(const RID &rid, Tuple *tuple, Transaction *txn, LockMan
   uint32_t tuple_size = GetTupleSize(slot_num);
   // If the tuple is deleted, abort the transaction.
   if (IsDeleted(tuple_size)) {
-    if (enable_logging) {
+    if (enable_logging && txn != nullptr) {
       txn->SetState(TransactionState::ABORTED);
     }
     return false;
   }
 
   // Otherwise we have a valid tuple, try to acquire at least a shared lock.
-  if (enable_logging) {
-    if (!txn->IsSharedLocked(rid) && !txn->IsExclusiveLocked(rid) && !lock_manager->LockShared(txn, rid)) {
+  if (enable_logging && txn != nullptr) {
+    if (!txn->IsSharedLocked(rid) && !txn->IsExclusiveLocked(rid) && !lock_manager->LockShared(txn, rid, table_oid)) {
       return false;
     }
   }
 
   // At this point, we have at least a shared lock on the RID. Copy the tuple data into our result.
+  return ReadTuple(rid, tuple);
+}
+
+bool TablePage::ReadTuple(const RID &rid, Tuple *tuple) {
+  uint32_t slot_num = rid.GetSlotNum();
+  if (slot_num >= GetTupleCount() || IsDeleted(GetTupleSize(slot_num))) {
+    return false;
+  }
   uint32_t tuple_offset = GetTupleOffsetAtSlot(slot_num);
-  tuple->size_ = tuple_size;
+  tuple->size_ = GetTupleSize(slot_num);
   if (tuple->allocated_) {
     delete[] tuple->data_;
   }
@@ -305,10 +363,10 @@ bool TablePage::GetTuple(const RID &rid, Tuple *tuple, Transaction *txn, LockMan
   return true;
 }
 
-bool TablePage::GetFirstTupleRid(RID *first_rid) {
+bool TablePage::GetFirstTupleRid(RID *first_rid, bool include_deleted) {
   // Find and return the first valid tuple.
   for (uint32_t i = 0; i < GetTupleCount(); ++i) {
-    if (!IsDeleted(GetTupleSize(i))) {
+    if (include_deleted || !IsDeleted(GetTupleSize(i))) {
       first_rid->Set(GetTablePageId(), i);
       return true;
     }
@@ -317,11 +375,11 @@ bool TablePage::GetFirstTupleRid(RID *first_rid) {
   return false;
 }
 
-bool TablePage::GetNextTupleRid(const RID &cur_rid, RID *next_rid) {
+bool TablePage::GetNextTupleRid(const RID &cur_rid, RID *next_rid, bool include_deleted) {
   BUSTUB_ASSERT(cur_rid.GetPageId() == GetTablePageId(), "Wrong table!");
   // Find and return the first valid tuple after our current slot number.
   for (auto i = cur_rid.GetSlotNum() + 1; i < GetTupleCount(); ++i) {
-    if (!IsDeleted(GetTupleSize(i))) {
+    if (include_deleted || !IsDeleted(GetTupleSize(i))) {
       next_rid->Set(GetTablePageId(), i);
       return true;
     }
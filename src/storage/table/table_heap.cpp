@@ -10,7 +10,9 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include <algorithm>
 #include <cassert>
+#include <vector>
 
 #include "common/logger.h"
 #include "storage/table/table_heap.h"
@@ -18,15 +20,19 @@
 namespace bustub {
 
 TableHeap::TableHeap(BufferPoolManager *buffer_pool_manager, LockManager *lock_manager, LogManager *log_manager,
-                     page_id_t first_page_id)
+                     page_id_t first_page_id, table_oid_t table_oid)
     : buffer_pool_manager_(buffer_pool_manager),
       lock_manager_(lock_manager),
       log_manager_(log_manager),
-      first_page_id_(first_page_id) {}
+      first_page_id_(first_page_id),
+      table_oid_(table_oid) {}
 
 TableHeap::TableHeap(BufferPoolManager *buffer_pool_manager, LockManager *lock_manager, LogManager *log_manager,
-                     Transaction *txn)
-    : buffer_pool_manager_(buffer_pool_manager), lock_manager_(lock_manager), log_manager_(log_manager) {
+                     Transaction *txn, table_oid_t table_oid)
+    : buffer_pool_manager_(buffer_pool_manager),
+      lock_manager_(lock_manager),
+      log_manager_(log_manager),
+      table_oid_(table_oid) {
   // Initialize the first table page.
   auto first_page = reinterpret_cast<TablePage *>(buffer_pool_manager_->NewPage(&first_page_id_));
   BUSTUB_ASSERT(first_page != nullptr, "Couldn't create a page for the table heap.");
@@ -41,6 +47,9 @@ bool TableHeap::InsertTuple(const Tuple &tuple, RID *rid, Transaction *txn) {
     txn->SetState(TransactionState::ABORTED);
     return false;
   }
+  if (!LockTable(txn, LockMode::INTENTION_EXCLUSIVE)) {
+    return false;
+  }
 
   auto cur_page = static_cast<TablePage *>(buffer_pool_manager_->FetchPage(first_page_id_));
   if (cur_page == nullptr) {
@@ -51,7 +60,7 @@ bool TableHeap::InsertTuple(const Tuple &tuple, RID *rid, Transaction *txn) {
   cur_page->WLatch();
   // Insert into the first page with enough space. If no such page exists, create a new page and insert into that.
   // INVARIANT: cur_page is WLatched if you leave the loop normally.
-  while (!cur_page->InsertTuple(tuple, rid, txn, lock_manager_, log_manager_)) {
+  while (!cur_page->InsertTuple(tuple, rid, txn, lock_manager_, log_manager_, table_oid_)) {
     auto next_page_id = cur_page->GetNextPageId();
     // If the next page is a valid page,
     if (next_page_id != INVALID_PAGE_ID) {
@@ -81,6 +90,7 @@ bool TableHeap::InsertTuple(const Tuple &tuple, RID *rid, Transaction *txn) {
       cur_page = new_page;
     }
   }
+  version_store_.BeginInsert(*rid, txn);
   // This line has caused most of us to double-take and "whoa double unlatch".
   // We are not, in fact, double unlatching. See the invariant above.
   cur_page->WUnlatch();
@@ -91,7 +101,32 @@ bool TableHeap::InsertTuple(const Tuple &tuple, RID *rid, Transaction *txn) {
 }
 
 bool TableHeap::MarkDelete(const RID &rid, Transaction *txn) {
+  if (DefersWrites(txn)) {
+    return DeferWrite(rid, WType::DELETE, Tuple{}, txn);
+  }
+  return MarkDeleteOnPage(rid, txn);
+}
+
+bool TableHeap::UpdateTuple(const Tuple &tuple, const RID &rid, Transaction *txn) {
+  if (DefersWrites(txn)) {
+    return DeferWrite(rid, WType::UPDATE, tuple, txn);
+  }
+  return UpdateTupleOnPage(tuple, rid, txn);
+}
+
+bool TableHeap::ApplyDeferredWrite(const TableWriteRecord &write, Transaction *txn) {
+  BUSTUB_ASSERT(write.table_ == this, "The write is for another table.");
+  if (write.wtype_ == WType::DELETE) {
+    return MarkDeleteOnPage(write.rid_, txn);
+  }
+  return UpdateTupleOnPage(write.tuple_, write.rid_, txn);
+}
+
+bool TableHeap::MarkDeleteOnPage(const RID &rid, Transaction *txn) {
   // TODO(Amadou): remove empty page
+  if (!LockTable(txn, LockMode::INTENTION_EXCLUSIVE) || !LockTuple(txn, rid, LockMode::EXCLUSIVE)) {
+    return false;
+  }
   // Find the page which contains the tuple.
   auto page = reinterpret_cast<TablePage *>(buffer_pool_manager_->FetchPage(rid.GetPageId()));
   // If the page could not be found, then abort the transaction.
@@ -101,7 +136,12 @@ bool TableHeap::MarkDelete(const RID &rid, Transaction *txn) {
   }
   // Otherwise, mark the tuple as deleted.
   page->WLatch();
-  page->MarkDelete(rid, txn, lock_manager_, log_manager_);
+  if (!BeginWrite(page, rid, txn)) {
+    page->WUnlatch();
+    buffer_pool_manager_->UnpinPage(page->GetTablePageId(), false);
+    return false;
+  }
+  page->MarkDelete(rid, txn, lock_manager_, log_manager_, table_oid_);
   page->WUnlatch();
   buffer_pool_manager_->UnpinPage(page->GetTablePageId(), true);
   // Update the transaction's write set.
@@ -109,7 +149,10 @@ bool TableHeap::MarkDelete(const RID &rid, Transaction *txn) {
   return true;
 }
 
-bool TableHeap::UpdateTuple(const Tuple &tuple, const RID &rid, Transaction *txn) {
+bool TableHeap::UpdateTupleOnPage(const Tuple &tuple, const RID &rid, Transaction *txn) {
+  if (!LockTable(txn, LockMode::INTENTION_EXCLUSIVE) || !LockTuple(txn, rid, LockMode::EXCLUSIVE)) {
+    return false;
+  }
   // Find the page which contains the tuple.
   auto page = reinterpret_cast<TablePage *>(buffer_pool_manager_->FetchPage(rid.GetPageId()));
   // If the page could not be found, then abort the transaction.
@@ -120,7 +163,12 @@ bool TableHeap::UpdateTuple(const Tuple &tuple, const RID &rid, Transaction *txn
   // Update the tuple; but first save the old value for rollbacks.
   Tuple old_tuple;
   page->WLatch();
-  bool is_updated = page->UpdateTuple(tuple, &old_tuple, rid, txn, lock_manager_, log_manager_);
+  if (!BeginWrite(page, rid, txn)) {
+    page->WUnlatch();
+    buffer_pool_manager_->UnpinPage(page->GetTablePageId(), false);
+    return false;
+  }
+  bool is_updated = page->UpdateTuple(tuple, &old_tuple, rid, txn, lock_manager_, log_manager_, table_oid_);
   page->WUnlatch();
   buffer_pool_manager_->UnpinPage(page->GetTablePageId(), is_updated);
   // Update the transaction's write set.
@@ -153,7 +201,78 @@ void TableHeap::RollbackDelete(const RID &rid, Transaction *txn) {
   buffer_pool_manager_->UnpinPage(page->GetTablePageId(), true);
 }
 
+void TableHeap::ApplyDeletes(const std::vector<const TableWriteRecord *> &writes, Transaction *txn) {
+  std::vector<RID> rids;
+  ApplyByPage(writes, [this, txn, &rids](TablePage *page, const std::vector<const TableWriteRecord *> &page_writes) {
+    rids.clear();
+    for (const auto *write : page_writes) {
+      rids.push_back(write->rid_);
+    }
+    page->ApplyDeletes(rids, txn, log_manager_);
+    for (const auto &rid : rids) {
+      lock_manager_->Unlock(txn, rid);
+    }
+  });
+}
+
+void TableHeap::RollbackWrites(const std::vector<const TableWriteRecord *> &writes, Transaction *txn) {
+  // txn holds the locks of the tuples and their version chains already.
+  ApplyByPage(writes, [this, txn](TablePage *page, const std::vector<const TableWriteRecord *> &page_writes) {
+    for (const auto *write : page_writes) {
+      if (write->wtype_ == WType::DELETE) {
+        page->RollbackDelete(write->rid_, txn, log_manager_);
+      } else if (write->wtype_ == WType::INSERT) {
+        page->ApplyDelete(write->rid_, txn, log_manager_);
+        lock_manager_->Unlock(txn, write->rid_);
+      } else if (write->wtype_ == WType::UPDATE) {
+        Tuple replaced;
+        page->UpdateTuple(write->tuple_, &replaced, write->rid_, txn, lock_manager_, log_manager_, table_oid_);
+      }
+    }
+  });
+}
+
+void TableHeap::ApplyByPage(
+    std::vector<const TableWriteRecord *> writes,
+    const std::function<void(TablePage *, const std::vector<const TableWriteRecord *> &)> &apply) {
+  std::stable_sort(writes.begin(), writes.end(), [](const TableWriteRecord *a, const TableWriteRecord *b) {
+    return a->rid_.GetPageId() < b->rid_.GetPageId();
+  });
+  std::vector<const TableWriteRecord *> page_writes;
+  for (auto begin = writes.begin(); begin != writes.end();) {
+    page_id_t page_id = (*begin)->rid_.GetPageId();
+    auto end = std::find_if(begin, writes.end(),
+                            [page_id](const TableWriteRecord *write) { return write->rid_.GetPageId() != page_id; });
+    page_writes.assign(begin, end);
+    auto page = reinterpret_cast<TablePage *>(buffer_pool_manager_->FetchPage(page_id));
+    BUSTUB_ASSERT(page != nullptr, "Couldn't find a page containing that RID.");
+    page->WLatch();
+    apply(page, page_writes);
+    page->WUnlatch();
+    buffer_pool_manager_->UnpinPage(page_id, true);
+    begin = end;
+  }
+}
+
 bool TableHeap::GetTuple(const RID &rid, Tuple *tuple, Transaction *txn) {
+  bool optimistic = txn->GetConcurrencyControl() == ConcurrencyControl::OPTIMISTIC;
+  if (optimistic) {
+    // An optimistic transaction reads its own writes.
+    const auto *write = FindDeferredWrite(rid, txn);
+    if (write != nullptr) {
+      if (write->wtype_ == WType::DELETE) {
+        return false;
+      }
+      *tuple = write->tuple_;
+      return true;
+    }
+  }
+  // READ_UNCOMMITTED, snapshot and optimistic reads take no shared locks.
+  bool snapshot = txn->GetIsolationLevel() == IsolationLevel::SNAPSHOT_ISOLATION;
+  if (txn->GetIsolationLevel() != IsolationLevel::READ_UNCOMMITTED && !snapshot && !optimistic &&
+      (!LockTable(txn, LockMode::INTENTION_SHARED) || !LockTuple(txn, rid, LockMode::SHARED))) {
+    return false;
+  }
   // Find the page which contains the tuple.
   auto page = static_cast<TablePage *>(buffer_pool_manager_->FetchPage(rid.GetPageId()));
   // If the page could not be found, then abort the transaction.
@@ -163,22 +282,87 @@ bool TableHeap::GetTuple(const RID &rid, Tuple *tuple, Transaction *txn) {
   }
   // Read the tuple from the page.
   page->RLatch();
-  bool res = page->GetTuple(rid, tuple, txn, lock_manager_);
+  bool res;
+  if (optimistic) {
+    timestamp_t begin_ts;
+    res = version_store_.GetLatest(rid, txn, page->ReadTuple(rid, tuple), tuple, &begin_ts);
+    txn->GetReadSet()->emplace_back(rid, begin_ts, this);
+  } else if (snapshot) {
+    res = version_store_.GetVisible(rid, txn, page->ReadTuple(rid, tuple), tuple);
+  } else {
+    res = page->GetTuple(rid, tuple, txn, lock_manager_, table_oid_);
+  }
   page->RUnlatch();
   buffer_pool_manager_->UnpinPage(rid.GetPageId(), false);
   return res;
 }
 
+bool TableHeap::LockTable(Transaction *txn, LockMode lock_mode) {
+  // Like the tuples, the table is only locked when logging is on, see TablePage.
+  if (!enable_logging || table_oid_ == INVALID_TABLE_OID) {
+    return true;
+  }
+  return lock_manager_->LockTable(txn, table_oid_, lock_mode);
+}
+
+bool TableHeap::LockTuple(Transaction *txn, const RID &rid, LockMode lock_mode) {
+  // Tuples are only locked when logging is on, see TablePage.
+  if (!enable_logging || txn->IsExclusiveLocked(rid)) {
+    return true;
+  }
+  if (lock_mode == LockMode::SHARED) {
+    return txn->IsSharedLocked(rid) || lock_manager_->LockShared(txn, rid, table_oid_);
+  }
+  if (txn->IsSharedLocked(rid)) {
+    return lock_manager_->LockUpgrade(txn, rid, table_oid_);
+  }
+  return lock_manager_->LockExclusive(txn, rid, table_oid_);
+}
+
+bool TableHeap::BeginWrite(TablePage *page, const RID &rid, Transaction *txn) {
+  Tuple tuple;
+  bool exists = page->ReadTuple(rid, &tuple);
+  if (!version_store_.BeginWrite(rid, txn, exists, tuple)) {
+    txn->SetState(TransactionState::ABORTED);
+    return false;
+  }
+  return true;
+}
+
+bool TableHeap::DeferWrite(const RID &rid, WType wtype, const Tuple &tuple, Transaction *txn) {
+  // The read is validated at commit like any other, so the tuple still exists when the write is applied.
+  Tuple current;
+  if (!GetTuple(rid, &current, txn)) {
+    return false;
+  }
+  auto &write = txn->GetDeferredWriteSet()->emplace_back(rid, wtype, tuple, this);
+  // So that reading the write back yields a tuple like any other.
+  write.tuple_.rid_ = rid;
+  return true;
+}
+
+const TableWriteRecord *TableHeap::FindDeferredWrite(const RID &rid, Transaction *txn) {
+  auto deferred_write_set = txn->GetDeferredWriteSet();
+  for (auto write = deferred_write_set->rbegin(); write != deferred_write_set->rend(); ++write) {
+    if (write->rid_ == rid && write->table_ == this) {
+      return &*write;
+    }
+  }
+  return nullptr;
+}
+
 TableIterator TableHeap::Begin(Transaction *txn) {
   // Start an iterator from the first page.
   // TODO(Wuwen): Hacky fix for now. Removing empty pages is a better way to handle this.
+  // A snapshot may still see the tuples deleted from the pages, and an optimistic transaction the ones being deleted.
+  bool snapshot = ReadsVersions(txn);
   RID rid;
   auto page_id = first_page_id_;
   while (page_id != INVALID_PAGE_ID) {
     auto page = static_cast<TablePage *>(buffer_pool_manager_->FetchPage(page_id));
     page->RLatch();
     // If this fails because there is no tuple, then RID will be the default-constructed value, which means EOF.
-    auto found_tuple = page->GetFirstTupleRid(&rid);
+    auto found_tuple = page->GetFirstTupleRid(&rid, snapshot);
     page->RUnlatch();
     buffer_pool_manager_->UnpinPage(page_id, false);
     if (found_tuple) {
@@ -186,7 +370,12 @@ TableIterator TableHeap::Begin(Transaction *txn) {
     }
     page_id = page->GetNextPageId();
   }
-  return TableIterator(this, rid, txn);
+  TableIterator itr(this, rid, txn);
+  Tuple tuple;
+  if (snapshot && rid.GetPageId() != INVALID_PAGE_ID && !GetTuple(rid, &tuple, txn)) {
+    ++itr;
+  }
+  return itr;
 }
 
 TableIterator TableHeap::End() { return TableIterator(this, RID(INVALID_PAGE_ID, 0), nullptr); }
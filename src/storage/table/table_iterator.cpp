@@ -39,24 +39,29 @@ TableIterator &TableIterator::operator++() {
   cur_page->RLatch();
   assert(cur_page != nullptr);  // all pages are pinned
 
-  RID next_tuple_rid;
-  if (!cur_page->GetNextTupleRid(tuple_->rid_,
-                                 &next_tuple_rid)) {  // end of this page
-    while (cur_page->GetNextPageId() != INVALID_PAGE_ID) {
-      auto next_page = static_cast<TablePage *>(buffer_pool_manager->FetchPage(cur_page->GetNextPageId()));
-      cur_page->RUnlatch();
-      buffer_pool_manager->UnpinPage(cur_page->GetTablePageId(), false);
-      cur_page = next_page;
-      cur_page->RLatch();
-      if (cur_page->GetFirstTupleRid(&next_tuple_rid)) {
-        break;
+  // A snapshot visits every slot, deleted or not, and skips the tuples it does not see. So does an optimistic read.
+  bool snapshot = txn_ != nullptr && TableHeap::ReadsVersions(txn_);
+  bool visible = false;
+  while (!visible) {
+    RID next_tuple_rid;
+    if (!cur_page->GetNextTupleRid(tuple_->rid_, &next_tuple_rid, snapshot)) {  // end of this page
+      while (cur_page->GetNextPageId() != INVALID_PAGE_ID) {
+        auto next_page = static_cast<TablePage *>(buffer_pool_manager->FetchPage(cur_page->GetNextPageId()));
+        cur_page->RUnlatch();
+        buffer_pool_manager->UnpinPage(cur_page->GetTablePageId(), false);
+        cur_page = next_page;
+        cur_page->RLatch();
+        if (cur_page->GetFirstTupleRid(&next_tuple_rid, snapshot)) {
+          break;
+        }
       }
     }
-  }
-  tuple_->rid_ = next_tuple_rid;
+    tuple_->rid_ = next_tuple_rid;
 
-  if (*this != table_heap_->End()) {
-    table_heap_->GetTuple(tuple_->rid_, tuple_, txn_);
+    if (*this == table_heap_->End()) {
+      break;
+    }
+    visible = table_heap_->GetTuple(tuple_->rid_, tuple_, txn_) || !snapshot;
   }
   // release until copy the tuple
   cur_page->RUnlatch();
@@ -11,10 +11,15 @@
 //===----------------------------------------------------------------------===//
 
 #include "buffer/buffer_pool_manager.h"
+#include <atomic>
+#include <chrono>  // NOLINT
 #include <cstdio>
+#include <future>  // NOLINT
 #include <random>
 #include <string>
+#include <thread>  // NOLINT
 #include "gtest/gtest.h"
+#include "logging/log_files.h"
 
 namespace bustub {
 
@@ -143,4 +148,192 @@ TEST(BufferPoolManagerTest, SampleTest) {
   delete disk_manager;
 }
 
+// NOLINTNEXTLINE
+TEST(BufferPoolManagerTest, WALAwareEvictionTest) {
+  const std::string db_name = "test.db";
+  const size_t buffer_pool_size = 3;
+
+  auto *disk_manager = new DiskManager(db_name);
+  auto *log_manager = new LogManager(disk_manager);
+  auto *bpm = new BufferPoolManager(buffer_pool_size, disk_manager, log_manager);
+  enable_logging = true;
+  log_manager->RunFlushThread();
+
+  page_id_t page_ids[buffer_pool_size];
+  Page *pages[buffer_pool_size];
+  for (size_t i = 0; i < buffer_pool_size; ++i) {
+    pages[i] = bpm->NewPage(&page_ids[i]);
+    ASSERT_NE(nullptr, pages[i]);
+  }
+
+  // Scenario: page 0 is dirty but its log record is on disk, page 1 has a log record that is held back on its way to
+  // disk and page 2 is clean.
+  LogRecord record(0, INVALID_LSN, LogRecordType::BEGIN);
+  pages[0]->SetLSN(log_manager->AppendLogRecord(&record));
+  log_manager->Flush();
+  std::promise<void> log_written;
+  std::future<void> log_written_future = log_written.get_future();
+  disk_manager->SetFlushLogFuture(&log_written_future);
+  pages[1]->SetLSN(log_manager->AppendLogRecord(&record));
+  EXPECT_TRUE(bpm->UnpinPage(page_ids[1], true));
+  EXPECT_TRUE(bpm->UnpinPage(page_ids[0], true));
+  EXPECT_TRUE(bpm->UnpinPage(page_ids[2], false));
+
+  // Scenario: eviction skips the least recently used page 1, whose log is not on disk, and takes page 0 and 2.
+  page_id_t new_page_id;
+  page_id_t page_id_temp;
+  EXPECT_EQ(pages[0], bpm->NewPage(&new_page_id));
+  EXPECT_EQ(pages[2], bpm->NewPage(&page_id_temp));
+  EXPECT_EQ(0, bpm->GetNumEvictionLogWaits());
+
+  // Scenario: only page 1 is left, so eviction waits for the log. The buffer pool stays available meanwhile.
+  std::atomic<bool> evicted{false};
+  std::thread evictor([&] {
+    page_id_t evictor_page_id;
+    EXPECT_EQ(pages[1], bpm->NewPage(&evictor_page_id));
+    evicted = true;
+  });
+  while (bpm->GetNumEvictionLogWaits() == 0) {
+    std::this_thread::yield();
+  }
+  EXPECT_EQ(pages[0], bpm->FetchPage(new_page_id));
+  EXPECT_TRUE(bpm->UnpinPage(new_page_id, false));
+  EXPECT_FALSE(evicted);
+
+  log_written.set_value();
+  evictor.join();
+  EXPECT_TRUE(evicted);
+  EXPECT_EQ(1, bpm->GetNumEvictionLogWaits());
+  EXPECT_EQ(3, bpm->GetNumEvictions());
+  EXPECT_LE(pages[1]->GetLSN(), log_manager->GetPersistentLSN());
+
+  disk_manager->SetFlushLogFuture(nullptr);
+  log_manager->StopFlushThread();
+  enable_logging = false;
+  disk_manager->ShutDown();
+  remove("test.db");
+  RemoveLogFiles("test.db");
+
+  delete bpm;
+  delete log_manager;
+  delete disk_manager;
+}
+
+// NOLINTNEXTLINE
+TEST(BufferPoolManagerTest, FlushPageLogWaitTest) {
+  const std::string db_name = "test.db";
+  const size_t buffer_pool_size = 2;
+
+  auto *disk_manager = new DiskManager(db_name);
+  auto *log_manager = new LogManager(disk_manager);
+  auto *bpm = new BufferPoolManager(buffer_pool_size, disk_manager, log_manager);
+  enable_logging = true;
+  log_manager->RunFlushThread();
+
+  page_id_t page_ids[buffer_pool_size];
+  Page *pages[buffer_pool_size];
+  for (size_t i = 0; i < buffer_pool_size; ++i) {
+    pages[i] = bpm->NewPage(&page_ids[i]);
+    ASSERT_NE(nullptr, pages[i]);
+  }
+
+  // Scenario: page 0 has a log record that is held back on its way to disk.
+  LogRecord record(0, INVALID_LSN, LogRecordType::BEGIN);
+  std::promise<void> log_written;
+  std::future<void> log_written_future = log_written.get_future();
+  disk_manager->SetFlushLogFuture(&log_written_future);
+  pages[0]->SetLSN(log_manager->AppendLogRecord(&record));
+  EXPECT_TRUE(bpm->UnpinPage(page_ids[0], true));
+
+  // Scenario: flushing page 0 waits for the log, without holding up the rest of the buffer pool.
+  std::atomic<bool> flushed{false};
+  std::thread flusher([&] {
+    EXPECT_TRUE(bpm->FlushPage(page_ids[0]));
+    flushed = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  auto fetched = std::async(std::launch::async, [&] {
+    EXPECT_EQ(pages[1], bpm->FetchPage(page_ids[1]));
+    EXPECT_TRUE(bpm->UnpinPage(page_ids[1], false));
+  });
+  EXPECT_EQ(std::future_status::ready, fetched.wait_for(std::chrono::seconds(1)));
+  EXPECT_FALSE(flushed);
+
+  log_written.set_value();
+  flusher.join();
+  fetched.wait();
+  EXPECT_TRUE(flushed);
+  EXPECT_LE(pages[0]->GetLSN(), log_manager->GetPersistentLSN());
+  EXPECT_FALSE(pages[0]->IsDirty());
+
+  disk_manager->SetFlushLogFuture(nullptr);
+  log_manager->StopFlushThread();
+  enable_logging = false;
+  disk_manager->ShutDown();
+  remove("test.db");
+  RemoveLogFiles("test.db");
+
+  delete bpm;
+  delete log_manager;
+  delete disk_manager;
+}
+
+// NOLINTNEXTLINE
+TEST(BufferPoolManagerTest, DeletePageLogWaitTest) {
+  const std::string db_name = "test.db";
+  const size_t buffer_pool_size = 2;
+
+  auto *disk_manager = new DiskManager(db_name);
+  auto *log_manager = new LogManager(disk_manager);
+  auto *bpm = new BufferPoolManager(buffer_pool_size, disk_manager, log_manager);
+  enable_logging = true;
+  log_manager->RunFlushThread();
+
+  page_id_t page_ids[buffer_pool_size];
+  Page *pages[buffer_pool_size];
+  for (size_t i = 0; i < buffer_pool_size; ++i) {
+    pages[i] = bpm->NewPage(&page_ids[i]);
+    ASSERT_NE(nullptr, pages[i]);
+  }
+
+  // Scenario: page 0 has a log record that is held back on its way to disk.
+  LogRecord record(0, INVALID_LSN, LogRecordType::BEGIN);
+  std::promise<void> log_written;
+  std::future<void> log_written_future = log_written.get_future();
+  disk_manager->SetFlushLogFuture(&log_written_future);
+  pages[0]->SetLSN(log_manager->AppendLogRecord(&record));
+  EXPECT_TRUE(bpm->UnpinPage(page_ids[0], true));
+
+  // Scenario: deleting page 0 writes it back first and waits for the log, without holding up the rest of the buffer
+  // pool.
+  std::atomic<bool> deleted{false};
+  std::thread deleter([&] {
+    EXPECT_TRUE(bpm->DeletePage(page_ids[0]));
+    deleted = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  auto fetched = std::async(std::launch::async, [&] {
+    EXPECT_EQ(pages[1], bpm->FetchPage(page_ids[1]));
+    EXPECT_TRUE(bpm->UnpinPage(page_ids[1], false));
+  });
+  EXPECT_EQ(std::future_status::ready, fetched.wait_for(std::chrono::seconds(1)));
+  EXPECT_FALSE(deleted);
+
+  log_written.set_value();
+  deleter.join();
+  fetched.wait();
+  EXPECT_TRUE(deleted);
+  EXPECT_LE(0, log_manager->GetPersistentLSN());
+
+  disk_manager->SetFlushLogFuture(nullptr);
+  log_manager->StopFlushThread();
+  enable_logging = false;
+  disk_manager->ShutDown();
+  remove("test.db");
+  RemoveLogFiles("test.db");
+
+  delete bpm;
+  delete log_manager;
+  delete disk_manager;
+}
 }  // namespace bustub
@@ -60,4 +60,24 @@ TEST(LRUReplacerTest, SampleTest) {
   EXPECT_EQ(4, value);
 }
 
+TEST(LRUReplacerTest, FilteredVictimTest) {
+  LRUReplacer lru_replacer(7);
+  for (int i = 1; i <= 5; ++i) {
+    lru_replacer.Unpin(i);
+  }
+
+  // Scenario: the least recently used frame the filter accepts is the victim, the rejected ones stay.
+  int value;
+  EXPECT_TRUE(lru_replacer.Victim(&value, [](frame_id_t frame_id) { return frame_id % 2 == 0; }));
+  EXPECT_EQ(2, value);
+  EXPECT_EQ(4, lru_replacer.Size());
+  EXPECT_FALSE(lru_replacer.Victim(&value, [](frame_id_t frame_id) { return frame_id > 5; }));
+  EXPECT_EQ(4, lru_replacer.Size());
+
+  lru_replacer.Victim(&value);
+  EXPECT_EQ(1, value);
+  lru_replacer.Victim(&value);
+  EXPECT_EQ(3, value);
+}
+
 }  // namespace bustub
@@ -0,0 +1,124 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// quiescent_latch_test.cpp
+//
+// Identification: test/common/quiescent_latch_test.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <iostream>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "common/quiescent_latch.h"
+#include "common/rwlatch.h"
+#include "gtest/gtest.h"
+
+namespace bustub {
+
+// A blocker waits for the critical section in progress, even one left on another thread, and keeps new ones out
+// NOLINTNEXTLINE
+TEST(QuiescentLatchTest, BlockTest) {
+  QuiescentLatch latch;
+  latch.Enter();
+
+  std::atomic<bool> blocked{false};
+  std::thread blocker([&] {
+    latch.Block();
+    blocked = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_FALSE(blocked);
+  std::thread([&] { latch.Exit(); }).join();
+  while (!blocked) {
+    std::this_thread::yield();
+  }
+  blocker.join();
+
+  std::atomic<bool> entered{false};
+  std::thread enterer([&] {
+    latch.Enter();
+    entered = true;
+    latch.Exit();
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_FALSE(entered);
+  latch.Resume();
+  enterer.join();
+  EXPECT_TRUE(entered);
+}
+
+// No critical section is ever in progress while the latch is blocked
+// NOLINTNEXTLINE
+TEST(QuiescentLatchTest, ConcurrentBlockTest) {
+  const int num_threads = 8;
+  const int num_blocks = 200;
+  QuiescentLatch latch;
+  std::atomic<int> inside{0};
+  std::atomic<bool> done{false};
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; i++) {
+    threads.emplace_back([&] {
+      while (!done) {
+        latch.Enter();
+        inside++;
+        std::this_thread::yield();
+        inside--;
+        latch.Exit();
+      }
+    });
+  }
+  for (int i = 0; i < num_blocks; i++) {
+    latch.Block();
+    EXPECT_EQ(0, inside);
+    latch.Resume();
+  }
+  done = true;
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+// Critical sections per second on every thread, against a reader-writer latch taken in shared mode
+// NOLINTNEXTLINE
+TEST(QuiescentLatchTest, EnterExitBenchmark) {
+  const int sections_per_thread = 200000;
+
+  for (int num_threads : {1, 4, 8}) {
+    QuiescentLatch quiescent_latch;
+    ReaderWriterLatch rw_latch;
+    double rates[2];
+    for (bool quiescent : {false, true}) {
+      auto start = std::chrono::steady_clock::now();
+      std::vector<std::thread> threads;
+      for (int i = 0; i < num_threads; i++) {
+        threads.emplace_back([&] {
+          for (int j = 0; j < sections_per_thread; j++) {
+            if (quiescent) {
+              quiescent_latch.Enter();
+              quiescent_latch.Exit();
+            } else {
+              rw_latch.RLock();
+              rw_latch.RUnlock();
+            }
+          }
+        });
+      }
+      for (auto &thread : threads) {
+        thread.join();
+      }
+      auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      rates[quiescent ? 1 : 0] = num_threads * sections_per_thread / elapsed;
+    }
+    std::cout << num_threads << " threads: " << static_cast<int64_t>(rates[0]) << " sections/s with a shared latch, "
+              << static_cast<int64_t>(rates[1]) << " sections/s with a quiescent latch" << std::endl;
+  }
+}
+}  // namespace bustub
@@ -0,0 +1,46 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// log_files.h
+//
+// Identification: test/include/logging/log_files.h
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <system_error>  // NOLINT
+#include <vector>
+
+namespace bustub {
+
+/**
+ * Remove the log a DiskManager keeps next to a database file: the segment files <db>.log.0, <db>.log.1, ..., the
+ * stream files of a striped log <db>.log.stream0, ..., the master record <db>.master, and <db>.log itself.
+ * @param db_file the database file the log belongs to, e.g. "test.db"
+ */
+inline void RemoveLogFiles(const std::string &db_file) {
+  namespace fs = std::filesystem;
+  const fs::path db_path(db_file);
+  const std::string stem = db_path.stem().string();
+  const std::string prefix = stem + ".log.";
+  std::error_code ec;
+  fs::remove(db_path.parent_path() / (stem + ".log"), ec);
+  fs::remove(db_path.parent_path() / (stem + ".master"), ec);
+  std::vector<fs::path> log_files;
+  for (const auto &entry : fs::directory_iterator(db_path.has_parent_path() ? db_path.parent_path() : ".", ec)) {
+    if (entry.path().filename().string().compare(0, prefix.size(), prefix) == 0) {
+      log_files.push_back(entry.path());
+    }
+  }
+  for (const auto &log_file : log_files) {
+    fs::remove(log_file, ec);
+  }
+}
+
+}  // namespace bustub
@@ -0,0 +1,571 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// log_manager_test.cpp
+//
+// Identification: test/recovery/log_manager_test.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+#include "catalog/schema.h"
+#include "concurrency/lock_manager.h"
+#include "concurrency/transaction_manager.h"
+#include "gtest/gtest.h"
+#include "recovery/log_manager.h"
+#include "recovery/log_recovery.h"
+#include "storage/disk/simulated_disk_manager.h"
+#include "storage/table/table_heap.h"
+#include "type/value_factory.h"
+
+namespace bustub {
+
+// NOLINTNEXTLINE
+TEST(LogManagerTest, AppendAndFlushTest) {
+  SimulatedDiskManager disk_manager;
+  LogManager log_manager(&disk_manager);
+  log_manager.RunFlushThread();
+  ASSERT_TRUE(enable_logging);
+
+  // enough records to fill the log buffer a few times.
+  const int num_records = 3 * LOG_BUFFER_SIZE / 20;
+  for (int i = 0; i < num_records; i++) {
+    LogRecord log_record(i, INVALID_LSN, LogRecordType::BEGIN);
+    EXPECT_EQ(i, log_manager.AppendLogRecord(&log_record));
+  }
+  log_manager.Flush();
+  EXPECT_EQ(num_records - 1, log_manager.GetPersistentLSN());
+
+  log_manager.StopFlushThread();
+  ASSERT_FALSE(enable_logging);
+
+  // the records are on disk in lsn order.
+  char header[20];
+  for (int i = 0; i < num_records; i++) {
+    ASSERT_TRUE(disk_manager.ReadLog(header, sizeof(header), i * 20));
+    int32_t size;
+    lsn_t lsn;
+    memcpy(&size, header, sizeof(int32_t));
+    memcpy(&lsn, header + 4, sizeof(lsn_t));
+    EXPECT_EQ(20, size);
+    EXPECT_EQ(i, lsn);
+  }
+}
+
+/**
+ * Records appended straight from tuple bytes are identical to the ones serialized from a LogRecord.
+ */
+// NOLINTNEXTLINE
+TEST(LogManagerTest, InPlaceAppendTest) {
+  Column col{"a", TypeId::VARCHAR, 20};
+  Schema schema{{col}};
+  const Tuple old_tuple{{ValueFactory::GetVarcharValue("old value")}, &schema};
+  const Tuple new_tuple{{ValueFactory::GetVarcharValue("a longer new value")}, &schema};
+  const RID rid(3, 7);
+
+  SimulatedDiskManager expected_disk;
+  SimulatedDiskManager actual_disk;
+  {
+    LogManager log_manager(&expected_disk);
+    log_manager.RunFlushThread();
+    LogRecord insert_record(0, INVALID_LSN, LogRecordType::INSERT, rid, old_tuple);
+    log_manager.AppendLogRecord(&insert_record);
+    LogRecord update_record(0, 0, LogRecordType::UPDATE, rid, old_tuple, new_tuple);
+    log_manager.AppendLogRecord(&update_record);
+    LogRecord delete_record(0, 1, LogRecordType::MARKDELETE, rid, Tuple());
+    log_manager.AppendLogRecord(&delete_record);
+    log_manager.StopFlushThread();
+  }
+  {
+    LogManager log_manager(&actual_disk);
+    log_manager.RunFlushThread();
+    EXPECT_EQ(0, log_manager.AppendTupleLogRecord(0, INVALID_LSN, LogRecordType::INSERT, rid, old_tuple.GetData(),
+                                                  old_tuple.GetLength()));
+    EXPECT_EQ(1, log_manager.AppendUpdateLogRecord(0, 0, rid, old_tuple.GetData(), old_tuple.GetLength(),
+                                                   new_tuple.GetData(), new_tuple.GetLength()));
+    EXPECT_EQ(2, log_manager.AppendTupleLogRecord(0, 1, LogRecordType::MARKDELETE, rid, nullptr, 0));
+    log_manager.StopFlushThread();
+  }
+
+  char expected[512] = {0};
+  char actual[512] = {0};
+  ASSERT_TRUE(expected_disk.ReadLog(expected, sizeof(expected), 0));
+  ASSERT_TRUE(actual_disk.ReadLog(actual, sizeof(actual), 0));
+  EXPECT_EQ(0, memcmp(expected, actual, sizeof(expected)));
+}
+
+/**
+ * An update that keeps the tuple size is logged as the byte ranges that changed, and recovery reads them back.
+ */
+// NOLINTNEXTLINE
+TEST(LogManagerTest, DeltaUpdateTest) {
+  Schema schema{{Column{"a", TypeId::INTEGER}, Column{"b", TypeId::BIGINT}, Column{"c", TypeId::BIGINT},
+                 Column{"d", TypeId::INTEGER}}};
+  auto make_tuple = [&schema](int32_t a, int32_t d) {
+    return Tuple{{ValueFactory::GetIntegerValue(a), ValueFactory::GetBigIntValue(7),
+                  ValueFactory::GetBigIntValue(8), ValueFactory::GetIntegerValue(d)},
+                 &schema};
+  };
+  const Tuple old_tuple = make_tuple(1, 5);
+  const Tuple new_tuple = make_tuple(2, 6);
+  const RID rid(3, 7);
+
+  // a and d differ in their lowest byte, too far apart to share a range.
+  std::vector<TupleDeltaRange> ranges{{0, {old_tuple.GetData()[0]}, {new_tuple.GetData()[0]}},
+                                      {20, {old_tuple.GetData()[20]}, {new_tuple.GetData()[20]}}};
+  LogRecord expected_record(0, INVALID_LSN, rid, old_tuple.GetLength(), ranges);
+  LogRecord full_record(0, INVALID_LSN, LogRecordType::UPDATE, rid, old_tuple, new_tuple);
+  EXPECT_LT(expected_record.GetSize(), full_record.GetSize());
+
+  SimulatedDiskManager expected_disk;
+  SimulatedDiskManager actual_disk;
+  {
+    LogManager log_manager(&expected_disk);
+    log_manager.RunFlushThread();
+    log_manager.AppendLogRecord(&expected_record);
+    log_manager.StopFlushThread();
+  }
+  {
+    LogManager log_manager(&actual_disk);
+    log_manager.RunFlushThread();
+    log_manager.AppendUpdateLogRecord(0, INVALID_LSN, rid, old_tuple.GetData(), old_tuple.GetLength(),
+                                      new_tuple.GetData(), new_tuple.GetLength());
+    log_manager.StopFlushThread();
+  }
+
+  char expected[512] = {0};
+  char actual[512] = {0};
+  ASSERT_TRUE(expected_disk.ReadLog(expected, sizeof(expected), 0));
+  ASSERT_TRUE(actual_disk.ReadLog(actual, sizeof(actual), 0));
+  EXPECT_EQ(0, memcmp(expected, actual, sizeof(expected)));
+
+  LogRecovery log_recovery(&actual_disk, nullptr);
+  LogRecord log_record;
+  ASSERT_TRUE(log_recovery.DeserializeLogRecord(actual, sizeof(actual), &log_record));
+  EXPECT_EQ(LogRecordType::UPDATE_DELTA, log_record.GetLogRecordType());
+  EXPECT_EQ(expected_record.GetSize(), log_record.GetSize());
+  EXPECT_EQ(rid, log_record.GetUpdateRID());
+  EXPECT_EQ(old_tuple.GetLength(), log_record.GetDeltaTupleSize());
+  ASSERT_EQ(2, log_record.GetDeltaRanges().size());
+
+  // replaying the ranges over the old tuple gives the new one.
+  std::vector<char> data(old_tuple.GetData(), old_tuple.GetData() + old_tuple.GetLength());
+  for (const auto &range : log_record.GetDeltaRanges()) {
+    EXPECT_EQ(0, memcmp(data.data() + range.offset_, range.old_bytes_.data(), range.old_bytes_.size()));
+    memcpy(data.data() + range.offset_, range.new_bytes_.data(), range.new_bytes_.size());
+  }
+  EXPECT_EQ(0, memcmp(data.data(), new_tuple.GetData(), new_tuple.GetLength()));
+}
+
+/**
+ * A 200-byte row whose counter column is updated over and over, logged with full UPDATE records and then with
+ * UPDATE_DELTA records.
+ */
+// NOLINTNEXTLINE
+TEST(LogManagerTest, UpdateLogVolumeBenchmark) {
+  const int num_updates = 10000;
+  Schema schema{{Column{"id", TypeId::INTEGER}, Column{"payload", TypeId::VARCHAR, 200},
+                 Column{"counter", TypeId::INTEGER}}};
+  const std::string payload(175, 'x');
+  std::vector<Tuple> versions;
+  for (int i = 0; i <= num_updates; i++) {
+    versions.emplace_back(std::vector<Value>{ValueFactory::GetIntegerValue(1), ValueFactory::GetVarcharValue(payload),
+                                             ValueFactory::GetIntegerValue(i)},
+                          &schema);
+  }
+  ASSERT_EQ(200, versions[0].GetLength());
+
+  uint64_t log_bytes[2];
+  for (bool delta : {false, true}) {
+    SimulatedDiskManager disk_manager;
+    LogManager log_manager(&disk_manager);
+    log_manager.RunFlushThread();
+    lsn_t prev_lsn = INVALID_LSN;
+    for (int i = 0; i < num_updates; i++) {
+      const Tuple &old_tuple = versions[i];
+      const Tuple &new_tuple = versions[i + 1];
+      if (delta) {
+        prev_lsn = log_manager.AppendUpdateLogRecord(0, prev_lsn, RID(0, 0), old_tuple.GetData(), old_tuple.GetLength(),
+                                                     new_tuple.GetData(), new_tuple.GetLength());
+      } else {
+        LogRecord log_record(0, prev_lsn, LogRecordType::UPDATE, RID(0, 0), old_tuple, new_tuple);
+        prev_lsn = log_manager.AppendLogRecord(&log_record);
+      }
+    }
+    log_manager.Flush();
+    log_manager.StopFlushThread();
+    log_bytes[delta ? 1 : 0] = disk_manager.GetStats().log_bytes_written_;
+  }
+
+  std::cout << "update log volume: " << num_updates << " updates of a 200-byte row, " << log_bytes[0]
+            << " bytes with full records, " << log_bytes[1] << " bytes with delta records ("
+            << 100 * log_bytes[1] / log_bytes[0] << "%)" << std::endl;
+  EXPECT_LT(4 * log_bytes[1], log_bytes[0]);
+}
+
+/**
+ * Every thread runs empty transactions back to back against a disk whose sync takes a millisecond. With group
+ * commit, the number of commits per second grows with the number of committing threads.
+ */
+// NOLINTNEXTLINE
+TEST(LogManagerTest, GroupCommitBenchmark) {
+  const int txns_per_thread = 50;
+  DiskProfile profile;
+  profile.sync_latency_ = std::chrono::microseconds(1000);
+
+  for (int num_threads : {1, 2, 4, 8}) {
+    SimulatedDiskManager disk_manager(profile);
+    LogManager log_manager(&disk_manager);
+    LockManager lock_manager;
+    TransactionManager txn_manager(&lock_manager, &log_manager);
+    log_manager.RunFlushThread();
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; i++) {
+      threads.emplace_back([&txn_manager] {
+        for (int j = 0; j < txns_per_thread; j++) {
+          Transaction *txn = txn_manager.Begin();
+          txn_manager.Commit(txn);
+          delete txn;
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    log_manager.StopFlushThread();
+
+    const int num_commits = num_threads * txns_per_thread;
+    std::cout << "group commit: " << num_threads << " threads, " << static_cast<int>(num_commits / elapsed)
+              << " commits/s, " << disk_manager.GetNumFlushes() << " log flushes for " << num_commits << " commits"
+              << std::endl;
+    // each commit waits for its own flush, and no more than one flush per commit is needed.
+    EXPECT_LE(disk_manager.GetNumFlushes(), num_commits);
+    if (num_threads == 8) {
+      EXPECT_LT(disk_manager.GetNumFlushes(), num_commits / 2);
+    }
+  }
+}
+
+/**
+ * With early lock release, a reader gets the lock of a committing writer before the writer is durable, but its own
+ * commit waits until the writer is.
+ */
+// NOLINTNEXTLINE
+TEST(LogManagerTest, EarlyLockReleaseTest) {
+  Schema schema{{Column{"a", TypeId::INTEGER}}};
+  DiskProfile profile;
+  profile.sync_latency_ = std::chrono::milliseconds(100);
+  SimulatedDiskManager disk_manager(profile);
+  BufferPoolManager buffer_pool_manager(10, &disk_manager);
+  LogManager log_manager(&disk_manager);
+  LockManager lock_manager;
+  TransactionManager txn_manager(&lock_manager, &log_manager);
+  log_manager.RunFlushThread();
+  enable_early_lock_release = true;
+
+  auto *txn = txn_manager.Begin();
+  TableHeap table(&buffer_pool_manager, &lock_manager, &log_manager, txn);
+  RID rid;
+  ASSERT_TRUE(table.InsertTuple(Tuple({ValueFactory::GetIntegerValue(0)}, &schema), &rid, txn));
+  txn_manager.Commit(txn);
+  delete txn;
+
+  auto *writer = txn_manager.Begin();
+  ASSERT_TRUE(table.UpdateTuple(Tuple({ValueFactory::GetIntegerValue(1)}, &schema), rid, writer));
+  std::thread committer([&] { EXPECT_TRUE(txn_manager.Commit(writer)); });
+
+  // The reader waits for the lock of the writer, which is released before the writer's commit record is durable.
+  auto *reader = txn_manager.Begin();
+  Tuple tuple;
+  ASSERT_TRUE(table.GetTuple(rid, &tuple, reader));
+  EXPECT_EQ(1, tuple.GetValue(&schema, 0).GetAs<int32_t>());
+  lsn_t commit_lsn = writer->GetPrevLSN();
+  EXPECT_LT(log_manager.GetPersistentLSN(), commit_lsn);
+  EXPECT_TRUE(txn_manager.Commit(reader));
+  EXPECT_GE(log_manager.GetPersistentLSN(), commit_lsn);
+  committer.join();
+
+  enable_early_lock_release = false;
+  log_manager.StopFlushThread();
+  delete writer;
+  delete reader;
+}
+
+/**
+ * Every thread updates the same row in transactions back to back, against a disk whose sync takes a millisecond.
+ * Holding the lock of the row through the log flush lets a single transaction commit per flush, while early lock
+ * release lets the transactions queued behind it join the flush.
+ */
+// NOLINTNEXTLINE
+TEST(LogManagerTest, EarlyLockReleaseBenchmark) {
+  const int num_threads = 8;
+  const int txns_per_thread = 25;
+  Schema schema{{Column{"a", TypeId::INTEGER}}};
+  DiskProfile profile;
+  profile.sync_latency_ = std::chrono::microseconds(1000);
+
+  for (bool early : {false, true}) {
+    SimulatedDiskManager disk_manager(profile);
+    BufferPoolManager buffer_pool_manager(10, &disk_manager);
+    LogManager log_manager(&disk_manager);
+    LockManager lock_manager;
+    TransactionManager txn_manager(&lock_manager, &log_manager);
+    log_manager.RunFlushThread();
+    enable_early_lock_release = early;
+
+    auto *txn = txn_manager.Begin();
+    TableHeap table(&buffer_pool_manager, &lock_manager, &log_manager, txn);
+    RID rid;
+    ASSERT_TRUE(table.InsertTuple(Tuple({ValueFactory::GetIntegerValue(0)}, &schema), &rid, txn));
+    txn_manager.Commit(txn);
+    delete txn;
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; i++) {
+      threads.emplace_back([&, i] {
+        for (int j = 0; j < txns_per_thread; j++) {
+          auto *txn = txn_manager.Begin();
+          EXPECT_TRUE(table.UpdateTuple(Tuple({ValueFactory::GetIntegerValue(i * txns_per_thread + j)}, &schema),
+                                        rid, txn));
+          EXPECT_TRUE(txn_manager.Commit(txn));
+          txn_manager.Release(txn);
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    enable_early_lock_release = false;
+    log_manager.StopFlushThread();
+
+    const int num_commits = num_threads * txns_per_thread;
+    std::cout << "hot row updates, early lock release " << (early ? "on" : "off") << ": "
+              << static_cast<int>(num_commits / elapsed) << " commits/s, " << disk_manager.GetNumFlushes()
+              << " log flushes for " << num_commits << " commits" << std::endl;
+    if (early) {
+      EXPECT_LT(disk_manager.GetNumFlushes(), num_commits / 2);
+    }
+  }
+}
+
+/**
+ * Every thread appends insert records as fast as it can. Appends reserve their space with a compare-and-swap and
+ * serialize in parallel, so the append rate should not collapse as threads are added.
+ */
+// NOLINTNEXTLINE
+TEST(LogManagerTest, ConcurrentAppendBenchmark) {
+  const int appends_per_thread = 50000;
+  Column col{"a", TypeId::VARCHAR, 100};
+  Schema schema{{col}};
+  const Tuple tuple{{ValueFactory::GetVarcharValue(std::string(100, 'x'))}, &schema};
+
+  for (int num_threads : {1, 2, 4, 8}) {
+    SimulatedDiskManager disk_manager;
+    LogManager log_manager(&disk_manager);
+    log_manager.RunFlushThread();
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; i++) {
+      threads.emplace_back([&log_manager, &tuple, i] {
+        lsn_t last_lsn = INVALID_LSN;
+        for (int j = 0; j < appends_per_thread; j++) {
+          LogRecord log_record(i, last_lsn, LogRecordType::INSERT, RID(i, j), tuple);
+          lsn_t lsn = log_manager.AppendLogRecord(&log_record);
+          // lsns handed out to one thread are increasing.
+          EXPECT_GT(lsn, last_lsn);
+          last_lsn = lsn;
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    log_manager.Flush();
+    log_manager.StopFlushThread();
+
+    const int num_appends = num_threads * appends_per_thread;
+    std::cout << "concurrent append: " << num_threads << " threads, " << static_cast<int64_t>(num_appends / elapsed)
+              << " appends/s" << std::endl;
+    EXPECT_EQ(num_appends, log_manager.GetNextLSN());
+    EXPECT_EQ(num_appends - 1, log_manager.GetPersistentLSN());
+
+    // every record made it to the log exactly once, in lsn order and without holes.
+    char header[20];
+    int offset = 0;
+    for (lsn_t lsn = 0; lsn < num_appends; lsn++) {
+      ASSERT_TRUE(disk_manager.ReadLog(header, sizeof(header), offset));
+      int32_t size;
+      lsn_t record_lsn;
+      memcpy(&size, header, sizeof(int32_t));
+      memcpy(&record_lsn, header + 4, sizeof(lsn_t));
+      ASSERT_EQ(lsn, record_lsn);
+      offset += size;
+    }
+  }
+}
+
+/**
+ * Every thread appends to its own stream of a striped log. The lsns are handed out without holes, a flush makes all
+ * of them persistent and recovery merges the streams into the log in lsn order.
+ */
+// NOLINTNEXTLINE
+TEST(LogManagerTest, StripedLogTest) {
+  const int num_threads = 4;
+  const int appends_per_thread = LOG_BUFFER_SIZE / 20;
+  SimulatedDiskManager disk_manager;
+  const auto saved_log_stream_count = log_stream_count;
+  log_stream_count = num_threads;
+  LogManager log_manager(&disk_manager);
+  log_stream_count = saved_log_stream_count;
+  ASSERT_TRUE(log_manager.IsStriped());
+  log_manager.RunFlushThread();
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; i++) {
+    threads.emplace_back([&log_manager, i] {
+      lsn_t last_lsn = INVALID_LSN;
+      for (int j = 0; j < appends_per_thread; j++) {
+        LogRecord log_record(i, last_lsn, LogRecordType::BEGIN);
+        lsn_t lsn = log_manager.AppendLogRecord(&log_record);
+        EXPECT_GT(lsn, last_lsn);
+        last_lsn = lsn;
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  const int num_appends = num_threads * appends_per_thread;
+  log_manager.Flush();
+  EXPECT_EQ(num_appends, log_manager.GetNextLSN());
+  EXPECT_EQ(num_appends - 1, log_manager.GetPersistentLSN());
+  log_manager.StopFlushThread();
+
+  // every stream has its share of the records and the log is empty until recovery merges them.
+  EXPECT_EQ(std::vector<int>({0, 1, 2, 3}), disk_manager.GetLogStreams());
+  for (int i = 0; i < num_threads; i++) {
+    EXPECT_EQ(appends_per_thread * 20, disk_manager.GetLogStreamSize(i));
+  }
+  EXPECT_EQ(0, disk_manager.GetLogSize());
+  LogRecovery log_recovery(&disk_manager, nullptr);
+  log_recovery.Redo();
+  EXPECT_TRUE(disk_manager.GetLogStreams().empty());
+
+  char header[20];
+  for (lsn_t lsn = 0; lsn < num_appends; lsn++) {
+    ASSERT_TRUE(disk_manager.ReadLog(header, sizeof(header), lsn * 20));
+    lsn_t record_lsn;
+    memcpy(&record_lsn, header + 4, sizeof(lsn_t));
+    ASSERT_EQ(lsn, record_lsn);
+  }
+}
+
+/**
+ * Many threads append to the same stream of a striped log at once. The records of the stream are in lsn order, so
+ * recovery merges every one of them into the log instead of stopping at an lsn that seems to be missing.
+ */
+// NOLINTNEXTLINE
+TEST(LogManagerTest, StripedLogSharedStreamTest) {
+  const int num_threads = 8;
+  const int appends_per_thread = LOG_BUFFER_SIZE / 20;
+  SimulatedDiskManager disk_manager;
+  const auto saved_log_stream_count = log_stream_count;
+  log_stream_count = 2;
+  LogManager log_manager(&disk_manager);
+  log_stream_count = saved_log_stream_count;
+  log_manager.RunFlushThread();
+
+  // transactions with even ids all log to stream 0.
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; i++) {
+    threads.emplace_back([&log_manager, i] {
+      for (int j = 0; j < appends_per_thread; j++) {
+        LogRecord log_record(2 * i, INVALID_LSN, LogRecordType::BEGIN);
+        log_manager.AppendLogRecord(&log_record);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  const int num_appends = num_threads * appends_per_thread;
+  log_manager.StopFlushThread();
+  EXPECT_EQ(num_appends * 20, disk_manager.GetLogStreamSize(0));
+
+  LogRecovery log_recovery(&disk_manager, nullptr);
+  log_recovery.Redo();
+  ASSERT_EQ(num_appends * 20, disk_manager.GetLogSize());
+  char header[20];
+  for (lsn_t lsn = 0; lsn < num_appends; lsn++) {
+    ASSERT_TRUE(disk_manager.ReadLog(header, sizeof(header), lsn * 20));
+    lsn_t record_lsn;
+    memcpy(&record_lsn, header + 4, sizeof(lsn_t));
+    ASSERT_EQ(lsn, record_lsn);
+  }
+}
+
+/**
+ * Like GroupCommitBenchmark, with the log striped over one stream per committing thread. Each stream writes and syncs
+ * its own file, but a commit still waits until every stream is durable up to its commit record.
+ */
+// NOLINTNEXTLINE
+TEST(LogManagerTest, StripedCommitBenchmark) {
+  const int num_threads = 8;
+  const int txns_per_thread = 50;
+  DiskProfile profile;
+  profile.sync_latency_ = std::chrono::microseconds(1000);
+  const auto saved_log_stream_count = log_stream_count;
+
+  for (int num_streams : {1, 2, 4, 8}) {
+    SimulatedDiskManager disk_manager(profile);
+    log_stream_count = num_streams;
+    LogManager log_manager(&disk_manager);
+    log_stream_count = saved_log_stream_count;
+    LockManager lock_manager;
+    TransactionManager txn_manager(&lock_manager, &log_manager);
+    log_manager.RunFlushThread();
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; i++) {
+      threads.emplace_back([&txn_manager] {
+        for (int j = 0; j < txns_per_thread; j++) {
+          Transaction *txn = txn_manager.Begin();
+          txn_manager.Commit(txn);
+          delete txn;
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    EXPECT_EQ(log_manager.GetNextLSN() - 1, log_manager.GetPersistentLSN());
+    log_manager.StopFlushThread();
+
+    const int num_commits = num_threads * txns_per_thread;
+    std::cout << "striped commit: " << num_streams << " streams, " << static_cast<int>(num_commits / elapsed)
+              << " commits/s, " << disk_manager.GetNumFlushes() << " log flushes for " << num_commits << " commits"
+              << std::endl;
+  }
+}
+
+}  // namespace bustub
@@ -3,6 +3,7 @@
  * b_plus_tree_test.cpp
  */
 
+#include <atomic>
 #include <chrono>  // NOLINT
 #include <cstdio>
 #include <functional>
@@ -10,7 +11,9 @@
 #include "b_plus_tree_test_util.h"  // NOLINT
 
 #include "buffer/buffer_pool_manager.h"
+#include "concurrency/transaction_manager.h"
 #include "gtest/gtest.h"
+#include "logging/log_files.h"
 #include "storage/index/b_plus_tree.h"
 
 namespace bustub {
@@ -153,7 +156,7 @@ TEST(BPlusTreeConcurrentTest, InsertTest1) {
   delete disk_manager;
   delete bpm;
   remove("test.db");
-  remove("test.log");
+  RemoveLogFiles("test.db");
 }
 
 // TEST(BPlusTreeConcurrentTest, DISABLED_InsertTest2) {
@@ -206,7 +209,7 @@ TEST(BPlusTreeConcurrentTest, InsertTest2) {
   delete disk_manager;
   delete bpm;
   remove("test.db");
-  remove("test.log");
+  RemoveLogFiles("test.db");
 }
 
 // TEST(BPlusTreeConcurrentTest, DISABLED_DeleteTest1) {
@@ -254,7 +257,7 @@ TEST(BPlusTreeConcurrentTest, DeleteTest1) {
   delete disk_manager;
   delete bpm;
   remove("test.db");
-  remove("test.log");
+  RemoveLogFiles("test.db");
 }
 
 // TEST(BPlusTreeConcurrentTest, DISABLED_DeleteTest2) {
@@ -299,7 +302,7 @@ TEST(BPlusTreeConcurrentTest, DeleteTest2) {
   delete disk_manager;
   delete bpm;
   remove("test.db");
-  remove("test.log");
+  RemoveLogFiles("test.db");
 }
 
 // TEST(BPlusTreeConcurrentTest, DISABLED_MixTest) {
@@ -346,7 +349,119 @@ TEST(BPlusTreeConcurrentTest, MixTest) {
   delete disk_manager;
   delete bpm;
   remove("test.db");
-  remove("test.log");
+  RemoveLogFiles("test.db");
+}
+
+// Key-range locks keep the keys a transaction scanned, and the gaps between them, as they were until it commits,
+// while other transactions keep inserting into the other gaps.
+TEST(BPlusTreeConcurrentTest, KeyRangeLockTest) {
+  Schema *key_schema = ParseCreateStatement("a bigint");
+  GenericComparator<8> comparator(key_schema);
+
+  DiskManager *disk_manager = new DiskManager("test.db");
+  BufferPoolManager *bpm = new BufferPoolManager(50, disk_manager);
+  LockManager lock_manager;
+  TransactionManager txn_manager(&lock_manager);
+  // small nodes, so that the ranges span several leaves.
+  BPlusTree<GenericKey<8>, RID, GenericComparator<8>> tree("foo_pk", bpm, comparator, 4, 5, nullptr, &lock_manager);
+  page_id_t page_id;
+  auto header_page = bpm->NewPage(&page_id);
+  (void)header_page;
+  // keys are only locked when logging is on.
+  enable_logging = true;
+
+  auto key_of = [](int64_t key) {
+    GenericKey<8> index_key;
+    index_key.SetFromInteger(key);
+    return index_key;
+  };
+  auto insert = [&](int64_t key, Transaction *txn) { return tree.Insert(key_of(key), RID(0, key), txn); };
+  auto scan = [&](int64_t low, int64_t high, Transaction *txn) {
+    std::vector<int64_t> keys;
+    for (auto iterator = tree.Begin(key_of(low), txn); !iterator.isEnd(); ++iterator) {
+      int64_t key = (*iterator).second.GetSlotNum();
+      if (key > high) {
+        break;
+      }
+      keys.push_back(key);
+    }
+    return keys;
+  };
+
+  auto *txn = txn_manager.Begin();
+  for (int64_t key = 0; key < 100; key += 10) {
+    ASSERT_TRUE(insert(key, txn));
+  }
+  txn_manager.Commit(txn);
+  delete txn;
+
+  // The scan locks 20, 30, 40 and 50, which covers (10, 50].
+  auto *scanner = txn_manager.Begin();
+  const std::vector<int64_t> range{20, 30, 40};
+  EXPECT_EQ(range, scan(15, 45, scanner));
+  EXPECT_EQ(4, scanner->GetSharedLockSet()->size());
+
+  // Writers into other gaps go through right away, and do not wait for each other either.
+  auto *writer0 = txn_manager.Begin();
+  auto *writer1 = txn_manager.Begin();
+  EXPECT_TRUE(insert(5, writer0));
+  EXPECT_TRUE(insert(75, writer1));
+  tree.Remove(key_of(90), writer1);
+  txn_manager.Commit(writer0);
+  txn_manager.Commit(writer1);
+  delete writer0;
+  delete writer1;
+
+  // A phantom waits for the scanner to commit.
+  std::atomic<bool> inserted{false};
+  auto *phantom_writer = txn_manager.Begin();
+  std::thread phantom([&] {
+    EXPECT_TRUE(insert(25, phantom_writer));
+    inserted = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_FALSE(inserted);
+  EXPECT_EQ(range, scan(15, 45, scanner));
+  txn_manager.Commit(scanner);
+  delete scanner;
+  phantom.join();
+  EXPECT_TRUE(inserted);
+  txn_manager.Commit(phantom_writer);
+  delete phantom_writer;
+
+  // So does a key a lookup did not find.
+  auto *reader = txn_manager.Begin();
+  std::vector<RID> rids;
+  EXPECT_FALSE(tree.GetValue(key_of(65), &rids, reader));
+  inserted = false;
+  auto *missing_writer = txn_manager.Begin();
+  std::thread missing([&] {
+    EXPECT_TRUE(insert(65, missing_writer));
+    inserted = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_FALSE(inserted);
+  EXPECT_FALSE(tree.GetValue(key_of(65), &rids, reader));
+  txn_manager.Commit(reader);
+  delete reader;
+  missing.join();
+  EXPECT_TRUE(inserted);
+  txn_manager.Commit(missing_writer);
+  delete missing_writer;
+
+  txn = txn_manager.Begin();
+  const std::vector<int64_t> all{0, 5, 10, 20, 25, 30, 40, 50, 60, 65, 70, 75, 80};
+  EXPECT_EQ(all, scan(0, 100, txn));
+  txn_manager.Commit(txn);
+  delete txn;
+
+  enable_logging = false;
+  bpm->UnpinPage(HEADER_PAGE_ID, true);
+  delete key_schema;
+  delete disk_manager;
+  delete bpm;
+  remove("test.db");
+  RemoveLogFiles("test.db");
 }
 
 }  // namespace bustub
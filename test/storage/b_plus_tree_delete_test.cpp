@@ -9,6 +9,7 @@
 #include "buffer/buffer_pool_manager.h"
 #include "concurrency/transaction.h"
 #include "gtest/gtest.h"
+#include "logging/log_files.h"
 #include "storage/index/b_plus_tree.h"
 #include "storage/index/generic_key.h"
 #include "storage/index/index_iterator.h"
@@ -112,7 +113,7 @@ TEST(BPlusTreeTests, LocalDeleteTest1) {
   delete disk_manager;
   delete bpm;
   remove("test.db");
-  remove("test.log");
+  RemoveLogFiles("test.db");
 }
 
 // TEST(BPlusTreeTests, DISABLED_LocalDeleteTest2) {
@@ -193,6 +194,6 @@ TEST(BPlusTreeTests, LocalDeleteTest2) {
   delete disk_manager;
   delete bpm;
   remove("test.db");
-  remove("test.log");
+  RemoveLogFiles("test.db");
 }
 }  // namespace bustub
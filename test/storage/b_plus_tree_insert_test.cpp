@@ -16,6 +16,7 @@
 #include <random>
 #include "buffer/buffer_pool_manager.h"
 #include "gtest/gtest.h"
+#include "logging/log_files.h"
 #include "storage/b_plus_tree_test_util.h"  // NOLINT
 #include "storage/index/b_plus_tree.h"
 
@@ -90,7 +91,7 @@ TEST(BPlusTreeTests, InsertDeleteTest) {
   delete disk_manager;
   delete bpm;
   remove("test.db");
-  remove("test.log");
+  RemoveLogFiles("test.db");
 }
 
 /*
@@ -154,7 +155,7 @@ TEST(BPlusTreeTests, InsertTest1) {
   delete disk_manager;
   delete bpm;
   remove("test.db");
-  remove("test.log");
+  RemoveLogFiles("test.db");
 }
 
 /*
@@ -228,7 +229,7 @@ TEST(BPlusTreeTests, InsertTest2) {
   delete disk_manager;
   delete bpm;
   remove("test.db");
-  remove("test.log");
+  RemoveLogFiles("test.db");
 }
 
 /*
@@ -313,7 +314,7 @@ TEST(BPlusTreeTests, DeleteTest1) {
   delete disk_manager;
   delete bpm;
   remove("test.db");
-  remove("test.log");
+  RemoveLogFiles("test.db");
 }
 
 /*
@@ -397,7 +398,7 @@ TEST(BPlusTreeTests, DeleteTest2) {
   delete disk_manager;
   delete bpm;
   remove("test.db");
-  remove("test.log");
+  RemoveLogFiles("test.db");
 }
 
 /*
@@ -484,7 +485,7 @@ TEST(BPlusTreeTests, ScaleTest) {
   delete disk_manager;
   delete bpm;
   remove("test.db");
-  remove("test.log");
+  RemoveLogFiles("test.db");
 }
 
 /*
@@ -565,7 +566,7 @@ TEST(BPlusTreeTests, SequentialMixTest) {
   delete disk_manager;
   delete bpm;
   remove("test.db");
-  remove("test.log");
+  RemoveLogFiles("test.db");
 }
 
 }  // namespace bustub
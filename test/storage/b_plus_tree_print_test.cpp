@@ -20,6 +20,7 @@
 #include "buffer/buffer_pool_manager.h"
 #include "common/logger.h"
 #include "gtest/gtest.h"
+#include "logging/log_files.h"
 #include "storage/index/b_plus_tree.h"
 
 namespace bustub {
@@ -117,6 +118,6 @@ TEST(BptTreeTest, DISABLED_UnitTest) {
   delete transaction;
   delete disk_manager;
   remove("test.db");
-  remove("test.log");
+  RemoveLogFiles("test.db");
 }
 }  // namespace bustub
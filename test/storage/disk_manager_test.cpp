@@ -10,11 +10,18 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include <cstdint>
 #include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
 
 #include "common/exception.h"
 #include "gtest/gtest.h"
+#include "logging/log_files.h"
 #include "storage/disk/disk_manager.h"
+#include "storage/disk/simulated_disk_manager.h"
 
 namespace bustub {
 
@@ -23,13 +30,13 @@ class DiskManagerTest : public ::testing::Test {
   // This function is called before every test.
   void SetUp() override {
     remove("test.db");
-    remove("test.log");
+    RemoveLogFiles("test.db");
   }
 
   // This function is called after every test.
   void TearDown() override {
     remove("test.db");
-    remove("test.log");
+    RemoveLogFiles("test.db");
   };
 };
 
@@ -72,6 +79,208 @@ TEST_F(DiskManagerTest, ReadWriteLogTest) {
   dm.ShutDown();
 }
 
+// NOLINTNEXTLINE
+TEST_F(DiskManagerTest, LogSegmentTest) {
+  const int segment_size = 64;
+  char data[200];
+  for (int i = 0; i < 200; i++) {
+    data[i] = static_cast<char>(i);
+  }
+  char buf[100] = {0};
+  {
+    auto dm = DiskManager("test.db", segment_size);
+    // writes straddle the segment boundaries.
+    for (int offset = 0; offset < 200; offset += 40) {
+      dm.WriteLog(data + offset, 40);
+    }
+    EXPECT_EQ(200, dm.GetLogSize());
+    for (int segment = 0; segment < 4; segment++) {
+      EXPECT_TRUE(std::ifstream("test.log." + std::to_string(segment)).good());
+    }
+    ASSERT_TRUE(dm.ReadLog(buf, sizeof(buf), 50));
+    EXPECT_EQ(0, std::memcmp(buf, data + 50, sizeof(buf)));
+
+    // only the segments that end before the offset go.
+    dm.TruncateLog(130);
+    EXPECT_FALSE(std::ifstream("test.log.0").good());
+    EXPECT_FALSE(std::ifstream("test.log.1").good());
+    EXPECT_TRUE(std::ifstream("test.log.2").good());
+    EXPECT_FALSE(dm.ReadLog(buf, sizeof(buf), 100));
+    ASSERT_TRUE(dm.ReadLog(buf, sizeof(buf), 128));
+    EXPECT_EQ(0, std::memcmp(buf, data + 128, 72));
+    // the log is zero-padded past its end.
+    EXPECT_EQ(0, buf[72]);
+    // truncation never goes back.
+    dm.TruncateLog(0);
+    EXPECT_TRUE(dm.ReadLog(buf, sizeof(buf), 128));
+    dm.ShutDown();
+  }
+
+  // a restart finds the remaining segments and appends to the last one.
+  auto dm = DiskManager("test.db", segment_size);
+  EXPECT_EQ(200, dm.GetLogSize());
+  EXPECT_FALSE(dm.ReadLog(buf, sizeof(buf), 0));
+  dm.WriteLog(data, 100);
+  EXPECT_EQ(300, dm.GetLogSize());
+  ASSERT_TRUE(dm.ReadLog(buf, sizeof(buf), 180));
+  EXPECT_EQ(0, std::memcmp(buf, data + 180, 20));
+  EXPECT_EQ(0, std::memcmp(buf + 20, data, 80));
+  dm.TruncateLog(dm.GetLogSize());
+  dm.ShutDown();
+  EXPECT_FALSE(std::ifstream("test.log.3").good());
+}
+
+// NOLINTNEXTLINE
+TEST_F(DiskManagerTest, LargeLogOffsetTest) {
+  const int segment_size = 64;
+  // a log whose older segments were all truncated, and which goes on past 2 GiB of offsets.
+  const int first_segment = (1 << 25) + 1;
+  const int64_t first_offset = static_cast<int64_t>(first_segment) * segment_size;
+  ASSERT_GT(first_offset, INT32_MAX);
+  std::ofstream("test.log." + std::to_string(first_segment)).close();
+
+  char data[100];
+  for (int i = 0; i < 100; i++) {
+    data[i] = static_cast<char>(i);
+  }
+  char buf[100] = {0};
+  auto dm = DiskManager("test.db", segment_size);
+  EXPECT_EQ(first_offset, dm.GetLogSize());
+  dm.WriteLog(data, sizeof(data));
+  EXPECT_EQ(first_offset + 100, dm.GetLogSize());
+  EXPECT_TRUE(std::ifstream("test.log." + std::to_string(first_segment + 1)).good());
+  ASSERT_TRUE(dm.ReadLog(buf, sizeof(buf), first_offset));
+  EXPECT_EQ(0, std::memcmp(buf, data, sizeof(buf)));
+  EXPECT_FALSE(dm.ReadLog(buf, sizeof(buf), first_offset - 1));
+
+  dm.TruncateLog(first_offset + segment_size);
+  EXPECT_FALSE(std::ifstream("test.log." + std::to_string(first_segment)).good());
+  ASSERT_TRUE(dm.ReadLog(buf, sizeof(buf), first_offset + segment_size));
+  EXPECT_EQ(0, std::memcmp(buf, data + segment_size, 100 - segment_size));
+  dm.ShutDown();
+}
+
+// NOLINTNEXTLINE
+TEST_F(DiskManagerTest, SimulatedReadWritePageTest) {
+  char buf[PAGE_SIZE] = {0};
+  char data[PAGE_SIZE] = {0};
+  SimulatedDiskManager dm(DiskProfile::SSD());
+  std::strncpy(data, "A test string.", sizeof(data));
+
+  dm.ReadPage(0, buf);  // tolerate empty read
+
+  dm.WritePage(0, data);
+  dm.ReadPage(0, buf);
+  EXPECT_EQ(std::memcmp(buf, data, sizeof(buf)), 0);
+
+  std::memset(buf, 0, sizeof(buf));
+  dm.WritePage(5, data);
+  dm.ReadPage(5, buf);
+  EXPECT_EQ(std::memcmp(buf, data, sizeof(buf)), 0);
+
+  dm.ShutDown();
+}
+
+// NOLINTNEXTLINE
+TEST_F(DiskManagerTest, SimulatedReadWriteLogTest) {
+  char buf[16] = {0};
+  char data[16] = {0};
+  SimulatedDiskManager dm(DiskProfile::SSD());
+  std::strncpy(data, "A test string.", sizeof(data));
+
+  dm.ReadLog(buf, sizeof(buf), 0);  // tolerate empty read
+
+  dm.WriteLog(data, sizeof(data));
+  dm.ReadLog(buf, sizeof(buf), 0);
+  EXPECT_EQ(std::memcmp(buf, data, sizeof(buf)), 0);
+
+  dm.ShutDown();
+}
+
+// NOLINTNEXTLINE
+TEST_F(DiskManagerTest, SimulatedLatencyTest) {
+  char data[PAGE_SIZE] = {0};
+  DiskProfile profile;
+  profile.write_latency_ = std::chrono::microseconds(1000);
+  // 4 pages per millisecond.
+  profile.bandwidth_ = 4 * PAGE_SIZE * 1000;
+  SimulatedDiskManager dm(profile);
+
+  auto start = std::chrono::steady_clock::now();
+  for (page_id_t page_id = 0; page_id < 10; page_id++) {
+    dm.WritePage(page_id, data);
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  // sequential writes are latency-bound.
+  EXPECT_GE(elapsed, std::chrono::milliseconds(10));
+
+  // concurrent writes overlap their latency but queue up on the bandwidth: 80 pages take at least 20ms, twice what
+  // the latency alone would take.
+  std::vector<std::thread> threads;
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < 8; i++) {
+    threads.emplace_back([&dm, &data, i] {
+      for (page_id_t page_id = 0; page_id < 10; page_id++) {
+        dm.WritePage(i * 10 + page_id, data);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  elapsed = std::chrono::steady_clock::now() - start;
+  EXPECT_GE(elapsed, std::chrono::milliseconds(20));
+
+  auto stats = dm.GetStats();
+  EXPECT_EQ(90, stats.write_latency_.count_);
+  EXPECT_GE(stats.write_latency_.Percentile(50), 1000);
+}
+
+// NOLINTNEXTLINE
+TEST_F(DiskManagerTest, IOStatsTest) {
+  char buf[PAGE_SIZE] = {0};
+  char data[PAGE_SIZE] = {0};
+  std::string db_file("test.db");
+  auto dm = DiskManager(db_file);
+  std::strncpy(data, "A test string.", sizeof(data));
+
+  for (page_id_t page_id = 0; page_id < 4; page_id++) {
+    dm.WritePage(page_id, data);
+    dm.ReadPage(page_id, buf);
+  }
+  dm.WriteLog(data, 16);
+  ASSERT_TRUE(dm.ReadLog(buf, 16, 0));
+
+  auto stats = dm.GetStats();
+  EXPECT_EQ(4, dm.GetNumWrites());
+  EXPECT_EQ(4, stats.write_latency_.count_);
+  EXPECT_EQ(4, stats.read_latency_.count_);
+  EXPECT_EQ(1, stats.log_read_latency_.count_);
+  EXPECT_EQ(1, stats.log_write_latency_.count_);
+  EXPECT_EQ(5, stats.sync_latency_.count_);
+  EXPECT_EQ(4 * PAGE_SIZE, stats.bytes_written_);
+  EXPECT_EQ(4 * PAGE_SIZE, stats.bytes_read_);
+  EXPECT_EQ(16, stats.log_bytes_read_);
+  EXPECT_EQ(16, stats.log_bytes_written_);
+  EXPECT_GE(stats.write_latency_.Percentile(99), stats.write_latency_.Percentile(50));
+  EXPECT_TRUE(stats.slow_ios_.empty());
+
+  // a page write issues a syscall, so it is never faster than the smallest positive threshold.
+  dm.SetSlowIOThreshold(std::chrono::microseconds(1));
+  dm.ResetStats();
+  for (int i = 0; i < 100; i++) {
+    dm.WritePage(0, data);
+  }
+  stats = dm.GetStats();
+  EXPECT_EQ(100, stats.write_latency_.count_);
+  EXPECT_EQ(0, stats.bytes_read_);
+  // the trace is bounded.
+  EXPECT_FALSE(stats.slow_ios_.empty());
+  EXPECT_LE(stats.slow_ios_.size(), 64);
+
+  dm.ShutDown();
+}
+
 // NOLINTNEXTLINE
 TEST_F(DiskManagerTest, ThrowBadFileTest) { EXPECT_THROW(DiskManager("dev/null\\/foo/bar/baz/test.db"), Exception); }
 
@@ -11,16 +11,25 @@
 //===----------------------------------------------------------------------===//
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <cmath>
 #include <cstdio>
 #include <iostream>
+#include <random>
 #include <string>
+#include <thread>  // NOLINT
+#include <utility>
 #include <vector>
 
 #include "buffer/buffer_pool_manager.h"
+#include "concurrency/transaction_manager.h"
 #include "gtest/gtest.h"
 #include "logging/common.h"
+#include "logging/log_files.h"
 #include "storage/table/table_heap.h"
 #include "storage/table/tuple.h"
+#include "type/value_factory.h"
 
 namespace bustub {
 // NOLINTNEXTLINE
@@ -65,10 +74,607 @@ TEST(TupleTest, DISABLED_TableHeapTest) {
   }
   disk_manager->ShutDown();
   remove("test.db");  // remove db file
-  remove("test.log");
+  RemoveLogFiles("test.db");
   delete table;
   delete buffer_pool_manager;
   delete disk_manager;
 }
 
+// A scan under REPEATABLE_READ ends up with one table lock instead of a lock per tuple
+TEST(TupleTest, TableLockEscalationTest) {
+  Column col1{"a", TypeId::INTEGER};
+  Schema schema{std::vector<Column>{col1}};
+  const int num_tuples = 3000;
+
+  auto *disk_manager = new DiskManager("test.db");
+  auto *buffer_pool_manager = new BufferPoolManager(50, disk_manager);
+  auto *lock_manager = new LockManager();
+  auto *log_manager = new LogManager(disk_manager);
+  auto *txn_manager = new TransactionManager(lock_manager, log_manager);
+  enable_logging = true;
+  log_manager->RunFlushThread();
+
+  auto *txn = txn_manager->Begin();
+  auto *table = new TableHeap(buffer_pool_manager, lock_manager, log_manager, txn, 0);
+  for (int i = 0; i < num_tuples; ++i) {
+    RID rid;
+    ASSERT_TRUE(table->InsertTuple(Tuple({ValueFactory::GetIntegerValue(i)}, &schema), &rid, txn));
+  }
+  EXPECT_EQ(LockMode::EXCLUSIVE, txn->GetTableLockSet()->at(0));
+  EXPECT_LE(txn->GetExclusiveLockSet()->size(), static_cast<size_t>(lock_escalation_threshold));
+  txn_manager->Commit(txn);
+  delete txn;
+
+  txn = txn_manager->Begin();
+  int count = 0;
+  for (auto itr = table->Begin(txn); itr != table->End(); ++itr) {
+    EXPECT_EQ(count++, itr->GetValue(&schema, 0).GetAs<int32_t>());
+  }
+  EXPECT_EQ(num_tuples, count);
+  EXPECT_EQ(LockMode::SHARED, txn->GetTableLockSet()->at(0));
+  EXPECT_LE(txn->GetSharedLockSet()->size(), static_cast<size_t>(lock_escalation_threshold));
+  txn_manager->Commit(txn);
+  EXPECT_TRUE(txn->GetTableLockSet()->empty());
+  delete txn;
+
+  log_manager->StopFlushThread();
+  enable_logging = false;
+  disk_manager->ShutDown();
+  remove("test.db");
+  RemoveLogFiles("test.db");
+  delete table;
+  delete txn_manager;
+  delete log_manager;
+  delete lock_manager;
+  delete buffer_pool_manager;
+  delete disk_manager;
+}
+
+// An abort rolls back updates, deletes and inserts page by page, and a commit deletes the tuples page by page
+TEST(TupleTest, GroupedRollbackTest) {
+  Column col1{"a", TypeId::INTEGER};
+  Schema schema{std::vector<Column>{col1}};
+  const int num_tuples = 1000;
+
+  auto *disk_manager = new DiskManager("test.db");
+  auto *buffer_pool_manager = new BufferPoolManager(50, disk_manager);
+  auto *lock_manager = new LockManager();
+  auto *log_manager = new LogManager(disk_manager);
+  auto *txn_manager = new TransactionManager(lock_manager, log_manager);
+  enable_logging = true;
+  log_manager->RunFlushThread();
+
+  auto *txn = txn_manager->Begin();
+  auto *table = new TableHeap(buffer_pool_manager, lock_manager, log_manager, txn, 0);
+  std::vector<RID> rids(num_tuples);
+  for (int i = 0; i < num_tuples; ++i) {
+    ASSERT_TRUE(table->InsertTuple(Tuple({ValueFactory::GetIntegerValue(i)}, &schema), &rids[i], txn));
+  }
+  txn_manager->Commit(txn);
+  delete txn;
+  ASSERT_NE(rids.front().GetPageId(), rids.back().GetPageId());
+
+  // Every third tuple is updated twice and the next one deleted, on every page, and new tuples are inserted.
+  txn = txn_manager->Begin();
+  for (int i = 0; i < num_tuples; ++i) {
+    if (i % 3 == 0) {
+      ASSERT_TRUE(table->UpdateTuple(Tuple({ValueFactory::GetIntegerValue(i + num_tuples)}, &schema), rids[i], txn));
+      ASSERT_TRUE(
+          table->UpdateTuple(Tuple({ValueFactory::GetIntegerValue(i + 2 * num_tuples)}, &schema), rids[i], txn));
+    } else if (i % 3 == 1) {
+      ASSERT_TRUE(table->MarkDelete(rids[i], txn));
+    }
+  }
+  for (int i = 0; i < 100; ++i) {
+    RID rid;
+    ASSERT_TRUE(table->InsertTuple(Tuple({ValueFactory::GetIntegerValue(-1)}, &schema), &rid, txn));
+  }
+  txn_manager->Abort(txn);
+  delete txn;
+
+  txn = txn_manager->Begin();
+  int count = 0;
+  for (auto itr = table->Begin(txn); itr != table->End(); ++itr) {
+    EXPECT_EQ(count++, itr->GetValue(&schema, 0).GetAs<int32_t>());
+  }
+  EXPECT_EQ(num_tuples, count);
+  // The tuples left on a page are packed once the others are deleted.
+  for (int i = 0; i < num_tuples; i += 2) {
+    ASSERT_TRUE(table->MarkDelete(rids[i], txn));
+  }
+  txn_manager->Commit(txn);
+  delete txn;
+
+  txn = txn_manager->Begin();
+  count = 0;
+  for (auto itr = table->Begin(txn); itr != table->End(); ++itr) {
+    EXPECT_EQ(2 * count++ + 1, itr->GetValue(&schema, 0).GetAs<int32_t>());
+  }
+  EXPECT_EQ(num_tuples / 2, count);
+  for (int i = 1; i < num_tuples; i += 2) {
+    ASSERT_TRUE(table->MarkDelete(rids[i], txn));
+  }
+  txn_manager->Commit(txn);
+  delete txn;
+
+  txn = txn_manager->Begin();
+  EXPECT_TRUE(table->Begin(txn) == table->End());
+  txn_manager->Commit(txn);
+  delete txn;
+
+  log_manager->StopFlushThread();
+  enable_logging = false;
+  disk_manager->ShutDown();
+  remove("test.db");
+  RemoveLogFiles("test.db");
+  delete table;
+  delete txn_manager;
+  delete log_manager;
+  delete lock_manager;
+  delete buffer_pool_manager;
+  delete disk_manager;
+}
+
+// The time a commit takes to delete the tuples a transaction marked, one tuple at a time or one page at a time
+TEST(TupleTest, BulkDeleteCommitBenchmark) {
+  Column col1{"a", TypeId::INTEGER};
+  Schema schema{std::vector<Column>{col1}};
+  const int num_tuples = 20000;
+
+  auto *disk_manager = new DiskManager("test.db");
+  auto *buffer_pool_manager = new BufferPoolManager(1000, disk_manager);
+  auto *lock_manager = new LockManager();
+  auto *txn_manager = new TransactionManager(lock_manager);
+
+  double elapsed[2];
+  for (bool grouped : {false, true}) {
+    auto *txn = txn_manager->Begin();
+    auto *table = new TableHeap(buffer_pool_manager, lock_manager, nullptr, txn);
+    for (int i = 0; i < num_tuples; ++i) {
+      RID rid;
+      ASSERT_TRUE(table->InsertTuple(Tuple({ValueFactory::GetIntegerValue(i)}, &schema), &rid, txn));
+    }
+    txn_manager->Commit(txn);
+    delete txn;
+
+    txn = txn_manager->Begin();
+    for (auto itr = table->Begin(txn); itr != table->End(); ++itr) {
+      ASSERT_TRUE(table->MarkDelete(itr->GetRid(), txn));
+    }
+    auto write_set = txn->GetWriteSet();
+    auto start = std::chrono::steady_clock::now();
+    if (grouped) {
+      std::vector<const TableWriteRecord *> writes;
+      for (auto item = write_set->rbegin(); item != write_set->rend(); ++item) {
+        writes.push_back(&*item);
+      }
+      table->ApplyDeletes(writes, txn);
+    } else {
+      for (auto item = write_set->rbegin(); item != write_set->rend(); ++item) {
+        table->ApplyDelete(item->rid_, txn);
+      }
+    }
+    elapsed[grouped ? 1 : 0] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    // The deletes are applied already.
+    write_set->clear();
+    txn_manager->Commit(txn);
+    delete txn;
+
+    txn = txn_manager->Begin();
+    EXPECT_TRUE(table->Begin(txn) == table->End());
+    txn_manager->Commit(txn);
+    delete txn;
+    delete table;
+  }
+  std::cout << "bulk delete of " << num_tuples << " tuples: " << elapsed[0] << "ms a tuple at a time, " << elapsed[1]
+            << "ms a page at a time" << std::endl;
+
+  disk_manager->ShutDown();
+  remove("test.db");
+  RemoveLogFiles("test.db");
+  delete txn_manager;
+  delete lock_manager;
+  delete buffer_pool_manager;
+  delete disk_manager;
+}
+
+// Snapshot reads see the tuples as of their snapshot and take no locks, and the first writer of a tuple wins
+TEST(TupleTest, SnapshotIsolationTest) {
+  Column col1{"a", TypeId::INTEGER};
+  Schema schema{std::vector<Column>{col1}};
+  const int num_tuples = 10;
+
+  auto *disk_manager = new DiskManager("test.db");
+  auto *buffer_pool_manager = new BufferPoolManager(50, disk_manager);
+  auto *lock_manager = new LockManager();
+  auto *log_manager = new LogManager(disk_manager);
+  auto *txn_manager = new TransactionManager(lock_manager, log_manager);
+  enable_logging = true;
+  log_manager->RunFlushThread();
+
+  auto value_of = [&schema](const Tuple &tuple) { return tuple.GetValue(&schema, 0).GetAs<int32_t>(); };
+  auto scan = [&](TableHeap *table, Transaction *txn) {
+    std::vector<int> values;
+    for (auto itr = table->Begin(txn); itr != table->End(); ++itr) {
+      values.push_back(value_of(*itr));
+    }
+    std::sort(values.begin(), values.end());
+    return values;
+  };
+
+  auto *txn = txn_manager->Begin();
+  auto *table = new TableHeap(buffer_pool_manager, lock_manager, log_manager, txn, 0);
+  std::vector<RID> rids(num_tuples);
+  std::vector<int> before;
+  for (int i = 0; i < num_tuples; ++i) {
+    ASSERT_TRUE(table->InsertTuple(Tuple({ValueFactory::GetIntegerValue(i)}, &schema), &rids[i], txn));
+    before.push_back(i);
+  }
+  txn_manager->Commit(txn);
+  delete txn;
+
+  auto *reader = txn_manager->Begin(nullptr, IsolationLevel::SNAPSHOT_ISOLATION);
+  auto *writer = txn_manager->Begin();
+  RID new_rid;
+  ASSERT_TRUE(table->UpdateTuple(Tuple({ValueFactory::GetIntegerValue(100)}, &schema), rids[0], writer));
+  ASSERT_TRUE(table->MarkDelete(rids[1], writer));
+  ASSERT_TRUE(table->InsertTuple(Tuple({ValueFactory::GetIntegerValue(num_tuples)}, &schema), &new_rid, writer));
+
+  // The reader is not blocked by the locks of the writer, before or after it commits.
+  Tuple tuple;
+  ASSERT_TRUE(table->GetTuple(rids[0], &tuple, reader));
+  EXPECT_EQ(0, value_of(tuple));
+  EXPECT_EQ(before, scan(table, reader));
+  txn_manager->Commit(writer);
+  delete writer;
+  ASSERT_TRUE(table->GetTuple(rids[1], &tuple, reader));
+  EXPECT_EQ(1, value_of(tuple));
+  EXPECT_FALSE(table->GetTuple(new_rid, &tuple, reader));
+  EXPECT_EQ(before, scan(table, reader));
+  EXPECT_TRUE(reader->GetSharedLockSet()->empty());
+  EXPECT_TRUE(reader->GetTableLockSet()->empty());
+
+  auto *late_reader = txn_manager->Begin(nullptr, IsolationLevel::SNAPSHOT_ISOLATION);
+  std::vector<int> after{2, 3, 4, 5, 6, 7, 8, 9, 10, 100};
+  EXPECT_EQ(after, scan(table, late_reader));
+
+  // The reader cannot update a tuple committed after its snapshot.
+  EXPECT_FALSE(table->UpdateTuple(Tuple({ValueFactory::GetIntegerValue(-1)}, &schema), rids[0], reader));
+  EXPECT_EQ(TransactionState::ABORTED, reader->GetState());
+  txn_manager->Abort(reader);
+  delete reader;
+
+  // A transaction sees its own writes, and nobody else does until it commits.
+  auto *updater = txn_manager->Begin(nullptr, IsolationLevel::SNAPSHOT_ISOLATION);
+  ASSERT_TRUE(table->UpdateTuple(Tuple({ValueFactory::GetIntegerValue(200)}, &schema), rids[2], updater));
+  ASSERT_TRUE(table->GetTuple(rids[2], &tuple, updater));
+  EXPECT_EQ(200, value_of(tuple));
+  ASSERT_TRUE(table->GetTuple(rids[2], &tuple, late_reader));
+  EXPECT_EQ(2, value_of(tuple));
+  txn_manager->Abort(updater);
+  delete updater;
+  EXPECT_EQ(after, scan(table, late_reader));
+  txn_manager->Commit(late_reader);
+  delete late_reader;
+
+  log_manager->StopFlushThread();
+  enable_logging = false;
+  disk_manager->ShutDown();
+  remove("test.db");
+  RemoveLogFiles("test.db");
+  delete table;
+  delete txn_manager;
+  delete log_manager;
+  delete lock_manager;
+  delete buffer_pool_manager;
+  delete disk_manager;
+}
+
+// Versions are kept for as long as the oldest snapshot needs them, and no longer
+TEST(TupleTest, VersionGarbageCollectionTest) {
+  Column col1{"a", TypeId::INTEGER};
+  Schema schema{std::vector<Column>{col1}};
+  const int num_tuples = 100;
+  const int num_rounds = 5;
+
+  auto *disk_manager = new DiskManager("test.db");
+  auto *buffer_pool_manager = new BufferPoolManager(50, disk_manager);
+  auto *lock_manager = new LockManager();
+  auto *txn_manager = new TransactionManager(lock_manager);
+
+  auto *txn = txn_manager->Begin();
+  auto *table = new TableHeap(buffer_pool_manager, lock_manager, nullptr, txn);
+  std::vector<RID> rids(num_tuples);
+  for (int i = 0; i < num_tuples; ++i) {
+    ASSERT_TRUE(table->InsertTuple(Tuple({ValueFactory::GetIntegerValue(i)}, &schema), &rids[i], txn));
+  }
+  txn_manager->Commit(txn);
+  delete txn;
+  // Nobody could see the tuples missing, so their chains are gone already.
+  EXPECT_EQ(0, txn_manager->CollectGarbage());
+
+  auto *reader = txn_manager->Begin(nullptr, IsolationLevel::SNAPSHOT_ISOLATION);
+  for (int round = 1; round <= num_rounds; ++round) {
+    txn = txn_manager->Begin();
+    for (int i = 0; i < num_tuples; ++i) {
+      ASSERT_TRUE(table->UpdateTuple(Tuple({ValueFactory::GetIntegerValue(round * num_tuples + i)}, &schema),
+                                     rids[i], txn));
+    }
+    txn_manager->Commit(txn);
+    delete txn;
+  }
+  // Nothing older than the snapshot of the reader was kept, and it holds back everything newer.
+  EXPECT_EQ(0, txn_manager->CollectGarbage());
+  Tuple tuple;
+  for (int i = 0; i < num_tuples; ++i) {
+    ASSERT_TRUE(table->GetTuple(rids[i], &tuple, reader));
+    EXPECT_EQ(i, tuple.GetValue(&schema, 0).GetAs<int32_t>());
+  }
+  txn_manager->Commit(reader);
+  delete reader;
+
+  EXPECT_EQ(num_rounds * num_tuples, txn_manager->CollectGarbage());
+  EXPECT_EQ(0, txn_manager->CollectGarbage());
+  reader = txn_manager->Begin(nullptr, IsolationLevel::SNAPSHOT_ISOLATION);
+  for (int i = 0; i < num_tuples; ++i) {
+    ASSERT_TRUE(table->GetTuple(rids[i], &tuple, reader));
+    EXPECT_EQ(num_rounds * num_tuples + i, tuple.GetValue(&schema, 0).GetAs<int32_t>());
+  }
+  txn_manager->Commit(reader);
+  delete reader;
+
+  // Without snapshots, a commit keeps no version at all.
+  txn = txn_manager->Begin();
+  ASSERT_TRUE(table->UpdateTuple(Tuple({ValueFactory::GetIntegerValue(-1)}, &schema), rids[0], txn));
+  txn_manager->Commit(txn);
+  delete txn;
+  EXPECT_EQ(0, txn_manager->CollectGarbage());
+
+  disk_manager->ShutDown();
+  remove("test.db");
+  RemoveLogFiles("test.db");
+  delete table;
+  delete txn_manager;
+  delete lock_manager;
+  delete buffer_pool_manager;
+  delete disk_manager;
+}
+
+TEST(TupleTest, OptimisticConcurrencyTest) {
+  Column col1{"a", TypeId::INTEGER};
+  Schema schema{std::vector<Column>{col1}};
+  const int num_tuples = 10;
+
+  auto *disk_manager = new DiskManager("test.db");
+  auto *buffer_pool_manager = new BufferPoolManager(50, disk_manager);
+  auto *lock_manager = new LockManager();
+  auto *log_manager = new LogManager(disk_manager);
+  auto *txn_manager = new TransactionManager(lock_manager, log_manager);
+  enable_logging = true;
+  log_manager->RunFlushThread();
+
+  auto value_of = [&schema](const Tuple &tuple) { return tuple.GetValue(&schema, 0).GetAs<int32_t>(); };
+  auto read = [&](TableHeap *table, const RID &rid, Transaction *txn) {
+    Tuple tuple;
+    return table->GetTuple(rid, &tuple, txn) ? value_of(tuple) : -1;
+  };
+  auto update = [&](TableHeap *table, const RID &rid, int value, Transaction *txn) {
+    return table->UpdateTuple(Tuple({ValueFactory::GetIntegerValue(value)}, &schema), rid, txn);
+  };
+  auto optimistic = [&] {
+    return txn_manager->Begin(nullptr, IsolationLevel::REPEATABLE_READ, ConcurrencyControl::OPTIMISTIC);
+  };
+
+  auto *txn = txn_manager->Begin();
+  auto *table = new TableHeap(buffer_pool_manager, lock_manager, log_manager, txn, 0);
+  std::vector<RID> rids(num_tuples);
+  for (int i = 0; i < num_tuples; ++i) {
+    ASSERT_TRUE(table->InsertTuple(Tuple({ValueFactory::GetIntegerValue(i)}, &schema), &rids[i], txn));
+  }
+  txn_manager->Commit(txn);
+  delete txn;
+
+  // The writes of an optimistic transaction only show to itself, and it locks nothing until it commits.
+  auto *writer = optimistic();
+  ASSERT_TRUE(update(table, rids[0], 100, writer));
+  ASSERT_TRUE(table->MarkDelete(rids[1], writer));
+  EXPECT_FALSE(table->MarkDelete(rids[1], writer));
+  EXPECT_EQ(100, read(table, rids[0], writer));
+  EXPECT_EQ(-1, read(table, rids[1], writer));
+  int num_scanned = 0;
+  for (auto itr = table->Begin(writer); itr != table->End(); ++itr) {
+    EXPECT_NE(1, value_of(*itr));
+    num_scanned++;
+  }
+  EXPECT_EQ(num_tuples - 1, num_scanned);
+  EXPECT_TRUE(writer->GetSharedLockSet()->empty());
+  EXPECT_TRUE(writer->GetExclusiveLockSet()->empty());
+  EXPECT_TRUE(writer->GetTableLockSet()->empty());
+  txn = txn_manager->Begin();
+  EXPECT_EQ(0, read(table, rids[0], txn));
+  EXPECT_EQ(1, read(table, rids[1], txn));
+  txn_manager->Commit(txn);
+  delete txn;
+  EXPECT_TRUE(txn_manager->Commit(writer));
+  delete writer;
+  txn = txn_manager->Begin();
+  EXPECT_EQ(100, read(table, rids[0], txn));
+  EXPECT_EQ(-1, read(table, rids[1], txn));
+  txn_manager->Commit(txn);
+  delete txn;
+
+  // A tuple read and written by another transaction since fails the validation, and the writes are rolled back.
+  writer = optimistic();
+  EXPECT_EQ(2, read(table, rids[2], writer));
+  ASSERT_TRUE(update(table, rids[3], 300, writer));
+  txn = txn_manager->Begin();
+  ASSERT_TRUE(update(table, rids[2], 200, txn));
+  txn_manager->Commit(txn);
+  delete txn;
+  EXPECT_FALSE(txn_manager->Commit(writer));
+  EXPECT_EQ(TransactionState::ABORTED, writer->GetState());
+  delete writer;
+
+  // So does a tuple being written by a transaction that has not committed yet.
+  writer = optimistic();
+  EXPECT_EQ(200, read(table, rids[2], writer));
+  txn = txn_manager->Begin();
+  ASSERT_TRUE(update(table, rids[2], 201, txn));
+  EXPECT_EQ(200, read(table, rids[2], writer));
+  EXPECT_FALSE(txn_manager->Commit(writer));
+  delete writer;
+  txn_manager->Abort(txn);
+  delete txn;
+
+  // Of two optimistic increments of the same tuple, only the first to commit goes through.
+  auto *first = optimistic();
+  auto *second = optimistic();
+  ASSERT_TRUE(update(table, rids[4], read(table, rids[4], first) + 1, first));
+  ASSERT_TRUE(update(table, rids[4], read(table, rids[4], second) + 1, second));
+  EXPECT_TRUE(txn_manager->Commit(first));
+  EXPECT_FALSE(txn_manager->Commit(second));
+  delete first;
+  delete second;
+
+  txn = txn_manager->Begin();
+  EXPECT_EQ(200, read(table, rids[2], txn));
+  EXPECT_EQ(3, read(table, rids[3], txn));
+  EXPECT_EQ(5, read(table, rids[4], txn));
+  txn_manager->Commit(txn);
+  delete txn;
+
+  log_manager->StopFlushThread();
+  enable_logging = false;
+  disk_manager->ShutDown();
+  remove("test.db");
+  RemoveLogFiles("test.db");
+  delete table;
+  delete txn_manager;
+  delete log_manager;
+  delete lock_manager;
+  delete buffer_pool_manager;
+  delete disk_manager;
+}
+
+// Committed transactions per second under two-phase locking and under optimistic concurrency control, when
+// transactions increment a few tuples picked from a Zipfian distribution. No increment may be lost either way.
+TEST(TupleTest, OptimisticConcurrencyBenchmark) {
+  Column col1{"a", TypeId::INTEGER};
+  Schema schema{std::vector<Column>{col1}};
+  const int num_tuples = 1000;
+  const int num_threads = 4;
+  const int txns_per_thread = 250;
+  const int reads_per_txn = 8;
+  const int writes_per_txn = 2;
+  const double theta = 0.9;
+
+  // The cumulative distribution of the Zipfian ranks, the lower ranks being the hotter.
+  std::vector<double> cdf(num_tuples);
+  double sum = 0;
+  for (int i = 0; i < num_tuples; i++) {
+    sum += 1.0 / std::pow(i + 1, theta);
+    cdf[i] = sum;
+  }
+  for (auto &p : cdf) {
+    p /= sum;
+  }
+
+  const std::pair<const char *, ConcurrencyControl> modes[] = {{"2PL", ConcurrencyControl::TWO_PHASE_LOCKING},
+                                                               {"OCC", ConcurrencyControl::OPTIMISTIC}};
+  for (const auto &[name, mode] : modes) {
+    auto *disk_manager = new DiskManager("test.db");
+    auto *buffer_pool_manager = new BufferPoolManager(50, disk_manager);
+    auto *lock_manager = new LockManager();
+    auto *log_manager = new LogManager(disk_manager);
+    auto *txn_manager = new TransactionManager(lock_manager, log_manager);
+    enable_logging = true;
+    log_manager->RunFlushThread();
+
+    auto *txn = txn_manager->Begin();
+    auto *table = new TableHeap(buffer_pool_manager, lock_manager, log_manager, txn, 0);
+    std::vector<RID> rids(num_tuples);
+    for (int i = 0; i < num_tuples; ++i) {
+      ASSERT_TRUE(table->InsertTuple(Tuple({ValueFactory::GetIntegerValue(0)}, &schema), &rids[i], txn));
+    }
+    txn_manager->Commit(txn);
+    delete txn;
+
+    std::atomic<int> num_aborts{0};
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; i++) {
+      threads.emplace_back([&, i] {
+        std::mt19937 rng(i);
+        std::uniform_real_distribution<double> uniform(0, 1);
+        for (int j = 0; j < txns_per_thread; j++) {
+          std::vector<size_t> keys;
+          while (keys.size() < reads_per_txn) {
+            size_t key = std::lower_bound(cdf.begin(), cdf.end() - 1, uniform(rng)) - cdf.begin();
+            if (std::find(keys.begin(), keys.end(), key) == keys.end()) {
+              keys.push_back(key);
+            }
+          }
+          for (bool committed = false; !committed;) {
+            Transaction *txn = txn_manager->Begin(nullptr, IsolationLevel::REPEATABLE_READ, mode);
+            bool ok = true;
+            try {
+              std::vector<int32_t> values;
+              Tuple tuple;
+              for (auto key : keys) {
+                ok = ok && table->GetTuple(rids[key], &tuple, txn);
+                values.push_back(ok ? tuple.GetValue(&schema, 0).GetAs<int32_t>() : 0);
+              }
+              for (int k = 0; ok && k < writes_per_txn; k++) {
+                ok = table->UpdateTuple(Tuple({ValueFactory::GetIntegerValue(values[k] + 1)}, &schema), rids[keys[k]],
+                                        txn);
+              }
+            } catch (TransactionAbortException &e) {
+              ok = false;
+            }
+            if (ok && txn->GetState() != TransactionState::ABORTED) {
+              committed = txn_manager->Commit(txn);
+            } else {
+              txn_manager->Abort(txn);
+            }
+            delete txn;
+            if (!committed) {
+              num_aborts++;
+              std::this_thread::yield();
+            }
+          }
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    txn = txn_manager->Begin();
+    int64_t total = 0;
+    for (const auto &rid : rids) {
+      Tuple tuple;
+      ASSERT_TRUE(table->GetTuple(rid, &tuple, txn));
+      total += tuple.GetValue(&schema, 0).GetAs<int32_t>();
+    }
+    txn_manager->Commit(txn);
+    delete txn;
+    EXPECT_EQ(num_threads * txns_per_thread * writes_per_txn, total);
+    std::cout << name << ": " << static_cast<int>(num_threads * txns_per_thread / elapsed) << " txns/s, "
+              << num_aborts << " aborts" << std::endl;
+
+    log_manager->StopFlushThread();
+    enable_logging = false;
+    disk_manager->ShutDown();
+    remove("test.db");
+    RemoveLogFiles("test.db");
+    delete table;
+    delete txn_manager;
+    delete log_manager;
+    delete lock_manager;
+    delete buffer_pool_manager;
+    delete disk_manager;
+  }
+}
+
 }  // namespace bustub